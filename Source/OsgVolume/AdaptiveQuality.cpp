@@ -0,0 +1,375 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Cull callback that trades volume quality for frame time.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/AdaptiveQuality.h"
+#include "OsgVolume/BrickedVolume.h"
+#include "OsgVolume/GPURayCasting.h"
+#include "OsgVolume/Texture3DVolume.h"
+
+#include "osg/FrameStamp"
+
+#include "osgUtil/CullVisitor"
+
+#include <algorithm>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // Frames further apart than this are not counted, the viewer was idle.
+  const double maxFrameTime ( 1000.0 );
+
+  // Get the detail of the volume.  It is the number of planes, or samples
+  // per unit for ray casting, so more is always better.
+  bool getDetail ( osg::Node &node, double &value )
+  {
+    if ( OsgVolume::Texture3DVolume *volume = dynamic_cast < OsgVolume::Texture3DVolume * > ( &node ) )
+    {
+      value = volume->numPlanes();
+      return true;
+    }
+    if ( OsgVolume::BrickedVolume *volume = dynamic_cast < OsgVolume::BrickedVolume * > ( &node ) )
+    {
+      value = volume->numPlanes();
+      return true;
+    }
+    if ( OsgVolume::GPURayCasting *volume = dynamic_cast < OsgVolume::GPURayCasting * > ( &node ) )
+    {
+      value = ( volume->samplingRate() > 0.0f ) ? 1.0 / volume->samplingRate() : 0.0;
+      return true;
+    }
+    return false;
+  }
+
+  // Set the detail of the volume.
+  void setDetail ( osg::Node &node, double value )
+  {
+    const unsigned int planes ( std::max ( 1u, static_cast < unsigned int > ( value + 0.5 ) ) );
+
+    if ( OsgVolume::Texture3DVolume *volume = dynamic_cast < OsgVolume::Texture3DVolume * > ( &node ) )
+    {
+      if ( planes != volume->numPlanes() )
+        volume->numPlanes ( planes );
+    }
+    else if ( OsgVolume::BrickedVolume *volume = dynamic_cast < OsgVolume::BrickedVolume * > ( &node ) )
+    {
+      if ( planes != volume->numPlanes() )
+        volume->numPlanes ( planes );
+    }
+    else if ( OsgVolume::GPURayCasting *volume = dynamic_cast < OsgVolume::GPURayCasting * > ( &node ) )
+    {
+      const float rate ( static_cast < float > ( 1.0 / std::max ( 1.0, value ) ) );
+      if ( rate != volume->samplingRate() )
+        volume->samplingRate ( rate );
+    }
+  }
+
+  // Get the transfer function image of the volume.
+  const osg::Image* transferFunction ( osg::Node &node )
+  {
+    OsgVolume::TransferFunction *tf ( 0x0 );
+
+    if ( OsgVolume::Texture3DVolume *volume = dynamic_cast < OsgVolume::Texture3DVolume * > ( &node ) )
+      tf = volume->transferFunction();
+    else if ( OsgVolume::BrickedVolume *volume = dynamic_cast < OsgVolume::BrickedVolume * > ( &node ) )
+      tf = volume->transferFunction();
+    else if ( OsgVolume::GPURayCasting *volume = dynamic_cast < OsgVolume::GPURayCasting * > ( &node ) )
+      tf = volume->transferFunction();
+
+    return ( 0x0 != tf ) ? tf->image() : 0x0;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+AdaptiveQuality::AdaptiveQuality ( double targetFrameTime ) : BaseClass(),
+  _mutex(),
+  _targetFrameTime ( targetFrameTime ),
+  _minQuality ( 0.125 ),
+  _idleTime ( 250.0 ),
+  _restoreRate ( 1.5 ),
+  _quality ( 1.0 ),
+  _full ( 0.0 ),
+  _applied ( 0.0 ),
+  _frameTime ( 0.0 ),
+  _lastTime ( 0.0 ),
+  _lastChange ( 0.0 ),
+  _frame ( 0 ),
+  _started ( false ),
+  _viewMatrix(),
+  _transferFunctionModified ( 0 )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+AdaptiveQuality::~AdaptiveQuality()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the target frame time.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AdaptiveQuality::targetFrameTime ( double ms )
+{
+  Guard guard ( _mutex );
+  _targetFrameTime = ms;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the target frame time.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double AdaptiveQuality::targetFrameTime () const
+{
+  Guard guard ( _mutex );
+  return _targetFrameTime;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the lowest quality.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AdaptiveQuality::minQuality ( double fraction )
+{
+  Guard guard ( _mutex );
+  _minQuality = std::min ( 1.0, std::max ( 0.01, fraction ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the lowest quality.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double AdaptiveQuality::minQuality () const
+{
+  Guard guard ( _mutex );
+  return _minQuality;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the time before the quality comes back.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AdaptiveQuality::idleTime ( double ms )
+{
+  Guard guard ( _mutex );
+  _idleTime = std::max ( 0.0, ms );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the time before the quality comes back.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double AdaptiveQuality::idleTime () const
+{
+  Guard guard ( _mutex );
+  return _idleTime;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set how fast the quality comes back.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AdaptiveQuality::restoreRate ( double factor )
+{
+  Guard guard ( _mutex );
+  _restoreRate = std::max ( 1.0, factor );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get how fast the quality comes back.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double AdaptiveQuality::restoreRate () const
+{
+  Guard guard ( _mutex );
+  return _restoreRate;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the quality.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double AdaptiveQuality::quality () const
+{
+  Guard guard ( _mutex );
+  return _quality;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the frame time.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double AdaptiveQuality::frameTime () const
+{
+  Guard guard ( _mutex );
+  return _frameTime;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Is the view changing?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool AdaptiveQuality::interacting () const
+{
+  Guard guard ( _mutex );
+  return _started && ( _lastTime - _lastChange ) < _idleTime;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Adjust the volume and cull it.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AdaptiveQuality::operator () ( osg::Node *node, osg::NodeVisitor *nv )
+{
+  osgUtil::CullVisitor *cv ( dynamic_cast < osgUtil::CullVisitor * > ( nv ) );
+  const osg::FrameStamp *fs ( ( 0x0 != nv ) ? nv->getFrameStamp() : 0x0 );
+
+  if ( 0x0 != node && 0x0 != cv && 0x0 != fs )
+    this->_update ( *node, *cv, *fs );
+
+  this->traverse ( node, nv );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Measure the frame and pick the quality.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AdaptiveQuality::_update ( osg::Node &node, osgUtil::CullVisitor &cv, const osg::FrameStamp &fs )
+{
+  Guard guard ( _mutex );
+
+  // Cameras drawing the same frame share it.
+  const unsigned int frame ( fs.getFrameNumber() );
+  if ( _started && frame == _frame )
+    return;
+
+  const double now ( fs.getReferenceTime() * 1000.0 );
+
+  // Smooth the frame time so one slow frame does not throw it off.
+  if ( _started )
+  {
+    const double elapsed ( now - _lastTime );
+    if ( elapsed > 0.0 && elapsed < Detail::maxFrameTime )
+      _frameTime = ( _frameTime > 0.0 ) ? _frameTime * 0.7 + elapsed * 0.3 : elapsed;
+  }
+
+  // Has the camera or the transfer function changed?
+  const osg::Matrixd view ( 0x0 != cv.getModelViewMatrix() ? osg::Matrixd ( *cv.getModelViewMatrix() ) : osg::Matrixd() );
+  const osg::Image *tf ( Detail::transferFunction ( node ) );
+  const unsigned int modified ( ( 0x0 != tf ) ? tf->getModifiedCount() : 0 );
+
+  if ( _started && ( view != _viewMatrix || modified != _transferFunctionModified ) )
+    _lastChange = now;
+
+  _viewMatrix = view;
+  _transferFunctionModified = modified;
+  _frame = frame;
+  _lastTime = now;
+
+  // The volume was given a new detail since we last set it.
+  double current ( 0.0 );
+  if ( false == Detail::getDetail ( node, current ) )
+    return;
+
+  if ( false == _started || current != _applied )
+    _full = current;
+
+  _started = true;
+
+  const bool interacting ( ( now - _lastChange ) < _idleTime );
+
+  if ( _targetFrameTime <= 0.0 )
+  {
+    _quality = 1.0;
+  }
+  else if ( interacting && _frameTime > _targetFrameTime )
+  {
+    // Too slow, so drop by about what it takes, but not all at once.
+    _quality *= std::max ( 0.5, _targetFrameTime / _frameTime );
+  }
+  else if ( interacting && _frameTime < _targetFrameTime * 0.75 )
+  {
+    // Room to spare, so use some of it.
+    _quality *= 1.1;
+  }
+  else if ( false == interacting )
+  {
+    // Still, so work back up to full quality.
+    _quality *= _restoreRate;
+  }
+
+  _quality = std::min ( 1.0, std::max ( _minQuality, _quality ) );
+
+  Detail::setDetail ( node, _full * _quality );
+  Detail::getDetail ( node, _applied );
+}
@@ -0,0 +1,110 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Cull callback that keeps a volume near a target frame time.  While the
+//  camera or the transfer function is changing, the frame time is measured
+//  and the number of planes (or the ray step) is lowered until the frames
+//  are fast enough.  Once the view has been still for a while, the quality
+//  is stepped back up to what the volume was given.
+//
+//  Works with Texture3DVolume, BrickedVolume and GPURayCasting.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_ADAPTIVE_QUALITY_H__
+#define __OSGTOOLS_VOLUME_ADAPTIVE_QUALITY_H__
+
+#include "OsgVolume/Export.h"
+
+#include "OpenThreads/Mutex"
+#include "OpenThreads/ScopedLock"
+
+#include "osg/Matrixd"
+#include "osg/NodeCallback"
+
+namespace osg { class FrameStamp; }
+namespace osgUtil { class CullVisitor; }
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT AdaptiveQuality : public osg::NodeCallback
+{
+public:
+  /// Typedefs.
+  typedef osg::NodeCallback                      BaseClass;
+  typedef OpenThreads::Mutex                     Mutex;
+  typedef OpenThreads::ScopedLock < Mutex >      Guard;
+
+  /// Construction.  The target is in milliseconds.
+  AdaptiveQuality ( double targetFrameTime = 50.0 );
+
+  /// Get/Set the frame time to aim for, in milliseconds.  Zero or less
+  /// always draws at full quality.
+  void                             targetFrameTime ( double ms );
+  double                           targetFrameTime () const;
+
+  /// Get/Set the lowest fraction of the full quality to drop to.
+  void                             minQuality ( double fraction );
+  double                           minQuality () const;
+
+  /// Get/Set how long the view must be still before the quality comes
+  /// back, in milliseconds.
+  void                             idleTime ( double ms );
+  double                           idleTime () const;
+
+  /// Get/Set how much the quality grows each frame once the view is still.
+  void                             restoreRate ( double factor );
+  double                           restoreRate () const;
+
+  /// Get the fraction of the full quality now drawn.
+  double                           quality () const;
+
+  /// Get the smoothed frame time, in milliseconds.
+  double                           frameTime () const;
+
+  /// Is the camera or transfer function changing?
+  bool                             interacting () const;
+
+  /// Adjust the volume and cull it.
+  virtual void                     operator () ( osg::Node *node, osg::NodeVisitor *nv );
+
+protected:
+  virtual ~AdaptiveQuality();
+
+  void                             _update ( osg::Node &node, osgUtil::CullVisitor &cv, const osg::FrameStamp &fs );
+
+private:
+
+  AdaptiveQuality ( const AdaptiveQuality & );
+  AdaptiveQuality &operator = ( const AdaptiveQuality & );
+
+  mutable Mutex                 _mutex;
+  double                        _targetFrameTime;
+  double                        _minQuality;
+  double                        _idleTime;
+  double                        _restoreRate;
+  double                        _quality;
+  double                        _full;
+  double                        _applied;
+  double                        _frameTime;
+  double                        _lastTime;
+  double                        _lastChange;
+  unsigned int                  _frame;
+  bool                          _started;
+  osg::Matrixd                  _viewMatrix;
+  unsigned int                  _transferFunctionModified;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_ADAPTIVE_QUALITY_H__
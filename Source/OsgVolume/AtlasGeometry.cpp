@@ -0,0 +1,344 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Proxy geometry for many small volumes that share one texture.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/AtlasGeometry.h"
+
+#include "osg/Notify"
+
+#include "OpenThreads/ScopedLock"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  typedef OpenThreads::ScopedLock < OpenThreads::Mutex > Guard;
+
+  // The distance of a block toward the eye, and its index.
+  typedef std::pair < float, unsigned int > Depth;
+  typedef std::vector < Depth > Depths;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor
+//
+///////////////////////////////////////////////////////////////////////////////
+
+AtlasGeometry::AtlasGeometry() : 
+  BaseClass(),
+  _blocks(),
+  _numPlanes ( 1 ),
+  _viewQuantization ( 32 ),
+  _mutex(),
+  _valid ( false ),
+  _key(),
+  _vertices(),
+  _texCoords(),
+  _indices()
+{
+  this->setUseDisplayList( false );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor
+//
+///////////////////////////////////////////////////////////////////////////////
+
+AtlasGeometry::AtlasGeometry ( const AtlasGeometry &d, const osg::CopyOp &options ) : 
+  BaseClass ( d, options ),
+  _blocks ( d.blocks() ),
+  _numPlanes ( d._numPlanes ),
+  _viewQuantization ( d._viewQuantization ),
+  _mutex(),
+  _valid ( false ),
+  _key(),
+  _vertices(),
+  _texCoords(),
+  _indices()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor
+//
+///////////////////////////////////////////////////////////////////////////////
+
+AtlasGeometry::~AtlasGeometry()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Overload of osg::Object::cloneType()
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Object *AtlasGeometry::cloneType() const
+{
+  return new AtlasGeometry;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Overload of osg::Object::clone()
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Object *AtlasGeometry::clone ( const osg::CopyOp &options ) const
+{
+  return new AtlasGeometry ( *this, options );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Draw the proxy geometry.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AtlasGeometry::drawImplementation( DrawArgs ) const
+{
+  try
+  {
+#if OSG_VERSION_MAJOR <= 1 && OSG_VERSION_MINOR <= 2
+    this->_drawImplementation ( state );
+#else
+    this->_drawImplementation ( *info.getState() );
+#endif
+  }
+  catch ( const std::exception &e )
+  {
+    const std::string message ( ( e.what() ) ? e.what() : "Error 1487306295: standard exception caught" );
+    osg::notify ( osg::WARN ) << message.c_str() << std::endl;
+  }
+  catch ( ... )
+  {
+    osg::notify ( osg::WARN ) << "Error 3017655482: unknown exception caught" << std::endl;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Slice every block for the view direction, back to front.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AtlasGeometry::_buildSlices ( const osg::Vec3f& viewVec ) const
+{
+  _vertices.clear();
+  _texCoords.clear();
+  _indices.clear();
+
+  // Blocks further along the view direction are closer to the eye.
+  Detail::Depths depths;
+  depths.reserve ( _blocks.size() );
+  for ( unsigned int i = 0; i < _blocks.size(); ++i )
+    depths.push_back ( Detail::Depth ( viewVec * _blocks[i].bb.center(), i ) );
+  std::sort ( depths.begin(), depths.end() );
+
+  _vertices.reserve ( _blocks.size() * _numPlanes * 6 );
+  _texCoords.reserve ( _blocks.size() * _numPlanes * 6 );
+  _indices.reserve ( _blocks.size() * _numPlanes * 12 );
+
+  for ( Detail::Depths::const_iterator iter = depths.begin(); iter != depths.end(); ++iter )
+  {
+    const Block &block ( _blocks[iter->second] );
+    const unsigned int first ( _vertices.size() );
+
+    PlanarProxyGeometry::slice ( block.bb, viewVec, _numPlanes, _vertices, _indices );
+
+    // Map the new vertices into the block's part of the texture.
+    const osg::Vec3f lengths ( block.bb.xMax() - block.bb.xMin(), block.bb.yMax() - block.bb.yMin(), block.bb.zMax() - block.bb.zMin() );
+    for ( unsigned int i = first; i < _vertices.size(); ++i )
+    {
+      const osg::Vec3f v ( _vertices[i] - block.bb._min );
+      _texCoords.push_back ( osg::Vec3f ( block.offset[0] + block.scale[0] * ( ( lengths[0] > 0.0f ) ? v[0] / lengths[0] : 0.0f ),
+                                          block.offset[1] + block.scale[1] * ( ( lengths[1] > 0.0f ) ? v[1] / lengths[1] : 0.0f ),
+                                          block.offset[2] + block.scale[2] * ( ( lengths[2] > 0.0f ) ? v[2] / lengths[2] : 0.0f ) ) );
+    }
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Draw the proxy geometry.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AtlasGeometry::_drawImplementation( osg::State& state ) const
+{
+  // Get the vector of the view direction.
+  osg::Matrix matrix ( state.getModelViewMatrix() );
+  osg::Vec3f  viewVec ( -matrix( 0, 2 ),-matrix( 1, 2 ), -matrix( 2, 2 ) );
+  if ( viewVec.normalize() <= 0.0f )
+    return;
+
+  // Round the direction so that nearby views share their slices.
+  const float steps ( static_cast < float > ( _viewQuantization ) );
+  const ViewKey key ( static_cast < int > ( std::floor ( viewVec[0] * steps + 0.5f ) ),
+                      std::make_pair ( static_cast < int > ( std::floor ( viewVec[1] * steps + 0.5f ) ),
+                                       static_cast < int > ( std::floor ( viewVec[2] * steps + 0.5f ) ) ) );
+
+  Detail::Guard guard ( _mutex );
+
+  // Only the last view is kept.  There are too many blocks to keep more.
+  if ( false == _valid || key != _key )
+  {
+    osg::Vec3f direction ( key.first, key.second.first, key.second.second );
+    direction.normalize();
+
+    this->_buildSlices ( direction );
+    _key = key;
+    _valid = true;
+  }
+
+  if ( _indices.empty() )
+    return;
+
+  // Draw all the blocks at once.
+  state.setVertexPointer ( 3, GL_FLOAT, 0, &_vertices.front() );
+  state.setTexCoordPointer ( 0, 3, GL_FLOAT, 0, &_texCoords.front() );
+  ::glDrawElements ( GL_TRIANGLES, _indices.size(), GL_UNSIGNED_INT, &_indices.front() );
+  state.disableTexCoordPointer ( 0 );
+  state.disableVertexPointer();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Compute the bounding box.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::BoundingBox AtlasGeometry::computeBound() const
+{
+  Detail::Guard guard ( _mutex );
+
+  osg::BoundingBox bb;
+  for ( Blocks::const_iterator iter = _blocks.begin(); iter != _blocks.end(); ++iter )
+    bb.expandBy ( iter->bb );
+  return bb;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the blocks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AtlasGeometry::blocks ( const Blocks &blocks )
+{
+  {
+    Detail::Guard guard ( _mutex );
+    _blocks = blocks;
+    _valid = false;
+  }
+  this->dirtyBound();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the blocks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+AtlasGeometry::Blocks AtlasGeometry::blocks () const
+{
+  Detail::Guard guard ( _mutex );
+  return _blocks;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the number of planes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AtlasGeometry::numPlanes ( unsigned int num )
+{
+  Detail::Guard guard ( _mutex );
+  if ( num != _numPlanes )
+  {
+    _numPlanes = num;
+    _valid = false;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of planes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int AtlasGeometry::numPlanes() const
+{
+  Detail::Guard guard ( _mutex );
+  return _numPlanes;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the number of steps per unit the view direction is rounded to.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void AtlasGeometry::viewQuantization ( unsigned int steps )
+{
+  steps = ( 0 == steps ) ? 1 : steps;
+
+  Detail::Guard guard ( _mutex );
+  if ( steps != _viewQuantization )
+  {
+    _viewQuantization = steps;
+    _valid = false;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of steps per unit the view direction is rounded to.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int AtlasGeometry::viewQuantization() const
+{
+  Detail::Guard guard ( _mutex );
+  return _viewQuantization;
+}
@@ -0,0 +1,109 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Proxy geometry for many small volumes that share one texture.  Each
+//  block is sliced like PlanarProxyGeometry, with texture coordinates into
+//  its part of the texture, and every block is drawn back to front with
+//  one call.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_ATLAS_GEOMETRY_H__
+#define __OSGTOOLS_VOLUME_ATLAS_GEOMETRY_H__
+
+#include "OsgVolume/Export.h"
+#include "OsgVolume/PlanarProxyGeometry.h"
+
+#include "osg/Drawable"
+
+#include "OpenThreads/Mutex"
+
+#include <vector>
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT AtlasGeometry : public osg::Drawable
+{
+public:
+  // Typedefs.
+  typedef osg::Drawable                            BaseClass;
+  typedef PlanarProxyGeometry::Vertices            Vertices;
+  typedef PlanarProxyGeometry::Indices             Indices;
+
+  // A block and the part of the texture it covers.  Texture coordinates
+  // are offset + scale * ( vertex - min ) / lengths.
+  struct Block
+  {
+    Block() : bb(), offset ( 0.0f, 0.0f, 0.0f ), scale ( 1.0f, 1.0f, 1.0f )
+    {
+    }
+
+    osg::BoundingBox bb;
+    osg::Vec3f       offset;
+    osg::Vec3f       scale;
+  };
+  typedef std::vector < Block >                    Blocks;
+
+  // Construction.
+  AtlasGeometry();
+  AtlasGeometry ( const AtlasGeometry &d, const osg::CopyOp &options = osg::CopyOp::SHALLOW_COPY );
+
+  // Implementation of osg::Object's cloning functions.
+  virtual osg::Object         *clone ( const osg::CopyOp &options ) const;
+  virtual osg::Object         *cloneType() const;
+
+  // Draw.
+  virtual void                drawImplementation( DrawArgs ) const;
+
+  // Set/Get the blocks.
+  void                        blocks ( const Blocks &blocks );
+  Blocks                      blocks () const;
+
+  // Set/get the number of planes through each block.
+  unsigned int                numPlanes() const;
+  void                        numPlanes ( unsigned int num );
+
+  /// Set/get the number of steps per unit each component of the view
+  /// direction is rounded to.  Views that round the same share slices.
+  unsigned int                viewQuantization() const;
+  void                        viewQuantization ( unsigned int steps );
+
+protected:
+
+  // Use reference counting.
+  virtual ~AtlasGeometry();
+
+  virtual osg::BoundingBox    computeBound() const;
+
+  void                        _drawImplementation( osg::State& state ) const;
+  void                        _buildSlices ( const osg::Vec3f& viewVec ) const;
+
+private:
+  typedef std::pair < int, std::pair < int, int > > ViewKey;
+
+  AtlasGeometry &operator = ( const AtlasGeometry & );
+
+  Blocks                      _blocks;
+  unsigned int                _numPlanes;
+  unsigned int                _viewQuantization;
+  mutable OpenThreads::Mutex  _mutex;
+  mutable bool                _valid;
+  mutable ViewKey             _key;
+  mutable Vertices            _vertices;
+  mutable Vertices            _texCoords;
+  mutable Indices             _indices;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_ATLAS_GEOMETRY_H__
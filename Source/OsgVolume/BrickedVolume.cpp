@@ -0,0 +1,866 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Volume split into bricks with a texture budget.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/BrickedVolume.h"
+#include "OsgVolume/SlabImage.h"
+
+#include "osg/FrameStamp"
+#include "osg/GraphicsContext"
+#include "osg/Texture3D"
+
+#include "osgUtil/CullVisitor"
+
+#include "OpenThreads/Condition"
+#include "OpenThreads/ScopedLock"
+#include "OpenThreads/Thread"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <utility>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // Copy the voxels of the brick and one voxel around it.  Voxels past the
+  // edge of the volume repeat the edge, like clamping does.
+  osg::Image* copyBrick ( const osg::Image &volume, const unsigned int *first, const unsigned int *size )
+  {
+    const int sizes[3] = { volume.s(), volume.t(), std::max ( 1, volume.r() ) };
+    const unsigned int pixelSize ( volume.getPixelSizeInBits() / 8 );
+    const unsigned int rowStride ( volume.getRowSizeInBytes() );
+    const unsigned int sliceStride ( volume.getImageSizeInBytes() );
+
+    osg::ref_ptr < osg::Image > brick ( new osg::Image );
+    brick->allocateImage ( size[0] + 2, size[1] + 2, size[2] + 2, volume.getPixelFormat(), volume.getDataType(), volume.getPacking() );
+    brick->setInternalTextureFormat ( volume.getInternalTextureFormat() );
+
+    const int x0 ( static_cast < int > ( first[0] ) - 1 );
+    const int x1 ( x0 + static_cast < int > ( size[0] ) + 1 );
+
+    // Interior of each row is one copy, the borders are done by themselves.
+    const int begin ( std::max ( x0, 0 ) );
+    const int end ( std::min ( x1, sizes[0] - 1 ) );
+
+    for ( unsigned int k = 0; k < size[2] + 2; ++k )
+    {
+      const int kk ( std::min ( std::max ( static_cast < int > ( first[2] + k ) - 1, 0 ), sizes[2] - 1 ) );
+
+      for ( unsigned int j = 0; j < size[1] + 2; ++j )
+      {
+        const int jj ( std::min ( std::max ( static_cast < int > ( first[1] + j ) - 1, 0 ), sizes[1] - 1 ) );
+
+        const unsigned char *in ( volume.data() + kk * sliceStride + jj * rowStride );
+        unsigned char *out ( brick->data ( 0, j, k ) );
+
+        for ( int i = x0; i < begin; ++i, out += pixelSize )
+          std::memcpy ( out, in, pixelSize );
+
+        std::memcpy ( out, in + begin * pixelSize, ( end - begin + 1 ) * pixelSize );
+        out += ( end - begin + 1 ) * pixelSize;
+
+        for ( int i = end + 1; i <= x1; ++i, out += pixelSize )
+          std::memcpy ( out, in + ( sizes[0] - 1 ) * pixelSize, pixelSize );
+      }
+    }
+
+    return brick.release();
+  }
+
+  // Order bricks by distance.
+  typedef std::pair < float, unsigned int > Distance;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copies the voxels of bricks on a thread of its own, so neither the cull
+//  nor the update waits on them.  Copies asked for before the bricks were
+//  last built are thrown away.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+struct BrickedVolume::Copier : public OpenThreads::Thread
+{
+  typedef OpenThreads::ScopedLock < Mutex > Guard;
+
+  struct Request
+  {
+    unsigned int generation;
+    unsigned int index;
+    unsigned int first[3];
+    unsigned int size[3];
+    osg::ref_ptr < const osg::Image > volume;
+  };
+
+  struct Result
+  {
+    unsigned int generation;
+    unsigned int index;
+    osg::ref_ptr < osg::Image > image;
+  };
+
+  typedef std::deque < Request > Requests;
+  typedef std::vector < Result > Results;
+
+  Copier() : OpenThreads::Thread(),
+    _mutex(),
+    _changed(),
+    _requests(),
+    _results(),
+    _started ( false ),
+    _stopped ( false )
+  {
+  }
+
+  virtual ~Copier()
+  {
+    this->stop();
+  }
+
+  // Ask for a copy of the brick.
+  void request ( unsigned int generation, unsigned int index, const Brick &brick, const osg::Image *volume )
+  {
+    Request request;
+    request.generation = generation;
+    request.index = index;
+    request.volume = volume;
+    for ( unsigned int a = 0; a < 3; ++a )
+    {
+      request.first[a] = brick.first[a];
+      request.size[a] = brick.size[a];
+    }
+
+    Guard guard ( _mutex );
+    _requests.push_back ( request );
+
+    if ( false == _started )
+    {
+      _started = true;
+      this->start();
+    }
+
+    _changed.signal();
+  }
+
+  // Forget the copies not yet made.
+  void clear()
+  {
+    Guard guard ( _mutex );
+    _requests.clear();
+  }
+
+  // Take the copies made so far.
+  void take ( Results &results )
+  {
+    Guard guard ( _mutex );
+    results.swap ( _results );
+    _results.clear();
+  }
+
+  // Stop and wait for the thread.
+  void stop()
+  {
+    bool started ( false );
+    {
+      Guard guard ( _mutex );
+      _stopped = true;
+      _requests.clear();
+      started = _started;
+      _changed.broadcast();
+    }
+
+    if ( started )
+      this->join();
+
+    Guard guard ( _mutex );
+    _started = false;
+  }
+
+  virtual void run()
+  {
+    while ( true )
+    {
+      Request request;
+      {
+        Guard guard ( _mutex );
+        while ( false == _stopped && true == _requests.empty() )
+          _changed.wait ( &_mutex );
+
+        if ( _stopped )
+          return;
+
+        request = _requests.front();
+        _requests.pop_front();
+      }
+
+      // A brick that cannot be copied comes back empty, and is asked for again.
+      Result result;
+      result.generation = request.generation;
+      result.index = request.index;
+
+      try
+      {
+        result.image = Detail::copyBrick ( *request.volume, request.first, request.size );
+      }
+      catch ( ... )
+      {
+        result.image = 0x0;
+      }
+
+      Guard guard ( _mutex );
+      _results.push_back ( result );
+    }
+  }
+
+private:
+  Copier ( const Copier & );
+  Copier &operator = ( const Copier & );
+
+  Mutex _mutex;
+  OpenThreads::Condition _changed;
+  Requests _requests;
+  Results _results;
+  bool _started;
+  bool _stopped;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+BrickedVolume::BrickedVolume() : BaseClass(),
+  _volume ( 0x0 ),
+  _program ( Texture3DVolume::createProgram() ),
+  _bb ( -1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f ),
+  _brickSize ( 128 ),
+  _numPlanes ( 256 ),
+  _transferFunction ( 0x0 ),
+  _budget ( 256 * 1024 * 1024 ),
+  _residentBytes ( 0 ),
+  _frame ( 0 ),
+  _bricks(),
+  _cullMutex(),
+  _generation ( 0 ),
+  _copier ( 0x0 )
+{
+  // The bricks are added and removed in the update.
+  this->setNumChildrenRequiringUpdateTraversal ( this->getNumChildrenRequiringUpdateTraversal() + 1 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+BrickedVolume::~BrickedVolume()
+{
+  delete _copier;
+  _copier = 0x0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Does the image need bricks?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool BrickedVolume::needsBricks ( const osg::Image *image, unsigned int maxTextureSize )
+{
+  if ( 0x0 == image )
+    return false;
+
+  const unsigned int s ( image->s() ), t ( image->t() ), r ( image->r() );
+  return ( s > maxTextureSize || t > maxTextureSize || r > maxTextureSize );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the largest 3D texture the graphics contexts can hold.  Contexts
+//  that have not drawn a 3D texture yet have no answer.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int BrickedVolume::maxTextureSize ( unsigned int fallback )
+{
+  unsigned int size ( std::numeric_limits < unsigned int >::max() );
+
+  const unsigned int numContexts ( osg::GraphicsContext::getMaxContextID() + 1 );
+  for ( unsigned int id = 0; id < numContexts; ++id )
+  {
+    const osg::Texture3D::Extensions *extensions ( osg::Texture3D::getExtensions ( id, false ) );
+    if ( 0x0 != extensions && extensions->maxTexture3DSize() > 0 )
+      size = std::min ( size, static_cast < unsigned int > ( extensions->maxTexture3DSize() ) );
+  }
+
+  return ( std::numeric_limits < unsigned int >::max() == size ) ? fallback : size;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* BrickedVolume::image ()
+{
+  return _volume.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::Image* BrickedVolume::image () const
+{
+  return _volume.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::image ( osg::Image* image )
+{
+  _volume = image;
+  this->_buildBricks();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the width of the brick textures.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::brickSize ( unsigned int size )
+{
+  size = std::max ( 4u, size );
+
+  if ( size != _brickSize )
+  {
+    _brickSize = size;
+    this->_buildBricks();
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the width of the brick textures.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int BrickedVolume::brickSize () const
+{
+  return _brickSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the number of planes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::numPlanes ( unsigned int num )
+{
+  _numPlanes = num;
+
+  for ( unsigned int i = 0; i < _bricks.size(); ++i )
+  {
+    if ( _bricks[i].node.valid() )
+      _bricks[i].node->numPlanes ( this->_planes ( i ) );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of planes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int BrickedVolume::numPlanes () const
+{
+  return _numPlanes;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the bounding box.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::boundingBox ( const osg::BoundingBox& bb )
+{
+  _bb = bb;
+  this->_buildBricks();
+  this->dirtyBound();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the bounding box.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::BoundingBox& BrickedVolume::boundingBox () const
+{
+  return _bb;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the transfer function.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::transferFunction ( TransferFunction* tf )
+{
+  _transferFunction = tf;
+
+  for ( Bricks::iterator iter = _bricks.begin(); iter != _bricks.end(); ++iter )
+  {
+    if ( iter->node.valid() )
+      iter->node->transferFunction ( tf );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the transfer function.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+OsgVolume::TransferFunction* BrickedVolume::transferFunction () const
+{
+  return _transferFunction.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the texture budget.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::textureBudget ( unsigned long bytes )
+{
+  _budget = bytes;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the texture budget.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long BrickedVolume::textureBudget () const
+{
+  return _budget;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of bricks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int BrickedVolume::numBricks () const
+{
+  return _bricks.size();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of resident bricks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int BrickedVolume::numResident () const
+{
+  return this->getNumChildren();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the bytes of resident bricks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long BrickedVolume::residentBytes () const
+{
+  return _residentBytes;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The bound is the box, whether or not the bricks are resident.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::BoundingSphere BrickedVolume::computeBound() const
+{
+  osg::BoundingSphere bound;
+  bound.expandBy ( _bb );
+  return bound;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Split the volume into bricks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::_buildBricks ()
+{
+  this->removeChildren ( 0, this->getNumChildren() );
+  _bricks.clear();
+  _residentBytes = 0;
+
+  // Copies under way are for the old bricks.
+  ++_generation;
+  if ( 0x0 != _copier )
+    _copier->clear();
+
+  if ( false == _volume.valid() || 0x0 == _volume->data() )
+    return;
+
+  const unsigned int sizes[3] =
+  {
+    static_cast < unsigned int > ( _volume->s() ),
+    static_cast < unsigned int > ( _volume->t() ),
+    static_cast < unsigned int > ( std::max ( 1, _volume->r() ) )
+  };
+  const unsigned int interior ( _brickSize - 2 );
+
+  unsigned int count[3];
+  for ( unsigned int a = 0; a < 3; ++a )
+    count[a] = ( sizes[a] + interior - 1 ) / interior;
+
+  const osg::Vec3 length ( _bb._max - _bb._min );
+  const unsigned long pixelSize ( _volume->getPixelSizeInBits() / 8 );
+
+  for ( unsigned int k = 0; k < count[2]; ++k )
+  {
+    for ( unsigned int j = 0; j < count[1]; ++j )
+    {
+      for ( unsigned int i = 0; i < count[0]; ++i )
+      {
+        Brick brick;
+        const unsigned int index[3] = { i, j, k };
+
+        osg::Vec3 low, high;
+        for ( unsigned int a = 0; a < 3; ++a )
+        {
+          brick.first[a] = index[a] * interior;
+          brick.size[a] = std::min ( interior, sizes[a] - brick.first[a] );
+
+          low[a]  = _bb._min[a] + length[a] * static_cast < float > ( brick.first[a] ) / sizes[a];
+          high[a] = _bb._min[a] + length[a] * static_cast < float > ( brick.first[a] + brick.size[a] ) / sizes[a];
+        }
+
+        brick.bb.set ( low, high );
+        brick.bytes = pixelSize * ( brick.size[0] + 2 ) * ( brick.size[1] + 2 ) * ( brick.size[2] + 2 );
+
+        _bricks.push_back ( brick );
+      }
+    }
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of planes for the brick, so the spacing matches the
+//  spacing across the whole volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int BrickedVolume::_planes ( unsigned int index ) const
+{
+  const Brick &brick ( _bricks.at ( index ) );
+  const float whole ( ( _bb._max - _bb._min ).length() );
+  const float part ( ( brick.bb._max - brick.bb._min ).length() );
+
+  if ( whole <= 0.0f )
+    return _numPlanes;
+
+  return std::max ( 1u, static_cast < unsigned int > ( std::ceil ( _numPlanes * part / whole ) ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Are the slices of the brick, and the one past each end, loaded?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool BrickedVolume::_loaded ( unsigned int index ) const
+{
+  if ( false == SlabImage::loading ( _volume.get() ) )
+    return true;
+
+  const Brick &brick ( _bricks.at ( index ) );
+  const unsigned int last ( std::min ( brick.first[2] + brick.size[2] + 1, static_cast < unsigned int > ( _volume->r() ) ) );
+  return ( static_cast < const SlabImage * > ( _volume.get() )->numLoaded() >= last );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Give the brick a texture made from its copy.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::_makeResident ( unsigned int index )
+{
+  Brick &brick ( _bricks.at ( index ) );
+  if ( brick.node.valid() || false == brick.copy.valid() )
+    return;
+
+  // All the bricks share the program.
+  brick.node = new Texture3DVolume ( _program.get() );
+  brick.node->numPlanes ( this->_planes ( index ) );
+  brick.node->image ( brick.copy.get() );
+  brick.copy = 0x0;
+  brick.node->boundingBox ( brick.bb );
+
+  // The box covers the texture inside the border.
+  osg::Vec3 offset, scale;
+  for ( unsigned int a = 0; a < 3; ++a )
+  {
+    const float width ( static_cast < float > ( brick.size[a] + 2 ) );
+    offset[a] = 1.0f / width;
+    scale[a] = static_cast < float > ( brick.size[a] ) / width;
+  }
+  brick.node->textureWindow ( offset, scale );
+
+  if ( _transferFunction.valid() )
+    brick.node->transferFunction ( _transferFunction.get() );
+
+  // Blend the bricks back to front.
+  brick.node->getOrCreateStateSet()->setRenderBinDetails ( 1000, "DepthSortedBin" );
+
+  this->addChild ( brick.node.get() );
+  _residentBytes += brick.bytes;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Let go of the brick's texture.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::_evict ( unsigned int index )
+{
+  Brick &brick ( _bricks.at ( index ) );
+  if ( false == brick.node.valid() )
+    return;
+
+  this->removeChild ( brick.node.get() );
+  brick.node = 0x0;
+  _residentBytes -= std::min ( _residentBytes, brick.bytes );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Note the bricks in view and how near they are.  Nothing in the graph
+//  changes here, so any number of views may cull at once.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::_cull ( osgUtil::CullVisitor &cv )
+{
+  // Cameras drawing the same frame share it.
+  const osg::FrameStamp *fs ( cv.getFrameStamp() );
+  const osg::Vec3 eye ( cv.getEyePoint() );
+
+  OpenThreads::ScopedLock < Mutex > guard ( _cullMutex );
+
+  const unsigned int frame ( ( 0x0 != fs ) ? fs->getFrameNumber() + 1 : _frame + 1 );
+  _frame = std::max ( _frame, frame );
+
+  for ( unsigned int i = 0; i < _bricks.size(); ++i )
+  {
+    Brick &brick ( _bricks[i] );
+    if ( true == cv.isCulled ( brick.bb ) || false == this->_loaded ( i ) )
+      continue;
+
+    // The nearest of the views decides.
+    const float distance ( ( brick.bb.center() - eye ).length2() );
+    brick.distance = ( brick.lastUsed == frame ) ? std::min ( brick.distance, distance ) : distance;
+    brick.lastUsed = frame;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Give textures to the bricks in view last frame, nearest first, up to the
+//  budget.  Bricks not copied yet are asked for, and drawn once they are.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::_update ()
+{
+  if ( _bricks.empty() )
+    return;
+
+  if ( 0x0 == _copier )
+    _copier = new Copier;
+
+  // Keep the copies made for these bricks.
+  Copier::Results results;
+  _copier->take ( results );
+  for ( Copier::Results::iterator iter = results.begin(); iter != results.end(); ++iter )
+  {
+    if ( iter->generation != _generation || iter->index >= _bricks.size() )
+      continue;
+
+    Brick &brick ( _bricks[iter->index] );
+    brick.requested = false;
+    brick.copy = iter->image;
+  }
+
+  // The bricks in view, nearest first.
+  std::vector < Detail::Distance > visible;
+  {
+    OpenThreads::ScopedLock < Mutex > guard ( _cullMutex );
+    visible.reserve ( _bricks.size() );
+
+    for ( unsigned int i = 0; i < _bricks.size(); ++i )
+    {
+      if ( _bricks[i].lastUsed == _frame )
+        visible.push_back ( Detail::Distance ( _bricks[i].distance, i ) );
+    }
+  }
+
+  std::sort ( visible.begin(), visible.end() );
+
+  // The nearest that fit the budget are wanted.  The nearest always is.
+  std::vector < bool > wanted ( _bricks.size(), false );
+  unsigned long bytes ( 0 );
+  for ( std::vector < Detail::Distance >::const_iterator iter = visible.begin(); iter != visible.end(); ++iter )
+  {
+    const Brick &brick ( _bricks[iter->second] );
+    if ( bytes + brick.bytes > _budget && bytes > 0 )
+      break;
+
+    bytes += brick.bytes;
+    wanted[iter->second] = true;
+  }
+
+  for ( std::vector < Detail::Distance >::const_iterator iter = visible.begin(); iter != visible.end(); ++iter )
+  {
+    const unsigned int index ( iter->second );
+    Brick &brick ( _bricks[index] );
+
+    if ( false == wanted[index] || brick.node.valid() )
+      continue;
+
+    if ( false == brick.copy.valid() )
+    {
+      if ( false == brick.requested )
+      {
+        brick.requested = true;
+        _copier->request ( _generation, index, brick, _volume.get() );
+      }
+      continue;
+    }
+
+    // Make room by letting go of the bricks not wanted, oldest first.
+    while ( _residentBytes + brick.bytes > _budget )
+    {
+      unsigned int oldest ( _bricks.size() );
+      for ( unsigned int i = 0; i < _bricks.size(); ++i )
+      {
+        if ( _bricks[i].node.valid() && false == wanted[i] && ( oldest == _bricks.size() || _bricks[i].lastUsed < _bricks[oldest].lastUsed ) )
+          oldest = i;
+      }
+
+      if ( oldest == _bricks.size() )
+        break;
+
+      this->_evict ( oldest );
+    }
+
+    this->_makeResident ( index );
+  }
+
+  // Copies of bricks no longer wanted are let go.
+  for ( unsigned int i = 0; i < _bricks.size(); ++i )
+  {
+    if ( false == wanted[i] )
+      _bricks[i].copy = 0x0;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Traverse this node.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void BrickedVolume::traverse ( osg::NodeVisitor &nv )
+{
+  if ( osg::NodeVisitor::UPDATE_VISITOR == nv.getVisitorType() )
+    this->_update();
+
+  osgUtil::CullVisitor *cv ( dynamic_cast < osgUtil::CullVisitor * > ( &nv ) );
+  if ( 0x0 != cv && false == _bricks.empty() )
+    this->_cull ( *cv );
+
+  // Call the base class' one.
+  BaseClass::traverse ( nv );
+}
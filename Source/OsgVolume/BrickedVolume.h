@@ -0,0 +1,153 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Volume too big for one 3D texture.  It is split into bricks that each
+//  fit, with a voxel of the neighbors around them so filtering matches
+//  across the seams.  Only the bricks in view are given textures, nearest
+//  first, up to a budget of bytes.  The bricks used longest ago are let go
+//  to make room.  While the image is still loading, bricks wait until
+//  their slices are in.
+//
+//  The cull only notes which bricks each view needs, so any number of views
+//  and cull threads may share the node.  The update traversal adds and
+//  removes the bricks, and their voxels are copied on a thread of their own.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_BRICKED_VOLUME_H__
+#define __OSGTOOLS_VOLUME_BRICKED_VOLUME_H__
+
+#include "OsgVolume/Export.h"
+#include "OsgVolume/Texture3DVolume.h"
+#include "OsgVolume/TransferFunction.h"
+
+#include "osg/BoundingBox"
+#include "osg/Group"
+#include "osg/Image"
+#include "osg/Program"
+
+#include "OpenThreads/Mutex"
+
+#include <vector>
+
+namespace osgUtil { class CullVisitor; }
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT BrickedVolume : public osg::Group
+{
+public:
+  /// Typedefs.
+  typedef osg::Group                             BaseClass;
+  typedef osg::ref_ptr < osg::Image >            ImagePtr;
+  typedef OsgVolume::TransferFunction            TransferFunction;
+
+  /// Construction.
+  BrickedVolume();
+
+  /// Does the image need bricks to fit in textures of the given size?
+  static bool                      needsBricks ( const osg::Image *image, unsigned int maxTextureSize );
+
+  /// Get the largest 3D texture every graphics context that has drawn one
+  /// can hold, or the fallback if none has yet.
+  static unsigned int              maxTextureSize ( unsigned int fallback );
+
+  /// Get/Set the image.
+  osg::Image*                      image ();
+  const osg::Image*                image () const;
+  void                             image ( osg::Image* image );
+
+  /// Get/Set the width of the brick textures, including the borders.
+  void                             brickSize ( unsigned int size );
+  unsigned int                     brickSize () const;
+
+  /// Get/Set the number of planes across the whole volume.
+  void                             numPlanes ( unsigned int num );
+  unsigned int                     numPlanes () const;
+
+  /// Get/Set the bounding box.
+  void                             boundingBox ( const osg::BoundingBox& bb );
+  const osg::BoundingBox&          boundingBox () const;
+
+  /// Get/Set the transfer function.
+  void                             transferFunction ( TransferFunction* tf );
+  TransferFunction*                transferFunction () const;
+
+  /// Get/Set the bytes of brick textures that may be resident.
+  void                             textureBudget ( unsigned long bytes );
+  unsigned long                    textureBudget () const;
+
+  /// Get the number of bricks, and how many and how many bytes are resident.
+  unsigned int                     numBricks () const;
+  unsigned int                     numResident () const;
+  unsigned long                    residentBytes () const;
+
+  /// Traverse this node.
+  virtual void                     traverse ( osg::NodeVisitor &nv );
+
+protected:
+  virtual ~BrickedVolume();
+
+  virtual osg::BoundingSphere      computeBound() const;
+
+  void                             _buildBricks ();
+  void                             _cull ( osgUtil::CullVisitor &cv );
+  void                             _update ();
+  void                             _makeResident ( unsigned int index );
+  void                             _evict ( unsigned int index );
+  bool                             _loaded ( unsigned int index ) const;
+  unsigned int                     _planes ( unsigned int index ) const;
+
+private:
+
+  typedef OpenThreads::Mutex Mutex;
+
+  struct Copier;
+
+  struct Brick
+  {
+    Brick() : bb(), first(), size(), bytes ( 0 ), lastUsed ( 0 ), distance ( 0.0f ), requested ( false ), copy ( 0x0 ), node ( 0x0 )
+    {
+    }
+
+    osg::BoundingBox                    bb;
+    unsigned int                        first[3];
+    unsigned int                        size[3];
+    unsigned long                       bytes;
+    unsigned int                        lastUsed;
+    float                               distance;
+    bool                                requested;
+    osg::ref_ptr < osg::Image >         copy;
+    osg::ref_ptr < Texture3DVolume >    node;
+  };
+
+  typedef std::vector < Brick > Bricks;
+
+  ImagePtr                      _volume;
+  osg::ref_ptr < osg::Program > _program;
+  osg::BoundingBox              _bb;
+  unsigned int                  _brickSize;
+  unsigned int                  _numPlanes;
+  TransferFunction::RefPtr      _transferFunction;
+  unsigned long                 _budget;
+  unsigned long                 _residentBytes;
+  unsigned int                  _frame;
+  Bricks                        _bricks;
+  Mutex                         _cullMutex;
+  unsigned int                  _generation;
+  Copier *                      _copier;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_BRICKED_VOLUME_H__
@@ -0,0 +1,777 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Software ray caster.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/CPURayCasting.h"
+#include "OsgVolume/Parallel.h"
+#include "OsgVolume/SimdVec4.h"
+#include "OsgVolume/TransferFunction1D.h"
+#include "OsgVolume/Voxels.h"
+
+#include "osg/Vec3d"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+CPURayCasting::CPURayCasting() : BaseClass(),
+  _volume ( 0x0 ),
+  _transferFunction ( 0x0 ),
+  _bb ( -1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f ),
+  _samplingRate ( 0.1f ),
+  _compositeMode ( Compositing::BACK_TO_FRONT ),
+  _opacityCutoff ( 0.95f ),
+  _tileSize ( 16 ),
+  _numThreads ( 0 ),
+  _macrocellSize ( 8 ),
+  _macrocells ( 0x0 ),
+  _macrocellsModified ( 0 ),
+  _mutex()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+CPURayCasting::~CPURayCasting()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* CPURayCasting::image ()
+{
+  return _volume.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::Image* CPURayCasting::image () const
+{
+  return _volume.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void CPURayCasting::image ( osg::Image* image )
+{
+  _volume = image;
+
+  Guard guard ( _mutex );
+  _macrocells = 0x0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the sampling rate.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+float CPURayCasting::samplingRate () const
+{
+  return _samplingRate;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the sampling rate.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void CPURayCasting::samplingRate ( float rate )
+{
+  _samplingRate = rate;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the bounding box.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void CPURayCasting::boundingBox ( const osg::BoundingBox& bb )
+{
+  _bb = bb;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the bounding box.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::BoundingBox& CPURayCasting::boundingBox () const
+{
+  return _bb;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the transfer function.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void CPURayCasting::transferFunction ( TransferFunction* tf )
+{
+  _transferFunction = tf;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the transfer function.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+OsgVolume::TransferFunction* CPURayCasting::transferFunction () const
+{
+  return _transferFunction.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the compositing mode.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void CPURayCasting::compositeMode ( CompositeMode mode )
+{
+  _compositeMode = mode;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the compositing mode.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+CPURayCasting::CompositeMode CPURayCasting::compositeMode () const
+{
+  return _compositeMode;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the opacity at which front to back rays stop.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void CPURayCasting::opacityCutoff ( float cutoff )
+{
+  _opacityCutoff = cutoff;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the opacity at which front to back rays stop.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+float CPURayCasting::opacityCutoff () const
+{
+  return _opacityCutoff;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the tile size.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void CPURayCasting::tileSize ( unsigned int size )
+{
+  _tileSize = std::max ( 1u, size );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the tile size.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int CPURayCasting::tileSize () const
+{
+  return _tileSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the number of threads.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void CPURayCasting::numThreads ( unsigned int num )
+{
+  _numThreads = num;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of threads.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int CPURayCasting::numThreads () const
+{
+  return _numThreads;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the macrocell size.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void CPURayCasting::macrocellSize ( unsigned int size )
+{
+  Guard guard ( _mutex );
+  _macrocellSize = std::max ( 1u, size );
+  _macrocells = 0x0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the macrocell size.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int CPURayCasting::macrocellSize () const
+{
+  return _macrocellSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the macrocells of the volume, building them if it changed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+MacrocellGrid::RefPtr CPURayCasting::_getMacrocells ( osg::Image *volume ) const
+{
+  Guard guard ( _mutex );
+
+  // Zero means never built, so counts are kept one up.
+  const unsigned int modified ( volume->getModifiedCount() + 1 );
+  if ( false == _macrocells.valid() || modified != _macrocellsModified )
+  {
+    _macrocells = new MacrocellGrid ( volume, _macrocellSize );
+    _macrocellsModified = modified;
+  }
+
+  return _macrocells;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for the ray caster.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // GL_LINEAR with CLAMP_TO_EDGE along one axis.
+  inline void linearTexel ( float s, int size, int &i0, int &i1, float &f )
+  {
+    const float u ( s * static_cast < float > ( size ) - 0.5f );
+    const float fl ( std::floor ( u ) );
+    f = u - fl;
+    i0 = static_cast < int > ( fl );
+    i1 = i0 + 1;
+    i0 = std::min ( std::max ( i0, 0 ), size - 1 );
+    i1 = std::min ( std::max ( i1, 0 ), size - 1 );
+  }
+
+  // Everything the tiles need.
+  struct RayCastContext
+  {
+    const unsigned char *data;
+    unsigned int rowStride;
+    unsigned int sliceStride;
+    unsigned int pixelStride;
+    unsigned int channel;
+    bool constant;
+    int size[3];
+
+    std::vector < float > colors;
+    int numColors;
+
+    osg::Matrixd inverse;
+    osg::Vec3d bbMin;
+    osg::Vec3d bbMax;
+    osg::Vec3d cameraTex;
+    float rate;
+    int maxSteps;
+    Compositing::Mode mode;
+    float opacityCutoff;
+
+    const MacrocellGrid *cells;
+    float cellsPerUnit[3];
+    float dataMinimum;
+    float dataMaximum;
+
+    unsigned char *output;
+    unsigned int width;
+    unsigned int height;
+    unsigned int tileSize;
+    unsigned int tilesX;
+  };
+
+  // Render the tiles of one image.  The voxel type is a template parameter so the inner loop has no switch.
+  template < class VoxelType > class RayCastTiles
+  {
+  public:
+    RayCastTiles ( const RayCastContext &c ) : _c ( c )
+    {
+    }
+
+    void operator () ( unsigned int tile )
+    {
+      const unsigned int x0 ( ( tile % _c.tilesX ) * _c.tileSize );
+      const unsigned int y0 ( ( tile / _c.tilesX ) * _c.tileSize );
+      const unsigned int x1 ( std::min ( x0 + _c.tileSize, _c.width ) );
+      const unsigned int y1 ( std::min ( y0 + _c.tileSize, _c.height ) );
+
+      for ( unsigned int y = y0; y < y1; ++y )
+      {
+        for ( unsigned int x = x0; x < x1; ++x )
+        {
+          unsigned char *pixel ( _c.output + ( y * _c.width + x ) * 4 );
+          this->_castRay ( x, y, pixel );
+        }
+      }
+    }
+
+  private:
+
+    RayCastTiles &operator = ( const RayCastTiles & );
+
+    float _voxel ( int i, int j, int k ) const
+    {
+      const unsigned char *p ( _c.data + k * _c.sliceStride + j * _c.rowStride + i * _c.pixelStride );
+      return Voxels::normalize ( reinterpret_cast < const VoxelType * > ( p )[_c.channel] );
+    }
+
+    // Trilinear sample of the volume at the texture coordinate.
+    float _sample ( float s, float t, float r ) const
+    {
+      if ( _c.constant )
+        return 1.0f;
+
+      int i0, i1, j0, j1, k0, k1;
+      float fx, fy, fz;
+      Detail::linearTexel ( s, _c.size[0], i0, i1, fx );
+      Detail::linearTexel ( t, _c.size[1], j0, j1, fy );
+      Detail::linearTexel ( r, _c.size[2], k0, k1, fz );
+
+      // Interpolate along x for the four ( y, z ) pairs at once.
+      const Simd::Vec4 a ( this->_voxel ( i0, j0, k0 ), this->_voxel ( i0, j1, k0 ), this->_voxel ( i0, j0, k1 ), this->_voxel ( i0, j1, k1 ) );
+      const Simd::Vec4 b ( this->_voxel ( i1, j0, k0 ), this->_voxel ( i1, j1, k0 ), this->_voxel ( i1, j0, k1 ), this->_voxel ( i1, j1, k1 ) );
+      float c[4];
+      Simd::lerp ( a, b, Simd::Vec4 ( fx ) ).store ( c );
+
+      const float c0 ( c[0] + ( c[1] - c[0] ) * fy );
+      const float c1 ( c[2] + ( c[3] - c[2] ) * fy );
+      return c0 + ( c1 - c0 ) * fz;
+    }
+
+    // Look up the transfer function like a linear 1D texture.
+    Simd::Vec4 _classify ( float scalar ) const
+    {
+      int i0, i1;
+      float f;
+      Detail::linearTexel ( scalar, _c.numColors, i0, i1, f );
+      return Simd::lerp ( Simd::Vec4::load ( &_c.colors[i0 * 4] ), Simd::Vec4::load ( &_c.colors[i1 * 4] ), Simd::Vec4 ( f ) );
+    }
+
+    // Composite the classified samples from the start to the far side.
+    Simd::Vec4 _composite ( float *position, const float *step, float voxels, bool backToFront ) const
+    {
+      // Used to replace the sample's alpha with one.
+      const Simd::Vec4 rgbMask ( 1.0f, 1.0f, 1.0f, 0.0f );
+      const Simd::Vec4 alphaOne ( 0.0f, 0.0f, 0.0f, 1.0f );
+
+      Simd::Vec4 dst;
+
+      for ( int i = 0; i < _c.maxSteps; ++i )
+      {
+        const Simd::Vec4 sample ( this->_classify ( this->_sample ( position[0], position[1], position[2] ) ) );
+        const Simd::Vec4 src ( sample * rgbMask + alphaOne );
+        const Simd::Vec4 a ( Compositing::correctOpacity ( sample.w(), voxels ) );
+
+        if ( backToFront )
+        {
+          // The over operator, which keeps alpha in [0,1].
+          dst = Simd::lerp ( dst, src, a );
+        }
+        else
+        {
+          // Add what still shows through, and stop once nearly opaque.
+          dst = dst + src * ( ( Simd::Vec4 ( 1.0f ) - dst.wwww() ) * a );
+          if ( dst.w() >= _c.opacityCutoff )
+            break;
+        }
+
+        position[0] += step[0];
+        position[1] += step[1];
+        position[2] += step[2];
+
+        // Same test as the shader: stop unless strictly inside the unit cube.
+        if ( position[0] <= 0.0f || position[1] <= 0.0f || position[2] <= 0.0f ||
+             position[0] >= 1.0f || position[1] >= 1.0f || position[2] >= 1.0f )
+          break;
+      }
+
+      return dst;
+    }
+
+    // Keep the largest, smallest or mean scalar along the ray.  Bricks whose
+    // range cannot change the maximum or minimum are jumped over, as in the
+    // shader, and the ray stops once it holds the volume's extreme.
+    float _project ( float *position, const float *step ) const
+    {
+      const bool maximum ( Compositing::MAXIMUM_INTENSITY == _c.mode );
+      const bool minimum ( Compositing::MINIMUM_INTENSITY == _c.mode );
+      const MacrocellGrid *cells ( ( maximum || minimum ) ? _c.cells : 0x0 );
+
+      float projected ( minimum ? 1.0f : 0.0f );
+      unsigned int count ( 0 );
+
+      for ( int i = 0; i < _c.maxSteps; ++i )
+      {
+        unsigned int cell[3] = { 0, 0, 0 };
+        bool skip ( false );
+        if ( 0x0 != cells )
+        {
+          for ( unsigned int a = 0; a < 3; ++a )
+          {
+            const int c ( static_cast < int > ( std::floor ( position[a] * _c.cellsPerUnit[a] ) ) );
+            cell[a] = static_cast < unsigned int > ( std::min ( std::max ( c, 0 ), static_cast < int > ( cells->numCells ( a ) ) - 1 ) );
+          }
+          skip = ( maximum ?
+                   cells->maximum ( cell[0], cell[1], cell[2] ) <= projected :
+                   cells->minimum ( cell[0], cell[1], cell[2] ) >= projected );
+        }
+
+        if ( skip )
+        {
+          // Jump to the first sample past the brick.
+          float exit ( std::numeric_limits < float >::max() );
+          for ( unsigned int a = 0; a < 3; ++a )
+          {
+            const float d ( step[a] / _c.rate );
+            if ( 0.0f != d )
+            {
+              const float side ( static_cast < float > ( cell[a] + ( ( d > 0.0f ) ? 1 : 0 ) ) / _c.cellsPerUnit[a] );
+              exit = std::min ( exit, ( side - position[a] ) / d );
+            }
+          }
+          const int steps ( static_cast < int > ( std::max ( 1.0f, std::ceil ( exit / _c.rate ) ) ) );
+          position[0] += step[0] * steps;
+          position[1] += step[1] * steps;
+          position[2] += step[2] * steps;
+          i += steps - 1;
+        }
+        else
+        {
+          const float scalar ( this->_sample ( position[0], position[1], position[2] ) );
+          if ( maximum )
+          {
+            projected = std::max ( projected, scalar );
+            if ( projected >= _c.dataMaximum )
+              break;
+          }
+          else if ( minimum )
+          {
+            projected = std::min ( projected, scalar );
+            if ( projected <= _c.dataMinimum )
+              break;
+          }
+          else
+          {
+            projected += scalar;
+            ++count;
+          }
+
+          position[0] += step[0];
+          position[1] += step[1];
+          position[2] += step[2];
+        }
+
+        if ( position[0] <= 0.0f || position[1] <= 0.0f || position[2] <= 0.0f ||
+             position[0] >= 1.0f || position[1] >= 1.0f || position[2] >= 1.0f )
+          break;
+      }
+
+      if ( Compositing::AVERAGE_INTENSITY == _c.mode )
+        return ( count > 0 ) ? projected / static_cast < float > ( count ) : 0.0f;
+
+      return projected;
+    }
+
+    void _castRay ( unsigned int x, unsigned int y, unsigned char *pixel ) const
+    {
+      // Ray through the pixel center from the near to the far plane.
+      const double nx ( ( 2.0 * ( x + 0.5 ) ) / _c.width - 1.0 );
+      const double ny ( ( 2.0 * ( y + 0.5 ) ) / _c.height - 1.0 );
+      const osg::Vec3d nearPoint ( osg::Vec3d ( nx, ny, -1.0 ) * _c.inverse );
+      const osg::Vec3d farPoint  ( osg::Vec3d ( nx, ny,  1.0 ) * _c.inverse );
+      const osg::Vec3d d ( farPoint - nearPoint );
+
+      // Where does it cross the box?
+      double tEnter ( -std::numeric_limits < double >::max() );
+      double tExit  (  std::numeric_limits < double >::max() );
+      for ( unsigned int i = 0; i < 3; ++i )
+      {
+        if ( 0.0 == d[i] )
+        {
+          if ( nearPoint[i] < _c.bbMin[i] || nearPoint[i] > _c.bbMax[i] )
+            return;
+          continue;
+        }
+        double t0 ( ( _c.bbMin[i] - nearPoint[i] ) / d[i] );
+        double t1 ( ( _c.bbMax[i] - nearPoint[i] ) / d[i] );
+        if ( t0 > t1 )
+          std::swap ( t0, t1 );
+        tEnter = std::max ( tEnter, t0 );
+        tExit  = std::min ( tExit,  t1 );
+      }
+      if ( tEnter > tExit )
+        return;
+
+      // The GPU version starts on the rasterized face: front faces when
+      // compositing front to back, back faces otherwise.
+      const bool backToFront ( Compositing::FRONT_TO_BACK != _c.mode );
+      const double tFace ( backToFront ? tExit : tEnter );
+      if ( tFace < 0.0 || tFace > 1.0 )
+        return;
+
+      const osg::Vec3d face ( nearPoint + d * tFace );
+      osg::Vec3d start;
+      for ( unsigned int i = 0; i < 3; ++i )
+        start[i] = ( face[i] - _c.bbMin[i] ) / ( _c.bbMax[i] - _c.bbMin[i] );
+
+      // Direction in texture space.
+      osg::Vec3d direction ( backToFront ? ( _c.cameraTex - start ) : ( start - _c.cameraTex ) );
+      const double length ( direction.length() );
+      if ( length <= 0.0 )
+        return;
+      direction /= length;
+
+      float position[3] = { static_cast < float > ( start[0] ), static_cast < float > ( start[1] ), static_cast < float > ( start[2] ) };
+      const float step[3] =
+      {
+        static_cast < float > ( direction[0] ) * _c.rate,
+        static_cast < float > ( direction[1] ) * _c.rate,
+        static_cast < float > ( direction[2] ) * _c.rate
+      };
+
+      // Voxels crossed by one step, for the opacities.
+      const osg::Vec3d voxels ( direction[0] * _c.size[0], direction[1] * _c.size[1], direction[2] * _c.size[2] );
+
+      // The projections classify only the scalar they keep.
+      const Simd::Vec4 dst ( Compositing::projection ( _c.mode ) ?
+                             this->_classify ( this->_project ( position, step ) ) :
+                             this->_composite ( position, step, static_cast < float > ( voxels.length() ) * _c.rate, backToFront ) );
+
+      float rgba[4];
+      Simd::saturate ( dst ).store ( rgba );
+
+      for ( unsigned int i = 0; i < 4; ++i )
+        pixel[i] = static_cast < unsigned char > ( rgba[i] * 255.0f + 0.5f );
+    }
+
+    const RayCastContext &_c;
+  };
+
+  // Copy the transfer function into rgba floats.
+  inline void transferFunctionColors ( osg::Image *image, std::vector < float > &colors )
+  {
+    if ( 0x0 == image || 0x0 == image->data() || image->s() <= 0 )
+      throw std::runtime_error ( "Error 3319702864: transfer function has no colors" );
+
+    if ( GL_RGBA != image->getPixelFormat() )
+      throw std::runtime_error ( "Error 1173520948: transfer function image must be GL_RGBA" );
+
+    const unsigned int size ( image->s() * 4 );
+    colors.resize ( size );
+
+    if ( GL_FLOAT == image->getDataType() )
+    {
+      const float *data ( reinterpret_cast < const float * > ( image->data() ) );
+      std::copy ( data, data + size, colors.begin() );
+    }
+    else if ( GL_UNSIGNED_BYTE == image->getDataType() )
+    {
+      const unsigned char *data ( image->data() );
+      for ( unsigned int i = 0; i < size; ++i )
+        colors[i] = Voxels::normalize ( data[i] );
+    }
+    else
+      throw std::runtime_error ( "Error 2487961530: transfer function data type not supported" );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Render the volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* CPURayCasting::render ( const osg::Matrixd &view, const osg::Matrixd &projection, unsigned int width, unsigned int height ) const
+{
+  osg::ref_ptr < osg::Image > volume ( _volume );
+  TransferFunction::RefPtr tf ( _transferFunction );
+
+  if ( false == volume.valid() || 0x0 == volume->data() )
+    throw std::runtime_error ( "Error 4030816259: no volume image to render" );
+
+  if ( false == tf.valid() || 1 != tf->dimensions() )
+    throw std::runtime_error ( "Error 1629354087: a 1D transfer function is needed" );
+
+  if ( 0 == width || 0 == height )
+    throw std::runtime_error ( "Error 2776409153: output image has no pixels" );
+
+  if ( _samplingRate <= 0.0f )
+    throw std::runtime_error ( "Error 3875160924: sampling rate must be positive" );
+
+  // Make sure the colors are up to date, as texture() does for the GPU.
+  TransferFunction1D *tf1 ( dynamic_cast < TransferFunction1D * > ( tf.get() ) );
+  if ( 0x0 != tf1 )
+    tf1->calculateColors();
+
+  Detail::RayCastContext c;
+  Detail::transferFunctionColors ( tf->image(), c.colors );
+  c.numColors = static_cast < int > ( c.colors.size() / 4 );
+
+  // Describe the voxels.
+  c.data = volume->data();
+  c.size[0] = volume->s();
+  c.size[1] = volume->t();
+  c.size[2] = std::max ( 1, volume->r() );
+  c.rowStride = volume->getRowSizeInBytes();
+  c.sliceStride = volume->getImageSizeInBytes();
+  c.pixelStride = volume->getPixelSizeInBits() / 8;
+  c.constant = ( false == Voxels::scalarChannel ( volume->getPixelFormat(), c.channel ) );
+
+  // Set up the camera.
+  c.inverse = osg::Matrixd::inverse ( view * projection );
+  c.bbMin = osg::Vec3d ( _bb._min );
+  c.bbMax = osg::Vec3d ( _bb._max );
+  const osg::Vec3d eye ( osg::Vec3d ( 0.0, 0.0, 0.0 ) * osg::Matrixd::inverse ( view ) );
+  for ( unsigned int i = 0; i < 3; ++i )
+    c.cameraTex[i] = ( eye[i] - c.bbMin[i] ) / ( c.bbMax[i] - c.bbMin[i] );
+  c.rate = _samplingRate;
+  c.maxSteps = Compositing::maxSteps ( _samplingRate );
+  c.mode = _compositeMode;
+  c.opacityCutoff = _opacityCutoff;
+
+  // The maximum and minimum projections skip bricks by their ranges.
+  MacrocellGrid::RefPtr cells ( 0x0 );
+  const bool extreme ( Compositing::MAXIMUM_INTENSITY == _compositeMode || Compositing::MINIMUM_INTENSITY == _compositeMode );
+  if ( extreme && false == c.constant && Voxels::supported ( volume->getDataType() ) )
+    cells = this->_getMacrocells ( volume.get() );
+
+  c.cells = cells.get();
+  c.dataMinimum = cells.valid() ? cells->minimum() : 0.0f;
+  c.dataMaximum = cells.valid() ? cells->maximum() : 1.0f;
+  for ( unsigned int i = 0; i < 3; ++i )
+    c.cellsPerUnit[i] = cells.valid() ? static_cast < float > ( c.size[i] ) / cells->cellSize() : 1.0f;
+
+  // Make the answer.  Pixels the rays miss stay clear.
+  osg::ref_ptr < osg::Image > answer ( new osg::Image );
+  answer->allocateImage ( width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+  ::memset ( answer->data(), 0, width * height * 4 );
+
+  c.output = answer->data();
+  c.width = width;
+  c.height = height;
+  c.tileSize = _tileSize;
+  c.tilesX = ( width + _tileSize - 1 ) / _tileSize;
+  const unsigned int tilesY ( ( height + _tileSize - 1 ) / _tileSize );
+
+  switch ( volume->getDataType() )
+  {
+  case GL_UNSIGNED_BYTE:
+    {
+      Detail::RayCastTiles < unsigned char > tiles ( c );
+      Parallel::forEach ( c.tilesX * tilesY, tiles, _numThreads );
+    }
+    break;
+  case GL_UNSIGNED_SHORT:
+    {
+      Detail::RayCastTiles < unsigned short > tiles ( c );
+      Parallel::forEach ( c.tilesX * tilesY, tiles, _numThreads );
+    }
+    break;
+  case GL_FLOAT:
+    {
+      Detail::RayCastTiles < float > tiles ( c );
+      Parallel::forEach ( c.tilesX * tilesY, tiles, _numThreads );
+    }
+    break;
+  default:
+    throw std::runtime_error ( "Error 1450283376: volume data type not supported" );
+  }
+
+  return answer.release();
+}
@@ -0,0 +1,127 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Software ray caster.  Takes the same inputs as GPURayCasting and follows
+//  the same sampling and compositing rules, but renders into an RGBA image
+//  on the CPU so frames can be made on machines without a graphics card.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_CPU_RAY_CASTING_H__
+#define __OSGTOOLS_VOLUME_CPU_RAY_CASTING_H__
+
+#include "OsgVolume/Export.h"
+#include "OsgVolume/Compositing.h"
+#include "OsgVolume/MacrocellGrid.h"
+#include "OsgVolume/TransferFunction.h"
+
+#include "OpenThreads/Mutex"
+#include "OpenThreads/ScopedLock"
+
+#include "Usul/Base/Referenced.h"
+#include "Usul/Pointers/Pointers.h"
+
+#include "osg/BoundingBox"
+#include "osg/Image"
+#include "osg/Matrixd"
+#include "osg/ref_ptr"
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT CPURayCasting : public Usul::Base::Referenced
+{
+public:
+  /// Typedefs.
+  typedef Usul::Base::Referenced                 BaseClass;
+  typedef osg::ref_ptr < osg::Image >            ImagePtr;
+  typedef OsgVolume::TransferFunction            TransferFunction;
+  typedef OsgVolume::Compositing::Mode           CompositeMode;
+  typedef OpenThreads::Mutex                     Mutex;
+  typedef OpenThreads::ScopedLock < Mutex >      Guard;
+
+  USUL_DECLARE_REF_POINTERS ( CPURayCasting );
+
+  /// Construction.
+  CPURayCasting();
+
+  /// Get/Set the image.
+  osg::Image*                      image ();
+  const osg::Image*                image () const;
+  void                             image ( osg::Image* image );
+
+  /// Get/Set the sampling rate.
+  float                            samplingRate () const;
+  void                             samplingRate ( float rate );
+
+  /// Get/Set the bounding box.
+  void                             boundingBox ( const osg::BoundingBox& bb );
+  const osg::BoundingBox&          boundingBox () const;
+
+  /// Get/Set the transfer function.
+  void                             transferFunction ( TransferFunction* tf );
+  TransferFunction*                transferFunction () const;
+
+  /// Get/Set the compositing mode.  The projections work as they do in
+  /// GPURayCasting, and the maximum and minimum ones skip bricks of voxels
+  /// that cannot change a ray.
+  void                             compositeMode ( CompositeMode mode );
+  CompositeMode                    compositeMode () const;
+
+  /// Get/Set the opacity at which front to back rays stop.
+  void                             opacityCutoff ( float cutoff );
+  float                            opacityCutoff () const;
+
+  /// Get/Set the width and height of the tiles handed to the threads.
+  void                             tileSize ( unsigned int size );
+  unsigned int                     tileSize () const;
+
+  /// Get/Set the number of threads.  Zero uses all processors.
+  void                             numThreads ( unsigned int num );
+  unsigned int                     numThreads () const;
+
+  /// Get/Set the number of voxels along each side of the bricks the
+  /// projections skip.
+  void                             macrocellSize ( unsigned int size );
+  unsigned int                     macrocellSize () const;
+
+  /// Render the volume as seen with the given matrices into a new GL_RGBA image.
+  /// The view matrix takes the bounding box into eye space.
+  osg::Image*                      render ( const osg::Matrixd &view, const osg::Matrixd &projection, unsigned int width, unsigned int height ) const;
+
+protected:
+  virtual ~CPURayCasting();
+
+  MacrocellGrid::RefPtr            _getMacrocells ( osg::Image *volume ) const;
+
+private:
+
+  CPURayCasting ( const CPURayCasting & );
+  CPURayCasting &operator = ( const CPURayCasting & );
+
+  ImagePtr                      _volume;
+  TransferFunction::RefPtr      _transferFunction;
+  osg::BoundingBox              _bb;
+  float                         _samplingRate;
+  CompositeMode                 _compositeMode;
+  float                         _opacityCutoff;
+  unsigned int                  _tileSize;
+  unsigned int                  _numThreads;
+  unsigned int                  _macrocellSize;
+  mutable MacrocellGrid::RefPtr _macrocells;
+  mutable unsigned int          _macrocellsModified;
+  mutable Mutex                 _mutex;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_CPU_RAY_CASTING_H__
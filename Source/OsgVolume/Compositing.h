@@ -0,0 +1,83 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  How samples along a ray are combined.  The projections keep one scalar
+//  per ray instead of compositing colors, and classify only that.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_COMPOSITING_H__
+#define __OSGTOOLS_VOLUME_COMPOSITING_H__
+
+#include <algorithm>
+#include <cmath>
+
+namespace OsgVolume {
+namespace Compositing {
+
+
+enum Mode
+{
+  BACK_TO_FRONT = 0,
+  FRONT_TO_BACK,
+  MAXIMUM_INTENSITY,
+  MINIMUM_INTENSITY,
+  AVERAGE_INTENSITY
+};
+
+
+/// Is the mode one of the projections?
+inline bool projection ( Mode mode )
+{
+  return ( MAXIMUM_INTENSITY == mode || MINIMUM_INTENSITY == mode || AVERAGE_INTENSITY == mode );
+}
+
+
+/// Number the shaders use for the mode's projection.  Zero when it composites.
+inline int projectionIndex ( Mode mode )
+{
+  switch ( mode )
+  {
+  case MAXIMUM_INTENSITY: return 1;
+  case MINIMUM_INTENSITY: return 2;
+  case AVERAGE_INTENSITY: return 3;
+  default:                return 0;
+  }
+}
+
+
+/// Number of steps a ray needs to cross the diagonal of the unit cube,
+/// which is the volume in texture space, at the sampling rate.
+inline int maxSteps ( float rate )
+{
+  if ( rate <= 0.0f )
+    return 0;
+
+  const double steps ( std::ceil ( std::sqrt ( 3.0 ) / rate ) + 1.0 );
+  return static_cast < int > ( std::min ( steps, 1048576.0 ) );
+}
+
+
+/// Correct the opacity of a sample for the distance to the next one.  The
+/// transfer functions give the opacity of a sample one voxel long, so a
+/// sample standing for the given number of voxels lets ( 1 - alpha ) to
+/// that power through.
+inline float correctOpacity ( float alpha, float voxels )
+{
+  return 1.0f - std::pow ( std::max ( 1.0f - alpha, 0.0f ), voxels );
+}
+
+
+} // namespace Compositing
+} // namespace OsgVolume
+
+
+#endif // __OSGTOOLS_VOLUME_COMPOSITING_H__
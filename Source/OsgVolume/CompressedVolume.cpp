@@ -0,0 +1,440 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Volume stored in 4x4x4 blocks for the GPU.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/CompressedVolume.h"
+#include "OsgVolume/Parallel.h"
+#include "OsgVolume/Voxels.h"
+
+#include "osg/Uniform"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for encoding the blocks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // Round up to a whole number of blocks.
+  inline unsigned int blocks ( unsigned int voxels )
+  {
+    return ( voxels + 3 ) / 4;
+  }
+
+  // Encode one slab of blocks.  Voxels past the edge repeat the edge.
+  template < class VoxelType > class EncodeBlocks
+  {
+  public:
+    EncodeBlocks ( const osg::Image &volume, osg::Image &indices, osg::Image &endpoints, unsigned int numTasks ) :
+      _data ( volume.data() ),
+      _rowStride ( volume.getRowSizeInBytes() ),
+      _sliceStride ( volume.getImageSizeInBytes() ),
+      _pixelStride ( volume.getPixelSizeInBits() / 8 ),
+      _channel ( 0 ),
+      _constant ( false ),
+      _wide ( GL_UNSIGNED_SHORT == endpoints.getDataType() ),
+      _levels ( ( GL_UNSIGNED_SHORT == endpoints.getDataType() ) ? 65535.0f : 255.0f ),
+      _indices ( indices ),
+      _endpoints ( endpoints ),
+      _squared ( numTasks, 0.0 ),
+      _largest ( numTasks, 0.0 )
+    {
+      // Without a scalar channel every voxel is opaque, as the ray casters see it.
+      _constant = ( false == OsgVolume::Voxels::scalarChannel ( volume.getPixelFormat(), _channel ) );
+
+      _size[0] = volume.s();
+      _size[1] = volume.t();
+      _size[2] = std::max ( 1, volume.r() );
+    }
+
+    void operator () ( unsigned int bz )
+    {
+      float voxels[64];
+      unsigned char index[64];
+
+      double squared ( 0.0 ), largest ( 0.0 );
+
+      for ( unsigned int by = 0; by < Detail::blocks ( _size[1] ); ++by )
+      {
+        for ( unsigned int bx = 0; bx < Detail::blocks ( _size[0] ); ++bx )
+        {
+          // Read the block.
+          float low ( 1.0f ), high ( 0.0f );
+          for ( unsigned int n = 0; n < 64; ++n )
+          {
+            const unsigned int x ( std::min ( bx * 4 + ( n & 3 ), _size[0] - 1 ) );
+            const unsigned int y ( std::min ( by * 4 + ( ( n >> 2 ) & 3 ), _size[1] - 1 ) );
+            const unsigned int z ( std::min ( bz * 4 + ( n >> 4 ), _size[2] - 1 ) );
+
+            const unsigned char *voxel ( _data + z * _sliceStride + y * _rowStride + x * _pixelStride + _channel * sizeof ( VoxelType ) );
+            const float value ( ( _constant ) ? 1.0f : OsgVolume::Voxels::normalize ( *reinterpret_cast < const VoxelType * > ( voxel ) ) );
+
+            // Floats may be outside of [0,1], and the texture clamps them anyway.
+            voxels[n] = std::min ( std::max ( value, 0.0f ), 1.0f );
+
+            low  = std::min ( low,  voxels[n] );
+            high = std::max ( high, voxels[n] );
+          }
+
+          // The ends as whole levels that still cover the block.
+          const unsigned int lo ( static_cast < unsigned int > ( std::floor ( low  * _levels ) ) );
+          const unsigned int hi ( static_cast < unsigned int > ( std::ceil  ( high * _levels ) ) );
+
+          if ( _wide )
+          {
+            unsigned short *ends ( reinterpret_cast < unsigned short * > ( _endpoints.data ( bx, by, bz ) ) );
+            ends[0] = static_cast < unsigned short > ( lo );
+            ends[1] = static_cast < unsigned short > ( hi );
+          }
+          else
+          {
+            unsigned char *ends ( _endpoints.data ( bx, by, bz ) );
+            ends[0] = static_cast < unsigned char > ( lo );
+            ends[1] = static_cast < unsigned char > ( hi );
+          }
+
+          // Pick the nearest of the four levels.
+          const float range ( static_cast < float > ( hi - lo ) );
+          for ( unsigned int n = 0; n < 64; ++n )
+          {
+            const float u ( ( range > 0.0f ) ? ( voxels[n] * _levels - lo ) * 3.0f / range : 0.0f );
+            index[n] = static_cast < unsigned char > ( std::min ( std::max ( u + 0.5f, 0.0f ), 3.0f ) );
+
+            // Only count the voxels that are in the volume.
+            const bool inside ( bx * 4 + ( n & 3 ) < _size[0] && by * 4 + ( ( n >> 2 ) & 3 ) < _size[1] && bz * 4 + ( n >> 4 ) < _size[2] );
+            if ( inside )
+            {
+              const double decoded ( ( lo + range * index[n] / 3.0 ) / _levels );
+              const double error ( std::fabs ( decoded - voxels[n] ) );
+              squared += error * error;
+              largest = std::max ( largest, error );
+            }
+          }
+
+          // Four voxels along x in each byte.
+          for ( unsigned int row = 0; row < 16; ++row )
+          {
+            const unsigned char *in ( index + row * 4 );
+            *_indices.data ( bx, by * 4 + ( row & 3 ), bz * 4 + ( row >> 2 ) ) = static_cast < unsigned char > ( in[0] | ( in[1] << 2 ) | ( in[2] << 4 ) | ( in[3] << 6 ) );
+          }
+        }
+      }
+
+      _squared.at ( bz ) = squared;
+      _largest.at ( bz ) = largest;
+    }
+
+    double squared() const
+    {
+      double sum ( 0.0 );
+      for ( unsigned int i = 0; i < _squared.size(); ++i )
+        sum += _squared[i];
+      return sum;
+    }
+
+    double largest() const
+    {
+      return ( _largest.empty() ) ? 0.0 : *std::max_element ( _largest.begin(), _largest.end() );
+    }
+
+  private:
+
+    EncodeBlocks &operator = ( const EncodeBlocks & );
+
+    const unsigned char *_data;
+    unsigned int _rowStride;
+    unsigned int _sliceStride;
+    unsigned int _pixelStride;
+    unsigned int _channel;
+    bool _constant;
+    bool _wide;
+    float _levels;
+    unsigned int _size[3];
+    osg::Image &_indices;
+    osg::Image &_endpoints;
+    std::vector < double > _squared;
+    std::vector < double > _largest;
+  };
+
+  template < class VoxelType > inline void encode ( const osg::Image &volume, osg::Image &indices, osg::Image &endpoints, double &rms, double &largest )
+  {
+    const unsigned int slabs ( endpoints.r() );
+    EncodeBlocks < VoxelType > encoder ( volume, indices, endpoints, slabs );
+    OsgVolume::Parallel::forEach ( slabs, encoder );
+
+    const double count ( static_cast < double > ( volume.s() ) * volume.t() * std::max ( 1, volume.r() ) );
+    rms = std::sqrt ( encoder.squared() / count );
+    largest = encoder.largest();
+  }
+
+  // Textures are read texel by texel.
+  inline osg::Texture3D* makeTexture ( osg::Image *image )
+  {
+    osg::ref_ptr < osg::Texture3D > texture ( new osg::Texture3D );
+    texture->setImage ( image );
+    texture->setFilter ( osg::Texture3D::MIN_FILTER, osg::Texture3D::NEAREST );
+    texture->setFilter ( osg::Texture3D::MAG_FILTER, osg::Texture3D::NEAREST );
+    texture->setWrap ( osg::Texture3D::WRAP_R, osg::Texture3D::CLAMP_TO_EDGE );
+    texture->setWrap ( osg::Texture3D::WRAP_S, osg::Texture3D::CLAMP_TO_EDGE );
+    texture->setWrap ( osg::Texture3D::WRAP_T, osg::Texture3D::CLAMP_TO_EDGE );
+    texture->setInternalFormatMode ( osg::Texture3D::USE_IMAGE_DATA_FORMAT );
+    texture->setResizeNonPowerOfTwoHint ( false );
+    return texture.release();
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+CompressedVolume::CompressedVolume ( const osg::Image *volume ) : BaseClass(),
+  _modifiedCount ( 0 ),
+  _volumeBytes ( 0 ),
+  _rmsError ( 0.0 ),
+  _maxError ( 0.0 ),
+  _indices ( new osg::Image ),
+  _endpoints ( new osg::Image ),
+  _indexTexture ( 0x0 ),
+  _endpointTexture ( 0x0 )
+{
+  if ( 0x0 == volume || 0x0 == volume->data() )
+    throw std::runtime_error ( "Error 2350174996: no volume given to compress" );
+
+  if ( false == Voxels::supported ( volume->getDataType() ) )
+    throw std::runtime_error ( "Error 1081569732: volume data type not supported by the compression" );
+
+  _size[0] = volume->s();
+  _size[1] = volume->t();
+  _size[2] = std::max ( 1, volume->r() );
+
+  _modifiedCount = volume->getModifiedCount();
+  _volumeBytes = static_cast < unsigned long > ( volume->getImageSizeInBytes() ) * _size[2];
+
+  const unsigned int bx ( Detail::blocks ( _size[0] ) ), by ( Detail::blocks ( _size[1] ) ), bz ( Detail::blocks ( _size[2] ) );
+  _indices->allocateImage ( bx, by * 4, bz * 4, GL_LUMINANCE, GL_UNSIGNED_BYTE );
+
+  // Deeper volumes keep 16-bit ends, or their blocks could only tell 256 levels apart.
+  if ( GL_UNSIGNED_BYTE == volume->getDataType() )
+  {
+    _endpoints->allocateImage ( bx, by, bz, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE );
+    _endpoints->setInternalTextureFormat ( GL_LUMINANCE8_ALPHA8 );
+  }
+  else
+  {
+    _endpoints->allocateImage ( bx, by, bz, GL_LUMINANCE_ALPHA, GL_UNSIGNED_SHORT );
+    _endpoints->setInternalTextureFormat ( GL_LUMINANCE16_ALPHA16 );
+  }
+
+  switch ( volume->getDataType() )
+  {
+  case GL_UNSIGNED_BYTE:
+    Detail::encode < unsigned char > ( *volume, *_indices, *_endpoints, _rmsError, _maxError );
+    break;
+  case GL_UNSIGNED_SHORT:
+    Detail::encode < unsigned short > ( *volume, *_indices, *_endpoints, _rmsError, _maxError );
+    break;
+  case GL_FLOAT:
+    Detail::encode < float > ( *volume, *_indices, *_endpoints, _rmsError, _maxError );
+    break;
+  }
+
+  _indexTexture = Detail::makeTexture ( _indices.get() );
+  _endpointTexture = Detail::makeTexture ( _endpoints.get() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+CompressedVolume::~CompressedVolume()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Was this built from the volume as it is now?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool CompressedVolume::current ( const osg::Image *volume ) const
+{
+  return ( 0x0 != volume &&
+           volume->getModifiedCount() == _modifiedCount &&
+           static_cast < int > ( _size[0] ) == volume->s() &&
+           static_cast < int > ( _size[1] ) == volume->t() &&
+           static_cast < int > ( _size[2] ) == std::max ( 1, volume->r() ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the root mean square error.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double CompressedVolume::rmsError () const
+{
+  return _rmsError;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the largest error.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double CompressedVolume::maxError () const
+{
+  return _maxError;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the bytes of the textures.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long CompressedVolume::bytes () const
+{
+  return static_cast < unsigned long > ( _indices->getImageSizeInBytes() ) * _indices->r() +
+         static_cast < unsigned long > ( _endpoints->getImageSizeInBytes() ) * _endpoints->r();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get how many times smaller the textures are than the volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double CompressedVolume::ratio () const
+{
+  const unsigned long compressed ( this->bytes() );
+  return ( compressed > 0 ) ? static_cast < double > ( _volumeBytes ) / compressed : 0.0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the indices.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* CompressedVolume::indices ()
+{
+  return _indices.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the ends of each block.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* CompressedVolume::endpoints ()
+{
+  return _endpoints.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Bind the textures and set the uniforms.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void CompressedVolume::apply ( osg::StateSet &ss, unsigned int indexUnit, unsigned int endpointUnit )
+{
+  ss.setTextureAttributeAndModes ( indexUnit, _indexTexture.get(), osg::StateAttribute::ON );
+  ss.setTextureAttributeAndModes ( endpointUnit, _endpointTexture.get(), osg::StateAttribute::ON );
+
+  ss.getOrCreateUniform ( "CompressedEndpoints", osg::Uniform::INT )->set ( static_cast < int > ( endpointUnit ) );
+  ss.getOrCreateUniform ( "CompressedSize", osg::Uniform::FLOAT_VEC3 )->set ( osg::Vec3 ( _size[0], _size[1], _size[2] ) );
+  ss.getOrCreateUniform ( "CompressedIndexSize", osg::Uniform::FLOAT_VEC3 )->set ( osg::Vec3 ( _indices->s(), _indices->t(), _indices->r() ) );
+  ss.getOrCreateUniform ( "CompressedBlocks", osg::Uniform::FLOAT_VEC3 )->set ( osg::Vec3 ( _endpoints->s(), _endpoints->t(), _endpoints->r() ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the shader code.  Each voxel is decoded from its block, and eight
+//  of them are blended since the hardware can not filter the indices.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+std::string CompressedVolume::shaderSource ()
+{
+  std::ostringstream os;
+
+  os << "uniform sampler3D CompressedEndpoints;\n"
+     << "uniform vec3 CompressedSize;\n"
+     << "uniform vec3 CompressedIndexSize;\n"
+     << "uniform vec3 CompressedBlocks;\n"
+
+     // One voxel, at whole voxel coordinates.
+     << "float compressedVoxel ( sampler3D indices, vec3 v )\n"
+     << "{\n"
+     << "  v = clamp ( v, vec3 ( 0.0 ), CompressedSize - 1.0 );\n"
+     << "  vec3 block = floor ( v * 0.25 );\n"
+     << "  vec2 ends = texture3D ( CompressedEndpoints, ( block + 0.5 ) / CompressedBlocks ).ra;\n"
+     << "  float packed = floor ( texture3D ( indices, ( vec3 ( block.x, v.y, v.z ) + 0.5 ) / CompressedIndexSize ).r * 255.0 + 0.5 );\n"
+     << "  float k = v.x - block.x * 4.0;\n"
+     << "  float shift = ( k < 0.5 ) ? 1.0 : ( k < 1.5 ) ? 4.0 : ( k < 2.5 ) ? 16.0 : 64.0;\n"
+     << "  float index = mod ( floor ( packed / shift ), 4.0 );\n"
+     << "  return mix ( ends.x, ends.y, index / 3.0 );\n"
+     << "}\n"
+
+     // Blend the eight voxels around the point, as linear filtering would.
+     << "float compressedScalar ( sampler3D indices, vec3 texCoord )\n"
+     << "{\n"
+     << "  vec3 p = texCoord * CompressedSize - 0.5;\n"
+     << "  vec3 b = floor ( p );\n"
+     << "  vec3 f = p - b;\n"
+     << "  float c000 = compressedVoxel ( indices, b );\n"
+     << "  float c100 = compressedVoxel ( indices, b + vec3 ( 1.0, 0.0, 0.0 ) );\n"
+     << "  float c010 = compressedVoxel ( indices, b + vec3 ( 0.0, 1.0, 0.0 ) );\n"
+     << "  float c110 = compressedVoxel ( indices, b + vec3 ( 1.0, 1.0, 0.0 ) );\n"
+     << "  float c001 = compressedVoxel ( indices, b + vec3 ( 0.0, 0.0, 1.0 ) );\n"
+     << "  float c101 = compressedVoxel ( indices, b + vec3 ( 1.0, 0.0, 1.0 ) );\n"
+     << "  float c011 = compressedVoxel ( indices, b + vec3 ( 0.0, 1.0, 1.0 ) );\n"
+     << "  float c111 = compressedVoxel ( indices, b + vec3 ( 1.0, 1.0, 1.0 ) );\n"
+     << "  float c00 = mix ( c000, c100, f.x );\n"
+     << "  float c10 = mix ( c010, c110, f.x );\n"
+     << "  float c01 = mix ( c001, c101, f.x );\n"
+     << "  float c11 = mix ( c011, c111, f.x );\n"
+     << "  return mix ( mix ( c00, c10, f.y ), mix ( c01, c11, f.y ), f.z );\n"
+     << "}\n";
+
+  return os.str();
+}
@@ -0,0 +1,99 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Volume stored in 4x4x4 blocks for the GPU.  Each block keeps its lowest
+//  and highest scalar, and each voxel a 2-bit index between them.  The ends
+//  are bytes for 8-bit volumes and shorts for deeper ones.  An 8-bit volume
+//  shrinks 3.6 times and a 16-bit one 6.4 times.  The fragment shaders put
+//  the voxels back together.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_COMPRESSED_VOLUME_H__
+#define __OSGTOOLS_VOLUME_COMPRESSED_VOLUME_H__
+
+#include "OsgVolume/Export.h"
+
+#include "Usul/Base/Referenced.h"
+#include "Usul/Pointers/Pointers.h"
+
+#include "osg/Image"
+#include "osg/StateSet"
+#include "osg/Texture3D"
+#include "osg/Vec3"
+#include "osg/ref_ptr"
+
+#include <string>
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT CompressedVolume : public Usul::Base::Referenced
+{
+public:
+  /// Typedefs.
+  typedef Usul::Base::Referenced                 BaseClass;
+
+  USUL_DECLARE_REF_POINTERS ( CompressedVolume );
+
+  /// Construction.  Compresses the scalar channel of the volume.
+  CompressedVolume ( const osg::Image *volume );
+
+  /// Was this built from the volume as it is now?
+  bool                             current ( const osg::Image *volume ) const;
+
+  /// Get the errors of the decoded scalars, in [0,1] units.
+  double                           rmsError () const;
+  double                           maxError () const;
+
+  /// Get the bytes of the textures, and how many times smaller they are
+  /// than the volume.
+  unsigned long                    bytes () const;
+  double                           ratio () const;
+
+  /// Get the indices as a GL_LUMINANCE image.  Each byte holds four voxels
+  /// along x, the first in the lowest bits.
+  osg::Image*                      indices ();
+
+  /// Get the ends of each block as a GL_LUMINANCE_ALPHA image, of bytes
+  /// for 8-bit volumes and of shorts otherwise.
+  osg::Image*                      endpoints ();
+
+  /// Bind the textures and set the uniforms compressedScalar() needs.
+  void                             apply ( osg::StateSet &ss, unsigned int indexUnit, unsigned int endpointUnit );
+
+  /// Get the shader code that declares the uniforms and defines
+  /// float compressedScalar ( sampler3D indices, vec3 texCoord ).
+  static std::string               shaderSource ();
+
+protected:
+  virtual ~CompressedVolume();
+
+private:
+
+  CompressedVolume ( const CompressedVolume & );
+  CompressedVolume &operator = ( const CompressedVolume & );
+
+  unsigned int                  _size[3];
+  unsigned int                  _modifiedCount;
+  unsigned long                 _volumeBytes;
+  double                        _rmsError;
+  double                        _maxError;
+  osg::ref_ptr < osg::Image >   _indices;
+  osg::ref_ptr < osg::Image >   _endpoints;
+  osg::ref_ptr < osg::Texture3D > _indexTexture;
+  osg::ref_ptr < osg::Texture3D > _endpointTexture;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_COMPRESSED_VOLUME_H__
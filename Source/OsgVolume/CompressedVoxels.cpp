@@ -0,0 +1,854 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Load raw voxels from a compressed file.
+//
+//  The reader reads the file in chunks and cuts it into frames as it goes.
+//  A BGZF member says how long it is in its header and how much it holds
+//  in its last four bytes; a zstd frame says how much it holds and can be
+//  walked to find its end.  Those go on a queue for the decoders, with
+//  where they land in the decompressed stream.  Anything else is one
+//  stream from there to the end of the file, which a single decoder
+//  follows as the chunks come in.  Only a few chunks are held at a time;
+//  the reader waits when the decoders fall behind.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/CompressedVoxels.h"
+#include "OsgVolume/Inflate.h"
+#include "OsgVolume/Parallel.h"
+
+#include "OpenThreads/Condition"
+#include "OpenThreads/Mutex"
+#include "OpenThreads/ScopedLock"
+
+#include "zstd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for the reader and the decoders.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  typedef OpenThreads::Mutex Mutex;
+  typedef OpenThreads::ScopedLock < Mutex > Guard;
+  typedef std::vector < unsigned char > Bytes;
+
+  const std::size_t CHUNK ( 4 * 1024 * 1024 );
+
+  // Compressed bytes read but not yet decompressed are kept under this, so
+  // the reader waits for the decoders instead of holding the whole file.
+  const std::size_t MAX_QUEUED ( 4 * CHUNK );
+
+  inline unsigned int read16 ( const unsigned char *p )
+  {
+    return static_cast < unsigned int > ( p[0] ) | ( static_cast < unsigned int > ( p[1] ) << 8 );
+  }
+
+  inline unsigned int read32 ( const unsigned char *p )
+  {
+    return Detail::read16 ( p ) | ( Detail::read16 ( p + 2 ) << 16 );
+  }
+
+  // Compressed bytes that decompress on their own to a known place in the
+  // stream, or, for a stream, the first of the bytes from there to the end
+  // of the file with its size not known.  The rest of a stream comes in
+  // chunks after it.
+  struct Frame
+  {
+    Frame() : bytes(), out ( 0 ), outSize ( 0 ), stream ( false )
+    {
+    }
+
+    void swap ( Frame &frame )
+    {
+      bytes.swap ( frame.bytes );
+      std::swap ( out, frame.out );
+      std::swap ( outSize, frame.outSize );
+      std::swap ( stream, frame.stream );
+    }
+
+    Bytes bytes;
+    unsigned long long out;
+    unsigned long long outSize;
+    bool stream;
+  };
+
+  // What the reader and decoders share.  Frames and chunks are handed over
+  // by swapping, so bytes are never copied between them.
+  class Shared
+  {
+  public:
+    Shared ( const std::string &filename, unsigned long long skip, unsigned long long needed, unsigned char *voxels ) :
+      filename ( filename ),
+      _frames(),
+      _chunks(),
+      _queued ( 0 ),
+      _closed ( false ),
+      _stopped ( false ),
+      _error(),
+      _skip ( skip ),
+      _needed ( needed ),
+      _voxels ( voxels ),
+      _placed ( 0 )
+    {
+    }
+
+    // Queue a frame for the decoders.
+    void push ( Frame &frame )
+    {
+      Guard guard ( _mutex );
+      this->_room ( frame.bytes.size() );
+      _frames.push_back ( Frame() );
+      _frames.back().swap ( frame );
+      _queued += _frames.back().bytes.size();
+      _changed.broadcast();
+    }
+
+    // Wait for the next frame.  Returns false when there are no more.
+    bool pop ( Frame &frame )
+    {
+      Guard guard ( _mutex );
+      while ( _frames.empty() && false == _closed && false == _stopped )
+        _changed.wait ( &_mutex );
+      if ( _stopped || _frames.empty() )
+        return false;
+      frame.swap ( _frames.front() );
+      _frames.pop_front();
+      _queued -= frame.bytes.size();
+      _changed.broadcast();
+      return true;
+    }
+
+    // Queue more bytes of the stream.
+    void feed ( Bytes &bytes )
+    {
+      Guard guard ( _mutex );
+      this->_room ( bytes.size() );
+      _chunks.push_back ( Bytes() );
+      _chunks.back().swap ( bytes );
+      _queued += _chunks.back().size();
+      _changed.broadcast();
+    }
+
+    // Wait for more bytes of the stream.  Returns false at the end.
+    bool next ( Bytes &bytes )
+    {
+      Guard guard ( _mutex );
+      while ( _chunks.empty() && false == _closed && false == _stopped )
+        _changed.wait ( &_mutex );
+      if ( _stopped )
+        throw std::runtime_error ( "Error 3360810582: loading '" + filename + "' was stopped" );
+      if ( _chunks.empty() )
+        return false;
+      bytes.swap ( _chunks.front() );
+      _chunks.pop_front();
+      _queued -= bytes.size();
+      _changed.broadcast();
+      return true;
+    }
+
+    // Nothing more is coming.
+    void close()
+    {
+      Guard guard ( _mutex );
+      _closed = true;
+      _changed.broadcast();
+    }
+
+    // Stop everyone, keeping the first error.
+    void fail ( const std::string &message )
+    {
+      Guard guard ( _mutex );
+      if ( false == _stopped )
+        _error = message;
+      _stopped = true;
+      _changed.broadcast();
+    }
+
+    bool stopped()
+    {
+      Guard guard ( _mutex );
+      return _stopped;
+    }
+
+    const std::string &error() const
+    {
+      return _error;
+    }
+
+    // Does the part of the stream hold any voxels?
+    bool wanted ( unsigned long long position, unsigned long long size ) const
+    {
+      return ( size > 0 && position < _skip + _needed && position + size > _skip );
+    }
+
+    // Copy the voxels in the part of the stream to their place.
+    void place ( unsigned long long position, const unsigned char *bytes, std::size_t size )
+    {
+      const unsigned long long low ( std::max ( position, _skip ) );
+      const unsigned long long high ( std::min ( position + size, _skip + _needed ) );
+      if ( low >= high )
+        return;
+
+      std::memcpy ( _voxels + ( low - _skip ), bytes + ( low - position ), static_cast < std::size_t > ( high - low ) );
+      this->placed ( high - low );
+    }
+
+    // Where the part of the stream goes in the volume, if it is all voxels.
+    unsigned char *target ( unsigned long long position, unsigned long long size ) const
+    {
+      return ( position >= _skip && position + size <= _skip + _needed ) ? _voxels + ( position - _skip ) : 0x0;
+    }
+
+    // Count voxel bytes put in place.
+    void placed ( unsigned long long size )
+    {
+      Guard guard ( _placedMutex );
+      _placed += size;
+    }
+
+    unsigned long long placed()
+    {
+      Guard guard ( _placedMutex );
+      return _placed;
+    }
+
+    const std::string filename;
+
+  private:
+
+    Shared &operator = ( const Shared & );
+
+    // Wait until the bytes fit under the limit.  Anything fits when nothing
+    // is queued, so a frame bigger than the limit still goes through.
+    void _room ( std::size_t size )
+    {
+      while ( _queued > 0 && _queued + size > MAX_QUEUED && false == _stopped )
+        _changed.wait ( &_mutex );
+      if ( _stopped )
+        throw std::runtime_error ( "Error 3360810582: loading '" + filename + "' was stopped" );
+    }
+
+    std::deque < Frame > _frames;
+    std::deque < Bytes > _chunks;
+    std::size_t _queued;
+    bool _closed;
+    bool _stopped;
+    std::string _error;
+    Mutex _mutex;
+    OpenThreads::Condition _changed;
+    unsigned long long _skip;
+    unsigned long long _needed;
+    unsigned char *_voxels;
+    Mutex _placedMutex;
+    unsigned long long _placed;
+  };
+
+  // Bytes of a frame, all read already.
+  class FrameSource : public Inflate::Source
+  {
+  public:
+    FrameSource ( const Bytes &bytes ) : _bytes ( bytes ), _done ( false )
+    {
+    }
+
+    virtual std::size_t read ( const unsigned char *&bytes )
+    {
+      if ( _done || _bytes.empty() )
+        return 0;
+
+      _done = true;
+      bytes = &_bytes[0];
+      return _bytes.size();
+    }
+
+  private:
+    FrameSource &operator = ( const FrameSource & );
+
+    const Bytes &_bytes;
+    bool _done;
+  };
+
+  // Bytes to the end of the file, a chunk at a time as the reader hands
+  // them over.
+  class StreamSource : public Inflate::Source
+  {
+  public:
+    StreamSource ( Shared &shared, Frame &frame ) : _shared ( shared ), _bytes(), _first ( true )
+    {
+      _bytes.swap ( frame.bytes );
+    }
+
+    virtual std::size_t read ( const unsigned char *&bytes )
+    {
+      if ( _first )
+        _first = false;
+      else
+        _bytes.clear();
+
+      while ( _bytes.empty() )
+      {
+        if ( false == _shared.next ( _bytes ) )
+          return 0;
+      }
+
+      bytes = &_bytes[0];
+      return _bytes.size();
+    }
+
+  private:
+    StreamSource &operator = ( const StreamSource & );
+
+    Shared &_shared;
+    Bytes _bytes;
+    bool _first;
+  };
+
+  // Puts decompressed bytes in place, from a position in the stream.
+  class Placer : public Inflate::Sink
+  {
+  public:
+    Placer ( Shared &shared, unsigned long long position ) : _shared ( shared ), _position ( position )
+    {
+    }
+
+    virtual void write ( const unsigned char *bytes, std::size_t size )
+    {
+      if ( _shared.stopped() )
+        throw std::runtime_error ( "Error 3360810582: loading '" + _shared.filename + "' was stopped" );
+
+      _shared.place ( _position, bytes, size );
+      _position += size;
+    }
+
+  private:
+    Placer &operator = ( const Placer & );
+
+    Shared &_shared;
+    unsigned long long _position;
+  };
+
+  // Contexts that free themselves.
+  struct ZstdContext
+  {
+    ZstdContext() : context ( ::ZSTD_createDCtx() )
+    {
+      if ( 0x0 == context )
+        throw std::runtime_error ( "Error 2843309176: could not make a zstd context" );
+    }
+    ~ZstdContext()
+    {
+      ::ZSTD_freeDCtx ( context );
+    }
+
+    ZSTD_DCtx *context;
+
+  private:
+    ZstdContext ( const ZstdContext & );
+    ZstdContext &operator = ( const ZstdContext & );
+  };
+
+  struct ZstdStream
+  {
+    ZstdStream() : stream ( ::ZSTD_createDStream() )
+    {
+      if ( 0x0 == stream )
+        throw std::runtime_error ( "Error 2843309176: could not make a zstd context" );
+      ::ZSTD_initDStream ( stream );
+    }
+    ~ZstdStream()
+    {
+      ::ZSTD_freeDStream ( stream );
+    }
+
+    ZSTD_DStream *stream;
+
+  private:
+    ZstdStream ( const ZstdStream & );
+    ZstdStream &operator = ( const ZstdStream & );
+  };
+
+  inline void check ( std::size_t result, const std::string &filename )
+  {
+    if ( ::ZSTD_isError ( result ) )
+      throw std::runtime_error ( "Error 1596742380: zstd frame of '" + filename + "' is broken: " + ::ZSTD_getErrorName ( result ) );
+  }
+
+  // Decompress frames as the bytes come in.
+  inline void zstd ( Inflate::Source &source, Inflate::Sink &sink, const std::string &filename )
+  {
+    ZstdStream stream;
+    std::vector < unsigned char > out ( ::ZSTD_DStreamOutSize() );
+    std::size_t left ( 0 );
+
+    const unsigned char *bytes ( 0x0 );
+    for ( std::size_t size = source.read ( bytes ); size > 0; size = source.read ( bytes ) )
+    {
+      ZSTD_inBuffer input = { bytes, size, 0 };
+      ZSTD_outBuffer output = { &out[0], out.size(), out.size() };
+
+      // Go until the input is used and the output has room to spare.  A
+      // frame that ended needs no more calls, even if it filled the output.
+      while ( input.pos < input.size || ( output.pos == output.size && 0 != left ) )
+      {
+        output.pos = 0;
+        left = ::ZSTD_decompressStream ( stream.stream, &output, &input );
+        Detail::check ( left, filename );
+        sink.write ( &out[0], output.pos );
+      }
+    }
+
+    if ( 0 != left )
+      throw std::runtime_error ( "Error 3006551982: zstd frame of '" + filename + "' ends early" );
+  }
+
+  // Cuts the file into frames as it is read.  Bytes of a frame not yet
+  // all read wait in the pending buffer.
+  class Splitter
+  {
+  public:
+    Splitter ( Shared &shared, CompressedVoxels::Codec codec ) :
+      _shared ( shared ),
+      _codec ( codec ),
+      _pending(),
+      _out ( 0 ),
+      _streaming ( false )
+    {
+    }
+
+    void add ( Bytes &chunk, bool end )
+    {
+      // Once streaming, chunks go to the decoder as they are.
+      if ( _streaming )
+      {
+        _shared.feed ( chunk );
+        return;
+      }
+
+      _pending.insert ( _pending.end(), chunk.begin(), chunk.end() );
+
+      std::size_t next ( 0 );
+      while ( false == _streaming && next < _pending.size() && this->_frame ( next, end ) )
+      {
+      }
+
+      if ( _streaming )
+        _pending.clear();
+      else
+        _pending.erase ( _pending.begin(), _pending.begin() + next );
+
+      if ( end && false == _pending.empty() )
+        throw std::runtime_error ( "Error 2196401457: '" + _shared.filename + "' ends inside a frame" );
+    }
+
+  private:
+
+    Splitter &operator = ( const Splitter & );
+
+    // Everything from here on is one stream.
+    bool _stream ( std::size_t &next )
+    {
+      Frame frame;
+      frame.bytes.assign ( _pending.begin() + next, _pending.end() );
+      frame.out = _out;
+      frame.stream = true;
+      _shared.push ( frame );
+
+      next = _pending.size();
+      _streaming = true;
+      return true;
+    }
+
+    // Push the frame at the next byte.  Returns false if it is not all read.
+    bool _frame ( std::size_t &next, bool end )
+    {
+      const unsigned char *p ( &_pending[next] );
+      const std::size_t have ( _pending.size() - next );
+
+      if ( CompressedVoxels::ZSTD == _codec )
+        return this->_zstd ( next, end );
+      if ( CompressedVoxels::GZIP != _codec )
+        return this->_stream ( next );
+
+      // A BGZF member has an extra field "BC" with its size less one.
+      const std::size_t HEADER ( 18 );
+      if ( have < HEADER )
+        return ( end ) ? this->_stream ( next ) : false;
+
+      const bool bgzf ( 0x1F == p[0] && 0x8B == p[1] && 8 == p[2] && 0 != ( p[3] & 0x04 ) &&
+                        6 == Detail::read16 ( p + 10 ) && 'B' == p[12] && 'C' == p[13] && 2 == Detail::read16 ( p + 14 ) );
+      if ( false == bgzf )
+        return this->_stream ( next );
+
+      const std::size_t size ( Detail::read16 ( p + 16 ) + 1 );
+      if ( size < HEADER + 8 )
+        throw std::runtime_error ( "Error 4120734569: BGZF member of '" + _shared.filename + "' is too small" );
+      if ( have < size )
+        return false;
+
+      Frame frame;
+      frame.bytes.assign ( p, p + size );
+      frame.out = _out;
+      frame.outSize = Detail::read32 ( p + size - 4 );
+      _out += frame.outSize;
+      _shared.push ( frame );
+
+      next += size;
+      return true;
+    }
+
+    // Push the zstd frame at the next byte.  A frame that does not say how
+    // much it holds starts a stream.
+    bool _zstd ( std::size_t &next, bool end )
+    {
+      const unsigned char *p ( &_pending[next] );
+      const std::size_t have ( _pending.size() - next );
+
+      if ( have < 8 )
+        return ( end ) ? this->_stream ( next ) : false;
+
+      // Skippable frames hold no voxels.
+      if ( 0x184D2A50 == ( Detail::read32 ( p ) & 0xFFFFFFF0 ) )
+      {
+        const std::size_t size ( 8 + static_cast < std::size_t > ( Detail::read32 ( p + 4 ) ) );
+        if ( have < size )
+          return false;
+        next += size;
+        return true;
+      }
+
+      // Longest frame header.
+      const std::size_t HEADER ( 18 );
+      if ( have < HEADER && false == end )
+        return false;
+
+      const unsigned long long outSize ( ::ZSTD_getFrameContentSize ( p, have ) );
+      if ( ZSTD_CONTENTSIZE_ERROR == outSize )
+        throw std::runtime_error ( "Error 1859024733: '" + _shared.filename + "' is not zstd" );
+      if ( ZSTD_CONTENTSIZE_UNKNOWN == outSize )
+        return this->_stream ( next );
+
+      // The frame is not all read while its end cannot be found.
+      const std::size_t size ( ::ZSTD_findFrameCompressedSize ( p, have ) );
+      if ( ::ZSTD_isError ( size ) )
+      {
+        if ( end )
+          Detail::check ( size, _shared.filename );
+        return false;
+      }
+
+      Frame frame;
+      frame.bytes.assign ( p, p + size );
+      frame.out = _out;
+      frame.outSize = outSize;
+      _out += outSize;
+      _shared.push ( frame );
+
+      next += size;
+      return true;
+    }
+
+    Shared &_shared;
+    CompressedVoxels::Codec _codec;
+    Bytes _pending;
+    unsigned long long _out;
+    bool _streaming;
+  };
+
+  // Task zero reads the file and the rest decompress.  Errors stop them all
+  // and are thrown once they are done.
+  class Pipeline
+  {
+  public:
+    Pipeline ( Shared &shared, CompressedVoxels::Codec codec, std::size_t start, unsigned long long size ) :
+      _shared ( shared ),
+      _codec ( codec ),
+      _start ( start ),
+      _size ( size )
+    {
+    }
+
+    void operator () ( unsigned int index )
+    {
+      try
+      {
+        if ( 0 == index )
+          this->_read();
+        else
+          this->_decode();
+      }
+      catch ( const std::exception &e )
+      {
+        _shared.fail ( e.what() );
+      }
+      catch ( ... )
+      {
+        _shared.fail ( "Error 1214307598: unknown error while loading '" + _shared.filename + "'" );
+      }
+    }
+
+  private:
+
+    Pipeline &operator = ( const Pipeline & );
+
+    void _read()
+    {
+      std::ifstream in ( _shared.filename.c_str(), std::ios::binary );
+      in.seekg ( static_cast < std::streamoff > ( _start ) );
+
+      Splitter splitter ( _shared, _codec );
+      unsigned long long done ( 0 );
+
+      while ( done < _size && false == _shared.stopped() )
+      {
+        Bytes chunk ( static_cast < std::size_t > ( std::min < unsigned long long > ( CHUNK, _size - done ) ) );
+        in.read ( reinterpret_cast < char * > ( &chunk[0] ), static_cast < std::streamsize > ( chunk.size() ) );
+        if ( static_cast < std::size_t > ( in.gcount() ) != chunk.size() )
+          throw std::runtime_error ( "Error 2977410536: could not read '" + _shared.filename + "'" );
+
+        done += chunk.size();
+        splitter.add ( chunk, done == _size );
+      }
+
+      _shared.close();
+    }
+
+    void _decode()
+    {
+      Frame frame;
+      while ( _shared.pop ( frame ) )
+      {
+        if ( frame.stream )
+        {
+          const unsigned long long out ( frame.out );
+          StreamSource source ( _shared, frame );
+          Placer sink ( _shared, out );
+          this->_decode ( source, sink );
+
+          // Take what comes after the end of the stream, so that the reader
+          // is not kept waiting for room.
+          while ( _shared.next ( frame.bytes ) )
+          {
+          }
+          continue;
+        }
+
+        // Frames past the voxels are not needed.
+        if ( false == _shared.wanted ( frame.out, frame.outSize ) )
+          continue;
+
+        if ( CompressedVoxels::ZSTD == _codec )
+        {
+          this->_zstd ( frame );
+          continue;
+        }
+
+        FrameSource source ( frame.bytes );
+        Placer sink ( _shared, frame.out );
+        this->_decode ( source, sink );
+      }
+    }
+
+    // A zstd frame of known size in one call.  Frames of nothing but voxels
+    // go straight into the volume.
+    void _zstd ( const Frame &frame )
+    {
+      if ( frame.outSize > static_cast < unsigned long long > ( static_cast < std::size_t > ( -1 ) ) )
+        throw std::runtime_error ( "Error 2534118095: zstd frame of '" + _shared.filename + "' is too big" );
+
+      const std::size_t outSize ( static_cast < std::size_t > ( frame.outSize ) );
+      unsigned char *target ( _shared.target ( frame.out, frame.outSize ) );
+      Bytes buffer ( ( 0x0 == target ) ? outSize : 0 );
+      unsigned char *out ( ( 0x0 == target ) ? &buffer[0] : target );
+
+      ZstdContext context;
+      const std::size_t size ( ::ZSTD_decompressDCtx ( context.context, out, outSize, &frame.bytes[0], frame.bytes.size() ) );
+      Detail::check ( size, _shared.filename );
+      if ( size != outSize )
+        throw std::runtime_error ( "Error 2534118095: zstd frame of '" + _shared.filename + "' is not the size it says" );
+
+      if ( 0x0 == target )
+        _shared.place ( frame.out, out, outSize );
+      else
+        _shared.placed ( outSize );
+    }
+
+    void _decode ( Inflate::Source &source, Placer &sink )
+    {
+      switch ( _codec )
+      {
+      case CompressedVoxels::GZIP:
+        Inflate::gzip ( source, sink );
+        break;
+      case CompressedVoxels::ZLIB:
+        Inflate::zlib ( source, sink );
+        break;
+      case CompressedVoxels::ZSTD:
+        Detail::zstd ( source, sink, _shared.filename );
+        break;
+      default:
+        throw std::runtime_error ( "Error 3732506418: codec of '" + _shared.filename + "' not supported" );
+      }
+    }
+
+    Shared &_shared;
+    CompressedVoxels::Codec _codec;
+    std::size_t _start;
+    unsigned long long _size;
+  };
+
+  // Lower case, for names and extensions.
+  inline std::string lower ( std::string s )
+  {
+    for ( std::string::iterator i = s.begin(); i != s.end(); ++i )
+      *i = static_cast < char > ( ( *i >= 'A' && *i <= 'Z' ) ? *i - 'A' + 'a' : *i );
+    return s;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the codec from the name.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+CompressedVoxels::Codec CompressedVoxels::codec ( const std::string &name )
+{
+  const std::string n ( Detail::lower ( name ) );
+
+  if ( n.empty() || "raw" == n || "none" == n )
+    return CompressedVoxels::NONE;
+  if ( "gzip" == n || "gz" == n )
+    return CompressedVoxels::GZIP;
+  if ( "zlib" == n )
+    return CompressedVoxels::ZLIB;
+  if ( "zstd" == n || "zst" == n )
+    return CompressedVoxels::ZSTD;
+
+  throw std::runtime_error ( "Error 2467815903: unknown compression '" + name + "'" );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the codec from the extension.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+CompressedVoxels::Codec CompressedVoxels::extension ( const std::string &filename )
+{
+  const std::string::size_type dot ( filename.find_last_of ( '.' ) );
+  const std::string::size_type slash ( filename.find_last_of ( "/\\" ) );
+  if ( std::string::npos == dot || ( std::string::npos != slash && slash > dot ) )
+    return CompressedVoxels::NONE;
+
+  const std::string ext ( Detail::lower ( filename.substr ( dot + 1 ) ) );
+  if ( "gz" == ext )
+    return CompressedVoxels::GZIP;
+  if ( "zst" == ext )
+    return CompressedVoxels::ZSTD;
+
+  return CompressedVoxels::NONE;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Load the volume.  Voxels the volumes can draw as they are decompress
+//  straight into the image.  Others decompress into bytes that are then
+//  converted like those of a raw file.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* CompressedVoxels::load ( const std::string &filename, Codec codec, std::size_t start,
+                                     const RawVoxels::Layout &layout, unsigned int s, unsigned int t, unsigned int r )
+{
+  if ( CompressedVoxels::NONE == codec )
+  {
+    RawVoxels::Layout file ( layout );
+    file.offset += start;
+    return RawVoxels::load ( filename, file, s, t, r );
+  }
+
+  if ( 0 == s || 0 == t || 0 == r )
+    throw std::runtime_error ( "Error 2590417736: raw volume '" + filename + "' has no voxels" );
+
+  // Size of the compressed bytes.
+  unsigned long long size ( 0 );
+  {
+    std::ifstream in ( filename.c_str(), std::ios::binary );
+    if ( false == in.is_open() )
+      throw std::runtime_error ( "Error 3489112065: could not open '" + filename + "'" );
+
+    in.seekg ( 0, std::ios::end );
+    const std::streamoff end ( in.tellg() );
+    if ( end < 0 || static_cast < unsigned long long > ( end ) <= start )
+      throw std::runtime_error ( "Error 1765830243: '" + filename + "' has no compressed bytes" );
+    size = static_cast < unsigned long long > ( end ) - start;
+  }
+
+  RawVoxels::Layout memory ( layout );
+  memory.offset = 0;
+  const bool direct ( RawVoxels::mapped ( memory ) );
+  const unsigned int bytes ( RawVoxels::numBytes ( layout.type ) );
+
+  osg::ref_ptr < osg::Image > image ( new osg::Image );
+  if ( direct )
+  {
+    const GLenum type ( ( RawVoxels::UINT8 == layout.type ) ? GL_UNSIGNED_BYTE : ( RawVoxels::UINT16 == layout.type ) ? GL_UNSIGNED_SHORT : GL_FLOAT );
+    image->allocateImage ( s, t, r, GL_LUMINANCE, type );
+    image->setInternalTextureFormat ( RawVoxels::internalFormat ( type ) );
+  }
+  else
+  {
+    image->allocateImage ( s * bytes, t, r, GL_LUMINANCE, GL_UNSIGNED_BYTE );
+  }
+  image->setFileName ( filename );
+
+  const unsigned long long needed ( static_cast < unsigned long long > ( s ) * t * r * bytes );
+  Detail::Shared shared ( filename, layout.offset, needed, image->data() );
+
+  // A zlib stream is only ever one frame, so it is decoded on one thread.
+  const unsigned int decoders ( ( CompressedVoxels::ZLIB == codec ) ? 1 : Parallel::numThreads() );
+  Detail::Pipeline pipeline ( shared, codec, start, size );
+  Parallel::forEach ( decoders + 1, pipeline, decoders + 1 );
+
+  if ( false == shared.error().empty() )
+    throw std::runtime_error ( shared.error() );
+  if ( shared.placed() < needed )
+    throw std::runtime_error ( "Error 2853906137: '" + filename + "' holds fewer voxels than its size says" );
+
+  if ( direct )
+    return image.release();
+
+  RawVoxels::SliceReader::RefPtr reader ( new RawVoxels::SliceReader ( image.get(), layout, s, t, r ) );
+
+  osg::ref_ptr < osg::Image > voxels ( new osg::Image );
+  voxels->allocateImage ( s, t, r, GL_LUMINANCE, reader->dataType() );
+  voxels->setInternalTextureFormat ( reader->internalFormat() );
+
+  reader->read ( 0, r, *voxels );
+  return voxels.release();
+}
@@ -0,0 +1,67 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Load raw voxels from a gzip, zlib or zstd compressed file without
+//  writing it out first.  One thread reads the file in chunks while the
+//  others decompress into the volume.  Frames that decompress on their
+//  own, the members of a BGZF file or the frames of a zstd file that say
+//  how much they hold, are spread over all of them.  A single stream, such
+//  as a plain gzip file or any zlib file, is decompressed on one thread as
+//  it is read.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_COMPRESSED_VOXELS_H__
+#define __OSGTOOLS_VOLUME_COMPRESSED_VOXELS_H__
+
+#include "OsgVolume/Export.h"
+#include "OsgVolume/RawVoxels.h"
+
+#include "osg/Image"
+
+#include <cstddef>
+#include <string>
+
+namespace OsgVolume {
+namespace CompressedVoxels {
+
+
+/// How the file is compressed.
+enum Codec
+{
+  NONE,
+  GZIP,
+  ZLIB,
+  ZSTD
+};
+
+
+/// Get the codec from names like "gzip", "zlib" or "zstd".  An empty name
+/// or "raw" is NONE.  Throws if the name is not known.
+OSG_VOLUME_EXPORT Codec         codec ( const std::string &name );
+
+/// Get the codec from the extension of the file, ".gz" or ".zst".  Other
+/// files are NONE.
+OSG_VOLUME_EXPORT Codec         extension ( const std::string &filename );
+
+/// Load the volume.  The compressed bytes start at the given byte of the
+/// file, and the offset of the layout is the number of bytes before the
+/// voxels once decompressed.  Throws if the file cannot be read, is
+/// broken, or holds fewer voxels than the size says.
+OSG_VOLUME_EXPORT osg::Image*   load ( const std::string &filename, Codec codec, std::size_t start,
+                                       const RawVoxels::Layout &layout, unsigned int s, unsigned int t, unsigned int r );
+
+
+} // namespace CompressedVoxels
+} // namespace OsgVolume
+
+
+#endif // __OSGTOOLS_VOLUME_COMPRESSED_VOXELS_H__
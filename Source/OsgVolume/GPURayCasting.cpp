@@ -9,19 +9,27 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "OsgVolume/GPURayCasting.h"
+#include "OsgVolume/BrickedVolume.h"
+#include "OsgVolume/LevelDrawable.h"
+#include "OsgVolume/ProgramCache.h"
+#include "OsgVolume/TransferFunction1D.h"
+#include "OsgVolume/Voxels.h"
 
 #include "Usul/Bits/Bits.h"
 
 #include "osg/CullFace"
 #include "osg/Texture1D"
+#include "osg/Texture2D"
 #include "osg/Texture3D"
 
 #include "osgUtil/CullVisitor"
 
+#include "OpenThreads/ScopedLock"
+
+#include <algorithm>
 #include <sstream>
 #include <iostream>
-
-#define BACK_TO_FRONT_COMPOSITE 1
+#include <stdexcept>
 
 using namespace OsgVolume;
 
@@ -44,7 +52,49 @@ GPURayCasting::GPURayCasting() : BaseClass (),
   _maxUniform ( new osg::Uniform ( osg::Uniform::FLOAT_VEC3, "bbMax" ) ),
   _volumeUniform ( new osg::Uniform ( osg::Uniform::INT, "Volume" ) ),
   _tfUniform ( new osg::Uniform ( osg::Uniform::INT, "TransferFunction" ) ),
-  _rateUniform ( new osg::Uniform ( osg::Uniform::FLOAT, "SampleRate" ) )
+  _rateUniform ( new osg::Uniform ( osg::Uniform::FLOAT, "SampleRate" ) ),
+  _macrocells ( 0x0 ),
+  _skipEmptySpace ( true ),
+  _macrocellSize ( 8 ),
+  _emptySpaceUnit ( 2 ),
+  _tfModifiedCount ( 0 ),
+  _emptySpaceUniform ( new osg::Uniform ( osg::Uniform::INT, "EmptySpace" ) ),
+  _skipUniform ( new osg::Uniform ( osg::Uniform::BOOL, "SkipEmptySpace" ) ),
+  _cellsPerUnitUniform ( new osg::Uniform ( osg::Uniform::FLOAT_VEC3, "CellsPerUnit" ) ),
+  _emptySpaceScaleUniform ( new osg::Uniform ( osg::Uniform::FLOAT_VEC3, "EmptySpaceScale" ) ),
+  _compositeMode ( Compositing::BACK_TO_FRONT ),
+  _opacityCutoff ( 0.95f ),
+  _cullFace ( new osg::CullFace ( osg::CullFace::FRONT ) ),
+  _frontToBackUniform ( new osg::Uniform ( osg::Uniform::BOOL, "FrontToBack" ) ),
+  _opacityCutoffUniform ( new osg::Uniform ( osg::Uniform::FLOAT, "OpacityCutoff" ) ),
+  _maxStepsUniform ( new osg::Uniform ( osg::Uniform::INT, "MaxSteps" ) ),
+  _volumeSizeUniform ( new osg::Uniform ( "VolumeSize", osg::Vec3 ( 1.0f, 1.0f, 1.0f ) ) ),
+  _preIntegration ( false ),
+  _preIntegrationUnit ( 3 ),
+  _preIntegratedUniform ( new osg::Uniform ( osg::Uniform::BOOL, "PreIntegrated" ) ),
+  _preIntegrationTableUniform ( new osg::Uniform ( osg::Uniform::INT, "PreIntegrationTable" ) ),
+  _compressed ( false ),
+  _compressedUnit ( 4 ),
+  _compressedVolume ( 0x0 ),
+  _compressedUniform ( new osg::Uniform ( osg::Uniform::BOOL, "Compressed" ) ),
+  _channelTransferFunctions ( MAX_CHANNELS ),
+  _channelUniforms ( MAX_CHANNELS ),
+  _numChannelsUniform ( new osg::Uniform ( osg::Uniform::INT, "NumChannels" ) ),
+  _specialize ( true ),
+  _roi(),
+  _region(),
+  _cellOffsetUniform ( new osg::Uniform ( osg::Uniform::FLOAT_VEC3, "CellOffset" ) ),
+  _projectionUniform ( new osg::Uniform ( osg::Uniform::INT, "Projection" ) ),
+  _dataMinimumUniform ( new osg::Uniform ( osg::Uniform::FLOAT, "DataMinimum" ) ),
+  _dataMaximumUniform ( new osg::Uniform ( osg::Uniform::FLOAT, "DataMaximum" ) ),
+  _levelOfDetail ( false ),
+  _preserveMaximum ( false ),
+  _pyramid ( 0x0 ),
+  _levelStateSets(),
+  _levelDrawables(),
+  _level ( 0 ),
+  _levelMutex(),
+  _maxTextureSize ( 0 )
 {
   this->_construct();
 }
@@ -68,7 +118,49 @@ GPURayCasting::GPURayCasting( osg::Program * program ) : BaseClass (),
   _maxUniform ( new osg::Uniform ( osg::Uniform::FLOAT_VEC3, "bbMax" ) ),
   _volumeUniform ( new osg::Uniform ( osg::Uniform::INT, "Volume" ) ),
   _tfUniform ( new osg::Uniform ( osg::Uniform::INT, "TransferFunction" ) ),
-  _rateUniform ( new osg::Uniform ( osg::Uniform::FLOAT, "SampleRate" ) )
+  _rateUniform ( new osg::Uniform ( osg::Uniform::FLOAT, "SampleRate" ) ),
+  _macrocells ( 0x0 ),
+  _skipEmptySpace ( true ),
+  _macrocellSize ( 8 ),
+  _emptySpaceUnit ( 2 ),
+  _tfModifiedCount ( 0 ),
+  _emptySpaceUniform ( new osg::Uniform ( osg::Uniform::INT, "EmptySpace" ) ),
+  _skipUniform ( new osg::Uniform ( osg::Uniform::BOOL, "SkipEmptySpace" ) ),
+  _cellsPerUnitUniform ( new osg::Uniform ( osg::Uniform::FLOAT_VEC3, "CellsPerUnit" ) ),
+  _emptySpaceScaleUniform ( new osg::Uniform ( osg::Uniform::FLOAT_VEC3, "EmptySpaceScale" ) ),
+  _compositeMode ( Compositing::BACK_TO_FRONT ),
+  _opacityCutoff ( 0.95f ),
+  _cullFace ( new osg::CullFace ( osg::CullFace::FRONT ) ),
+  _frontToBackUniform ( new osg::Uniform ( osg::Uniform::BOOL, "FrontToBack" ) ),
+  _opacityCutoffUniform ( new osg::Uniform ( osg::Uniform::FLOAT, "OpacityCutoff" ) ),
+  _maxStepsUniform ( new osg::Uniform ( osg::Uniform::INT, "MaxSteps" ) ),
+  _volumeSizeUniform ( new osg::Uniform ( "VolumeSize", osg::Vec3 ( 1.0f, 1.0f, 1.0f ) ) ),
+  _preIntegration ( false ),
+  _preIntegrationUnit ( 3 ),
+  _preIntegratedUniform ( new osg::Uniform ( osg::Uniform::BOOL, "PreIntegrated" ) ),
+  _preIntegrationTableUniform ( new osg::Uniform ( osg::Uniform::INT, "PreIntegrationTable" ) ),
+  _compressed ( false ),
+  _compressedUnit ( 4 ),
+  _compressedVolume ( 0x0 ),
+  _compressedUniform ( new osg::Uniform ( osg::Uniform::BOOL, "Compressed" ) ),
+  _channelTransferFunctions ( MAX_CHANNELS ),
+  _channelUniforms ( MAX_CHANNELS ),
+  _numChannelsUniform ( new osg::Uniform ( osg::Uniform::INT, "NumChannels" ) ),
+  _specialize ( false ),
+  _roi(),
+  _region(),
+  _cellOffsetUniform ( new osg::Uniform ( osg::Uniform::FLOAT_VEC3, "CellOffset" ) ),
+  _projectionUniform ( new osg::Uniform ( osg::Uniform::INT, "Projection" ) ),
+  _dataMinimumUniform ( new osg::Uniform ( osg::Uniform::FLOAT, "DataMinimum" ) ),
+  _dataMaximumUniform ( new osg::Uniform ( osg::Uniform::FLOAT, "DataMaximum" ) ),
+  _levelOfDetail ( false ),
+  _preserveMaximum ( false ),
+  _pyramid ( 0x0 ),
+  _levelStateSets(),
+  _levelDrawables(),
+  _level ( 0 ),
+  _levelMutex(),
+  _maxTextureSize ( 0 )
 {
   this->_construct();
 }
@@ -85,10 +177,8 @@ void GPURayCasting::_construct()
   // Get the state set.
   osg::ref_ptr < osg::StateSet > ss  ( this->getOrCreateStateSet() );
   
-  // Turn on front face culling
-#if BACK_TO_FRONT_COMPOSITE
-  ss->setAttributeAndModes ( new osg::CullFace ( osg::CullFace::FRONT ), osg::StateAttribute::ON );
-#endif
+  // Cull the faces we don't start the rays from.
+  ss->setAttributeAndModes ( _cullFace.get(), osg::StateAttribute::ON );
   ss->setMode ( GL_CULL_FACE, osg::StateAttribute::OVERRIDE | osg::StateAttribute::ON );
   ss->setMode ( GL_BLEND, osg::StateAttribute::ON | osg::StateAttribute::PROTECTED );
   
@@ -109,6 +199,52 @@ void GPURayCasting::_construct()
   ss->addUniform ( _volumeUniform.get() );
   ss->addUniform ( _tfUniform.get() );
   ss->addUniform ( _rateUniform.get() );
+  ss->addUniform ( _emptySpaceUniform.get() );
+  ss->addUniform ( _skipUniform.get() );
+  ss->addUniform ( _cellsPerUnitUniform.get() );
+  ss->addUniform ( _emptySpaceScaleUniform.get() );
+  ss->addUniform ( _frontToBackUniform.get() );
+  ss->addUniform ( _opacityCutoffUniform.get() );
+  ss->addUniform ( _maxStepsUniform.get() );
+  ss->addUniform ( _volumeSizeUniform.get() );
+  ss->addUniform ( _preIntegratedUniform.get() );
+  ss->addUniform ( _preIntegrationTableUniform.get() );
+  ss->addUniform ( _compressedUniform.get() );
+  ss->addUniform ( _numChannelsUniform.get() );
+  ss->addUniform ( _cellOffsetUniform.get() );
+  ss->addUniform ( _projectionUniform.get() );
+  ss->addUniform ( _dataMinimumUniform.get() );
+  ss->addUniform ( _dataMaximumUniform.get() );
+
+  // Channel 0 uses the usual transfer function.  The others start on units
+  // of their own so no two samplers of different kinds share one.
+  _channelUniforms[0] = _tfUniform;
+  for ( unsigned int i = 1; i < MAX_CHANNELS; ++i )
+  {
+    std::ostringstream name;
+    name << "TransferFunction" << i;
+    _channelUniforms[i] = new osg::Uniform ( osg::Uniform::INT, name.str() );
+    _channelUniforms[i]->set ( static_cast < int > ( _compressedUnit + i ) );
+    ss->addUniform ( _channelUniforms[i].get() );
+  }
+  _numChannelsUniform->set ( 1 );
+
+  // Nothing to skip until there is an image.
+  _skipUniform->set ( false );
+  _cellOffsetUniform->set ( osg::Vec3 ( 0.0f, 0.0f, 0.0f ) );
+
+  // Without the cells the scalars may take any value.
+  _dataMinimumUniform->set ( 0.0f );
+  _dataMaximumUniform->set ( 1.0f );
+
+  // Nothing to look up until there is a transfer function.
+  _preIntegratedUniform->set ( false );
+  _preIntegrationTableUniform->set ( static_cast < int > ( _preIntegrationUnit ) );
+
+  this->compositeMode ( _compositeMode );
+  this->opacityCutoff ( _opacityCutoff );
+  this->samplingRate ( _samplingRate );
+  this->_applyProgram();
 }
 
 
@@ -147,6 +283,29 @@ const osg::Image* GPURayCasting::image () const
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the intensity format with the precision of the image's voxels, so
+//  that 16 bit and float volumes are not squashed to 8 bits on the card.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  inline GLint intensityFormat ( const osg::Image &image )
+  {
+    switch ( image.getInternalTextureFormat() )
+    {
+    case GL_LUMINANCE32F_ARB:
+    case GL_INTENSITY32F_ARB:
+      return GL_INTENSITY32F_ARB;
+    default:
+      return ( GL_UNSIGNED_BYTE == image.getDataType() ) ? GL_INTENSITY : GL_INTENSITY16;
+    }
+  }
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  Set the image.
@@ -155,54 +314,110 @@ const osg::Image* GPURayCasting::image () const
 
 void GPURayCasting::image ( osg::Image* image, TextureUnit unit )
 {
+  // One texture holds the whole volume, so it has to fit.
+  const unsigned int maxSize ( this->maxTextureSize() );
+  if ( BrickedVolume::needsBricks ( image, maxSize ) )
+  {
+    std::ostringstream message;
+    message << "Error 2705318846: volume of " << image->s() << " x " << image->t() << " x " << image->r()
+            << " voxels is bigger than the largest 3D texture, " << maxSize << ", and cannot be ray cast; draw it with BrickedVolume";
+    throw std::runtime_error ( message.str() );
+  }
+
   _volume.first = image;
   _volume.second = unit;
 
+  // The channels the image has may limit how many are drawn.
+  _numChannelsUniform->set ( static_cast < int > ( this->numChannels() ) );
+
   // Set the uniform for the volume.
   _volumeUniform->set ( static_cast < int > ( unit ) );
 
-  // Create the 3D texture.
-  osg::ref_ptr < osg::Texture3D > texture3D ( new osg::Texture3D );
-  texture3D->setImage( image );    
+  // Find the voxels under the region of interest, if there is one.
+  this->_applyRegion();
 
-  texture3D->setFilter( osg::Texture3D::MIN_FILTER, osg::Texture3D::LINEAR );
-  texture3D->setFilter( osg::Texture3D::MAG_FILTER, osg::Texture3D::LINEAR );
+  // Compressed blocks take the place of the texture.
+  if ( false == this->_applyCompression() )
+  {
+    // Create the 3D texture.  With a region only its voxels are sent.
+    osg::ref_ptr < osg::Texture3D > texture3D ( _region.valid() ? RegionUpload::texture ( image, _region ) : new osg::Texture3D );
+    if ( false == _region.valid() )
+      texture3D->setImage( image );    
+
+    texture3D->setFilter( osg::Texture3D::MIN_FILTER, osg::Texture3D::LINEAR );
+    texture3D->setFilter( osg::Texture3D::MAG_FILTER, osg::Texture3D::LINEAR );
 
 #if 0
-  texture3D->setWrap( osg::Texture3D::WRAP_R, osg::Texture3D::CLAMP );
-  texture3D->setWrap( osg::Texture3D::WRAP_S, osg::Texture3D::CLAMP );
-  texture3D->setWrap( osg::Texture3D::WRAP_T, osg::Texture3D::CLAMP );
+    texture3D->setWrap( osg::Texture3D::WRAP_R, osg::Texture3D::CLAMP );
+    texture3D->setWrap( osg::Texture3D::WRAP_S, osg::Texture3D::CLAMP );
+    texture3D->setWrap( osg::Texture3D::WRAP_T, osg::Texture3D::CLAMP );
 #else
-  texture3D->setWrap( osg::Texture3D::WRAP_R, osg::Texture3D::CLAMP_TO_EDGE );
-  texture3D->setWrap( osg::Texture3D::WRAP_S, osg::Texture3D::CLAMP_TO_EDGE );
-  texture3D->setWrap( osg::Texture3D::WRAP_T, osg::Texture3D::CLAMP_TO_EDGE );
+    texture3D->setWrap( osg::Texture3D::WRAP_R, osg::Texture3D::CLAMP_TO_EDGE );
+    texture3D->setWrap( osg::Texture3D::WRAP_S, osg::Texture3D::CLAMP_TO_EDGE );
+    texture3D->setWrap( osg::Texture3D::WRAP_T, osg::Texture3D::CLAMP_TO_EDGE );
 #endif
   
-  if ( 0x0 != image )
-  {
-    if ( GL_ALPHA == image->getPixelFormat() || GL_LUMINANCE == image->getPixelFormat() )
+    if ( 0x0 != image )
     {
-      texture3D->setInternalFormatMode ( osg::Texture3D::USE_USER_DEFINED_FORMAT );
-      texture3D->setInternalFormat ( GL_INTENSITY );
-    }
-    else
-    {
-      texture3D->setInternalFormatMode ( osg::Texture3D::USE_IMAGE_DATA_FORMAT );
+      if ( GL_ALPHA == image->getPixelFormat() || GL_LUMINANCE == image->getPixelFormat() )
+      {
+        texture3D->setInternalFormatMode ( osg::Texture3D::USE_USER_DEFINED_FORMAT );
+        texture3D->setInternalFormat ( Detail::intensityFormat ( *image ) );
+      }
+      else if ( false == _region.valid() )
+      {
+        texture3D->setInternalFormatMode ( osg::Texture3D::USE_IMAGE_DATA_FORMAT );
+      }
     }
+
+    // Don't resize.
+    texture3D->setResizeNonPowerOfTwoHint( false );
+
+    // Get the state set.
+    osg::ref_ptr< osg::StateSet > ss ( this->getOrCreateStateSet() );
+    ss->setTextureAttributeAndModes ( unit, texture3D.get(), osg::StateAttribute::ON );
+
+    // Coarser copies to draw from when the volume is small on screen.
+    this->_applyPyramid ( texture3D.get() );
+  }
+  else
+  {
+    this->_applyPyramid ( 0x0 );
   }
 
-  // Don't resize.
-  texture3D->setResizeNonPowerOfTwoHint( false );
+  // The macrocells depend on the image.
+  this->_buildMacrocells();
+}
 
-  // Get the state set.
-  osg::ref_ptr< osg::StateSet > ss ( this->getOrCreateStateSet() );
-  ss->setTextureAttributeAndModes ( unit, texture3D.get(), osg::StateAttribute::ON );
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the largest 3D texture.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::maxTextureSize ( unsigned int size )
+{
+  _maxTextureSize = size;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the largest 3D texture.  Until a context has drawn one, a size most
+//  cards hold is assumed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int GPURayCasting::maxTextureSize() const
+{
+  return ( 0 == _maxTextureSize ) ? BrickedVolume::maxTextureSize ( 512 ) : _maxTextureSize;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-//  Get the number of planes.
+//  Get the sampling rate.
 //
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -214,14 +429,48 @@ float GPURayCasting::samplingRate () const
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-//  Set the number of planes.
+//  Set the sampling rate.
 //
 ///////////////////////////////////////////////////////////////////////////////
 
 void GPURayCasting::samplingRate ( float rate )
 {
-  _rateUniform->set ( rate );
   _samplingRate = rate;
+  this->_applySamplingRate();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the step the rays take.  The rays march in the unit cube of the box
+//  they are drawn in, so a region of interest takes longer steps to keep
+//  the same samples per voxel.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::_applySamplingRate ()
+{
+  float rate ( _samplingRate );
+
+  const osg::Image *image ( this->image() );
+  if ( _region.valid() && 0x0 != image )
+  {
+    const osg::Vec3 whole ( image->s(), image->t(), std::max ( 1, image->r() ) );
+    const osg::Vec3 part ( _region.size[0], _region.size[1], _region.size[2] );
+    rate *= whole.length() / part.length();
+  }
+
+  _rateUniform->set ( rate );
+
+  // Voxels along each side of the cube, so the opacities can be corrected
+  // for the steps.
+  if ( _region.valid() )
+    _volumeSizeUniform->set ( osg::Vec3 ( _region.size[0], _region.size[1], _region.size[2] ) );
+  else if ( 0x0 != image )
+    _volumeSizeUniform->set ( osg::Vec3 ( image->s(), image->t(), std::max ( 1, image->r() ) ) );
+
+  // Enough steps to cross the diagonal of the unit cube the rays march in.
+  _maxStepsUniform->set ( Compositing::maxSteps ( rate ) );
 }
 
 
@@ -283,6 +532,51 @@ namespace Detail
        <<  "uniform vec3 bbMin;\n"
        <<  "uniform vec3 bbMax;\n"
        <<  "uniform float SampleRate;\n"
+       <<  "uniform vec3 VolumeSize;\n"
+       <<  "uniform sampler3D EmptySpace;\n"
+       <<  "uniform bool SkipEmptySpace;\n"
+       <<  "uniform vec3 CellsPerUnit;\n"
+       <<  "uniform vec3 CellOffset;\n"
+       <<  "uniform vec3 EmptySpaceScale;\n"
+       <<  "uniform bool FrontToBack;\n"
+       <<  "uniform float OpacityCutoff;\n"
+       <<  "uniform int MaxSteps;\n"
+       <<  "uniform bool PreIntegrated;\n"
+       <<  "uniform sampler2D PreIntegrationTable;\n"
+       <<  "uniform bool Compressed;\n"
+       <<  "uniform int NumChannels;\n"
+       <<  "uniform sampler1D TransferFunction1;\n"
+       <<  "uniform sampler1D TransferFunction2;\n"
+       <<  "uniform sampler1D TransferFunction3;\n"
+       <<  "uniform int Projection;\n"
+       <<  "uniform float DataMinimum;\n"
+       <<  "uniform float DataMaximum;\n"
+       << OsgVolume::CompressedVolume::shaderSource()
+
+    // The scalar at a position, from either kind of storage.
+       <<  "float volumeScalar ( vec3 position )\n"
+       <<  "{\n"
+       <<  "  if ( Compressed )\n"
+       <<  "    return compressedScalar ( Volume, position );\n"
+       <<  "  return texture3D ( Volume, position ).a;\n"
+       <<  "}\n"
+
+    // Classify each channel and mix them where they overlap.  The opacities
+    // stack like layers and the colors are weighted by opacity.  Channel 0
+    // is the scalar in alpha, like volumeScalar() reads, and the others
+    // follow in red, green and blue.
+       <<  "vec4 classifyChannels ( vec3 position )\n"
+       <<  "{\n"
+       <<  "  vec4 value = texture3D ( Volume, position );\n"
+       <<  "  vec4 c0 = texture1D ( TransferFunction, value.a );\n"
+       <<  "  vec4 c1 = texture1D ( TransferFunction1, value.r );\n"
+       <<  "  vec4 c2 = ( NumChannels > 2 ) ? texture1D ( TransferFunction2, value.g ) : vec4 ( 0.0 );\n"
+       <<  "  vec4 c3 = ( NumChannels > 3 ) ? texture1D ( TransferFunction3, value.b ) : vec4 ( 0.0 );\n"
+       <<  "  float weight = c0.a + c1.a + c2.a + c3.a;\n"
+       <<  "  vec3 color = c0.rgb * c0.a + c1.rgb * c1.a + c2.rgb * c2.a + c3.rgb * c3.a;\n"
+       <<  "  float alpha = 1.0 - ( 1.0 - c0.a ) * ( 1.0 - c1.a ) * ( 1.0 - c2.a ) * ( 1.0 - c3.a );\n"
+       <<  "  return vec4 ( ( weight > 0.0 ) ? color / weight : vec3 ( 0.0 ), alpha );\n"
+       <<  "}\n"
        << " varying vec3 vertexPos;\n"
        << " varying vec3 cameraPos;\n"
        <<  "void main(void)\n"
@@ -290,40 +584,129 @@ namespace Detail
        <<  "  vec4 value;\n"
        <<  "  float scalar;\n"
 
+       // Scalar of the last sample, or negative if there is none.
+       <<  "  float previous = -1.0;\n"
+
+       // What the projections keep: 1 is the maximum, 2 the minimum and 3 the mean.
+       <<  "  float projected = ( 2 == Projection ) ? 1.0 : 0.0;\n"
+       <<  "  float count = 0.0;\n"
+
        // Initialize answer fragment.
        <<  "   vec4 dst = vec4 ( 0.0, 0.0, 0.0, 0.0 );\n"
 
       // Find the entry position in the volume.
       <<  " vec3 position = gl_TexCoord[0].xyz;\n"
 
-      // Compute the ray direction.
-#if BACK_TO_FRONT_COMPOSITE
+      // Compute the ray direction.  Back to front starts on the back faces and walks toward the eye.
     <<  "   vec3 direction = normalize ( cameraPos.xyz - gl_TexCoord[0].xyz );\n"
-#else
-      <<  "   vec3 direction = normalize ( gl_TexCoord[0].xyz - cameraPos.xyz );\n"
-#endif
+    <<  "   if ( FrontToBack )\n"
+    <<  "     direction = -direction;\n"
+
+    // The transfer function's opacities are for samples one voxel apart.
+       <<  "   float opacityExponent = SampleRate * length ( direction * VolumeSize );\n"
+
+    // Avoid dividing by zero when finding where the ray leaves a macrocell.
+       <<  "   vec3 cellDirection = direction + vec3 ( equal ( direction, vec3 ( 0.0 ) ) ) * 1.0e-6;\n"
+
+    // Ray traversal loop.  Enough steps to cross the volume.
+       <<  "   for ( int i = 0; i < MaxSteps; i++ )\n"
+       <<  "   {\n"
+
+    // Jump to the first sample past a macrocell that has nothing to show.
+    // For the projections the texture holds the range of each cell instead,
+    // and cells that cannot raise the maximum or lower the minimum are skipped.
+       <<  "   vec3 cell = floor ( position * CellsPerUnit + CellOffset );\n"
+       <<  "   bool skip = false;\n"
+       <<  "   if ( SkipEmptySpace )\n"
+       <<  "   {\n"
+       <<  "     vec4 cellValue = texture3D ( EmptySpace, ( cell + 0.5 ) * EmptySpaceScale );\n"
+       <<  "     if ( 1 == Projection )\n"
+       <<  "       skip = ( cellValue.a <= projected );\n"
+       <<  "     else if ( 2 == Projection )\n"
+       <<  "       skip = ( cellValue.r >= projected );\n"
+       <<  "     else\n"
+       <<  "       skip = ( cellValue.a < 0.5 );\n"
+       <<  "   }\n"
+       <<  "   if ( skip )\n"
+       <<  "   {\n"
+       <<  "     vec3 exit = ( ( cell - CellOffset + step ( 0.0, cellDirection ) ) / CellsPerUnit - position ) / cellDirection;\n"
+       <<  "     float steps = max ( 1.0, ceil ( min ( exit.x, min ( exit.y, exit.z ) ) / SampleRate ) );\n"
+       <<  "     position = position + direction * ( SampleRate * steps );\n"
+       <<  "     i += int ( steps ) - 1;\n"
+       <<  "     previous = -1.0;\n"
+       <<  "   }\n"
+
+    // The projections only look at the scalar.  Once the ray holds the
+    // volume's extreme nothing further along can change it.
+       <<  "   else if ( Projection > 0 )\n"
+       <<  "   {\n"
+       <<  "     scalar = volumeScalar ( position );\n"
+       <<  "     if ( 1 == Projection )\n"
+       <<  "     {\n"
+       <<  "       projected = max ( projected, scalar );\n"
+       <<  "       if ( projected >= DataMaximum )\n"
+       <<  "         break;\n"
+       <<  "     }\n"
+       <<  "     else if ( 2 == Projection )\n"
+       <<  "     {\n"
+       <<  "       projected = min ( projected, scalar );\n"
+       <<  "       if ( projected <= DataMinimum )\n"
+       <<  "         break;\n"
+       <<  "     }\n"
+       <<  "     else\n"
+       <<  "     {\n"
+       <<  "       projected += scalar;\n"
+       <<  "       count += 1.0;\n"
+       <<  "     }\n"
+       <<  "     position = position + direction * SampleRate;\n"
+       <<  "   }\n"
+       <<  "   else\n"
+       <<  "   {\n"
 
-    // Ray traversal loop.  Should probably make the 200 an input.
-       <<  "   for ( int i = 0; i < 2048; i++ )\n"
+    // Several channels share the sample.
+       <<  "   vec4 src;\n"
+       <<  "   if ( NumChannels > 1 )\n"
+       <<  "   {\n"
+       <<  "     src = classifyChannels ( position );\n"
+       <<  "   }\n"
+       <<  "   else\n"
        <<  "   {\n"
 
     //  Look up the scalar value.
-       <<  "   value = texture3D( Volume, position );\n"
-       <<  "   scalar = value.a;\n"
+       <<  "   scalar = volumeScalar ( position );\n"
     
     // Apply the transfer function.
-       <<  "   vec4 src = vec4( texture1D( TransferFunction, scalar ) );\n"
+       <<  "   src = vec4( texture1D( TransferFunction, scalar ) );\n"
+
+    // Or the segment from the last sample to this one.
+       <<  "   if ( PreIntegrated )\n"
+       <<  "   {\n"
+       <<  "     src = texture2D ( PreIntegrationTable, vec2 ( ( previous < 0.0 ) ? scalar : previous, scalar ) );\n"
+       <<  "     previous = scalar;\n"
+       <<  "   }\n"
+       <<  "   }\n"
+       <<  "   src.a = 1.0 - pow ( max ( 1.0 - src.a, 0.0 ), opacityExponent );\n"
    
-#if BACK_TO_FRONT_COMPOSITE
-    <<  "   dst.xyz = dst.xyz * ( 1.0 - src.a ) + src.xyz * src.a;\n"
-    <<  "   dst.a += src.a;\n"
-#else
-    // Front to back compositing.
-    <<  "   dst = ( ( 1.0 - dst.a ) * src ) + dst;\n"
-   // <<  "  if ( dst.a > .95 ) break;\n "
-#endif
+    // Front to back: add what still shows through, and stop once nearly opaque.
+       <<  "   if ( FrontToBack )\n"
+       <<  "   {\n"
+       <<  "     float weight = ( 1.0 - dst.a ) * src.a;\n"
+       <<  "     dst.rgb += src.rgb * weight;\n"
+       <<  "     dst.a += weight;\n"
+       <<  "     if ( dst.a >= OpacityCutoff )\n"
+       <<  "       break;\n"
+       <<  "   }\n"
+
+    // Back to front: the over operator, which keeps alpha in [0,1].
+       <<  "   else\n"
+       <<  "   {\n"
+       <<  "     dst.rgb = mix ( dst.rgb, src.rgb, src.a );\n"
+       <<  "     dst.a = mix ( dst.a, 1.0, src.a );\n"
+       <<  "   }\n"
+
        // Advance the ray position
        <<  "   position = position + direction * SampleRate;\n"
+       <<  "   }\n"
 
        // Ray termination.
        //<<  "   vec3 temp1 = sign ( position - bbMin );\n"
@@ -346,7 +729,10 @@ namespace Detail
     // End of the for loop.
        <<  "   }\n"
 
-      <<   "  if ( dst.a > 1.0 ) dst.a = 1.0;\n"
+    // The projected scalar is classified once.
+       <<  "   if ( Projection > 0 )\n"
+       <<  "     dst = texture1D ( TransferFunction, ( 3 == Projection ) ? projected / max ( count, 1.0 ) : projected );\n"
+
     // Return the result.
        <<  "   gl_FragColor = vec4( dst );\n"
        <<  "}\n";
@@ -376,14 +762,23 @@ osg::Shader* GPURayCasting::_buildFragmentShader()
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-osg::Program* GPURayCasting::createProgram()
+osg::ref_ptr<osg::Program> GPURayCasting::createProgram()
 {
-  osg::ref_ptr< osg::Program > program ( new osg::Program ); 
+  return GPURayCasting::_createProgram ( ProgramCache::Constants() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the program with the uniforms in the constants folded in.
+//
+///////////////////////////////////////////////////////////////////////////////
 
-	program->addShader ( GPURayCasting::_buildVertexShader() );
-	program->addShader ( GPURayCasting::_buildFragmentShader() );
- 
-  return program.release();
+osg::ref_ptr<osg::Program> GPURayCasting::_createProgram ( const ProgramCache::Constants &constants )
+{
+  osg::ref_ptr < osg::Shader > vertex ( GPURayCasting::_buildVertexShader() );
+  osg::ref_ptr < osg::Shader > fragment ( GPURayCasting::_buildFragmentShader() );
+  return ProgramCache::program ( vertex->getShaderSource(), fragment->getShaderSource(), constants );
 }
 
 
@@ -396,7 +791,21 @@ osg::Program* GPURayCasting::createProgram()
 void GPURayCasting::boundingBox ( const osg::BoundingBox& bb )
 {
   _bb = bb;
-  
+
+  // A different region needs a new texture.
+  if ( this->_applyRegion() && 0x0 != this->image() )
+    this->image ( _volume.first.get(), _volume.second );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Make the box the rays start from.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::_buildGeometry ( const osg::BoundingBox& bb )
+{
   const osg::Vec3 min ( bb._min );
   const osg::Vec3 max ( bb._max );
 
@@ -481,6 +890,98 @@ const osg::BoundingBox& GPURayCasting::boundingBox () const
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the region of interest.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::regionOfInterest ( const osg::BoundingBox& roi )
+{
+  _roi = roi;
+
+  // A different region needs a new texture.
+  if ( this->_applyRegion() && 0x0 != this->image() )
+    this->image ( _volume.first.get(), _volume.second );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the region of interest.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::BoundingBox& GPURayCasting::regionOfInterest () const
+{
+  return _roi;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Fit the box the rays march in to the region of interest.  The box is
+//  snapped out to whole voxels, so its unit cube is the smaller texture
+//  holding just those voxels.  Returns true when the voxels in the region
+//  changed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool GPURayCasting::_applyRegion ()
+{
+  const RegionUpload::Region last ( _region );
+  _region = RegionUpload::Region();
+
+  osg::BoundingBox box ( _bb );
+
+  const osg::Image *image ( this->image() );
+  const bool use ( _roi.valid() && _bb.valid() );
+  bool empty ( use && false == _roi.intersects ( _bb ) );
+
+  if ( use && false == empty && 0x0 != image && image->s() > 0 && image->t() > 0 )
+  {
+    // Texture coordinates of the part of the box in the region.
+    const osg::Vec3 lengths ( _bb._max - _bb._min );
+    osg::Vec3 lower ( 0.0f, 0.0f, 0.0f ), upper ( 1.0f, 1.0f, 1.0f );
+    for ( unsigned int a = 0; a < 3; ++a )
+    {
+      if ( lengths[a] > 0.0f )
+      {
+        lower[a] = ( std::max ( _roi._min[a], _bb._min[a] ) - _bb._min[a] ) / lengths[a];
+        upper[a] = ( std::min ( _roi._max[a], _bb._max[a] ) - _bb._min[a] ) / lengths[a];
+      }
+    }
+
+    _region = RegionUpload::region ( *image, lower, upper );
+    empty = false == _region.valid();
+
+    // The box over whole voxels.
+    if ( _region.valid() )
+    {
+      const float dims[3] = { static_cast < float > ( image->s() ), static_cast < float > ( image->t() ), static_cast < float > ( std::max ( 1, image->r() ) ) };
+      for ( unsigned int a = 0; a < 3; ++a )
+      {
+        box._min[a] = _bb._min[a] + lengths[a] * _region.offset[a] / dims[a];
+        box._max[a] = _bb._min[a] + lengths[a] * ( _region.offset[a] + _region.size[a] ) / dims[a];
+      }
+    }
+  }
+
+  // Nothing is drawn when the region misses the volume.
+  if ( empty )
+    this->removeDrawables ( 0, this->getNumDrawables() );
+  else
+    this->_buildGeometry ( box );
+
+  // The levels draw the new geometry.
+  this->_applyLevels();
+
+  this->_applySamplingRate();
+
+  return _region != last;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  Set the transfer function image.
@@ -500,6 +1001,12 @@ void GPURayCasting::transferFunction ( TransferFunction* tf, TextureUnit unit )
 
     // Set the uniform value.
     _tfUniform->set ( static_cast < int > ( unit ) );
+
+    // Find the cells this transfer function makes transparent.
+    this->_classifyMacrocells();
+
+    // The table belongs to the transfer function.
+    this->_applyPreIntegration();
   }
 }
 
@@ -516,6 +1023,88 @@ OsgVolume::TransferFunction* GPURayCasting::transferFunction() const
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the transfer function of a channel.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::channelTransferFunction ( unsigned int channel, TransferFunction* tf, TextureUnit unit )
+{
+  if ( 0 == channel )
+  {
+    this->transferFunction ( tf, unit );
+    return;
+  }
+
+  if ( channel >= MAX_CHANNELS )
+    throw std::runtime_error ( "Error 3184620597: channel is past the last one an image can hold" );
+
+  osg::ref_ptr< osg::StateSet > ss ( this->getOrCreateStateSet() );
+
+  // Remove the old table in case the unit changed.
+  int oldUnit ( 0 );
+  if ( _channelTransferFunctions[channel].valid() && _channelUniforms[channel]->get ( oldUnit ) )
+    ss->removeTextureAttribute ( static_cast < unsigned int > ( oldUnit ), osg::StateAttribute::TEXTURE );
+
+  _channelTransferFunctions[channel] = tf;
+
+  if ( 0x0 != tf )
+  {
+    tf->textureUnit ( unit );
+    ss->setTextureAttributeAndModes ( unit, tf->texture(), osg::StateAttribute::ON );
+    _channelUniforms[channel]->set ( static_cast < int > ( unit ) );
+  }
+
+  // Bind the storage again, it depends on the number of channels.
+  if ( 0x0 != this->image() )
+    this->image ( _volume.first.get(), _volume.second );
+  else
+    _numChannelsUniform->set ( static_cast < int > ( this->numChannels() ) );
+
+  this->_applyPreIntegration();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the transfer function of a channel.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+OsgVolume::TransferFunction* GPURayCasting::channelTransferFunction ( unsigned int channel ) const
+{
+  if ( 0 == channel )
+    return this->transferFunction();
+
+  return ( channel < MAX_CHANNELS ) ? _channelTransferFunctions[channel].get() : 0x0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of channels drawn.  It is one past the last channel with
+//  a transfer function, but no more than the image has.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int GPURayCasting::numChannels () const
+{
+  unsigned int channels ( 1 );
+  for ( unsigned int i = 1; i < MAX_CHANNELS; ++i )
+  {
+    if ( _channelTransferFunctions[i].valid() )
+      channels = i + 1;
+  }
+
+  const osg::Image *image ( this->image() );
+  if ( 0x0 != image )
+    channels = std::min < unsigned int > ( channels, osg::Image::computeNumComponents ( image->getPixelFormat() ) );
+
+  return std::max ( 1u, channels );
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  Traverse this node.
@@ -528,8 +1117,550 @@ void GPURayCasting::traverse ( osg::NodeVisitor &nv )
   {
     const osg::Vec3 camera ( nv.getEyePoint() );
     _cameraUniform->set ( camera );
+
+    // Reclassify if the transfer function changed since last time.
+    osg::Image *tf ( _transferFunction.valid() ? _transferFunction->image() : 0x0 );
+    if ( _macrocells.valid() && 0x0 != tf && tf->getModifiedCount() != _tfModifiedCount )
+      this->_classifyMacrocells();
+
+    // Each level is a drawable of its own that culls itself from views it
+    // does not suit.  Remember the level for this view.
+    osgUtil::CullVisitor *cv ( ( false == _levelDrawables.empty() ) ? dynamic_cast < osgUtil::CullVisitor * > ( &nv ) : 0x0 );
+    if ( 0x0 != cv )
+    {
+      const unsigned int level ( LevelDrawable::levelFor ( *_pyramid, *cv, _geometry->getBound() ) );
+      OpenThreads::ScopedLock < OpenThreads::Mutex > guard ( _levelMutex );
+      _level = level;
+    }
   }
 
   // Call the base class' one.
   BaseClass::traverse ( nv );
 }
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set empty space skipping.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::emptySpaceSkipping ( bool state, TextureUnit unit )
+{
+  // Remove the old texture in case the unit changed.
+  if ( _macrocells.valid() )
+    this->getOrCreateStateSet()->removeTextureAttribute ( _emptySpaceUnit, osg::StateAttribute::TEXTURE );
+
+  _skipEmptySpace = state;
+  _emptySpaceUnit = unit;
+
+  this->_buildMacrocells();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get empty space skipping.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool GPURayCasting::emptySpaceSkipping () const
+{
+  return _skipEmptySpace;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the macrocell size.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::macrocellSize ( unsigned int size )
+{
+  if ( size != _macrocellSize )
+  {
+    _macrocellSize = size;
+    this->_buildMacrocells();
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the macrocell size.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int GPURayCasting::macrocellSize () const
+{
+  return _macrocellSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the macrocells.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+MacrocellGrid* GPURayCasting::macrocells () const
+{
+  return _macrocells.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Build the macrocells for the image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::_buildMacrocells ()
+{
+  osg::ref_ptr < osg::StateSet > ss ( this->getOrCreateStateSet() );
+  osg::ref_ptr < osg::Image > image ( _volume.first );
+
+  _macrocells = 0x0;
+  _skipUniform->set ( false );
+  _dataMinimumUniform->set ( 0.0f );
+  _dataMaximumUniform->set ( 1.0f );
+
+  if ( false == _skipEmptySpace || this->numChannels() > 1 || false == image.valid() || 0x0 == image->data() || false == Voxels::supported ( image->getDataType() ) )
+  {
+    ss->removeTextureAttribute ( _emptySpaceUnit, osg::StateAttribute::TEXTURE );
+    this->_applyProgram();
+    return;
+  }
+
+  _macrocells = new MacrocellGrid ( image.get(), _macrocellSize );
+
+  this->_bindMacrocells();
+  this->_classifyMacrocells();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Bind the cells the compositing mode uses.  Compositing reads which cells
+//  the transfer function shows, and the projections read their ranges.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::_bindMacrocells ()
+{
+  if ( false == _macrocells.valid() )
+    return;
+
+  const bool projection ( Compositing::projection ( _compositeMode ) );
+
+  // One texel per cell.  No filtering so a cell is either on or off.
+  osg::ref_ptr < osg::Texture3D > texture3D ( new osg::Texture3D );
+  texture3D->setImage ( projection ? _macrocells->rangeImage() : _macrocells->image() );
+  texture3D->setFilter ( osg::Texture3D::MIN_FILTER, osg::Texture3D::NEAREST );
+  texture3D->setFilter ( osg::Texture3D::MAG_FILTER, osg::Texture3D::NEAREST );
+  texture3D->setWrap ( osg::Texture3D::WRAP_R, osg::Texture3D::CLAMP_TO_EDGE );
+  texture3D->setWrap ( osg::Texture3D::WRAP_S, osg::Texture3D::CLAMP_TO_EDGE );
+  texture3D->setWrap ( osg::Texture3D::WRAP_T, osg::Texture3D::CLAMP_TO_EDGE );
+  texture3D->setInternalFormatMode ( osg::Texture3D::USE_IMAGE_DATA_FORMAT );
+  texture3D->setResizeNonPowerOfTwoHint ( false );
+
+  osg::ref_ptr < osg::StateSet > ss ( this->getOrCreateStateSet() );
+  ss->setTextureAttributeAndModes ( _emptySpaceUnit, texture3D.get(), osg::StateAttribute::ON );
+
+  // With a region of interest the unit cube covers only its voxels.
+  const float size ( static_cast < float > ( _macrocells->cellSize() ) );
+  if ( _region.valid() )
+  {
+    _cellsPerUnitUniform->set ( osg::Vec3 ( _region.size[0] / size, _region.size[1] / size, _region.size[2] / size ) );
+    _cellOffsetUniform->set ( osg::Vec3 ( _region.offset[0] / size, _region.offset[1] / size, _region.offset[2] / size ) );
+  }
+  else
+  {
+    _cellsPerUnitUniform->set ( osg::Vec3 ( _macrocells->volumeSize ( 0 ) / size, _macrocells->volumeSize ( 1 ) / size, _macrocells->volumeSize ( 2 ) / size ) );
+    _cellOffsetUniform->set ( osg::Vec3 ( 0.0f, 0.0f, 0.0f ) );
+  }
+  _emptySpaceScaleUniform->set ( osg::Vec3 ( 1.0f / _macrocells->numCells ( 0 ), 1.0f / _macrocells->numCells ( 1 ), 1.0f / _macrocells->numCells ( 2 ) ) );
+  _emptySpaceUniform->set ( static_cast < int > ( _emptySpaceUnit ) );
+
+  // Rays stop at the extremes of the volume.  Texels hold a little less
+  // precision than the cells, so stop just short of them.
+  _dataMinimumUniform->set ( _macrocells->minimum() + 1.0e-4f );
+  _dataMaximumUniform->set ( _macrocells->maximum() - 1.0e-4f );
+
+  // Every sample counts toward the mean.
+  _skipUniform->set ( Compositing::AVERAGE_INTENSITY != _compositeMode );
+  this->_applyProgram();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Classify the macrocells against the transfer function.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::_classifyMacrocells ()
+{
+  if ( false == _macrocells.valid() )
+    return;
+
+  osg::Image *tf ( _transferFunction.valid() ? _transferFunction->image() : 0x0 );
+  _tfModifiedCount = ( 0x0 != tf ) ? tf->getModifiedCount() : 0;
+
+  _macrocells->classify ( _transferFunction.get() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the compositing mode.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::compositeMode ( CompositeMode mode )
+{
+  _compositeMode = mode;
+
+  // The projections do not care about order, and walk like back to front.
+  const bool frontToBack ( Compositing::FRONT_TO_BACK == mode );
+  _frontToBackUniform->set ( frontToBack );
+  _projectionUniform->set ( Compositing::projectionIndex ( mode ) );
+
+  // Rays start on the faces that are drawn.
+  _cullFace->setMode ( frontToBack ? osg::CullFace::BACK : osg::CullFace::FRONT );
+
+  // The cells hold something else for the projections.
+  this->_bindMacrocells();
+
+  this->_applyProgram();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the compositing mode.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+GPURayCasting::CompositeMode GPURayCasting::compositeMode () const
+{
+  return _compositeMode;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the opacity at which front to back rays stop.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::opacityCutoff ( float cutoff )
+{
+  _opacityCutoff = cutoff;
+  _opacityCutoffUniform->set ( cutoff );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the opacity at which front to back rays stop.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+float GPURayCasting::opacityCutoff () const
+{
+  return _opacityCutoff;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set use of the pre-integrated table.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::preIntegration ( bool state, TextureUnit unit )
+{
+  // Remove the old table in case the unit changed.
+  this->getOrCreateStateSet()->removeTextureAttribute ( _preIntegrationUnit, osg::StateAttribute::TEXTURE );
+
+  _preIntegration = state;
+  _preIntegrationUnit = unit;
+
+  this->_applyPreIntegration();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get use of the pre-integrated table.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool GPURayCasting::preIntegration () const
+{
+  return _preIntegration;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Bind the pre-integrated table if there is one to use.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::_applyPreIntegration ()
+{
+  TransferFunction1D *tf ( dynamic_cast < TransferFunction1D * > ( _transferFunction.get() ) );
+  const bool use ( _preIntegration && 0x0 != tf && 1 == this->numChannels() );
+
+  if ( use )
+  {
+    osg::ref_ptr< osg::StateSet > ss ( this->getOrCreateStateSet() );
+    ss->setTextureAttributeAndModes ( _preIntegrationUnit, tf->preIntegratedTexture(), osg::StateAttribute::ON );
+    _preIntegrationTableUniform->set ( static_cast < int > ( _preIntegrationUnit ) );
+  }
+
+  _preIntegratedUniform->set ( use );
+  this->_applyProgram();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set compressed storage.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::compressed ( bool state, TextureUnit unit )
+{
+  // Remove the old ends in case the unit changed.
+  if ( _compressedVolume.valid() )
+    this->getOrCreateStateSet()->removeTextureAttribute ( _compressedUnit, osg::StateAttribute::TEXTURE );
+
+  _compressed = state;
+  _compressedUnit = unit;
+
+  // Bind the storage again.
+  if ( 0x0 != this->image() )
+    this->image ( _volume.first.get(), _volume.second );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get compressed storage.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool GPURayCasting::compressed () const
+{
+  return _compressed;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the compressed volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+CompressedVolume* GPURayCasting::compressedVolume () const
+{
+  return _compressedVolume.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Bind the compressed blocks if compression is on.  Returns false when the
+//  image should be bound as it is.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool GPURayCasting::_applyCompression ()
+{
+  osg::Image *image ( _volume.first.get() );
+  const bool use ( _compressed && false == _region.valid() && 1 == this->numChannels() && 0x0 != image && 0x0 != image->data() && Voxels::supported ( image->getDataType() ) );
+
+  _compressedUniform->set ( use );
+  this->_applyProgram();
+
+  if ( false == use )
+  {
+    _compressedVolume = 0x0;
+    return false;
+  }
+
+  // Compress only when the image changed.
+  if ( false == _compressedVolume.valid() || false == _compressedVolume->current ( image ) )
+    _compressedVolume = new CompressedVolume ( image );
+
+  _compressedVolume->apply ( *this->getOrCreateStateSet(), _volume.second, _compressedUnit );
+  return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set drawing from coarser copies.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::levelOfDetail ( bool state, bool preserveMaximum )
+{
+  _levelOfDetail = state;
+  _preserveMaximum = preserveMaximum;
+
+  // Bind the storage again.
+  if ( 0x0 != this->image() )
+    this->image ( _volume.first.get(), _volume.second );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get drawing from coarser copies.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool GPURayCasting::levelOfDetail () const
+{
+  return _levelOfDetail;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the coarser copies.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+VolumePyramid* GPURayCasting::pyramid () const
+{
+  return _pyramid.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the level drawn.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int GPURayCasting::level () const
+{
+  OpenThreads::ScopedLock < OpenThreads::Mutex > guard ( _levelMutex );
+  return _level;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Make a texture for each level of the pyramid, set up like the one for
+//  the whole image, and a state set that binds it.  The state sets do not
+//  change once made, so any number of views may draw them at once.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::_applyPyramid ( osg::Texture3D *texture )
+{
+  osg::Image *image ( _volume.first.get() );
+  const bool use ( _levelOfDetail && 0x0 != texture && false == _region.valid() && 0x0 != image && 0x0 != image->data() && Voxels::supported ( image->getDataType() ) );
+
+  _levelStateSets.clear();
+  {
+    OpenThreads::ScopedLock < OpenThreads::Mutex > guard ( _levelMutex );
+    _level = 0;
+  }
+
+  if ( false == use )
+  {
+    _pyramid = 0x0;
+    this->_applyLevels();
+    return;
+  }
+
+  // Build the levels only when the image changed.
+  if ( false == _pyramid.valid() || false == _pyramid->current ( image, _preserveMaximum ) )
+    _pyramid = new VolumePyramid ( image, _preserveMaximum );
+
+  // A level is sent to the card the first time it is drawn.  The whole
+  // image is in our own state set.
+  _levelStateSets.push_back ( 0x0 );
+  for ( unsigned int i = 1; i < _pyramid->numLevels(); ++i )
+  {
+    osg::ref_ptr < osg::Texture3D > coarse ( new osg::Texture3D ( *texture ) );
+    coarse->setImage ( _pyramid->level ( i ) );
+
+    osg::ref_ptr < osg::StateSet > ss ( new osg::StateSet );
+    ss->setTextureAttributeAndModes ( _volume.second, coarse.get(), osg::StateAttribute::ON );
+    _levelStateSets.push_back ( ss );
+  }
+
+  this->_applyLevels();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Add a drawable for each coarser level, drawing our geometry with the
+//  level's state set.  Each drawable, and the geometry for the whole image,
+//  is culled from views that want another level.  Called again when the
+//  geometry is rebuilt.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::_applyLevels()
+{
+  for ( unsigned int i = 0; i < _levelDrawables.size(); ++i )
+    this->removeDrawable ( _levelDrawables[i].get() );
+  _levelDrawables.clear();
+  _geometry->setCullCallback ( 0x0 );
+
+  // Nothing is drawn when the region misses the volume.
+  if ( _levelStateSets.size() < 2 || false == _pyramid.valid() || false == this->containsDrawable ( _geometry.get() ) )
+    return;
+
+  _geometry->setCullCallback ( new LevelDrawable::Cull ( _pyramid.get(), 0 ) );
+  for ( unsigned int i = 1; i < _levelStateSets.size(); ++i )
+  {
+    osg::ref_ptr < osg::Drawable > drawable ( new LevelDrawable ( _geometry.get(), _pyramid.get(), i, _levelStateSets[i].get() ) );
+    this->addDrawable ( drawable.get() );
+    _levelDrawables.push_back ( drawable );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Swap in the program made for the switches now in use.  The compositing
+//  mode, projection, skipping, pre-integration, compression and number of
+//  channels are constants in it, so each ray runs only the code it needs.
+//  A program given to the constructor is kept as it is.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void GPURayCasting::_applyProgram ()
+{
+  if ( false == _specialize )
+    return;
+
+  ProgramCache::Constants constants;
+  ProgramCache::fold ( *_frontToBackUniform, constants );
+  ProgramCache::fold ( *_skipUniform, constants );
+  ProgramCache::fold ( *_preIntegratedUniform, constants );
+  ProgramCache::fold ( *_compressedUniform, constants );
+  ProgramCache::fold ( *_numChannelsUniform, constants );
+  ProgramCache::fold ( *_projectionUniform, constants );
+
+  osg::ref_ptr < osg::Program > program ( GPURayCasting::_createProgram ( constants ) );
+  if ( program == _program )
+    return;
+
+  _program = program;
+
+  osg::ref_ptr < osg::StateSet > ss ( this->getOrCreateStateSet() );
+  ss->setAttributeAndModes( _program.get(), osg::StateAttribute::ON );
+}
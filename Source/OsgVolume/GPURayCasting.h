@@ -12,16 +12,28 @@
 #define __OSGTOOLS_VOLUME_GPU_RAY_CASTING_H__
 
 #include "OsgVolume/Export.h"
+#include "OsgVolume/Compositing.h"
+#include "OsgVolume/CompressedVolume.h"
+#include "OsgVolume/MacrocellGrid.h"
+#include "OsgVolume/ProgramCache.h"
+#include "OsgVolume/RegionUpload.h"
 #include "OsgVolume/TransferFunction.h"
+#include "OsgVolume/VolumePyramid.h"
 
 #include "OsgTools/Configure/OSG.h"
 
+#include "osg/CullFace"
 #include "osg/Image"
 #include "osg/Geode"
 #include "osg/Geometry"
 #include "osg/Shader"
+#include "osg/Texture3D"
 #include "osg/Uniform"
 
+#include "OpenThreads/Mutex"
+
+#include <vector>
+
 namespace OsgVolume {
 
 class OSG_VOLUME_EXPORT GPURayCasting : public osg::Geode
@@ -34,26 +46,58 @@ public:
   typedef unsigned int                           TextureUnit;
   typedef std::pair < ImagePtr, TextureUnit >    TexutreInfo;
   typedef OsgVolume::TransferFunction     TransferFunction;
+  typedef OsgVolume::Compositing::Mode    CompositeMode;
+
+  /// The most channels one image can hold.
+  enum { MAX_CHANNELS = 4 };
 
   /// Construction.
   GPURayCasting();
   GPURayCasting( osg::Program * );
   
-  static osg::Program*             createProgram();
+  /// Get the generic program, with the switches left as uniforms.  It is
+  /// shared with every other caller, so do not change it.  Ray casters made
+  /// without a program use ones with the switches folded in instead.
+  static osg::ref_ptr<osg::Program> createProgram();
 
-  /// Get/Set the image.
+  /// Get/Set the image.  Throws if it is bigger than the largest 3D
+  /// texture, since it could not be sent; draw those with BrickedVolume.
   osg::Image*                      image ();
   const osg::Image*                image () const;
   void                             image ( osg::Image* image, TextureUnit unit = 0 );
 
+  /// Get/Set the largest 3D texture.  Zero, the default, asks the graphics
+  /// contexts, as BrickedVolume::maxTextureSize does.
+  void                             maxTextureSize ( unsigned int size );
+  unsigned int                     maxTextureSize () const;
+
   /// Get/Set the sampling rate.
   float                            samplingRate () const;
   void                             samplingRate ( float rate );
 
+  /// Get/Set the compositing mode.  The projections classify the largest,
+  /// smallest or mean scalar along each ray with the transfer function.
+  /// With empty space skipping on, the maximum and minimum projections jump
+  /// over cells that cannot change the ray and stop once the ray holds the
+  /// volume's extreme.
+  void                             compositeMode ( CompositeMode mode );
+  CompositeMode                    compositeMode () const;
+
+  /// Get/Set the opacity at which front to back rays stop.
+  void                             opacityCutoff ( float cutoff );
+  float                            opacityCutoff () const;
+
   /// Get/Set the bounding box.
   void                             boundingBox ( const osg::BoundingBox& bb );
   const osg::BoundingBox&          boundingBox () const;
 
+  /// Get/Set the region of interest.  Rays only march through the part of
+  /// the volume inside it, and only the voxels under it are sent to the
+  /// texture.  An invalid box draws the whole volume.  Compression is not
+  /// used with one.
+  void                             regionOfInterest ( const osg::BoundingBox& roi );
+  const osg::BoundingBox&          regionOfInterest () const;
+
   /// Traverse this node.
   void                             traverse ( osg::NodeVisitor &nv );
   
@@ -61,12 +105,75 @@ public:
   void                             transferFunction ( TransferFunction* tf, TextureUnit unit = 1 );
   TransferFunction*                transferFunction () const;
 
+  /// Get/Set the transfer function of a channel.  Giving channels past the
+  /// first their own transfer functions makes the components of the image
+  /// separate volumes, which are classified and mixed at every sample of the
+  /// same rays.  Channel 0 is transferFunction() and reads the scalar, which
+  /// is alpha as Voxels::scalarChannel says.  Channels 1 to 3 read red, green
+  /// and blue, the way packChannels() lays them out.
+  void                             channelTransferFunction ( unsigned int channel, TransferFunction* tf, TextureUnit unit );
+  TransferFunction*                channelTransferFunction ( unsigned int channel ) const;
+
+  /// Get the number of channels drawn.  Compression, pre-integration and
+  /// empty space skipping only work with one.
+  unsigned int                     numChannels () const;
+
+  /// Get/Set skipping of cells the transfer function makes transparent.
+  void                             emptySpaceSkipping ( bool state, TextureUnit unit = 2 );
+  bool                             emptySpaceSkipping () const;
+
+  /// Get/Set the number of voxels along each side of a macrocell.
+  void                             macrocellSize ( unsigned int size );
+  unsigned int                     macrocellSize () const;
+
+  /// Get the macrocells.  May be null.
+  MacrocellGrid*                   macrocells () const;
+
+  /// Get/Set use of the transfer function's pre-integrated table.  Each
+  /// step then shades the segment from the previous sample.
+  void                             preIntegration ( bool state, TextureUnit unit = 3 );
+  bool                             preIntegration () const;
+
+  /// Get/Set compressed storage.  The image is kept on the GPU in 4x4x4
+  /// blocks, with the ends of the blocks on the given unit.
+  void                             compressed ( bool state, TextureUnit unit = 4 );
+  bool                             compressed () const;
+
+  /// Get the compressed volume, which has the compression error.  May be null.
+  CompressedVolume*                compressedVolume () const;
+
+  /// Get/Set drawing from coarser copies of the image when the volume covers
+  /// few pixels.  The copies are made when the image is set.  With
+  /// preserveMaximum each coarse voxel is the largest it covers instead of
+  /// the mean.  Not used with compression or a region of interest.
+  void                             levelOfDetail ( bool state, bool preserveMaximum = false );
+  bool                             levelOfDetail () const;
+
+  /// Get the copies, which may be null, and the level the last view culled
+  /// chose.  Each view draws the level that suits it.
+  VolumePyramid*                   pyramid () const;
+  unsigned int                     level () const;
+
 protected:
   virtual ~GPURayCasting();
 
   void                             _construct();
   static osg::Shader*              _buildVertexShader ();
   static osg::Shader*              _buildFragmentShader ();
+  static osg::ref_ptr<osg::Program> _createProgram ( const ProgramCache::Constants &constants );
+
+  void                             _buildMacrocells ();
+  void                             _bindMacrocells ();
+  void                             _classifyMacrocells ();
+
+  void                             _applyPreIntegration ();
+  bool                             _applyCompression ();
+  void                             _applyPyramid ( osg::Texture3D *texture );
+  void                             _applyLevels();
+  void                             _applyProgram ();
+  bool                             _applyRegion ();
+  void                             _applySamplingRate ();
+  void                             _buildGeometry ( const osg::BoundingBox &bb );
 
 private:
 
@@ -83,6 +190,48 @@ private:
   osg::ref_ptr < osg::Uniform > _volumeUniform;
   osg::ref_ptr < osg::Uniform > _tfUniform;
   osg::ref_ptr < osg::Uniform > _rateUniform;
+  MacrocellGrid::RefPtr         _macrocells;
+  bool                          _skipEmptySpace;
+  unsigned int                  _macrocellSize;
+  unsigned int                  _emptySpaceUnit;
+  unsigned int                  _tfModifiedCount;
+  osg::ref_ptr < osg::Uniform > _emptySpaceUniform;
+  osg::ref_ptr < osg::Uniform > _skipUniform;
+  osg::ref_ptr < osg::Uniform > _cellsPerUnitUniform;
+  osg::ref_ptr < osg::Uniform > _emptySpaceScaleUniform;
+  CompositeMode                 _compositeMode;
+  float                         _opacityCutoff;
+  osg::ref_ptr < osg::CullFace > _cullFace;
+  osg::ref_ptr < osg::Uniform > _frontToBackUniform;
+  osg::ref_ptr < osg::Uniform > _opacityCutoffUniform;
+  osg::ref_ptr < osg::Uniform > _maxStepsUniform;
+  osg::ref_ptr < osg::Uniform > _volumeSizeUniform;
+  bool                          _preIntegration;
+  unsigned int                  _preIntegrationUnit;
+  osg::ref_ptr < osg::Uniform > _preIntegratedUniform;
+  osg::ref_ptr < osg::Uniform > _preIntegrationTableUniform;
+  bool                          _compressed;
+  unsigned int                  _compressedUnit;
+  CompressedVolume::RefPtr      _compressedVolume;
+  osg::ref_ptr < osg::Uniform > _compressedUniform;
+  std::vector < TransferFunction::RefPtr > _channelTransferFunctions;
+  std::vector < osg::ref_ptr < osg::Uniform > > _channelUniforms;
+  osg::ref_ptr < osg::Uniform > _numChannelsUniform;
+  bool                          _specialize;
+  osg::BoundingBox              _roi;
+  RegionUpload::Region          _region;
+  osg::ref_ptr < osg::Uniform > _cellOffsetUniform;
+  osg::ref_ptr < osg::Uniform > _projectionUniform;
+  osg::ref_ptr < osg::Uniform > _dataMinimumUniform;
+  osg::ref_ptr < osg::Uniform > _dataMaximumUniform;
+  bool                          _levelOfDetail;
+  bool                          _preserveMaximum;
+  VolumePyramid::RefPtr         _pyramid;
+  std::vector < osg::ref_ptr < osg::StateSet > > _levelStateSets;
+  std::vector < osg::ref_ptr < osg::Drawable > > _levelDrawables;
+  unsigned int                  _level;
+  mutable OpenThreads::Mutex    _levelMutex;
+  unsigned int                  _maxTextureSize;
 };
 
 
@@ -0,0 +1,331 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Precomputed gradients for shading.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/GradientVolume.h"
+#include "OsgVolume/Parallel.h"
+#include "OsgVolume/SimdVec4.h"
+#include "OsgVolume/Voxels.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for building the gradients.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // Find the gradients of one slice.  Rows are read into floats, padded to
+  // a multiple of four, so four voxels along x are done at a time.  Inside
+  // the volume the differences are central; on its faces they are one
+  // sided, so the gradient there is not halved.
+  template < class VoxelType > class CentralDifferences
+  {
+  public:
+    CentralDifferences ( const osg::Image &volume, unsigned int channel, const osg::Vec3f &spacing, osg::Image &gradients ) :
+      _data ( volume.data() ),
+      _rowStride ( volume.getRowSizeInBytes() ),
+      _sliceStride ( volume.getImageSizeInBytes() ),
+      _pixelStride ( volume.getPixelSizeInBits() / 8 ),
+      _channel ( channel ),
+      _spacing ( spacing ),
+      _gradients ( gradients )
+    {
+      _size[0] = volume.s();
+      _size[1] = volume.t();
+      _size[2] = std::max ( 1, volume.r() );
+    }
+
+    void operator () ( unsigned int k )
+    {
+      typedef OsgVolume::Simd::Vec4 Vec4;
+
+      const unsigned int width  ( _size[0] );
+      const unsigned int padded ( ( width + 3 ) & ~3u );
+
+      // The center row has a voxel of padding on each side for the x differences.
+      std::vector < float > center ( padded + 2, 0.0f );
+      std::vector < float > below ( padded, 0.0f ), above ( padded, 0.0f );
+      std::vector < float > behind ( padded, 0.0f ), front ( padded, 0.0f );
+
+      const unsigned int k0 ( ( k > 0 ) ? k - 1 : k );
+      const unsigned int k1 ( std::min ( k + 1, _size[2] - 1 ) );
+
+      // Divide the differences by the voxels they span: two inside, one on
+      // the faces.
+      std::vector < float > sx ( padded, 0.5f );
+      sx[0] = 1.0f;
+      sx[width - 1] = 1.0f;
+      const Vec4 sz ( 1.0f / static_cast < float > ( std::max ( 1u, k1 - k0 ) ) );
+
+      // The inverse spacing, so differences per voxel become gradients.
+      const Vec4 ix ( 1.0f / _spacing[0] ), iy ( 1.0f / _spacing[1] ), iz ( 1.0f / _spacing[2] );
+      const Vec4 half ( 0.5f ), one ( 1.0f ), tiny ( 1e-12f );
+
+      float gx[4], gy[4], gz[4], length[4];
+
+      for ( unsigned int j = 0; j < _size[1]; ++j )
+      {
+        const unsigned int j0 ( ( j > 0 ) ? j - 1 : j );
+        const unsigned int j1 ( std::min ( j + 1, _size[1] - 1 ) );
+        const Vec4 sy ( 1.0f / static_cast < float > ( std::max ( 1u, j1 - j0 ) ) );
+
+        this->_row ( j, k, &center[1] );
+        center[0] = center[1];
+        center[width + 1] = center[width];
+
+        this->_row ( j0, k, &below[0] );
+        this->_row ( j1, k, &above[0] );
+        this->_row ( j, k0, &behind[0] );
+        this->_row ( j, k1, &front[0] );
+
+        unsigned char *out ( _gradients.data ( 0, j, k ) );
+
+        for ( unsigned int i = 0; i < width; i += 4 )
+        {
+          // Differences per voxel.
+          const Vec4 dx ( ( Vec4::load ( &center[i + 2] ) - Vec4::load ( &center[i] ) ) * Vec4::load ( &sx[i] ) );
+          const Vec4 dy ( ( Vec4::load ( &above[i] ) - Vec4::load ( &below[i] ) ) * sy );
+          const Vec4 dz ( ( Vec4::load ( &front[i] ) - Vec4::load ( &behind[i] ) ) * sz );
+
+          // Gradient in the units of the spacing, and its direction.
+          const Vec4 x ( dx * ix ), y ( dy * iy ), z ( dz * iz );
+          const Vec4 norm ( Vec4::sqrt ( Vec4::maximum ( x * x + y * y + z * z, tiny ) ) );
+
+          ( ( x / norm ) * half + half ).store ( gx );
+          ( ( y / norm ) * half + half ).store ( gy );
+          ( ( z / norm ) * half + half ).store ( gz );
+
+          // Length in voxel units.
+          Vec4::minimum ( Vec4::sqrt ( dx * dx + dy * dy + dz * dz ), one ).store ( length );
+
+          const unsigned int count ( std::min ( 4u, width - i ) );
+          for ( unsigned int n = 0; n < count; ++n )
+          {
+            unsigned char *texel ( out + ( i + n ) * 4 );
+            texel[0] = toByte ( gx[n] );
+            texel[1] = toByte ( gy[n] );
+            texel[2] = toByte ( gz[n] );
+            texel[3] = toByte ( length[n] );
+          }
+        }
+      }
+    }
+
+  private:
+
+    CentralDifferences &operator = ( const CentralDifferences & );
+
+    static unsigned char toByte ( float v )
+    {
+      return static_cast < unsigned char > ( v * 255.0f + 0.5f );
+    }
+
+    void _row ( unsigned int j, unsigned int k, float *row ) const
+    {
+      const unsigned char *voxel ( _data + k * _sliceStride + j * _rowStride + _channel * sizeof ( VoxelType ) );
+      for ( unsigned int i = 0; i < _size[0]; ++i, voxel += _pixelStride )
+        row[i] = OsgVolume::Voxels::normalize ( *reinterpret_cast < const VoxelType * > ( voxel ) );
+    }
+
+    const unsigned char *_data;
+    unsigned int _rowStride;
+    unsigned int _sliceStride;
+    unsigned int _pixelStride;
+    unsigned int _channel;
+    unsigned int _size[3];
+    osg::Vec3f _spacing;
+    osg::Image &_gradients;
+  };
+
+  template < class VoxelType > inline void buildGradients ( const osg::Image &volume, unsigned int channel, const osg::Vec3f &spacing, osg::Image &gradients )
+  {
+    CentralDifferences < VoxelType > differences ( volume, channel, spacing, gradients );
+    OsgVolume::Parallel::forEach ( std::max ( 1, volume.r() ), differences );
+  }
+
+  // Keeps the gradients in an image's user data.
+  struct GradientHolder : public osg::Referenced
+  {
+    GradientHolder() : gradients ( 0x0 )
+    {
+    }
+
+    OsgVolume::GradientVolume::RefPtr gradients;
+
+  protected:
+    virtual ~GradientHolder()
+    {
+    }
+  };
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+GradientVolume::GradientVolume ( const osg::Image *volume, const osg::Vec3f &spacing ) : BaseClass(),
+  _spacing ( spacing ),
+  _modifiedCount ( 0 ),
+  _image ( new osg::Image )
+{
+  if ( 0x0 == volume || 0x0 == volume->data() )
+    throw std::runtime_error ( "Error 1630595927: no volume given for the gradients" );
+
+  if ( false == Voxels::supported ( volume->getDataType() ) )
+    throw std::runtime_error ( "Error 2818760452: volume data type not supported by the gradients" );
+
+  if ( spacing[0] <= 0.0f || spacing[1] <= 0.0f || spacing[2] <= 0.0f )
+    throw std::runtime_error ( "Error 4109867253: voxel spacing must be positive" );
+
+  _modifiedCount = volume->getModifiedCount();
+
+  _image->allocateImage ( volume->s(), volume->t(), std::max ( 1, volume->r() ), GL_RGBA, GL_UNSIGNED_BYTE );
+
+  // Formats without a scalar are drawn with an alpha of one everywhere,
+  // so nothing changes and there is no gradient.
+  unsigned int channel ( 0 );
+  if ( false == Voxels::scalarChannel ( volume->getPixelFormat(), channel ) )
+  {
+    unsigned char *texel ( _image->data() );
+    const unsigned int num ( _image->s() * _image->t() * _image->r() );
+    for ( unsigned int i = 0; i < num; ++i, texel += 4 )
+    {
+      texel[0] = texel[1] = texel[2] = 128;
+      texel[3] = 0;
+    }
+    return;
+  }
+
+  switch ( volume->getDataType() )
+  {
+  case GL_UNSIGNED_BYTE:
+    Detail::buildGradients < unsigned char > ( *volume, channel, _spacing, *_image );
+    break;
+  case GL_UNSIGNED_SHORT:
+    Detail::buildGradients < unsigned short > ( *volume, channel, _spacing, *_image );
+    break;
+  case GL_FLOAT:
+    Detail::buildGradients < float > ( *volume, channel, _spacing, *_image );
+    break;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+GradientVolume::~GradientVolume()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the gradients kept with the volume, building them if needed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+GradientVolume::RefPtr GradientVolume::cached ( osg::Image *volume, const osg::Vec3f &spacing )
+{
+  if ( 0x0 == volume )
+    return RefPtr ( 0x0 );
+
+  osg::Referenced *data ( volume->getUserData() );
+  Detail::GradientHolder *holder ( dynamic_cast < Detail::GradientHolder * > ( data ) );
+
+  // Reuse them if nothing changed.
+  if ( 0x0 != holder && holder->gradients.valid() && holder->gradients->current ( volume, spacing ) )
+    return holder->gradients;
+
+  RefPtr gradients ( new GradientVolume ( volume, spacing ) );
+
+  // Keep them unless the user data is taken.
+  if ( 0x0 == data )
+  {
+    holder = new Detail::GradientHolder;
+    volume->setUserData ( holder );
+  }
+
+  if ( 0x0 != holder )
+    holder->gradients = gradients;
+
+  return gradients;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Were these gradients built from the volume as it is now?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool GradientVolume::current ( const osg::Image *volume, const osg::Vec3f &spacing ) const
+{
+  return ( 0x0 != volume &&
+           volume->getModifiedCount() == _modifiedCount &&
+           static_cast < int > ( _image->s() ) == volume->s() &&
+           static_cast < int > ( _image->t() ) == volume->t() &&
+           static_cast < int > ( _image->r() ) == std::max ( 1, volume->r() ) &&
+           spacing == _spacing );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the spacing.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::Vec3f& GradientVolume::spacing () const
+{
+  return _spacing;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the gradients.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* GradientVolume::image ()
+{
+  return _image.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the gradients.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::Image* GradientVolume::image () const
+{
+  return _image.get();
+}
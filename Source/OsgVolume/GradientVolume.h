@@ -0,0 +1,77 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Gradients of a volume found once on the CPU, so shading needs one more
+//  texture fetch per fragment instead of six.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_GRADIENT_VOLUME_H__
+#define __OSGTOOLS_VOLUME_GRADIENT_VOLUME_H__
+
+#include "OsgVolume/Export.h"
+
+#include "Usul/Base/Referenced.h"
+#include "Usul/Pointers/Pointers.h"
+
+#include "osg/Image"
+#include "osg/Vec3f"
+#include "osg/ref_ptr"
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT GradientVolume : public Usul::Base::Referenced
+{
+public:
+  /// Typedefs.
+  typedef Usul::Base::Referenced                 BaseClass;
+
+  USUL_DECLARE_REF_POINTERS ( GradientVolume );
+
+  /// Construction.  Builds the gradients with central differences, where
+  /// spacing is the distance between neighboring voxels along each axis.
+  GradientVolume ( const osg::Image *volume, const osg::Vec3f &spacing );
+
+  /// Get the gradients kept with the volume's image.  They are built, and
+  /// kept in the image's user data, if they are missing or out of date.
+  /// When the user data holds something else the gradients are not kept.
+  static RefPtr                    cached ( osg::Image *volume, const osg::Vec3f &spacing );
+
+  /// Were these gradients built from the volume as it is now?
+  bool                             current ( const osg::Image *volume, const osg::Vec3f &spacing ) const;
+
+  /// Get the spacing.
+  const osg::Vec3f&                spacing () const;
+
+  /// Get the gradients as a GL_RGBA image.  RGB is the unit gradient mapped
+  /// from [-1,1] to [0,1].  Alpha is the gradient's length in voxel units,
+  /// clamped to one.
+  osg::Image*                      image ();
+  const osg::Image*                image () const;
+
+protected:
+  virtual ~GradientVolume();
+
+private:
+
+  GradientVolume ( const GradientVolume & );
+  GradientVolume &operator = ( const GradientVolume & );
+
+  osg::Vec3f                    _spacing;
+  unsigned int                  _modifiedCount;
+  osg::ref_ptr < osg::Image >   _image;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_GRADIENT_VOLUME_H__
@@ -8,9 +8,273 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "OsgVolume/Image3d.h"
+#include "OsgVolume/Parallel.h"
+
+#include "Usul/Interfaces/IProgressBar.h"
+
+#include "OpenThreads/Mutex"
+#include "OpenThreads/ScopedLock"
+#include "OpenThreads/Thread"
 
 #include "osg/ref_ptr"
 #include "osg/Image"
+#include "osg/Timer"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for assembling the slices.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // Where each output pixel along one axis reads from, with linear weights.
+  struct Samples
+  {
+    Samples ( unsigned int from, unsigned int to ) : first ( to ), second ( to ), weight ( to )
+    {
+      const float ratio ( static_cast < float > ( from ) / to );
+      for ( unsigned int i = 0; i < to; ++i )
+      {
+        // Match pixel centers.
+        const float x ( std::max ( 0.0f, ( i + 0.5f ) * ratio - 0.5f ) );
+        first[i]  = std::min ( static_cast < unsigned int > ( x ), from - 1 );
+        second[i] = std::min ( first[i] + 1, from - 1 );
+        weight[i] = x - first[i];
+      }
+    }
+
+    std::vector < unsigned int > first;
+    std::vector < unsigned int > second;
+    std::vector < float > weight;
+  };
+
+  // Round to the nearest integer, or keep floats as they are.
+  template < class T > inline T convert ( float value )
+  {
+    return static_cast < T > ( value + ( ( value < 0.0f ) ? -0.5f : 0.5f ) );
+  }
+  template <> inline float convert < float > ( float value )
+  {
+    return value;
+  }
+
+  // Resample one slice straight into the 3D image with linear filtering.
+  template < class T > void resample ( const osg::Image &slice, const Samples &xs, const Samples &ys, unsigned int components, osg::Image &image, unsigned int r )
+  {
+    const unsigned int width ( xs.first.size() );
+
+    for ( unsigned int j = 0; j < ys.first.size(); ++j )
+    {
+      const T *row0 ( reinterpret_cast < const T * > ( slice.data ( 0, ys.first[j] ) ) );
+      const T *row1 ( reinterpret_cast < const T * > ( slice.data ( 0, ys.second[j] ) ) );
+      const float v ( ys.weight[j] );
+
+      T *out ( reinterpret_cast < T * > ( image.data ( 0, j, r ) ) );
+
+      for ( unsigned int i = 0; i < width; ++i )
+      {
+        const unsigned int a ( xs.first[i] * components ), b ( xs.second[i] * components );
+        const float u ( xs.weight[i] );
+
+        for ( unsigned int c = 0; c < components; ++c )
+        {
+          const float top    ( row0[a + c] + ( row0[b + c] - static_cast < float > ( row0[a + c] ) ) * u );
+          const float bottom ( row1[a + c] + ( row1[b + c] - static_cast < float > ( row1[a + c] ) ) * u );
+          const float value  ( top + ( bottom - top ) * v );
+
+          *out++ = convert < T > ( value );
+        }
+      }
+    }
+  }
+
+  // Resample types we do not know by taking the nearest pixel.
+  inline void nearest ( const osg::Image &slice, const Samples &xs, const Samples &ys, osg::Image &image, unsigned int r )
+  {
+    const unsigned int pixelSize ( slice.getPixelSizeInBits() / 8 );
+
+    for ( unsigned int j = 0; j < ys.first.size(); ++j )
+    {
+      const unsigned int y ( ( ys.weight[j] < 0.5f ) ? ys.first[j] : ys.second[j] );
+      const unsigned char *in ( slice.data ( 0, y ) );
+      unsigned char *out ( image.data ( 0, j, r ) );
+
+      for ( unsigned int i = 0; i < xs.first.size(); ++i, out += pixelSize )
+      {
+        const unsigned int x ( ( xs.weight[i] < 0.5f ) ? xs.first[i] : xs.second[i] );
+        std::memcpy ( out, in + x * pixelSize, pixelSize );
+      }
+    }
+  }
+
+  // Puts each slice into the 3D image, resampling when the sizes differ.
+  class Assemble
+  {
+  public:
+    typedef OpenThreads::Mutex Mutex;
+    typedef OpenThreads::ScopedLock < Mutex > Guard;
+
+    Assemble ( const OsgVolume::ImageList &images, osg::Image &image, double updateTime, Usul::Interfaces::IUnknown *caller ) :
+      _images ( images ),
+      _image ( image ),
+      _components ( osg::Image::computeNumComponents ( image.getPixelFormat() ) ),
+      _samples(),
+      _mutex(),
+      _done ( 0 ),
+      _updateTime ( updateTime ),
+      _last ( osg::Timer::instance()->tick() ),
+      _thread ( OpenThreads::Thread::CurrentThread() ),
+      _progress ( caller )
+    {
+      if ( _progress.valid() )
+        _progress->setTotalProgressBar ( _images.size() );
+    }
+
+    ~Assemble()
+    {
+      for ( Cache::iterator iter = _samples.begin(); iter != _samples.end(); ++iter )
+      {
+        delete iter->second.first;
+        delete iter->second.second;
+      }
+    }
+
+    void operator () ( unsigned int r )
+    {
+      const osg::Image &slice ( *_images.at ( r ) );
+      const unsigned int width ( _image.s() ), height ( _image.t() );
+
+      if ( static_cast < int > ( width ) == slice.s() && static_cast < int > ( height ) == slice.t() )
+      {
+        // Same size, so copy the rows.
+        const unsigned int bytes ( width * _image.getPixelSizeInBits() / 8 );
+        for ( unsigned int j = 0; j < height; ++j )
+          std::memcpy ( _image.data ( 0, j, r ), slice.data ( 0, j ), bytes );
+      }
+      else
+      {
+        const SamplesPair samples ( this->_getSamples ( slice.s(), slice.t() ) );
+        const Samples &xs ( *samples.first ), &ys ( *samples.second );
+
+        switch ( _image.getDataType() )
+        {
+        case GL_UNSIGNED_BYTE:  resample < unsigned char >  ( slice, xs, ys, _components, _image, r ); break;
+        case GL_BYTE:           resample < signed char >    ( slice, xs, ys, _components, _image, r ); break;
+        case GL_UNSIGNED_SHORT: resample < unsigned short > ( slice, xs, ys, _components, _image, r ); break;
+        case GL_SHORT:          resample < short >          ( slice, xs, ys, _components, _image, r ); break;
+        case GL_UNSIGNED_INT:   resample < unsigned int >   ( slice, xs, ys, _components, _image, r ); break;
+        case GL_INT:            resample < int >            ( slice, xs, ys, _components, _image, r ); break;
+        case GL_FLOAT:          resample < float >          ( slice, xs, ys, _components, _image, r ); break;
+        default:                nearest                     ( slice, xs, ys, _image, r );              break;
+        }
+      }
+
+      this->_finished();
+    }
+
+    // Report the last of the progress.
+    void done()
+    {
+      if ( _progress.valid() )
+        _progress->updateProgressBar ( _done );
+    }
+
+  private:
+
+    typedef std::pair < Samples *, Samples * > SamplesPair;
+    typedef std::pair < unsigned int, unsigned int > Size;
+    typedef std::map < Size, SamplesPair > Cache;
+
+    Assemble ( const Assemble & );
+    Assemble &operator = ( const Assemble & );
+
+    // Slices of the same size share the sample positions.
+    SamplesPair _getSamples ( unsigned int s, unsigned int t )
+    {
+      Guard guard ( _mutex );
+
+      const Size size ( s, t );
+      Cache::iterator iter ( _samples.find ( size ) );
+      if ( _samples.end() != iter )
+        return iter->second;
+
+      const SamplesPair samples ( new Samples ( s, _image.s() ), new Samples ( t, _image.t() ) );
+      _samples.insert ( Cache::value_type ( size, samples ) );
+      return samples;
+    }
+
+    // Count the slice.  Only the calling thread talks to the progress bar.
+    void _finished()
+    {
+      unsigned int done ( 0 );
+      {
+        Guard guard ( _mutex );
+        done = ++_done;
+      }
+
+      if ( false == _progress.valid() || OpenThreads::Thread::CurrentThread() != _thread )
+        return;
+
+      const osg::Timer_t now ( osg::Timer::instance()->tick() );
+      if ( osg::Timer::instance()->delta_m ( _last, now ) >= _updateTime )
+      {
+        _last = now;
+        _progress->updateProgressBar ( done );
+      }
+    }
+
+    const OsgVolume::ImageList &_images;
+    osg::Image &_image;
+    unsigned int _components;
+    Cache _samples;
+    Mutex _mutex;
+    unsigned int _done;
+    double _updateTime;
+    osg::Timer_t _last;
+    OpenThreads::Thread *_thread;
+    Usul::Interfaces::IProgressBar::QueryPtr _progress;
+  };
+
+  // Interleaves the channels of one slice.
+  class Pack
+  {
+  public:
+    Pack ( const OsgVolume::ImageList &channels, osg::Image &image ) : _channels ( channels ), _image ( image )
+    {
+    }
+
+    void operator () ( unsigned int r )
+    {
+      const unsigned int size ( _image.s() * _image.t() );
+      unsigned char *out ( _image.data ( 0, 0, r ) );
+
+      // The first channel is the scalar, in alpha.
+      for ( unsigned int c = 0; c < 4; ++c )
+      {
+        const unsigned char *in ( ( c < _channels.size() ) ? _channels[c]->data ( 0, 0, r ) : 0x0 );
+        const unsigned int component ( ( c + 3 ) % 4 );
+
+        for ( unsigned int i = 0; i < size; ++i )
+          out[i * 4 + component] = ( 0x0 != in ) ? in[i] : 0;
+      }
+    }
+
+  private:
+
+    Pack &operator = ( const Pack & );
+
+    const OsgVolume::ImageList &_channels;
+    osg::Image &_image;
+  };
+}
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -21,6 +285,9 @@
 
 osg::Image* OsgVolume::image3d ( ImageList& images, bool ensureProperTextureSize, double updateTime, Usul::Interfaces::IUnknown *caller )
 {
+  if ( images.empty() || false == images.front().valid() )
+    throw std::runtime_error ( "Error 3517942186: no images given for the 3D image" );
+
   // Make an image
   ImagePtr image3d ( new osg::Image );
 
@@ -30,40 +297,71 @@ osg::Image* OsgVolume::image3d ( ImageList& images, bool ensureProperTextureSize
   unsigned int height ( front->t() );
 
   GLenum pixelFormat ( front->getPixelFormat() );
+  GLenum dataType ( front->getDataType() );
 
   //Ensure proper size for texturing
-  int new_s ( front->computeNearestPowerOfTwo( width  ) );
-  int new_t ( front->computeNearestPowerOfTwo( height ) );
-
   if( ensureProperTextureSize )
   {
-    width  = new_s;
-    height = new_t;
+    width  = front->computeNearestPowerOfTwo( width  );
+    height = front->computeNearestPowerOfTwo( height );
   }
 
-  // Make enough room
-  image3d->allocateImage ( width, height, images.size(), pixelFormat, images.front()->getDataType());
-
-  // Add each image to the 3d image
-  for( ImageList::iterator i = images.begin(); i != images.end(); ++i )
+  // The slices are resampled as they are copied, so they must all be alike.
+  for( ImageList::const_iterator i = images.begin(); i != images.end(); ++i )
   {
-    // Do we need to scale the image for textures
-    if( ensureProperTextureSize )
-    {
-      if( new_s != (*i)->s() || new_t != (*i)->t() )
-      {
-        (*i)->scaleImage( new_s, new_t, 1 );
-      }
-    }
-
-    // Copy the image to our 3d image
-    image3d->copySubImage ( 0, 0, ( i - images.begin() ), i->get() );
+    if ( false == i->valid() || 0x0 == (*i)->data() )
+      throw std::runtime_error ( "Error 1147396532: slice of the 3D image has no data" );
 
+    if ( pixelFormat != (*i)->getPixelFormat() || dataType != (*i)->getDataType() )
+      throw std::runtime_error ( "Error 2606087413: slices of the 3D image differ in pixel format or data type" );
   }
 
+  // Make enough room
+  image3d->allocateImage ( width, height, images.size(), pixelFormat, dataType );
+
+  // Fill each slice of the 3d image in parallel.
+  Detail::Assemble assemble ( images, *image3d, updateTime, caller );
+  OsgVolume::Parallel::forEach ( images.size(), assemble );
+  assemble.done();
+
   image3d->setInternalTextureFormat( front->getInternalTextureFormat() );
 
   // Return the image
   return image3d.release();
 }
 
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Pack the channels into one image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* OsgVolume::packChannels ( const ImageList& channels )
+{
+  if ( channels.empty() || channels.size() > 4 )
+    throw std::runtime_error ( "Error 2274610593: between one and four channels are needed to pack" );
+
+  for ( ImageList::const_iterator i = channels.begin(); i != channels.end(); ++i )
+  {
+    if ( false == i->valid() || 0x0 == (*i)->data() )
+      throw std::runtime_error ( "Error 1658203947: channel to pack has no data" );
+
+    if ( GL_UNSIGNED_BYTE != (*i)->getDataType() || 1 != osg::Image::computeNumComponents ( (*i)->getPixelFormat() ) )
+      throw std::runtime_error ( "Error 3920475168: channels to pack must have one 8-bit component" );
+
+    if ( (*i)->s() != channels.front()->s() || (*i)->t() != channels.front()->t() || (*i)->r() != channels.front()->r() )
+      throw std::runtime_error ( "Error 4051937286: channels to pack differ in size" );
+  }
+
+  const osg::Image &front ( *channels.front() );
+
+  ImagePtr image ( new osg::Image );
+  image->allocateImage ( front.s(), front.t(), front.r(), GL_RGBA, GL_UNSIGNED_BYTE );
+  image->setInternalTextureFormat ( GL_RGBA );
+
+  Detail::Pack pack ( channels, *image );
+  OsgVolume::Parallel::forEach ( front.r(), pack );
+
+  return image.release();
+}
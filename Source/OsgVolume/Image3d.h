@@ -24,6 +24,11 @@ namespace OsgVolume {
 
   OSG_VOLUME_EXPORT osg::Image* image3d ( ImageList&, bool ensureProperTextureSize = false, double updateTime = 1000, Usul::Interfaces::IUnknown *caller = 0x0  );
 
+  // Pack up to four 8-bit volumes of the same size into the channels of one GL_RGBA volume.
+  // The first goes in alpha, where the scalar of an RGBA volume is read, and the others
+  // in red, green and blue.
+  OSG_VOLUME_EXPORT osg::Image* packChannels ( const ImageList& channels );
+
 }
 
 #endif // __OSG_TOOLS_IMAGES_THRESHOLD_H__
@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Deflate (RFC 1951), with the gzip (RFC 1952) and zlib (RFC 1950)
+//  wrappers, decompressed by zlib.  The window bits given to zlib pick the
+//  wrapper; zlib checks the CRC or Adler-32 and the size.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/Inflate.h"
+
+#include "zlib.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for driving zlib.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  const std::size_t BUFFER ( 256 * 1024 );
+
+  // zlib counts in unsigned ints, so big inputs are fed in pieces.
+  const std::size_t MAX_PIECE ( 1024 * 1024 * 1024 );
+
+  // Window bits for each wrapper.
+  const int DEFLATE ( -MAX_WBITS );
+  const int ZLIB    ( MAX_WBITS );
+  const int GZIP    ( MAX_WBITS + 16 );
+
+  // A stream that ends itself.
+  struct Stream
+  {
+    Stream ( int windowBits )
+    {
+      std::memset ( &z, 0, sizeof ( z ) );
+      if ( Z_OK != ::inflateInit2 ( &z, windowBits ) )
+        throw std::runtime_error ( "Error 2876619405: could not start decompressing" );
+    }
+    ~Stream()
+    {
+      ::inflateEnd ( &z );
+    }
+
+    z_stream z;
+
+  private:
+    Stream ( const Stream & );
+    Stream &operator = ( const Stream & );
+  };
+
+  inline std::string message ( const z_stream &z )
+  {
+    return ( 0x0 == z.msg ) ? std::string ( "unknown error" ) : std::string ( z.msg );
+  }
+
+  // Decompress until the stream ends.  With members, a stream that ends
+  // may be followed by another; bytes after the last that do not start a
+  // gzip member are ignored, as gzip does.  Otherwise anything after the
+  // end is ignored.
+  inline void inflate ( int windowBits, bool members, Inflate::Source &source, Inflate::Sink &sink )
+  {
+    Stream stream ( windowBits );
+    z_stream &z ( stream.z );
+    std::vector < unsigned char > out ( BUFFER );
+    bool ended ( false ), done ( false );
+
+    const unsigned char *bytes ( 0x0 );
+    for ( std::size_t size = source.read ( bytes ); size > 0 && false == done; size = source.read ( bytes ) )
+    {
+      while ( size > 0 && false == done )
+      {
+        const std::size_t piece ( std::min ( size, MAX_PIECE ) );
+        z.next_in = const_cast < Bytef * > ( bytes );
+        z.avail_in = static_cast < uInt > ( piece );
+        bytes += piece;
+        size -= piece;
+
+        do
+        {
+          if ( ended )
+          {
+            if ( 0 == z.avail_in )
+              break;
+            if ( false == members || 0x1F != z.next_in[0] )
+            {
+              done = true;
+              break;
+            }
+            if ( Z_OK != ::inflateReset ( &z ) )
+              throw std::runtime_error ( "Error 1330497752: could not start the next gzip member" );
+            ended = false;
+          }
+
+          z.next_out = &out[0];
+          z.avail_out = static_cast < uInt > ( out.size() );
+          const int result ( ::inflate ( &z, Z_NO_FLUSH ) );
+
+          const std::size_t made ( out.size() - z.avail_out );
+          if ( made > 0 )
+            sink.write ( &out[0], made );
+
+          if ( Z_STREAM_END == result )
+            ended = true;
+          else if ( Z_BUF_ERROR == result )
+            break;
+          else if ( Z_OK != result )
+            throw std::runtime_error ( "Error 3805128174: compressed stream is broken: " + Detail::message ( z ) );
+        }
+        while ( z.avail_in > 0 || 0 == z.avail_out );
+      }
+    }
+
+    if ( false == ended )
+      throw std::runtime_error ( "Error 2149096343: compressed stream ends early" );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Decompress a bare deflate stream.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Inflate::deflate ( Source &source, Sink &sink )
+{
+  Detail::inflate ( Detail::DEFLATE, false, source, sink );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Decompress a gzip file of one or more members.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Inflate::gzip ( Source &source, Sink &sink )
+{
+  Detail::inflate ( Detail::GZIP, true, source, sink );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Decompress a zlib stream.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Inflate::zlib ( Source &source, Sink &sink )
+{
+  Detail::inflate ( Detail::ZLIB, false, source, sink );
+}
@@ -0,0 +1,65 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Decompress deflate streams, bare or wrapped as gzip or zlib, with the
+//  zlib library.  Bytes are pulled from a source as they are needed and
+//  pushed to a sink as they are made, so neither side has to be in memory
+//  at once.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_INFLATE_H__
+#define __OSGTOOLS_VOLUME_INFLATE_H__
+
+#include "OsgVolume/Export.h"
+
+#include <cstddef>
+
+namespace OsgVolume {
+namespace Inflate {
+
+
+/// Where the compressed bytes come from.
+struct OSG_VOLUME_EXPORT Source
+{
+  virtual ~Source() {}
+
+  /// Point at the next bytes and return how many there are.  Zero is the
+  /// end.  The bytes must stay valid until the next call.
+  virtual std::size_t             read ( const unsigned char *&bytes ) = 0;
+};
+
+
+/// Where the decompressed bytes go, in order.
+struct OSG_VOLUME_EXPORT Sink
+{
+  virtual ~Sink() {}
+  virtual void                    write ( const unsigned char *bytes, std::size_t size ) = 0;
+};
+
+
+/// Decompress a bare deflate stream.
+OSG_VOLUME_EXPORT void            deflate ( Source &source, Sink &sink );
+
+/// Decompress a gzip file of one or more members, checking the CRC and
+/// size of each.  Bytes after the last member that do not start another
+/// one are ignored, as gzip does.
+OSG_VOLUME_EXPORT void            gzip ( Source &source, Sink &sink );
+
+/// Decompress a zlib stream, checking its Adler-32.
+OSG_VOLUME_EXPORT void            zlib ( Source &source, Sink &sink );
+
+
+} // namespace Inflate
+} // namespace OsgVolume
+
+
+#endif // __OSGTOOLS_VOLUME_INFLATE_H__
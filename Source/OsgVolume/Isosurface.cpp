@@ -0,0 +1,745 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Marching cubes over the scalar channel of a volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/Isosurface.h"
+#include "OsgVolume/Parallel.h"
+#include "OsgVolume/Voxels.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for the extraction.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // No vertex yet.
+  const unsigned int NONE ( 0xffffffff );
+
+  // The corners of a cube are numbered with x in bit 0, y in bit 1 and z in
+  // bit 2.  The edges along x are 0-3, along y 4-7 and along z 8-11, each
+  // numbered by the two bits of its lower corner off its axis.
+  inline unsigned int edge ( unsigned int a, unsigned int b )
+  {
+    const unsigned int lower ( std::min ( a, b ) );
+    const unsigned int axis ( ( a ^ b ) == 1 ? 0 : ( ( a ^ b ) == 2 ? 1 : 2 ) );
+    unsigned int bits ( 0 );
+    for ( unsigned int bit = 0, n = 0; bit < 3; ++bit )
+    {
+      if ( bit != axis )
+        bits |= ( ( lower >> bit ) & 1 ) << n++;
+    }
+    return axis * 4 + bits;
+  }
+
+  // The lower corner of an edge.
+  inline unsigned int corner ( unsigned int edge )
+  {
+    const unsigned int axis ( edge / 4 ), bits ( edge % 4 );
+    unsigned int lower ( 0 );
+    for ( unsigned int bit = 0, n = 0; bit < 3; ++bit )
+    {
+      if ( bit != axis )
+        lower |= ( ( bits >> n++ ) & 1 ) << bit;
+    }
+    return lower;
+  }
+
+  // Triangles for each case, made once.  Each face joins where the surface
+  // enters it to where it leaves, going around the face counter-clockwise
+  // seen from outside, so the inside corners of a face with two are kept
+  // apart the same way by both cubes that share it.  The joins make loops
+  // around the cube, and each loop becomes a fan.  No case needs more than
+  // five triangles.
+  struct Tables
+  {
+    Tables()
+    {
+      static const unsigned int faces[6][4] =
+      {
+        { 0, 2, 3, 1 }, { 4, 5, 7, 6 },
+        { 0, 1, 5, 4 }, { 2, 6, 7, 3 },
+        { 0, 4, 6, 2 }, { 1, 3, 7, 5 }
+      };
+
+      for ( unsigned int c = 0; c < 256; ++c )
+      {
+        count[c] = 0;
+
+        int next[12];
+        std::fill ( next, next + 12, -1 );
+
+        for ( unsigned int f = 0; f < 6; ++f )
+        {
+          unsigned int crossings[4], entering[4], num ( 0 );
+          for ( unsigned int n = 0; n < 4; ++n )
+          {
+            const unsigned int a ( faces[f][n] ), b ( faces[f][( n + 1 ) % 4] );
+            const bool inA ( 0 != ( ( c >> a ) & 1 ) ), inB ( 0 != ( ( c >> b ) & 1 ) );
+            if ( inA != inB )
+            {
+              crossings[num] = Detail::edge ( a, b );
+              entering[num] = inB ? 1 : 0;
+              ++num;
+            }
+          }
+
+          // An exit always follows an entry.
+          for ( unsigned int n = 0; n < num; ++n )
+          {
+            if ( 1 == entering[n] )
+              next[crossings[n]] = static_cast < int > ( crossings[( n + 1 ) % num] );
+          }
+        }
+
+        bool used[12] = { false, false, false, false, false, false, false, false, false, false, false, false };
+        for ( unsigned int e = 0; e < 12; ++e )
+        {
+          if ( used[e] || next[e] < 0 )
+            continue;
+
+          unsigned int loop[12], size ( 0 );
+          for ( int at = static_cast < int > ( e ); false == used[at]; at = next[at] )
+          {
+            used[at] = true;
+            loop[size++] = static_cast < unsigned int > ( at );
+          }
+
+          for ( unsigned int n = 1; n + 1 < size; ++n )
+          {
+            unsigned char *triangle ( edges[c] + 3 * count[c]++ );
+            triangle[0] = static_cast < unsigned char > ( loop[0] );
+            triangle[1] = static_cast < unsigned char > ( loop[n] );
+            triangle[2] = static_cast < unsigned char > ( loop[n + 1] );
+          }
+        }
+      }
+    }
+
+    unsigned char count[256];
+    unsigned char edges[256][15];
+  };
+
+  const Tables tables;
+
+  // Reads normalized scalars and their gradients.
+  template < class VoxelType > class Sampler
+  {
+  public:
+    Sampler ( const osg::Image &volume ) :
+      _data ( volume.data() ),
+      _rowStride ( volume.getRowSizeInBytes() ),
+      _sliceStride ( volume.getImageSizeInBytes() ),
+      _pixelStride ( volume.getPixelSizeInBits() / 8 ),
+      _channel ( 0 )
+    {
+      OsgVolume::Voxels::scalarChannel ( volume.getPixelFormat(), _channel );
+      _size[0] = volume.s();
+      _size[1] = volume.t();
+      _size[2] = std::max ( 1, volume.r() );
+    }
+
+    float value ( unsigned int i, unsigned int j, unsigned int k ) const
+    {
+      return OsgVolume::Voxels::normalize ( reinterpret_cast < const VoxelType * > ( _data + k * _sliceStride + j * _rowStride + i * _pixelStride )[_channel] );
+    }
+
+    // Central differences, one-sided at the edges of the volume.
+    osg::Vec3 gradient ( unsigned int i, unsigned int j, unsigned int k, const osg::Vec3 &spacing ) const
+    {
+      const unsigned int p[3] = { i, j, k };
+      osg::Vec3 g;
+      for ( unsigned int a = 0; a < 3; ++a )
+      {
+        unsigned int lo[3] = { i, j, k }, hi[3] = { i, j, k };
+        lo[a] = ( p[a] > 0 ) ? p[a] - 1 : 0;
+        hi[a] = std::min ( p[a] + 1, _size[a] - 1 );
+        const float d ( static_cast < float > ( hi[a] - lo[a] ) * spacing[a] );
+        g[a] = ( d > 0.0f ) ? ( this->value ( hi[0], hi[1], hi[2] ) - this->value ( lo[0], lo[1], lo[2] ) ) / d : 0.0f;
+      }
+      return g;
+    }
+
+  private:
+
+    Sampler &operator = ( const Sampler & );
+
+    const unsigned char *_data;
+    unsigned int _rowStride;
+    unsigned int _sliceStride;
+    unsigned int _pixelStride;
+    unsigned int _channel;
+    unsigned int _size[3];
+  };
+
+  // What one slab of blocks made.  Vertices on the planes at each end are
+  // remembered so the slabs next to it can share them.
+  struct Slab
+  {
+    Slab() : k0 ( 0 ), k1 ( 0 ), width ( 0 ), height ( 0 )
+    {
+      lo[0] = lo[1] = 0;
+    }
+
+    unsigned int k0, k1;
+    unsigned int lo[2];
+    unsigned int width, height;
+    std::vector < unsigned int > blocks;
+    std::vector < osg::Vec3 > vertices;
+    std::vector < osg::Vec3 > normals;
+    std::vector < unsigned int > indices;
+    std::vector < unsigned int > first[2];
+    std::vector < unsigned int > last[2];
+    std::vector < unsigned int > remap;
+  };
+  typedef std::vector < Slab > Slabs;
+
+  // Indices of the vertices made on the edges of the planes below and
+  // above the layer of cubes, and on the edges between them.
+  struct Caches
+  {
+    std::vector < unsigned int > below[2];
+    std::vector < unsigned int > above[2];
+    std::vector < unsigned int > up;
+  };
+
+  // Marches the cubes of one slab of blocks.
+  template < class VoxelType > class Extract
+  {
+  public:
+    Extract ( const osg::Image &volume, const osg::BoundingBox &bb, unsigned int blockSize, unsigned int blocksAcross, float value, Slabs &slabs, const std::vector < unsigned int > &active ) :
+      _sampler ( volume ),
+      _blockSize ( blockSize ),
+      _blocksAcross ( blocksAcross ),
+      _value ( value ),
+      _slabs ( slabs ),
+      _active ( active )
+    {
+      _size[0] = volume.s();
+      _size[1] = volume.t();
+      _size[2] = std::max ( 1, volume.r() );
+
+      for ( unsigned int a = 0; a < 3; ++a )
+      {
+        _spacing[a] = ( bb._max[a] - bb._min[a] ) / _size[a];
+        _origin[a] = bb._min[a] + 0.5f * _spacing[a];
+      }
+    }
+
+    void operator () ( unsigned int index )
+    {
+      Slab &slab ( _slabs.at ( _active.at ( index ) ) );
+
+      // The voxels under the blocks, so the caches cover only them.
+      unsigned int lo[2] = { _size[0], _size[1] }, hi[2] = { 0, 0 };
+      for ( unsigned int b = 0; b < slab.blocks.size(); ++b )
+      {
+        const unsigned int block[2] = { slab.blocks[b] % _blocksAcross, slab.blocks[b] / _blocksAcross };
+        for ( unsigned int a = 0; a < 2; ++a )
+        {
+          lo[a] = std::min ( lo[a], block[a] * _blockSize );
+          hi[a] = std::max ( hi[a], std::min ( ( block[a] + 1 ) * _blockSize, _size[a] - 1 ) );
+        }
+      }
+      if ( lo[0] > hi[0] || lo[1] > hi[1] )
+        return;
+
+      slab.lo[0] = lo[0];
+      slab.lo[1] = lo[1];
+      slab.width = hi[0] - lo[0] + 1;
+      slab.height = hi[1] - lo[1] + 1;
+
+      const unsigned int area ( slab.width * slab.height );
+      Caches caches;
+      for ( unsigned int a = 0; a < 2; ++a )
+      {
+        caches.below[a].assign ( area, NONE );
+        caches.above[a].assign ( area, NONE );
+      }
+      caches.up.assign ( area, NONE );
+
+      for ( unsigned int k = slab.k0; k < slab.k1; ++k )
+      {
+        // The plane above the last layer is below this one.
+        if ( k > slab.k0 )
+        {
+          for ( unsigned int a = 0; a < 2; ++a )
+          {
+            caches.below[a].swap ( caches.above[a] );
+            std::fill ( caches.above[a].begin(), caches.above[a].end(), NONE );
+          }
+          std::fill ( caches.up.begin(), caches.up.end(), NONE );
+        }
+
+        for ( unsigned int b = 0; b < slab.blocks.size(); ++b )
+        {
+          const unsigned int bi ( slab.blocks[b] % _blocksAcross ), bj ( slab.blocks[b] / _blocksAcross );
+          const unsigned int i1 ( std::min ( ( bi + 1 ) * _blockSize, _size[0] - 1 ) );
+          const unsigned int j1 ( std::min ( ( bj + 1 ) * _blockSize, _size[1] - 1 ) );
+          for ( unsigned int j = bj * _blockSize; j < j1; ++j )
+          {
+            for ( unsigned int i = bi * _blockSize; i < i1; ++i )
+              this->_cube ( slab, caches, i, j, k );
+          }
+        }
+
+        if ( k == slab.k0 )
+        {
+          slab.first[0] = caches.below[0];
+          slab.first[1] = caches.below[1];
+        }
+      }
+
+      slab.last[0] = caches.above[0];
+      slab.last[1] = caches.above[1];
+    }
+
+  private:
+
+    Extract &operator = ( const Extract & );
+
+    void _cube ( Slab &slab, Caches &caches, unsigned int i, unsigned int j, unsigned int k )
+    {
+      float values[8];
+      unsigned int c ( 0 );
+      for ( unsigned int n = 0; n < 8; ++n )
+      {
+        values[n] = _sampler.value ( i + ( n & 1 ), j + ( ( n >> 1 ) & 1 ), k + ( ( n >> 2 ) & 1 ) );
+        if ( values[n] >= _value )
+          c |= 1 << n;
+      }
+
+      const unsigned char *edges ( tables.edges[c] );
+      for ( unsigned int n = 0; n < 3u * tables.count[c]; ++n )
+        slab.indices.push_back ( this->_vertex ( slab, caches, edges[n], i, j, k, values ) );
+    }
+
+    unsigned int _vertex ( Slab &slab, Caches &caches, unsigned int edge, unsigned int i, unsigned int j, unsigned int k, const float *values )
+    {
+      const unsigned int axis ( edge / 4 ), a ( Detail::corner ( edge ) ), b ( a | ( 1 << axis ) );
+      const unsigned int p[3] = { i + ( a & 1 ), j + ( ( a >> 1 ) & 1 ), k + ( ( a >> 2 ) & 1 ) };
+
+      const unsigned int cell ( ( p[1] - slab.lo[1] ) * slab.width + ( p[0] - slab.lo[0] ) );
+      unsigned int &cached ( ( 2 == axis ) ? caches.up[cell] : ( ( p[2] > k ) ? caches.above[axis][cell] : caches.below[axis][cell] ) );
+      if ( NONE != cached )
+        return cached;
+
+      const float t ( ( _value - values[a] ) / ( values[b] - values[a] ) );
+
+      osg::Vec3 position ( p[0], p[1], p[2] );
+      position[axis] += t;
+      for ( unsigned int n = 0; n < 3; ++n )
+        position[n] = _origin[n] + position[n] * _spacing[n];
+
+      const unsigned int q[3] = { p[0] + ( 0 == axis ? 1 : 0 ), p[1] + ( 1 == axis ? 1 : 0 ), p[2] + ( 2 == axis ? 1 : 0 ) };
+      osg::Vec3 normal ( _sampler.gradient ( p[0], p[1], p[2], _spacing ) * ( t - 1.0f ) - _sampler.gradient ( q[0], q[1], q[2], _spacing ) * t );
+      normal.normalize();
+
+      cached = static_cast < unsigned int > ( slab.vertices.size() );
+      slab.vertices.push_back ( position );
+      slab.normals.push_back ( normal );
+      return cached;
+    }
+
+    Sampler < VoxelType > _sampler;
+    unsigned int _size[3];
+    osg::Vec3 _origin;
+    osg::Vec3 _spacing;
+    unsigned int _blockSize;
+    unsigned int _blocksAcross;
+    float _value;
+    Slabs &_slabs;
+    const std::vector < unsigned int > &_active;
+  };
+
+  // Copies the slabs into the shared arrays.
+  struct Gather
+  {
+    Gather ( Slabs &slabs, const std::vector < unsigned int > &active, const std::vector < unsigned int > &offsets, osg::Vec3Array &vertices, osg::Vec3Array &normals, osg::DrawElementsUInt &triangles ) :
+      _slabs ( slabs ),
+      _active ( active ),
+      _offsets ( offsets ),
+      _vertices ( vertices ),
+      _normals ( normals ),
+      _triangles ( triangles )
+    {
+    }
+
+    void operator () ( unsigned int index )
+    {
+      Slab &slab ( _slabs.at ( _active.at ( index ) ) );
+
+      for ( unsigned int v = 0; v < slab.vertices.size(); ++v )
+      {
+        _vertices[slab.remap[v]] = slab.vertices[v];
+        _normals[slab.remap[v]] = slab.normals[v];
+      }
+
+      const unsigned int offset ( _offsets.at ( index ) );
+      for ( unsigned int n = 0; n < slab.indices.size(); ++n )
+        _triangles[offset + n] = slab.remap[slab.indices[n]];
+    }
+
+  private:
+
+    Gather &operator = ( const Gather & );
+
+    Slabs &_slabs;
+    const std::vector < unsigned int > &_active;
+    const std::vector < unsigned int > &_offsets;
+    osg::Vec3Array &_vertices;
+    osg::Vec3Array &_normals;
+    osg::DrawElementsUInt &_triangles;
+  };
+
+  // Run the extraction for the voxel type.
+  template < class VoxelType > inline void extract ( const osg::Image &volume, const osg::BoundingBox &bb, unsigned int blockSize, unsigned int blocksAcross, float value, Slabs &slabs, const std::vector < unsigned int > &active )
+  {
+    Extract < VoxelType > extract ( volume, bb, blockSize, blocksAcross, value, slabs, active );
+    OsgVolume::Parallel::forEach ( static_cast < unsigned int > ( active.size() ), extract );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+Isosurface::Isosurface ( const osg::Image *volume, const osg::BoundingBox &bb, unsigned int blockSize ) : BaseClass(),
+  _volume ( volume ),
+  _modifiedCount ( 0 ),
+  _bb ( bb ),
+  _cells ( 0x0 ),
+  _levels()
+{
+  if ( 0x0 == volume || 0x0 == volume->data() )
+    throw std::runtime_error ( "Error 1640275398: no volume given for the isosurface" );
+
+  if ( false == Voxels::supported ( volume->getDataType() ) )
+    throw std::runtime_error ( "Error 2873915064: volume data type not supported by the isosurface" );
+
+  // Without a scalar every voxel is opaque, and there is no surface to find.
+  unsigned int channel ( 0 );
+  if ( false == Voxels::scalarChannel ( volume->getPixelFormat(), channel ) )
+    throw std::runtime_error ( "Error 3057214689: volume pixel format has no scalar for the isosurface" );
+
+  _modifiedCount = volume->getModifiedCount();
+  _cells = new MacrocellGrid ( volume, blockSize );
+
+  this->_buildLevels();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+Isosurface::~Isosurface()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Build the tree of ranges.  The macrocells are the leaves, and each level
+//  above holds the range of two by two by two of the one below, until one
+//  node covers everything.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Isosurface::_buildLevels()
+{
+  Level leaves;
+  for ( unsigned int a = 0; a < 3; ++a )
+    leaves.size[a] = _cells->numCells ( a );
+
+  for ( unsigned int k = 0; k < leaves.size[2]; ++k )
+  {
+    for ( unsigned int j = 0; j < leaves.size[1]; ++j )
+    {
+      for ( unsigned int i = 0; i < leaves.size[0]; ++i )
+      {
+        leaves.minimum.push_back ( _cells->minimum ( i, j, k ) );
+        leaves.maximum.push_back ( _cells->maximum ( i, j, k ) );
+      }
+    }
+  }
+  _levels.push_back ( leaves );
+
+  while ( _levels.back().size[0] > 1 || _levels.back().size[1] > 1 || _levels.back().size[2] > 1 )
+  {
+    const Level &below ( _levels.back() );
+
+    Level level;
+    for ( unsigned int a = 0; a < 3; ++a )
+      level.size[a] = ( below.size[a] + 1 ) / 2;
+
+    const unsigned int num ( level.size[0] * level.size[1] * level.size[2] );
+    level.minimum.resize ( num, 1.0f );
+    level.maximum.resize ( num, 0.0f );
+
+    for ( unsigned int k = 0; k < below.size[2]; ++k )
+    {
+      for ( unsigned int j = 0; j < below.size[1]; ++j )
+      {
+        for ( unsigned int i = 0; i < below.size[0]; ++i )
+        {
+          const unsigned int from ( ( k * below.size[1] + j ) * below.size[0] + i );
+          const unsigned int to ( ( ( k / 2 ) * level.size[1] + j / 2 ) * level.size[0] + i / 2 );
+          level.minimum[to] = std::min ( level.minimum[to], below.minimum[from] );
+          level.maximum[to] = std::max ( level.maximum[to], below.maximum[from] );
+        }
+      }
+    }
+
+    _levels.push_back ( level );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Was this built from the volume as it is now?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool Isosurface::current ( const osg::Image *volume ) const
+{
+  return ( volume == _volume.get() && 0x0 != volume && volume->getModifiedCount() == _modifiedCount &&
+           _cells->volumeSize ( 0 ) == static_cast < unsigned int > ( volume->s() ) &&
+           _cells->volumeSize ( 1 ) == static_cast < unsigned int > ( volume->t() ) &&
+           _cells->volumeSize ( 2 ) == static_cast < unsigned int > ( std::max ( 1, volume->r() ) ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the box the surfaces are made in.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::BoundingBox& Isosurface::boundingBox() const
+{
+  return _bb;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of blocks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int Isosurface::numBlocks() const
+{
+  return static_cast < unsigned int > ( _levels.front().minimum.size() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of blocks the value passes through.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int Isosurface::numActiveBlocks ( float value ) const
+{
+  SlabBlocks slabs;
+  this->_activeBlocks ( value, slabs );
+
+  unsigned int num ( 0 );
+  for ( unsigned int k = 0; k < slabs.size(); ++k )
+    num += static_cast < unsigned int > ( slabs[k].size() );
+  return num;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Find the blocks the value passes through, by slab.  Blocks are numbered
+//  across each slab.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Isosurface::_activeBlocks ( float value, SlabBlocks &slabs ) const
+{
+  slabs.clear();
+  slabs.resize ( _levels.front().size[2] );
+  this->_activeBlocks ( value, static_cast < unsigned int > ( _levels.size() - 1 ), 0, 0, 0, slabs );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Look under the node if the value is in its range.  A cube has part of
+//  the surface when some corners are below the value and some are not.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Isosurface::_activeBlocks ( float value, unsigned int level, unsigned int i, unsigned int j, unsigned int k, SlabBlocks &slabs ) const
+{
+  const Level &node ( _levels.at ( level ) );
+  if ( i >= node.size[0] || j >= node.size[1] || k >= node.size[2] )
+    return;
+
+  const unsigned int index ( ( k * node.size[1] + j ) * node.size[0] + i );
+  if ( false == ( node.minimum[index] < value && node.maximum[index] >= value ) )
+    return;
+
+  if ( 0 == level )
+  {
+    slabs.at ( k ).push_back ( j * node.size[0] + i );
+    return;
+  }
+
+  for ( unsigned int n = 0; n < 8; ++n )
+    this->_activeBlocks ( value, level - 1, 2 * i + ( n & 1 ), 2 * j + ( ( n >> 1 ) & 1 ), 2 * k + ( ( n >> 2 ) & 1 ), slabs );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Make the surface.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Geometry* Isosurface::extract ( float value ) const
+{
+  osg::ref_ptr < osg::Vec3Array > vertices ( new osg::Vec3Array );
+  osg::ref_ptr < osg::Vec3Array > normals ( new osg::Vec3Array );
+  osg::ref_ptr < osg::DrawElementsUInt > triangles ( new osg::DrawElementsUInt ( osg::PrimitiveSet::TRIANGLES ) );
+
+  this->extract ( value, *vertices, *normals, *triangles );
+
+  osg::ref_ptr < osg::Geometry > geometry ( new osg::Geometry );
+  geometry->setVertexArray ( vertices.get() );
+  geometry->setNormalArray ( normals.get() );
+  geometry->setNormalBinding ( osg::Geometry::BIND_PER_VERTEX );
+  if ( false == triangles->empty() )
+    geometry->addPrimitiveSet ( triangles.get() );
+
+  return geometry.release();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Make the surface into arrays.  The slabs each make their own vertices,
+//  then the ones on a plane two slabs share are joined, and the slabs are
+//  copied into the arrays.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Isosurface::extract ( float value, osg::Vec3Array &vertices, osg::Vec3Array &normals, osg::DrawElementsUInt &triangles ) const
+{
+  vertices.clear();
+  normals.clear();
+  triangles.clear();
+
+  const osg::Image &volume ( *_volume );
+  const unsigned int blockSize ( _cells->cellSize() );
+  const unsigned int depth ( _cells->volumeSize ( 2 ) );
+  if ( depth < 2 || _cells->volumeSize ( 0 ) < 2 || _cells->volumeSize ( 1 ) < 2 )
+    return;
+
+  SlabBlocks blocks;
+  this->_activeBlocks ( value, blocks );
+
+  // The slabs with something in them.
+  Detail::Slabs slabs ( blocks.size() );
+  std::vector < unsigned int > active;
+  for ( unsigned int s = 0; s < blocks.size(); ++s )
+  {
+    slabs[s].k0 = s * blockSize;
+    slabs[s].k1 = std::min ( ( s + 1 ) * blockSize, depth - 1 );
+    if ( false == blocks[s].empty() && slabs[s].k0 < slabs[s].k1 )
+    {
+      slabs[s].blocks.swap ( blocks[s] );
+      active.push_back ( s );
+    }
+  }
+
+  if ( active.empty() )
+    return;
+
+  const unsigned int across ( _levels.front().size[0] );
+  switch ( volume.getDataType() )
+  {
+  case GL_UNSIGNED_BYTE:
+    Detail::extract < unsigned char > ( volume, _bb, blockSize, across, value, slabs, active );
+    break;
+  case GL_UNSIGNED_SHORT:
+    Detail::extract < unsigned short > ( volume, _bb, blockSize, across, value, slabs, active );
+    break;
+  case GL_FLOAT:
+    Detail::extract < float > ( volume, _bb, blockSize, across, value, slabs, active );
+    break;
+  }
+
+  // Join the vertices on the plane between each slab and the one before.
+  unsigned int numVertices ( 0 ), numIndices ( 0 );
+  std::vector < unsigned int > offsets;
+  for ( unsigned int n = 0; n < active.size(); ++n )
+  {
+    Detail::Slab &slab ( slabs[active[n]] );
+    slab.remap.assign ( slab.vertices.size(), Detail::NONE );
+
+    const Detail::Slab *before ( ( n > 0 && active[n - 1] + 1 == active[n] ) ? &slabs[active[n - 1]] : 0x0 );
+    if ( 0x0 != before && false == slab.first[0].empty() && false == before->last[0].empty() )
+    {
+      const unsigned int i0 ( std::max ( slab.lo[0], before->lo[0] ) ), i1 ( std::min ( slab.lo[0] + slab.width, before->lo[0] + before->width ) );
+      const unsigned int j0 ( std::max ( slab.lo[1], before->lo[1] ) ), j1 ( std::min ( slab.lo[1] + slab.height, before->lo[1] + before->height ) );
+      for ( unsigned int j = j0; j < j1; ++j )
+      {
+        for ( unsigned int i = i0; i < i1; ++i )
+        {
+          const unsigned int here ( ( j - slab.lo[1] ) * slab.width + ( i - slab.lo[0] ) );
+          const unsigned int there ( ( j - before->lo[1] ) * before->width + ( i - before->lo[0] ) );
+          for ( unsigned int a = 0; a < 2; ++a )
+          {
+            if ( Detail::NONE != slab.first[a][here] && Detail::NONE != before->last[a][there] )
+              slab.remap[slab.first[a][here]] = before->remap[before->last[a][there]];
+          }
+        }
+      }
+    }
+
+    for ( unsigned int v = 0; v < slab.remap.size(); ++v )
+    {
+      if ( Detail::NONE == slab.remap[v] )
+        slab.remap[v] = numVertices++;
+    }
+
+    offsets.push_back ( numIndices );
+    numIndices += static_cast < unsigned int > ( slab.indices.size() );
+  }
+
+  vertices.resize ( numVertices );
+  normals.resize ( numVertices );
+  triangles.resize ( numIndices );
+
+  Detail::Gather gather ( slabs, active, offsets, vertices, normals, triangles );
+  OsgVolume::Parallel::forEach ( static_cast < unsigned int > ( active.size() ), gather );
+}
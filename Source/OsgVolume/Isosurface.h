@@ -0,0 +1,102 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Marching cubes over the scalar channel of a volume.  The macrocells keep
+//  the range of each block of voxels, and a tree of coarser ranges above
+//  them finds the blocks a value passes through without looking at the
+//  rest.  Each slab of blocks is extracted on its own processor, and the
+//  vertices the slabs share are joined afterwards.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_ISOSURFACE_H__
+#define __OSGTOOLS_VOLUME_ISOSURFACE_H__
+
+#include "OsgVolume/Export.h"
+#include "OsgVolume/MacrocellGrid.h"
+
+#include "Usul/Base/Referenced.h"
+#include "Usul/Pointers/Pointers.h"
+
+#include "osg/Array"
+#include "osg/BoundingBox"
+#include "osg/Geometry"
+#include "osg/Image"
+#include "osg/PrimitiveSet"
+#include "osg/ref_ptr"
+
+#include <vector>
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT Isosurface : public Usul::Base::Referenced
+{
+public:
+  /// Typedefs.
+  typedef Usul::Base::Referenced                 BaseClass;
+
+  USUL_DECLARE_REF_POINTERS ( Isosurface );
+
+  /// Construction.  Builds the ranges of the blocks.  The box is the one the
+  /// volume is drawn in, with the voxels at the centers of its cells.  The
+  /// pixel format must have a scalar, as Voxels::scalarChannel() says.
+  Isosurface ( const osg::Image *volume, const osg::BoundingBox &bb, unsigned int blockSize = 8 );
+
+  /// Was this built from the volume as it is now?
+  bool                             current ( const osg::Image *volume ) const;
+
+  /// Get the box the surfaces are made in.
+  const osg::BoundingBox&          boundingBox () const;
+
+  /// Get the number of blocks, and the number a value passes through.
+  unsigned int                     numBlocks () const;
+  unsigned int                     numActiveBlocks ( float value ) const;
+
+  /// Make the surface where the scalar, in [0,1], equals the value.  The
+  /// normals point toward lower scalars.
+  osg::Geometry*                   extract ( float value ) const;
+
+  /// Same, into arrays.  Each three indices are a triangle.
+  void                             extract ( float value, osg::Vec3Array &vertices, osg::Vec3Array &normals, osg::DrawElementsUInt &triangles ) const;
+
+protected:
+  virtual ~Isosurface();
+
+  struct Level
+  {
+    unsigned int size[3];
+    std::vector < float > minimum;
+    std::vector < float > maximum;
+  };
+  typedef std::vector < Level > Levels;
+  typedef std::vector < std::vector < unsigned int > > SlabBlocks;
+
+  void                             _buildLevels ();
+  void                             _activeBlocks ( float value, SlabBlocks &slabs ) const;
+  void                             _activeBlocks ( float value, unsigned int level, unsigned int i, unsigned int j, unsigned int k, SlabBlocks &slabs ) const;
+
+private:
+
+  Isosurface ( const Isosurface & );
+  Isosurface &operator = ( const Isosurface & );
+
+  osg::ref_ptr < const osg::Image > _volume;
+  unsigned int                  _modifiedCount;
+  osg::BoundingBox              _bb;
+  MacrocellGrid::RefPtr         _cells;
+  Levels                        _levels;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_ISOSURFACE_H__
@@ -0,0 +1,227 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Draws a volume's proxy geometry with the texture of one pyramid level.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/LevelDrawable.h"
+
+#include "osgUtil/CullVisitor"
+
+#include "osg/Notify"
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor
+//
+///////////////////////////////////////////////////////////////////////////////
+
+LevelDrawable::Cull::Cull ( VolumePyramid *pyramid, unsigned int level ) :
+  _pyramid ( pyramid ),
+  _level ( level )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor
+//
+///////////////////////////////////////////////////////////////////////////////
+
+LevelDrawable::Cull::~Cull()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Return true to leave the drawable out of this view.  The callback has
+//  no state of its own, so views may cull at the same time.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool LevelDrawable::Cull::cull ( osg::NodeVisitor *nv, osg::Drawable *drawable, osg::State * ) const
+{
+  osgUtil::CullVisitor *cv ( dynamic_cast < osgUtil::CullVisitor * > ( nv ) );
+  if ( 0x0 == cv || 0x0 == drawable || false == _pyramid.valid() )
+    return false;
+
+  return _level != LevelDrawable::levelFor ( *_pyramid, *cv, drawable->getBound() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor
+//
+///////////////////////////////////////////////////////////////////////////////
+
+LevelDrawable::LevelDrawable() :
+  BaseClass(),
+  _drawn ( 0x0 ),
+  _level ( 0 )
+{
+  this->setUseDisplayList( false );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor
+//
+///////////////////////////////////////////////////////////////////////////////
+
+LevelDrawable::LevelDrawable ( osg::Drawable *drawn, VolumePyramid *pyramid, unsigned int level, osg::StateSet *ss ) :
+  BaseClass(),
+  _drawn ( drawn ),
+  _level ( level )
+{
+  this->setUseDisplayList( false );
+  this->setStateSet ( ss );
+  this->setCullCallback ( new Cull ( pyramid, level ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor
+//
+///////////////////////////////////////////////////////////////////////////////
+
+LevelDrawable::LevelDrawable ( const LevelDrawable &d, const osg::CopyOp &options ) :
+  BaseClass ( d, options ),
+  _drawn ( d._drawn ),
+  _level ( d._level )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor
+//
+///////////////////////////////////////////////////////////////////////////////
+
+LevelDrawable::~LevelDrawable()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Overload of osg::Object::cloneType()
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Object *LevelDrawable::cloneType() const
+{
+  return new LevelDrawable;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Overload of osg::Object::clone()
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Object *LevelDrawable::clone ( const osg::CopyOp &options ) const
+{
+  return new LevelDrawable ( *this, options );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the drawable drawn.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Drawable *LevelDrawable::drawn() const
+{
+  return _drawn.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the level drawn from.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int LevelDrawable::level() const
+{
+  return _level;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The level with about a voxel for each pixel the box covers in the view.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int LevelDrawable::levelFor ( const VolumePyramid &pyramid, osgUtil::CullVisitor &cv, const osg::BoundingBox &bb )
+{
+  if ( false == bb.valid() )
+    return 0;
+
+  return pyramid.levelFor ( cv.pixelSize ( bb.center(), bb.radius() ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The bound of the drawable drawn.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::BoundingBox LevelDrawable::computeBound() const
+{
+  return ( _drawn.valid() ) ? _drawn->getBound() : osg::BoundingBox();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Draw the wrapped drawable.  Our state set, with the level's texture, is
+//  already applied.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void LevelDrawable::drawImplementation( DrawArgs ) const
+{
+  if ( false == _drawn.valid() )
+    return;
+
+  try
+  {
+#if OSG_VERSION_MAJOR <= 1 && OSG_VERSION_MINOR <= 2
+    _drawn->drawImplementation ( state );
+#else
+    _drawn->drawImplementation ( info );
+#endif
+  }
+  catch ( const std::exception &e )
+  {
+    const std::string message ( ( e.what() ) ? e.what() : "Error 2417730958: standard exception caught" );
+    osg::notify ( osg::WARN ) << message.c_str() << std::endl;
+  }
+  catch ( ... )
+  {
+    osg::notify ( osg::WARN ) << "Error 1596402381: unknown exception caught" << std::endl;
+  }
+}
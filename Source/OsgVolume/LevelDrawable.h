@@ -0,0 +1,93 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Draws a volume's proxy geometry with the texture of one level of its
+//  pyramid.  Each level is its own drawable with its own state set, and a
+//  cull callback keeps only the level that suits the view, so views that
+//  see the volume at different sizes draw different levels.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_LEVEL_DRAWABLE_H__
+#define __OSGTOOLS_VOLUME_LEVEL_DRAWABLE_H__
+
+#include "OsgVolume/Export.h"
+#include "OsgVolume/PlanarProxyGeometry.h"
+#include "OsgVolume/VolumePyramid.h"
+
+#include "osg/Drawable"
+
+namespace osgUtil { class CullVisitor; }
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT LevelDrawable : public osg::Drawable
+{
+public:
+  // Typedefs.
+  typedef osg::Drawable                            BaseClass;
+
+  // Culls the drawable it is on unless the view wants the given level.
+  // The drawable of the whole image gets one for level zero.
+  class OSG_VOLUME_EXPORT Cull : public osg::Drawable::CullCallback
+  {
+  public:
+    Cull ( VolumePyramid *pyramid, unsigned int level );
+
+    virtual bool              cull ( osg::NodeVisitor *nv, osg::Drawable *drawable, osg::State *state ) const;
+
+  protected:
+    virtual ~Cull();
+
+  private:
+    VolumePyramid::RefPtr     _pyramid;
+    unsigned int              _level;
+  };
+
+  // Construction.
+  LevelDrawable();
+  LevelDrawable ( osg::Drawable *drawn, VolumePyramid *pyramid, unsigned int level, osg::StateSet *ss );
+  LevelDrawable ( const LevelDrawable &d, const osg::CopyOp &options = osg::CopyOp::SHALLOW_COPY );
+
+  // Implementation of osg::Object's cloning functions.
+  virtual osg::Object         *clone ( const osg::CopyOp &options ) const;
+  virtual osg::Object         *cloneType() const;
+
+  // Draw.
+  virtual void                drawImplementation( DrawArgs ) const;
+
+  // Get the drawable drawn and the level drawn from.
+  osg::Drawable *             drawn() const;
+  unsigned int                level() const;
+
+  // The level that suits a box in the visitor's view.
+  static unsigned int         levelFor ( const VolumePyramid &pyramid, osgUtil::CullVisitor &cv, const osg::BoundingBox &bb );
+
+protected:
+
+  // Use reference counting.
+  virtual ~LevelDrawable();
+
+  virtual osg::BoundingBox    computeBound() const;
+
+private:
+
+  LevelDrawable &operator = ( const LevelDrawable & );
+
+  osg::ref_ptr < osg::Drawable > _drawn;
+  unsigned int                _level;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_LEVEL_DRAWABLE_H__
@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  LZ4 blocks, made and read by the LZ4 library.  Its sizes are ints, so
+//  blocks larger than it takes are refused here.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/Lz4.h"
+
+#include "lz4.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Largest number of bytes a block of the given size can compress to.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+std::size_t Lz4::bound ( std::size_t size )
+{
+  if ( size > static_cast < std::size_t > ( LZ4_MAX_INPUT_SIZE ) )
+    return 0;
+
+  return static_cast < std::size_t > ( ::LZ4_compressBound ( static_cast < int > ( size ) ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Compress the bytes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+std::size_t Lz4::compress ( const unsigned char *in, std::size_t size, unsigned char *out, std::size_t capacity )
+{
+  if ( size > static_cast < std::size_t > ( LZ4_MAX_INPUT_SIZE ) )
+    return 0;
+
+  // The library never writes more than it is told it may.
+  const int room ( static_cast < int > ( std::min < std::size_t > ( capacity, static_cast < std::size_t > ( ::LZ4_compressBound ( static_cast < int > ( size ) ) ) ) ) );
+  const int written ( ::LZ4_compress_default ( reinterpret_cast < const char * > ( in ), reinterpret_cast < char * > ( out ), static_cast < int > ( size ), room ) );
+
+  return ( written > 0 ) ? static_cast < std::size_t > ( written ) : 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Decompress the block.  The library checks every length and offset
+//  against both buffers, so a broken block cannot read or write past them.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Lz4::decompress ( const unsigned char *in, std::size_t size, unsigned char *out, std::size_t outSize )
+{
+  const std::size_t most ( static_cast < std::size_t > ( LZ4_MAX_INPUT_SIZE ) );
+  if ( size > most || outSize > most )
+    throw std::runtime_error ( "Error 1062835497: LZ4 block is not the expected size" );
+
+  const int made ( ::LZ4_decompress_safe ( reinterpret_cast < const char * > ( in ), reinterpret_cast < char * > ( out ), static_cast < int > ( size ), static_cast < int > ( outSize ) ) );
+  if ( made < 0 )
+    throw std::runtime_error ( "Error 3380147562: LZ4 block is broken" );
+
+  if ( static_cast < std::size_t > ( made ) != outSize )
+    throw std::runtime_error ( "Error 1062835497: LZ4 block is not the expected size" );
+}
@@ -0,0 +1,45 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Compress and decompress blocks in the LZ4 block format with the LZ4
+//  library, which the build must link.  LZ4 trades ratio for speed, which
+//  suits voxels that are read far more often than they are written.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_LZ4_H__
+#define __OSGTOOLS_VOLUME_LZ4_H__
+
+#include "OsgVolume/Export.h"
+
+#include <cstddef>
+
+namespace OsgVolume {
+namespace Lz4 {
+
+
+/// Largest number of bytes a block of the given size can compress to.
+OSG_VOLUME_EXPORT std::size_t   bound ( std::size_t size );
+
+/// Compress the bytes.  Returns the size of the block, or zero if it does
+/// not fit in the capacity.
+OSG_VOLUME_EXPORT std::size_t   compress ( const unsigned char *in, std::size_t size, unsigned char *out, std::size_t capacity );
+
+/// Decompress the block into exactly the given number of bytes.  Throws if
+/// the block is broken or does not make that many.
+OSG_VOLUME_EXPORT void          decompress ( const unsigned char *in, std::size_t size, unsigned char *out, std::size_t outSize );
+
+
+} // namespace Lz4
+} // namespace OsgVolume
+
+
+#endif // __OSGTOOLS_VOLUME_LZ4_H__
@@ -0,0 +1,491 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Coarse min/max grid for skipping empty space.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/MacrocellGrid.h"
+#include "OsgVolume/Parallel.h"
+#include "OsgVolume/Voxels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for building the grid.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // Find the range of each cell in one slab of cells.  Linear filtering
+  // reads one voxel past each face of the cell, so the range includes them.
+  template < class VoxelType > class MacrocellRange
+  {
+  public:
+    MacrocellRange ( const osg::Image &volume, unsigned int channel, unsigned int cellSize, const unsigned int *size, const unsigned int *cells, float *minimum, float *maximum ) :
+      _data ( volume.data() ),
+      _rowStride ( volume.getRowSizeInBytes() ),
+      _sliceStride ( volume.getImageSizeInBytes() ),
+      _pixelStride ( volume.getPixelSizeInBits() / 8 ),
+      _channel ( channel ),
+      _cellSize ( cellSize ),
+      _size ( size ),
+      _cells ( cells ),
+      _minimum ( minimum ),
+      _maximum ( maximum )
+    {
+    }
+
+    void operator () ( unsigned int kc )
+    {
+      for ( unsigned int jc = 0; jc < _cells[1]; ++jc )
+      {
+        for ( unsigned int ic = 0; ic < _cells[0]; ++ic )
+        {
+          unsigned int first[3], last[3];
+          const unsigned int cell[3] = { ic, jc, kc };
+          for ( unsigned int a = 0; a < 3; ++a )
+          {
+            first[a] = ( cell[a] * _cellSize > 0 ) ? cell[a] * _cellSize - 1 : 0;
+            last[a] = std::min ( ( cell[a] + 1 ) * _cellSize, _size[a] - 1 );
+          }
+
+          VoxelType low  ( this->_voxel ( first[0], first[1], first[2] ) );
+          VoxelType high ( low );
+
+          for ( unsigned int k = first[2]; k <= last[2]; ++k )
+          {
+            for ( unsigned int j = first[1]; j <= last[1]; ++j )
+            {
+              const unsigned char *row ( _data + k * _sliceStride + j * _rowStride + _channel * sizeof ( VoxelType ) );
+              for ( unsigned int i = first[0]; i <= last[0]; ++i )
+              {
+                const VoxelType v ( *reinterpret_cast < const VoxelType * > ( row + i * _pixelStride ) );
+                low = std::min ( low, v );
+                high = std::max ( high, v );
+              }
+            }
+          }
+
+          const unsigned int index ( ( kc * _cells[1] + jc ) * _cells[0] + ic );
+          _minimum[index] = OsgVolume::Voxels::normalize ( low );
+          _maximum[index] = OsgVolume::Voxels::normalize ( high );
+        }
+      }
+    }
+
+  private:
+
+    MacrocellRange &operator = ( const MacrocellRange & );
+
+    VoxelType _voxel ( unsigned int i, unsigned int j, unsigned int k ) const
+    {
+      return reinterpret_cast < const VoxelType * > ( _data + k * _sliceStride + j * _rowStride + i * _pixelStride )[_channel];
+    }
+
+    const unsigned char *_data;
+    unsigned int _rowStride;
+    unsigned int _sliceStride;
+    unsigned int _pixelStride;
+    unsigned int _channel;
+    unsigned int _cellSize;
+    const unsigned int *_size;
+    const unsigned int *_cells;
+    float *_minimum;
+    float *_maximum;
+  };
+
+  template < class VoxelType > inline void buildMacrocells ( const osg::Image &volume, unsigned int channel, unsigned int cellSize, const unsigned int *size, const unsigned int *cells, float *minimum, float *maximum )
+  {
+    MacrocellRange < VoxelType > range ( volume, channel, cellSize, size, cells, minimum, maximum );
+    OsgVolume::Parallel::forEach ( cells[2], range );
+  }
+
+  // Transfer function entries that can show through linear filtering of scalar s.
+  inline void transferFunctionEntries ( float s, unsigned int size, unsigned int &first, unsigned int &last )
+  {
+    const int i ( static_cast < int > ( std::floor ( s * static_cast < float > ( size ) - 0.5f ) ) );
+    first = static_cast < unsigned int > ( std::min ( std::max ( i,     0 ), static_cast < int > ( size ) - 1 ) );
+    last  = static_cast < unsigned int > ( std::min ( std::max ( i + 1, 0 ), static_cast < int > ( size ) - 1 ) );
+  }
+
+  // Which entries of the transfer function have any opacity?
+  inline void visibleEntries ( const osg::Image *image, std::vector < unsigned char > &visible )
+  {
+    visible.clear();
+    if ( 0x0 == image || 0x0 == image->data() || image->s() <= 0 || GL_RGBA != image->getPixelFormat() )
+      return;
+
+    const unsigned int size ( image->s() );
+    visible.resize ( size, 1 );
+
+    if ( GL_FLOAT == image->getDataType() )
+    {
+      const float *data ( reinterpret_cast < const float * > ( image->data() ) );
+      for ( unsigned int i = 0; i < size; ++i )
+        visible[i] = ( data[i * 4 + 3] > 0.0f ) ? 1 : 0;
+    }
+    else if ( GL_UNSIGNED_BYTE == image->getDataType() )
+    {
+      const unsigned char *data ( image->data() );
+      for ( unsigned int i = 0; i < size; ++i )
+        visible[i] = ( data[i * 4 + 3] > 0 ) ? 1 : 0;
+    }
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+MacrocellGrid::MacrocellGrid ( const osg::Image *volume, unsigned int cellSize ) : BaseClass(),
+  _cellSize ( std::max ( 1u, cellSize ) ),
+  _minimum(),
+  _maximum(),
+  _volumeMinimum ( 0.0f ),
+  _volumeMaximum ( 0.0f ),
+  _visible(),
+  _numEmpty ( 0 ),
+  _image ( new osg::Image ),
+  _rangeImage ( new osg::Image )
+{
+  if ( 0x0 == volume || 0x0 == volume->data() )
+    throw std::runtime_error ( "Error 2236605198: no volume given for the macrocell grid" );
+
+  if ( false == Voxels::supported ( volume->getDataType() ) )
+    throw std::runtime_error ( "Error 3701942876: volume data type not supported by the macrocell grid" );
+
+  _volumeSize[0] = volume->s();
+  _volumeSize[1] = volume->t();
+  _volumeSize[2] = std::max ( 1, volume->r() );
+
+  for ( unsigned int a = 0; a < 3; ++a )
+    _numCells[a] = ( _volumeSize[a] + _cellSize - 1 ) / _cellSize;
+
+  const unsigned int num ( _numCells[0] * _numCells[1] * _numCells[2] );
+  _minimum.resize ( num, 0.0f );
+  _maximum.resize ( num, 0.0f );
+
+  // Formats without a scalar are drawn with an alpha of one everywhere.
+  unsigned int channel ( 0 );
+  const bool constant ( false == Voxels::scalarChannel ( volume->getPixelFormat(), channel ) );
+
+  if ( constant )
+  {
+    std::fill ( _minimum.begin(), _minimum.end(), 1.0f );
+    std::fill ( _maximum.begin(), _maximum.end(), 1.0f );
+  }
+  else
+  {
+    switch ( volume->getDataType() )
+    {
+    case GL_UNSIGNED_BYTE:
+      Detail::buildMacrocells < unsigned char > ( *volume, channel, _cellSize, _volumeSize, _numCells, &_minimum[0], &_maximum[0] );
+      break;
+    case GL_UNSIGNED_SHORT:
+      Detail::buildMacrocells < unsigned short > ( *volume, channel, _cellSize, _volumeSize, _numCells, &_minimum[0], &_maximum[0] );
+      break;
+    case GL_FLOAT:
+      Detail::buildMacrocells < float > ( *volume, channel, _cellSize, _volumeSize, _numCells, &_minimum[0], &_maximum[0] );
+      break;
+    }
+  }
+
+  // Until classified nothing is empty.
+  _image->allocateImage ( _numCells[0], _numCells[1], _numCells[2], GL_ALPHA, GL_UNSIGNED_BYTE );
+  std::fill ( _image->data(), _image->data() + num, 255 );
+
+  if ( num > 0 )
+  {
+    _volumeMinimum = *std::min_element ( _minimum.begin(), _minimum.end() );
+    _volumeMaximum = *std::max_element ( _maximum.begin(), _maximum.end() );
+  }
+
+  // The ranges in bytes, with the minimum rounded down and the maximum up.
+  _rangeImage->allocateImage ( _numCells[0], _numCells[1], _numCells[2], GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE );
+  unsigned char *range ( _rangeImage->data() );
+  for ( unsigned int i = 0; i < num; ++i )
+  {
+    const float low  ( std::min ( std::max ( _minimum[i], 0.0f ), 1.0f ) );
+    const float high ( std::min ( std::max ( _maximum[i], 0.0f ), 1.0f ) );
+    range[i * 2 + 0] = static_cast < unsigned char > ( std::floor ( low  * 255.0f ) );
+    range[i * 2 + 1] = static_cast < unsigned char > ( std::ceil  ( high * 255.0f ) );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+MacrocellGrid::~MacrocellGrid()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the cell size.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int MacrocellGrid::cellSize () const
+{
+  return _cellSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of cells along the axis.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int MacrocellGrid::numCells ( unsigned int axis ) const
+{
+  return _numCells[axis];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of voxels along the axis.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int MacrocellGrid::volumeSize ( unsigned int axis ) const
+{
+  return _volumeSize[axis];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the index of the cell.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int MacrocellGrid::_index ( unsigned int i, unsigned int j, unsigned int k ) const
+{
+  return ( k * _numCells[1] + j ) * _numCells[0] + i;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the minimum of the cell.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+float MacrocellGrid::minimum ( unsigned int i, unsigned int j, unsigned int k ) const
+{
+  return _minimum.at ( this->_index ( i, j, k ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the maximum of the cell.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+float MacrocellGrid::maximum ( unsigned int i, unsigned int j, unsigned int k ) const
+{
+  return _maximum.at ( this->_index ( i, j, k ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the minimum of the volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+float MacrocellGrid::minimum () const
+{
+  return _volumeMinimum;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the maximum of the volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+float MacrocellGrid::maximum () const
+{
+  return _volumeMaximum;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Is the cell empty?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool MacrocellGrid::empty ( unsigned int i, unsigned int j, unsigned int k ) const
+{
+  return 0 == _image->data()[this->_index ( i, j, k )];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the fraction of empty cells.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double MacrocellGrid::emptyFraction () const
+{
+  return ( _minimum.empty() ) ? 0.0 : static_cast < double > ( _numEmpty ) / _minimum.size();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* MacrocellGrid::image ()
+{
+  return _image.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::Image* MacrocellGrid::image () const
+{
+  return _image.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Classify the cells against the transfer function.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool MacrocellGrid::classify ( const TransferFunction *tf )
+{
+  std::vector < unsigned char > visible;
+  Detail::visibleEntries ( ( 0x0 != tf ) ? tf->image() : 0x0, visible );
+
+  // Find the entries that changed.  A new size means all of them.
+  const unsigned int size ( visible.size() );
+  unsigned int first ( 0 ), last ( 0 );
+  if ( size != _visible.size() )
+  {
+    last = ( size > 0 ) ? size - 1 : 0;
+  }
+  else
+  {
+    unsigned int i ( 0 );
+    while ( i < size && visible[i] == _visible[i] )
+      ++i;
+    if ( i == size )
+      return false;
+    first = i;
+    last = size - 1;
+    while ( last > first && visible[last] == _visible[last] )
+      --last;
+  }
+
+  _visible.swap ( visible );
+
+  // Without a usable transfer function nothing can be skipped.
+  if ( 0 == size )
+  {
+    const bool changed ( _numEmpty > 0 );
+    std::fill ( _image->data(), _image->data() + _minimum.size(), 255 );
+    _numEmpty = 0;
+    if ( changed )
+      _image->dirty();
+    return changed;
+  }
+
+  // Running count of visible entries, so a range is checked in constant time.
+  std::vector < unsigned int > count ( size + 1, 0 );
+  for ( unsigned int i = 0; i < size; ++i )
+    count[i + 1] = count[i] + _visible[i];
+
+  bool changed ( false );
+  unsigned char *cells ( _image->data() );
+  for ( unsigned int c = 0; c < _minimum.size(); ++c )
+  {
+    unsigned int low ( 0 ), high ( 0 ), unused ( 0 );
+    Detail::transferFunctionEntries ( _minimum[c], size, low, unused );
+    Detail::transferFunctionEntries ( _maximum[c], size, unused, high );
+
+    // Skip cells that can not see the change.
+    if ( high < first || low > last )
+      continue;
+
+    const unsigned char value ( ( count[high + 1] - count[low] > 0 ) ? 255 : 0 );
+    if ( value != cells[c] )
+    {
+      if ( 0 == value )
+        ++_numEmpty;
+      else
+        --_numEmpty;
+      cells[c] = value;
+      changed = true;
+    }
+  }
+
+  if ( changed )
+    _image->dirty();
+
+  return changed;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the ranges as an image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* MacrocellGrid::rangeImage ()
+{
+  return _rangeImage.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the ranges as an image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::Image* MacrocellGrid::rangeImage () const
+{
+  return _rangeImage.get();
+}
@@ -0,0 +1,110 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Coarse grid of cells that hold the minimum and maximum scalar of the
+//  voxels they cover.  Classifying the cells against a transfer function
+//  tells which ones are fully transparent so rays can jump over them.  The
+//  ranges themselves tell projections which cells cannot change a ray.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_MACROCELL_GRID_H__
+#define __OSGTOOLS_VOLUME_MACROCELL_GRID_H__
+
+#include "OsgVolume/Export.h"
+#include "OsgVolume/TransferFunction.h"
+
+#include "Usul/Base/Referenced.h"
+#include "Usul/Pointers/Pointers.h"
+
+#include "osg/Image"
+#include "osg/ref_ptr"
+
+#include <vector>
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT MacrocellGrid : public Usul::Base::Referenced
+{
+public:
+  /// Typedefs.
+  typedef Usul::Base::Referenced                 BaseClass;
+  typedef OsgVolume::TransferFunction            TransferFunction;
+
+  USUL_DECLARE_REF_POINTERS ( MacrocellGrid );
+
+  /// Construction.  Builds the minimum and maximum of every cell.
+  MacrocellGrid ( const osg::Image *volume, unsigned int cellSize = 8 );
+
+  /// Get the number of voxels along each side of a cell.
+  unsigned int                     cellSize () const;
+
+  /// Get the number of cells and voxels along the axis.
+  unsigned int                     numCells ( unsigned int axis ) const;
+  unsigned int                     volumeSize ( unsigned int axis ) const;
+
+  /// Get the range of scalars, in [0,1], that samples inside the cell can have.
+  float                            minimum ( unsigned int i, unsigned int j, unsigned int k ) const;
+  float                            maximum ( unsigned int i, unsigned int j, unsigned int k ) const;
+
+  /// Get the range of scalars in the whole volume.
+  float                            minimum () const;
+  float                            maximum () const;
+
+  /// Classify the cells against the transfer function.  Only the cells whose
+  /// range touches entries that changed since the last call are looked at.
+  /// Returns true if any cell changed.
+  bool                             classify ( const TransferFunction *tf );
+
+  /// Is the cell fully transparent?
+  bool                             empty ( unsigned int i, unsigned int j, unsigned int k ) const;
+
+  /// Get the fraction of cells that are fully transparent.
+  double                           emptyFraction () const;
+
+  /// Get the cells as a GL_ALPHA image.  Cells with something to show are 255.
+  osg::Image*                      image ();
+  const osg::Image*                image () const;
+
+  /// Get the ranges of the cells as a GL_LUMINANCE_ALPHA image, with the
+  /// minimum in luminance and the maximum in alpha.  Both are rounded
+  /// outward to bytes, so the true range is always inside.
+  osg::Image*                      rangeImage ();
+  const osg::Image*                rangeImage () const;
+
+protected:
+  virtual ~MacrocellGrid();
+
+  unsigned int                     _index ( unsigned int i, unsigned int j, unsigned int k ) const;
+
+private:
+
+  MacrocellGrid ( const MacrocellGrid & );
+  MacrocellGrid &operator = ( const MacrocellGrid & );
+
+  unsigned int                  _cellSize;
+  unsigned int                  _volumeSize[3];
+  unsigned int                  _numCells[3];
+  std::vector < float >         _minimum;
+  std::vector < float >         _maximum;
+  float                         _volumeMinimum;
+  float                         _volumeMaximum;
+  std::vector < unsigned char > _visible;
+  unsigned int                  _numEmpty;
+  osg::ref_ptr < osg::Image >   _image;
+  osg::ref_ptr < osg::Image >   _rangeImage;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_MACROCELL_GRID_H__
@@ -0,0 +1,199 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Image whose voxels are a file mapped into memory.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/MappedImage.h"
+
+#ifdef _WIN32
+# ifndef NOMINMAX
+#  define NOMINMAX
+# endif
+# include <windows.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#include <stdexcept>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+MappedImage::MappedImage ( const std::string &filename, std::size_t offset, int s, int t, int r, GLint internalFormat, GLenum pixelFormat, GLenum type ) : BaseClass(),
+  _filename ( filename ),
+  _view ( 0x0 ),
+  _viewLength ( 0 ),
+  _voxels ( 0x0 )
+{
+  if ( s <= 0 || t <= 0 || r <= 0 )
+    throw std::runtime_error ( "Error 2851940376: image to map from '" + filename + "' has no voxels" );
+
+  // Rows are packed tight, as they are in the file.
+  const std::size_t pixel ( osg::Image::computePixelSizeInBits ( pixelFormat, type ) / 8 );
+  const std::size_t length ( pixel * s * t * r );
+  if ( 0 == length )
+    throw std::runtime_error ( "Error 1306589427: format of the image to map from '" + filename + "' is not known" );
+
+  this->_map ( offset, length );
+
+  this->setImage ( s, t, r, internalFormat, pixelFormat, type, _voxels, osg::Image::NO_DELETE, 1 );
+  this->setFileName ( filename );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.  The image does not delete the voxels; they go with the view.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+MappedImage::~MappedImage()
+{
+  this->_unmap();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the file.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const std::string& MappedImage::filename() const
+{
+  return _filename;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of bytes of voxels.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+std::size_t MappedImage::numBytes() const
+{
+  return static_cast < std::size_t > ( this->getTotalSizeInBytes() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Map the bytes of the file.  Views have to start on a boundary the system
+//  chooses, so the view starts before the offset and the voxels are found
+//  inside it.  The file is closed once mapped; the view keeps it open.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+
+void MappedImage::_map ( std::size_t offset, std::size_t length )
+{
+  SYSTEM_INFO info;
+  ::GetSystemInfo ( &info );
+  const std::size_t granularity ( info.dwAllocationGranularity );
+  const std::size_t start ( ( offset / granularity ) * granularity );
+
+  HANDLE file ( ::CreateFileA ( _filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0x0, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, 0x0 ) );
+  if ( INVALID_HANDLE_VALUE == file )
+    throw std::runtime_error ( "Error 3942760158: could not open '" + _filename + "'" );
+
+  LARGE_INTEGER size;
+  if ( 0 == ::GetFileSizeEx ( file, &size ) || static_cast < unsigned long long > ( size.QuadPart ) < static_cast < unsigned long long > ( offset ) + length )
+  {
+    ::CloseHandle ( file );
+    throw std::runtime_error ( "Error 2217034685: '" + _filename + "' is too small for the image" );
+  }
+
+  HANDLE mapping ( ::CreateFileMappingA ( file, 0x0, PAGE_WRITECOPY, 0, 0, 0x0 ) );
+  ::CloseHandle ( file );
+  if ( 0x0 == mapping )
+    throw std::runtime_error ( "Error 1470593826: could not map '" + _filename + "'" );
+
+  const unsigned long long first ( start );
+  _viewLength = length + ( offset - start );
+  _view = ::MapViewOfFile ( mapping, FILE_MAP_COPY, static_cast < DWORD > ( first >> 32 ), static_cast < DWORD > ( first & 0xFFFFFFFF ), _viewLength );
+  ::CloseHandle ( mapping );
+  if ( 0x0 == _view )
+  {
+    _viewLength = 0;
+    throw std::runtime_error ( "Error 4085316729: could not map a view of '" + _filename + "'" );
+  }
+
+  _voxels = static_cast < unsigned char * > ( _view ) + ( offset - start );
+}
+
+#else
+
+void MappedImage::_map ( std::size_t offset, std::size_t length )
+{
+  const std::size_t granularity ( static_cast < std::size_t > ( ::sysconf ( _SC_PAGESIZE ) ) );
+  const std::size_t start ( ( offset / granularity ) * granularity );
+
+  const int file ( ::open ( _filename.c_str(), O_RDONLY ) );
+  if ( file < 0 )
+    throw std::runtime_error ( "Error 3942760158: could not open '" + _filename + "'" );
+
+  struct stat info;
+  if ( 0 != ::fstat ( file, &info ) || static_cast < unsigned long long > ( info.st_size ) < static_cast < unsigned long long > ( offset ) + length )
+  {
+    ::close ( file );
+    throw std::runtime_error ( "Error 2217034685: '" + _filename + "' is too small for the image" );
+  }
+
+  _viewLength = length + ( offset - start );
+  void *view ( ::mmap ( 0x0, _viewLength, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, static_cast < off_t > ( start ) ) );
+  ::close ( file );
+  if ( MAP_FAILED == view )
+  {
+    _viewLength = 0;
+    throw std::runtime_error ( "Error 1470593826: could not map '" + _filename + "'" );
+  }
+
+  _view = view;
+  _voxels = static_cast < unsigned char * > ( _view ) + ( offset - start );
+}
+
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Let go of the view.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void MappedImage::_unmap()
+{
+  if ( 0x0 == _view )
+    return;
+
+#ifdef _WIN32
+  ::UnmapViewOfFile ( _view );
+#else
+  ::munmap ( _view, _viewLength );
+#endif
+
+  _view = 0x0;
+  _viewLength = 0;
+  _voxels = 0x0;
+}
@@ -0,0 +1,69 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Image whose voxels are a file mapped into memory.  Nothing is read when
+//  it is made; pages come in from the file the first time they are touched,
+//  and the operating system may drop them again.  The mapping is private,
+//  so writing to the image changes the copy in memory but never the file.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_MAPPED_IMAGE_H__
+#define __OSGTOOLS_VOLUME_MAPPED_IMAGE_H__
+
+#include "OsgVolume/Export.h"
+
+#include "osg/Image"
+
+#include <cstddef>
+#include <string>
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT MappedImage : public osg::Image
+{
+public:
+  /// Typedefs.
+  typedef osg::Image                             BaseClass;
+  typedef osg::ref_ptr < MappedImage >           RefPtr;
+
+  /// Map the voxels that start at the offset in the file.  The file must
+  /// hold all of them.  Throws if it cannot be mapped.
+  MappedImage ( const std::string &filename, std::size_t offset, int s, int t, int r, GLint internalFormat, GLenum pixelFormat, GLenum type );
+
+  /// Get the file.
+  const std::string&               filename() const;
+
+  /// Get the number of bytes of voxels.
+  std::size_t                      numBytes() const;
+
+protected:
+  virtual ~MappedImage();
+
+  void                             _map ( std::size_t offset, std::size_t length );
+  void                             _unmap();
+
+private:
+
+  MappedImage ( const MappedImage & );
+  MappedImage &operator = ( const MappedImage & );
+
+  std::string                   _filename;
+  void *                        _view;
+  std::size_t                   _viewLength;
+  unsigned char *               _voxels;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_MAPPED_IMAGE_H__
@@ -0,0 +1,263 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Run independent tasks on all processors.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/Parallel.h"
+
+#include "OpenThreads/Mutex"
+#include "OpenThreads/ScopedLock"
+#include "OpenThreads/Thread"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of worker threads.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int Parallel::numThreads()
+{
+  const int processors ( OpenThreads::GetNumberOfProcessors() );
+  return ( processors > 0 ? static_cast < unsigned int > ( processors ) : 1 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Scheduler that hands out task indices and lets idle workers steal.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  typedef OpenThreads::Mutex Mutex;
+  typedef OpenThreads::ScopedLock < Mutex > Guard;
+
+  class Scheduler
+  {
+  public:
+    Scheduler ( unsigned int numTasks, unsigned int numWorkers ) :
+      _ranges ( numWorkers ),
+      _errorMutex(),
+      _error()
+    {
+      // Give each worker an even, contiguous share.
+      for ( unsigned int i = 0; i < numWorkers; ++i )
+      {
+        _ranges[i].mutex = new Mutex;
+        _ranges[i].begin = static_cast < unsigned int > ( ( static_cast < unsigned long long > ( numTasks ) * i ) / numWorkers );
+        _ranges[i].end   = static_cast < unsigned int > ( ( static_cast < unsigned long long > ( numTasks ) * ( i + 1 ) ) / numWorkers );
+      }
+    }
+
+    ~Scheduler()
+    {
+      for ( unsigned int i = 0; i < _ranges.size(); ++i )
+        delete _ranges[i].mutex;
+    }
+
+    // Get the next task for the worker.  Returns false when there is no work left anywhere.
+    bool next ( unsigned int worker, unsigned int &task )
+    {
+      // Take from the front of our own range.
+      {
+        Range &mine ( _ranges[worker] );
+        Guard guard ( *mine.mutex );
+        if ( mine.begin < mine.end )
+        {
+          task = mine.begin++;
+          return true;
+        }
+      }
+
+      // Steal the back half of the largest remaining range.
+      while ( true )
+      {
+        unsigned int victim ( worker );
+        unsigned int largest ( 0 );
+        for ( unsigned int i = 0; i < _ranges.size(); ++i )
+        {
+          if ( i == worker )
+            continue;
+          Guard guard ( *_ranges[i].mutex );
+          const unsigned int remaining ( _ranges[i].end - _ranges[i].begin );
+          if ( remaining > largest )
+          {
+            largest = remaining;
+            victim = i;
+          }
+        }
+
+        if ( 0 == largest )
+          return false;
+
+        unsigned int begin ( 0 ), end ( 0 );
+        {
+          Range &other ( _ranges[victim] );
+          Guard guard ( *other.mutex );
+          const unsigned int remaining ( other.end - other.begin );
+
+          // Someone else got there first; look again.
+          if ( 0 == remaining )
+            continue;
+
+          const unsigned int take ( ( remaining + 1 ) / 2 );
+          end = other.end;
+          begin = other.end - take;
+          other.end = begin;
+        }
+
+        // Keep what we did not use right now for ourselves.
+        {
+          Range &mine ( _ranges[worker] );
+          Guard guard ( *mine.mutex );
+          mine.begin = begin + 1;
+          mine.end = end;
+        }
+
+        task = begin;
+        return true;
+      }
+    }
+
+    // Remember the first error.
+    void error ( const std::string &message )
+    {
+      Guard guard ( _errorMutex );
+      if ( _error.empty() )
+        _error = message;
+    }
+
+    const std::string &error() const
+    {
+      return _error;
+    }
+
+  private:
+
+    struct Range
+    {
+      Range() : mutex ( 0x0 ), begin ( 0 ), end ( 0 )
+      {
+      }
+
+      Mutex *mutex;
+      unsigned int begin;
+      unsigned int end;
+    };
+
+    std::vector < Range > _ranges;
+    Mutex _errorMutex;
+    std::string _error;
+  };
+
+
+  // Run tasks until the scheduler is empty.
+  inline void work ( Scheduler &scheduler, Parallel::Task &task, unsigned int worker )
+  {
+    try
+    {
+      unsigned int index ( 0 );
+      while ( scheduler.next ( worker, index ) )
+        task ( index );
+    }
+
+    catch ( const std::exception &e )
+    {
+      scheduler.error ( ( e.what() ) ? e.what() : "Error 1893024517: standard exception caught" );
+    }
+
+    catch ( ... )
+    {
+      scheduler.error ( "Error 2961047735: unknown exception caught" );
+    }
+  }
+
+
+  class Worker : public OpenThreads::Thread
+  {
+  public:
+    Worker ( Scheduler &scheduler, Parallel::Task &task, unsigned int index ) : OpenThreads::Thread(),
+      _scheduler ( scheduler ),
+      _task ( task ),
+      _index ( index )
+    {
+    }
+
+    virtual void run()
+    {
+      Detail::work ( _scheduler, _task, _index );
+    }
+
+  private:
+    Worker ( const Worker & );
+    Worker &operator = ( const Worker & );
+
+    Scheduler &_scheduler;
+    Parallel::Task &_task;
+    unsigned int _index;
+  };
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Run the tasks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Parallel::run ( unsigned int numTasks, Task &task, unsigned int maxThreads )
+{
+  if ( 0 == numTasks )
+    return;
+
+  const unsigned int threads ( ( 0 == maxThreads ) ? Parallel::numThreads() : maxThreads );
+  const unsigned int numWorkers ( std::max ( 1u, std::min ( threads, numTasks ) ) );
+
+  // No need for threads.
+  if ( 1 == numWorkers )
+  {
+    for ( unsigned int i = 0; i < numTasks; ++i )
+      task ( i );
+    return;
+  }
+
+  ::Detail::Scheduler scheduler ( numTasks, numWorkers );
+
+  // The calling thread is worker zero.
+  std::vector < ::Detail::Worker * > workers;
+  for ( unsigned int i = 1; i < numWorkers; ++i )
+  {
+    workers.push_back ( new ::Detail::Worker ( scheduler, task, i ) );
+    workers.back()->start();
+  }
+
+  ::Detail::work ( scheduler, task, 0 );
+
+  for ( unsigned int i = 0; i < workers.size(); ++i )
+  {
+    workers[i]->join();
+    delete workers[i];
+  }
+
+  if ( false == scheduler.error().empty() )
+    throw std::runtime_error ( scheduler.error() );
+}
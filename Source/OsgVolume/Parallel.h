@@ -0,0 +1,76 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Run independent tasks on all processors.  Each worker starts with an
+//  even share of the task indices and steals half of the largest remaining
+//  share when it runs out, so uneven tasks still keep every core busy.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_PARALLEL_H__
+#define __OSGTOOLS_VOLUME_PARALLEL_H__
+
+#include "OsgVolume/Export.h"
+
+namespace OsgVolume {
+namespace Parallel {
+
+
+/// Base class for a task that can be run by the workers.
+struct OSG_VOLUME_EXPORT Task
+{
+  virtual ~Task() {}
+  virtual void operator () ( unsigned int index ) = 0;
+};
+
+
+/// Number of worker threads used when none is given.
+OSG_VOLUME_EXPORT unsigned int  numThreads();
+
+/// Run task ( i ) for i in [0,numTasks).  Blocks until all tasks are done.
+/// A maxThreads of zero uses numThreads().
+OSG_VOLUME_EXPORT void          run ( unsigned int numTasks, Task &task, unsigned int maxThreads = 0 );
+
+
+namespace Detail
+{
+  template < class Function > struct FunctionTask : public OsgVolume::Parallel::Task
+  {
+    FunctionTask ( Function &function ) : _function ( function )
+    {
+    }
+
+    virtual void operator () ( unsigned int index )
+    {
+      _function ( index );
+    }
+
+  private:
+    FunctionTask &operator = ( const FunctionTask & );
+
+    Function &_function;
+  };
+}
+
+
+/// Call function ( i ) for i in [0,numTasks) across the workers.
+template < class Function > inline void forEach ( unsigned int numTasks, Function &function, unsigned int maxThreads = 0 )
+{
+  Detail::FunctionTask < Function > task ( function );
+  OsgVolume::Parallel::run ( numTasks, task, maxThreads );
+}
+
+
+} // namespace Parallel
+} // namespace OsgVolume
+
+
+#endif // __OSGTOOLS_VOLUME_PARALLEL_H__
@@ -20,6 +20,10 @@
 
 #include "osg/Notify"
 
+#include "OpenThreads/ScopedLock"
+
+#include <cmath>
+
 using namespace OsgVolume;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -34,14 +38,16 @@ PlanarProxyGeometry::PlanarProxyGeometry() :
   _bbox      ( osg::Vec3 ( -1, -1, -1 ), osg::Vec3 ( 1, 1, 1 ) ),
   _corners   ( 8 ),
   _edges     ( 12 ),
-  _vertices  (),
-  _indices   ( 6 )
+  _viewQuantization ( 32 ),
+  _cacheSize ( 8 ),
+  _cache     (),
+  _cacheMutex(),
+  _drawCount ( 0 ),
+  _hits      ( 0 ),
+  _misses    ( 0 )
 {
   this->_initCornersAndEdges();
   this->setUseDisplayList( false );
-
-  for ( unsigned int i = 0; i < 6; ++i )
-    _indices[ i ] = i;
 }
 
 
@@ -57,8 +63,13 @@ PlanarProxyGeometry::PlanarProxyGeometry ( const PlanarProxyGeometry &d, const o
   _bbox      ( d._bbox      ),
   _corners   ( d._corners   ),
   _edges     ( d._edges     ),
-  _vertices  ( d._vertices  ),
-  _indices   ( d._indices   )
+  _viewQuantization ( d._viewQuantization ),
+  _cacheSize ( d._cacheSize ),
+  _cache     (),
+  _cacheMutex(),
+  _drawCount ( 0 ),
+  _hits      ( 0 ),
+  _misses    ( 0 )
 {
 }
 
@@ -75,8 +86,9 @@ PlanarProxyGeometry &PlanarProxyGeometry::operator = ( const PlanarProxyGeometry
   _bbox      = d._bbox;
   _corners   = d._corners;
   _edges     = d._edges;
-  _vertices  = d._vertices;
-  _indices   = d._indices;
+  _viewQuantization = d._viewQuantization;
+  _cacheSize = d._cacheSize;
+  this->_clearCache();
   return *this;
 }
 
@@ -124,33 +136,48 @@ osg::Object *PlanarProxyGeometry::clone ( const osg::CopyOp &options ) const
 
 void PlanarProxyGeometry::_initCornersAndEdges ()
 {
-  osg::Vec3 min ( _bbox._min );
-  osg::Vec3 max ( _bbox._max );
+  PlanarProxyGeometry::_initCornersAndEdges ( _bbox, _corners, _edges );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Initialize the corners and edges of the box.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void PlanarProxyGeometry::_initCornersAndEdges ( const osg::BoundingBox &bb, Corners &corners, Edges &edges )
+{
+  corners.resize ( 8 );
+  edges.resize ( 12 );
+
+  osg::Vec3 min ( bb._min );
+  osg::Vec3 max ( bb._max );
 
   // The corners.
-  _corners[0] = min;
-	_corners[1] = osg::Vec3f( max.x(), min.y(), min.z() );
-	_corners[2] = osg::Vec3f( max.x(), max.y(), min.z() );
-	_corners[3] = osg::Vec3f( min.x(), max.y(), min.z() );
+  corners[0] = min;
+	corners[1] = osg::Vec3f( max.x(), min.y(), min.z() );
+	corners[2] = osg::Vec3f( max.x(), max.y(), min.z() );
+	corners[3] = osg::Vec3f( min.x(), max.y(), min.z() );
 
-	_corners[4] = osg::Vec3f( min.x(), min.y(), max.z() );
-	_corners[5] = osg::Vec3f( max.x(), min.y(), max.z() );
-	_corners[6] = max;
-	_corners[7] = osg::Vec3f( min.x(), max.y(), max.z() );
+	corners[4] = osg::Vec3f( min.x(), min.y(), max.z() );
+	corners[5] = osg::Vec3f( max.x(), min.y(), max.z() );
+	corners[6] = max;
+	corners[7] = osg::Vec3f( min.x(), max.y(), max.z() );
 
   // Edge connectivity.
-	_edges[0]  = Edge( 0,1 );
-	_edges[1]  = Edge( 1,2 );
-	_edges[2]  = Edge( 2,3 );
-	_edges[3]  = Edge( 3,0 );
-	_edges[4]  = Edge( 0,4 );
-	_edges[5]  = Edge( 1,5 );
-	_edges[6]  = Edge( 2,6 );
-	_edges[7]  = Edge( 3,7 );
-	_edges[8]  = Edge( 4,5 );
-	_edges[9]  = Edge( 5,6 );
-	_edges[10] = Edge( 6,7 );
-	_edges[11] = Edge( 7,4 );
+	edges[0]  = Edge( 0,1 );
+	edges[1]  = Edge( 1,2 );
+	edges[2]  = Edge( 2,3 );
+	edges[3]  = Edge( 3,0 );
+	edges[4]  = Edge( 0,4 );
+	edges[5]  = Edge( 1,5 );
+	edges[6]  = Edge( 2,6 );
+	edges[7]  = Edge( 3,7 );
+	edges[8]  = Edge( 4,5 );
+	edges[9]  = Edge( 5,6 );
+	edges[10] = Edge( 6,7 );
+	edges[11] = Edge( 7,4 );
 }
 
 
@@ -236,21 +263,53 @@ namespace Detail
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-//  Draw the proxy geometry.
+//  Build the slices for the view direction.  They are listed back to front
+//  as triangle fans of six vertices, some of which may repeat.
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-void PlanarProxyGeometry::_drawImplementation( osg::State& state ) const
+void PlanarProxyGeometry::_buildSlices ( const osg::Vec3f& viewVec, Slices& slices ) const
 {
-  // Apply the state.
-  //Detail::PushPopStateSet pushPopState ( this->getStateSet(), state );
+  slices.vertices.clear();
+  slices.indices.clear();
 
-  // Get the vector of the view direction.
-  osg::Matrix matrix ( state.getModelViewMatrix() );
-  osg::Vec4f  viewVec ( -matrix( 0, 2 ),-matrix( 1, 2 ), -matrix( 2, 2 ), 0.0 );
+  slices.vertices.reserve ( _numPlanes * 6 );
+  slices.indices.reserve ( _numPlanes * 12 );
+
+  PlanarProxyGeometry::_slice ( _corners, _edges, viewVec, _numPlanes, slices.vertices, slices.indices );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Add the slices through the box for the view direction.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void PlanarProxyGeometry::slice ( const osg::BoundingBox &bb, const osg::Vec3f &viewVec, unsigned int numPlanes, Vertices &vertices, Indices &indices )
+{
+  Corners corners;
+  Edges edges;
+  PlanarProxyGeometry::_initCornersAndEdges ( bb, corners, edges );
+  PlanarProxyGeometry::_slice ( corners, edges, viewVec, numPlanes, vertices, indices );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Add the slices between the corners for the view direction.  They are
+//  listed back to front as triangle fans of six vertices, some of which may
+//  repeat.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void PlanarProxyGeometry::_slice ( const Corners &corners, const Edges &edges, const osg::Vec3f& viewVec, unsigned int numPlanes, Vertices &vertices, Indices &indices )
+{
+  if ( 0 == numPlanes )
+    return;
 
   // Min and Max distance of the box from the eye point.
-	double maxDistance ( viewVec * _corners[0] );
+	double maxDistance ( viewVec * corners[0] );
 	double minDistance ( maxDistance );
 
   // Index of the vertex that is closest to the eye point.
@@ -259,7 +318,7 @@ void PlanarProxyGeometry::_drawImplementation( osg::State& state ) const
   // Loop through the points of the box and find which point is closet to the eye.
   for( unsigned int i = 1; i < 8; ++i ) 
   {
-		double distance ( viewVec * _corners[ i ] );
+		double distance ( viewVec * corners[ i ] );
 		
     if ( distance > maxDistance )
     {
@@ -273,7 +332,7 @@ void PlanarProxyGeometry::_drawImplementation( osg::State& state ) const
 	}
 
   double planeDistance    ( minDistance );
-	double planeIncrement   ( ( maxDistance - minDistance ) / _numPlanes );
+	double planeIncrement   ( ( maxDistance - minDistance ) / numPlanes );
 
   float lambda      [ 12 ];
 	float lambdaInc   [ 12 ];
@@ -285,11 +344,11 @@ void PlanarProxyGeometry::_drawImplementation( osg::State& state ) const
 	for( unsigned int i = 0; i < 12; ++i )
 	{ 
     // Get the edge.
-    const Edge &edge ( _edges[ Detail::edgeList[ frontId ][ i ] ] );
+    const Edge &edge ( edges[ Detail::edgeList[ frontId ][ i ] ] );
 
     // Get the corner and vector along the edge.
-		vecStart[i] = _corners[ edge.first ];
-		vecDir[i]   = _corners[ edge.second ] - _corners[ edge.first ];
+		vecStart[i] = corners[ edge.first ];
+		vecDir[i]   = corners[ edge.second ] - corners[ edge.first ];
 
 		double d ( vecDir[i] * viewVec );
 
@@ -307,13 +366,11 @@ void PlanarProxyGeometry::_drawImplementation( osg::State& state ) const
 	}
 
   float lmb [ 12 ];
-  
+  osg::Vec3f intersection [ 6 ];
 
   // Create the slices.
-	for( int n = _numPlanes - 1; n >= 0; --n ) 
+	for( int n = numPlanes - 1; n >= 0; --n ) 
 	{
-    Vertices& intersection ( const_cast < Vertices& > ( _vertices.at ( n ) ) );
-
 		for( int e = 0; e < 12; e++ ) 
     {
 			lmb[ e ] = lambda[ e ] + n * lambdaInc[ e ];
@@ -347,31 +404,81 @@ void PlanarProxyGeometry::_drawImplementation( osg::State& state ) const
 		else if ( ( lmb[ 9 ] >= 0.0 ) && ( lmb[ 9 ] < 1.0 ) ) intersection[ 5 ] = vecStart[ 9 ] + vecDir[ 9 ]  * lmb[ 9 ];
 		else intersection[ 5 ] = vecStart[ 11 ]+ vecDir[ 11 ] * lmb[ 11 ];
 
-# if 1
-    ::glBegin ( GL_TRIANGLE_FAN );
-   
-    for( unsigned int k = 0; k < 6; ++k )
+    // Add the fan as triangles.
+    const unsigned int first ( vertices.size() );
+    vertices.insert ( vertices.end(), intersection, intersection + 6 );
+
+    for ( unsigned int k = 1; k < 5; ++k )
     {
-#if 0
-      float r ( 0.0 ), g ( 0.0 ), b ( 0.0 );
-      float c ( 1.0 - ( float ( n ) / _numPlanes ) );
-      Usul::Functions::hsvToRgb  ( r, g, b, c * 360.0f, 1.0f, 1.0f );
-      
-      ::glColor4f ( r, g, b, 1.0 );
-#endif
-      ::glVertex3fv ( intersection[k].ptr() );
+      indices.push_back ( first );
+      indices.push_back ( first + k );
+      indices.push_back ( first + k + 1 );
     }
+  }
+}
 
-    ::glEnd();
-#endif
-    
-    //state.setVertexPointer ( 3, GL_FLOAT, 0, &intersection.front() );
-    //::glVertexPointer ( 3, GL_FLOAT, 0, &intersection.front() );
-    //::glDrawElements ( GL_TRIANGLE_FAN, 6, GL_UNSIGNED_SHORT, &_indices.front() );
-    
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Draw the proxy geometry.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void PlanarProxyGeometry::_drawImplementation( osg::State& state ) const
+{
+  // Get the vector of the view direction.
+  osg::Matrix matrix ( state.getModelViewMatrix() );
+  osg::Vec3f  viewVec ( -matrix( 0, 2 ),-matrix( 1, 2 ), -matrix( 2, 2 ) );
+  if ( viewVec.normalize() <= 0.0f )
+    return;
+
+  // Round the direction so that nearby views share their slices.
+  const float steps ( static_cast < float > ( _viewQuantization ) );
+  const ViewKey key ( static_cast < int > ( std::floor ( viewVec[0] * steps + 0.5f ) ),
+                      std::make_pair ( static_cast < int > ( std::floor ( viewVec[1] * steps + 0.5f ) ),
+                                       static_cast < int > ( std::floor ( viewVec[2] * steps + 0.5f ) ) ) );
+
+  OpenThreads::ScopedLock < OpenThreads::Mutex > lock ( _cacheMutex );
+
+  SliceCache::iterator iter ( _cache.find ( key ) );
+  if ( _cache.end() == iter )
+  {
+    ++_misses;
+
+    // Make room by dropping the view used longest ago.
+    if ( _cache.size() >= _cacheSize && false == _cache.empty() )
+    {
+      SliceCache::iterator oldest ( _cache.begin() );
+      for ( SliceCache::iterator i = _cache.begin(); i != _cache.end(); ++i )
+      {
+        if ( i->second.lastUsed < oldest->second.lastUsed )
+          oldest = i;
+      }
+      _cache.erase ( oldest );
+    }
+
+    // Slice for the rounded direction so the result does not depend on which view came first.
+    osg::Vec3f direction ( key.first, key.second.first, key.second.second );
+    direction.normalize();
+
+    iter = _cache.insert ( SliceCache::value_type ( key, Slices() ) ).first;
+    this->_buildSlices ( direction, iter->second );
+  }
+  else
+  {
+    ++_hits;
   }
 
-  //state.disableVertexPointer ();
+  Slices &slices ( iter->second );
+  slices.lastUsed = ++_drawCount;
+
+  if ( slices.indices.empty() )
+    return;
+
+  // Draw all the slices at once.
+  state.setVertexPointer ( 3, GL_FLOAT, 0, &slices.vertices.front() );
+  ::glDrawElements ( GL_TRIANGLES, slices.indices.size(), GL_UNSIGNED_INT, &slices.indices.front() );
+  state.disableVertexPointer();
 }
 
 
@@ -397,6 +504,8 @@ void PlanarProxyGeometry::boundingBox ( const osg::BoundingBox& bb )
 {
   _bbox = bb;
   this->_initCornersAndEdges ();
+  this->_clearCache();
+  this->dirtyBound();
 }
 
 
@@ -420,8 +529,106 @@ const osg::BoundingBox& PlanarProxyGeometry::boundingBox () const
 
 void PlanarProxyGeometry::numPlanes ( unsigned int num )
 {
-  _numPlanes = num;
-  _vertices.resize ( num );
-  for ( std::vector < Vertices >::iterator iter = _vertices.begin(); iter != _vertices.end(); ++iter )
-    iter->resize ( 6 );
+  if ( num != _numPlanes )
+  {
+    _numPlanes = num;
+    this->_clearCache();
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the number of steps per unit the view direction is rounded to.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void PlanarProxyGeometry::viewQuantization ( unsigned int steps )
+{
+  steps = ( 0 == steps ) ? 1 : steps;
+
+  if ( steps != _viewQuantization )
+  {
+    _viewQuantization = steps;
+    this->_clearCache();
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of steps per unit the view direction is rounded to.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int PlanarProxyGeometry::viewQuantization() const
+{
+  return _viewQuantization;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the number of view directions kept.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void PlanarProxyGeometry::cacheSize ( unsigned int size )
+{
+  _cacheSize = size;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of view directions kept.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int PlanarProxyGeometry::cacheSize() const
+{
+  return _cacheSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the fraction of draws that reused slices.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double PlanarProxyGeometry::cacheHitRate() const
+{
+  OpenThreads::ScopedLock < OpenThreads::Mutex > lock ( _cacheMutex );
+
+  const double total ( static_cast < double > ( _hits ) + static_cast < double > ( _misses ) );
+  return ( total > 0.0 ) ? static_cast < double > ( _hits ) / total : 0.0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Reset the hit and miss counts.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void PlanarProxyGeometry::resetCacheStatistics()
+{
+  OpenThreads::ScopedLock < OpenThreads::Mutex > lock ( _cacheMutex );
+
+  _hits = 0;
+  _misses = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Throw away the slices.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void PlanarProxyGeometry::_clearCache()
+{
+  OpenThreads::ScopedLock < OpenThreads::Mutex > lock ( _cacheMutex );
+  _cache.clear();
 }
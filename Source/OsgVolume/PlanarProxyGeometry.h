@@ -18,6 +18,11 @@
 #include "osg/Drawable"
 #include "osg/Version"
 
+#include "OpenThreads/Mutex"
+
+#include <map>
+#include <vector>
+
 #if OSG_VERSION_MAJOR <= 1 && OSG_VERSION_MINOR <= 2
 #define DrawArgs osg::State& state
 #else
@@ -35,6 +40,8 @@ public:
   typedef std::pair< unsigned int, unsigned int >  Edge;
   typedef std::vector < Edge >                     Edges;
   typedef std::vector < osg::Vec3f >               Corners;
+  typedef std::vector < osg::Vec3f >               Vertices;
+  typedef std::vector < GLuint >                   Indices;
 
   // Construction.
   PlanarProxyGeometry();
@@ -58,6 +65,23 @@ public:
   unsigned int                numPlanes() const { return _numPlanes; }
   void                        numPlanes ( unsigned int num );
 
+  /// Set/get the number of steps per unit each component of the view
+  /// direction is rounded to.  Views that round the same share slices.
+  unsigned int                viewQuantization() const;
+  void                        viewQuantization ( unsigned int steps );
+
+  /// Set/get the number of view directions to keep slices for.
+  unsigned int                cacheSize() const;
+  void                        cacheSize ( unsigned int size );
+
+  /// Get the fraction of draws that reused slices, and reset the counts.
+  double                      cacheHitRate() const;
+  void                        resetCacheStatistics();
+
+  /// Add the slices through the box for the unit view direction to the
+  /// vertices and indices, back to front, as triangles.
+  static void                 slice ( const osg::BoundingBox &bb, const osg::Vec3f &viewVec, unsigned int numPlanes, Vertices &vertices, Indices &indices );
+
 protected:
 
   // Use reference counting.
@@ -67,17 +91,39 @@ protected:
 
   void                        _drawImplementation( osg::State& state ) const;
   void                        _initCornersAndEdges();
+  void                        _clearCache();
 
 private:
-  typedef std::vector < osg::Vec3 > Vertices;
-  typedef std::vector < unsigned short > Indices;
+  typedef std::pair < int, std::pair < int, int > > ViewKey;
+
+  struct Slices
+  {
+    Slices() : vertices(), indices(), lastUsed ( 0 )
+    {
+    }
+
+    Vertices      vertices;
+    Indices       indices;
+    unsigned long lastUsed;
+  };
+
+  typedef std::map < ViewKey, Slices > SliceCache;
+
+  void                        _buildSlices ( const osg::Vec3f& viewVec, Slices& slices ) const;
+  static void                 _slice ( const Corners &corners, const Edges &edges, const osg::Vec3f& viewVec, unsigned int numPlanes, Vertices &vertices, Indices &indices );
+  static void                 _initCornersAndEdges ( const osg::BoundingBox &bb, Corners &corners, Edges &edges );
 
   unsigned int      _numPlanes;
   osg::BoundingBox  _bbox;
   Corners           _corners;
   Edges             _edges;
-  std::vector < Vertices > _vertices;
-  Indices           _indices;
+  unsigned int      _viewQuantization;
+  unsigned int      _cacheSize;
+  mutable SliceCache          _cache;
+  mutable OpenThreads::Mutex  _cacheMutex;
+  mutable unsigned long       _drawCount;
+  mutable unsigned long       _hits;
+  mutable unsigned long       _misses;
 };
 
 
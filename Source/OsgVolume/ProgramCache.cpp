@@ -0,0 +1,259 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Programs shared by every volume in the process.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/ProgramCache.h"
+
+#include "OpenThreads/Mutex"
+#include "OpenThreads/ScopedLock"
+
+#include "osg/Shader"
+
+#include <sstream>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  typedef OpenThreads::Mutex                     Mutex;
+  typedef OpenThreads::ScopedLock < Mutex >      Guard;
+  typedef osg::ref_ptr < osg::Program >          ProgramPtr;
+  typedef std::map < std::string, ProgramPtr >   Programs;
+
+  // Made before main, so before any thread can ask for a program.  The
+  // programs are made on first use and let go of by clear() or prune().
+  Mutex mutex;
+  Programs *programs ( 0x0 );
+
+  // Let go of the programs once there are none.
+  inline void destroyIfEmpty()
+  {
+    if ( 0x0 != programs && true == programs->empty() )
+    {
+      delete programs;
+      programs = 0x0;
+    }
+  }
+
+  // Is the character part of a name?
+  inline bool isName ( char c )
+  {
+    return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' ) || '_' == c;
+  }
+
+  // Specialize one line.  Returns false if it is not a uniform in the constants.
+  bool specializeLine ( const std::string &line, const ProgramCache::Constants &constants, std::string &result )
+  {
+    std::istringstream in ( line );
+    std::string keyword, type, name;
+    in >> keyword >> type >> name;
+
+    if ( "uniform" != keyword || name.size() < 2 || ';' != name[name.size() - 1] )
+      return false;
+
+    name.erase ( name.size() - 1 );
+    for ( std::string::const_iterator i = name.begin(); i != name.end(); ++i )
+    {
+      if ( false == isName ( *i ) )
+        return false;
+    }
+
+    ProgramCache::Constants::const_iterator iter ( constants.find ( name ) );
+    if ( constants.end() == iter )
+      return false;
+
+    result = "const " + type + " " + name + " = " + iter->second + ";";
+    return true;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the program made from the sources.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::ref_ptr<osg::Program> ProgramCache::program ( const std::string &vertex, const std::string &fragment, const Constants &constants )
+{
+  const std::string vertexSource ( ProgramCache::specialize ( vertex, constants ) );
+  const std::string fragmentSource ( ProgramCache::specialize ( fragment, constants ) );
+
+  // The sources are the key, so two programs are the same only if every
+  // feature and constant that went into them is.
+  const std::string key ( vertexSource + '\0' + fragmentSource );
+
+  Detail::Guard guard ( Detail::mutex );
+
+  if ( 0x0 == Detail::programs )
+    Detail::programs = new Detail::Programs;
+
+  Detail::Programs::const_iterator iter ( Detail::programs->find ( key ) );
+  if ( Detail::programs->end() != iter )
+    return iter->second;
+
+  Detail::ProgramPtr program ( new osg::Program );
+
+  if ( false == vertexSource.empty() )
+    program->addShader ( new osg::Shader ( osg::Shader::VERTEX, vertexSource ) );
+  if ( false == fragmentSource.empty() )
+    program->addShader ( new osg::Shader ( osg::Shader::FRAGMENT, fragmentSource ) );
+
+  (*Detail::programs)[key] = program;
+  return program;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Add the value of a bool or int uniform to the constants.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgramCache::fold ( const osg::Uniform &uniform, Constants &constants )
+{
+  if ( osg::Uniform::BOOL == uniform.getType() )
+  {
+    bool value ( false );
+    if ( uniform.get ( value ) )
+      constants[uniform.getName()] = ( value ? "true" : "false" );
+  }
+  else if ( osg::Uniform::INT == uniform.getType() )
+  {
+    int value ( 0 );
+    if ( uniform.get ( value ) )
+    {
+      std::ostringstream os;
+      os << value;
+      constants[uniform.getName()] = os.str();
+    }
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Fold the constants into the source.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+std::string ProgramCache::specialize ( const std::string &source, const Constants &constants )
+{
+  if ( constants.empty() )
+    return source;
+
+  std::string result;
+  result.reserve ( source.size() );
+
+  std::string::size_type start ( 0 );
+  while ( start < source.size() )
+  {
+    std::string::size_type end ( source.find ( '\n', start ) );
+    if ( std::string::npos == end )
+      end = source.size();
+
+    const std::string line ( source, start, end - start );
+    std::string replaced;
+    result += ( Detail::specializeLine ( line, constants, replaced ) ? replaced : line );
+
+    if ( end < source.size() )
+      result += '\n';
+
+    start = end + 1;
+  }
+
+  return result;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of programs kept.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int ProgramCache::size()
+{
+  Detail::Guard guard ( Detail::mutex );
+  return ( 0x0 == Detail::programs ) ? 0 : static_cast < unsigned int > ( Detail::programs->size() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Release the GL objects of the programs for the context.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgramCache::releaseGLObjects ( osg::State *state )
+{
+  Detail::Guard guard ( Detail::mutex );
+
+  if ( 0x0 == Detail::programs )
+    return;
+
+  for ( Detail::Programs::iterator iter = Detail::programs->begin(); iter != Detail::programs->end(); ++iter )
+    iter->second->releaseGLObjects ( state );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Forget the programs only we hold.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgramCache::prune()
+{
+  Detail::Guard guard ( Detail::mutex );
+
+  if ( 0x0 == Detail::programs )
+    return;
+
+  Detail::Programs::iterator iter ( Detail::programs->begin() );
+  while ( iter != Detail::programs->end() )
+  {
+    if ( 1 == iter->second->referenceCount() )
+      Detail::programs->erase ( iter++ );
+    else
+      ++iter;
+  }
+
+  Detail::destroyIfEmpty();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Forget the programs.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgramCache::clear()
+{
+  Detail::Guard guard ( Detail::mutex );
+
+  if ( 0x0 == Detail::programs )
+    return;
+
+  Detail::programs->clear();
+  Detail::destroyIfEmpty();
+}
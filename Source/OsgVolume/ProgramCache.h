@@ -0,0 +1,78 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Programs shared by every volume in the process.  A volume asks for its
+//  shaders with the switches it is using folded in as constants, so the
+//  compiler can drop the branches it will never take.  Volumes with the
+//  same switches get the same program, and a program is only compiled once
+//  no matter how many documents draw with it.
+//
+//  The programs are kept on the heap until clear() or prune() lets the last
+//  of them go, so nothing is left for static destruction at exit.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_PROGRAM_CACHE_H__
+#define __OSGTOOLS_VOLUME_PROGRAM_CACHE_H__
+
+#include "OsgVolume/Export.h"
+
+#include "osg/Program"
+#include "osg/State"
+#include "osg/Uniform"
+
+#include <map>
+#include <string>
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT ProgramCache
+{
+public:
+  /// Typedefs.
+  typedef std::map < std::string, std::string >  Constants;
+
+  /// Get the program made from the sources.  Uniforms named in the constants
+  /// become constants with the given values.  The reference is taken while
+  /// the cache is locked, so a prune() on another thread cannot free it.
+  static osg::ref_ptr<osg::Program> program ( const std::string &vertex, const std::string &fragment, const Constants &constants = Constants() );
+
+  /// Add the value of a bool or int uniform to the constants.
+  static void                      fold ( const osg::Uniform &uniform, Constants &constants );
+
+  /// Replace each "uniform <type> <name>;" line for the constants with
+  /// "const <type> <name> = <value>;".
+  static std::string               specialize ( const std::string &source, const Constants &constants );
+
+  /// Get the number of programs kept.
+  static unsigned int              size();
+
+  /// Release the GL objects of the programs for the context, which is about
+  /// to close, or for every context if none is given.  Its ID may be used
+  /// again by a new context, which then compiles the programs afresh.
+  static void                      releaseGLObjects ( osg::State *state = 0x0 );
+
+  /// Forget the programs no volume draws with any more.
+  static void                      prune();
+
+  /// Forget the programs.  Volumes drawing with them keep them.
+  static void                      clear();
+
+private:
+
+  ProgramCache();
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_PROGRAM_CACHE_H__
@@ -0,0 +1,792 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Group that draws volumes at a lower resolution while the view changes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/ProgressiveVolume.h"
+#include "OsgVolume/PlanarProxyGeometry.h"
+
+#include "osg/BlendFunc"
+#include "osg/ColorMask"
+#include "osg/Depth"
+#include "osg/FrameStamp"
+#include "osg/Geode"
+#include "osg/Geometry"
+#include "osg/Program"
+#include "osg/Shader"
+#include "osg/Viewport"
+
+#include "osgUtil/CullVisitor"
+
+#include "OpenThreads/ScopedLock"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Shaders that stretch the smaller image over the screen, and that give it
+//  the depth of the scene.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  std::string buildVertexShader()
+  {
+    std::ostringstream os;
+
+    os << "varying vec2 texCoord;\n"
+       << "void main()\n"
+       << "{\n"
+       << "  texCoord = gl_MultiTexCoord0.xy;\n"
+       << "  gl_Position = ftransform();\n"
+       << "}\n";
+
+    return os.str();
+  }
+
+  // Bilinear filter where the four texels are also weighted by how close
+  // their color is to the nearest one, and how close the scene under them
+  // is to the scene under this pixel, so edges stay sharp and the volume
+  // does not bleed over geometry in front of it.  The colors are
+  // premultiplied by alpha, so they can be filtered as they are.
+  std::string buildFragmentShader()
+  {
+    std::ostringstream os;
+
+    os << "uniform sampler2D Image;\n"
+       << "uniform sampler2D SceneDepth;\n"
+       << "uniform mat4 SceneProjectionInverse;\n"
+       << "uniform vec2 TexelSize;\n"
+       << "uniform vec2 Extent;\n"
+       << "uniform float Sharpness;\n"
+       << "uniform float DepthSharpness;\n"
+       << "varying vec2 texCoord;\n"
+
+       // Distance from the eye to the scene at a point on the screen.
+       << "float sceneDistance ( vec2 uv )\n"
+       << "{\n"
+       << "  float depth = texture2D ( SceneDepth, uv ).x;\n"
+       << "  vec4 eye = SceneProjectionInverse * vec4 ( uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0 );\n"
+       << "  return abs ( eye.z / eye.w );\n"
+       << "}\n"
+
+       << "void main()\n"
+       << "{\n"
+
+       // Where we are in the texels of the smaller image.
+       << "  vec2 p = texCoord * Extent / TexelSize - 0.5;\n"
+       << "  vec2 f = fract ( p );\n"
+       << "  vec2 first = 0.5 * TexelSize;\n"
+       << "  vec2 last = Extent - 0.5 * TexelSize;\n"
+       << "  vec2 a = clamp ( ( floor ( p ) + 0.5 ) * TexelSize, first, last );\n"
+       << "  vec2 b = clamp ( ( floor ( p ) + 1.5 ) * TexelSize, first, last );\n"
+
+       << "  vec4 c00 = texture2D ( Image, a );\n"
+       << "  vec4 c10 = texture2D ( Image, vec2 ( b.x, a.y ) );\n"
+       << "  vec4 c01 = texture2D ( Image, vec2 ( a.x, b.y ) );\n"
+       << "  vec4 c11 = texture2D ( Image, b );\n"
+
+       // The nearest texel guides the weights.
+       << "  vec2 n = step ( 0.5, f );\n"
+       << "  vec4 guide = mix ( mix ( c00, c10, n.x ), mix ( c01, c11, n.x ), n.y );\n"
+
+       << "  vec4 d = vec4 ( dot ( c00 - guide, c00 - guide ),\n"
+       << "                  dot ( c10 - guide, c10 - guide ),\n"
+       << "                  dot ( c01 - guide, c01 - guide ),\n"
+       << "                  dot ( c11 - guide, c11 - guide ) );\n"
+
+       // The smaller image covers the screen, so a texel is over the scene
+       // at its place in the extent.
+       << "  float z = sceneDistance ( texCoord );\n"
+       << "  vec4 dz = abs ( vec4 ( sceneDistance ( a / Extent ),\n"
+       << "                         sceneDistance ( vec2 ( b.x, a.y ) / Extent ),\n"
+       << "                         sceneDistance ( vec2 ( a.x, b.y ) / Extent ),\n"
+       << "                         sceneDistance ( b / Extent ) ) - z ) / max ( z, 0.0001 );\n"
+
+       << "  vec4 w = vec4 ( ( 1.0 - f.x ) * ( 1.0 - f.y ), f.x * ( 1.0 - f.y ), ( 1.0 - f.x ) * f.y, f.x * f.y );\n"
+       << "  w *= exp ( -Sharpness * d - DepthSharpness * dz );\n"
+
+       << "  gl_FragColor = ( c00 * w.x + c10 * w.y + c01 * w.z + c11 * w.w ) / max ( dot ( w, vec4 ( 1.0 ) ), 0.0001 );\n"
+       << "}\n";
+
+    return os.str();
+  }
+
+  // Quad over the viewport, given in clip coordinates.
+  std::string buildDepthVertexShader()
+  {
+    std::ostringstream os;
+
+    os << "varying vec2 screenCoord;\n"
+       << "void main()\n"
+       << "{\n"
+       << "  screenCoord = gl_Vertex.xy * 0.5 + 0.5;\n"
+       << "  gl_Position = vec4 ( gl_Vertex.xy, 0.0, 1.0 );\n"
+       << "}\n";
+
+    return os.str();
+  }
+
+  // Write the depth of the scene as the smaller image's projection puts it,
+  // so that the volumes are hidden by the geometry in front of them.
+  std::string buildDepthFragmentShader()
+  {
+    std::ostringstream os;
+
+    os << "uniform sampler2D SceneDepth;\n"
+       << "uniform mat4 SceneProjectionInverse;\n"
+       << "varying vec2 screenCoord;\n"
+
+       << "void main()\n"
+       << "{\n"
+       << "  float depth = texture2D ( SceneDepth, screenCoord ).x;\n"
+       << "  vec4 eye = SceneProjectionInverse * vec4 ( screenCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0 );\n"
+       << "  vec4 clip = gl_ProjectionMatrix * eye;\n"
+       << "  gl_FragDepth = ( depth < 1.0 ) ? clamp ( 0.5 * clip.z / clip.w + 0.5, 0.0, 1.0 ) : 1.0;\n"
+       << "}\n";
+
+    return os.str();
+  }
+
+  osg::Program* makeProgram ( const std::string &vertex, const std::string &fragment )
+  {
+    osg::ref_ptr < osg::Program > program ( new osg::Program );
+    program->addShader ( new osg::Shader ( osg::Shader::VERTEX, vertex ) );
+    program->addShader ( new osg::Shader ( osg::Shader::FRAGMENT, fragment ) );
+    return program.release();
+  }
+
+  // Copies the depth of what has been drawn in the viewport to a texture,
+  // and keeps the inverse of the projection it was drawn with.
+  class CopyDepth : public osg::Drawable
+  {
+  public:
+    CopyDepth ( osg::Texture2D *texture, osg::Uniform *inverseProjection ) : osg::Drawable(),
+      _texture ( texture ),
+      _inverseProjection ( inverseProjection )
+    {
+      this->setUseDisplayList ( false );
+    }
+
+    CopyDepth ( const CopyDepth &d, const osg::CopyOp &options ) : osg::Drawable ( d, options ),
+      _texture ( d._texture ),
+      _inverseProjection ( d._inverseProjection )
+    {
+    }
+
+    virtual osg::Object *cloneType() const { return new CopyDepth ( 0x0, 0x0 ); }
+    virtual osg::Object *clone ( const osg::CopyOp &options ) const { return new CopyDepth ( *this, options ); }
+
+    virtual void drawImplementation ( DrawArgs ) const
+    {
+#if OSG_VERSION_MAJOR <= 1 && OSG_VERSION_MINOR <= 2
+      this->_copy ( state );
+#else
+      this->_copy ( *info.getState() );
+#endif
+    }
+
+  protected:
+    virtual ~CopyDepth()
+    {
+    }
+
+    // Nothing is drawn, so there is no bound to cull or to fit the near and
+    // far planes to.
+    virtual osg::BoundingBox computeBound() const
+    {
+      return osg::BoundingBox();
+    }
+
+    void _copy ( osg::State &state ) const
+    {
+      GLint viewport[4] = { 0, 0, 0, 0 };
+      ::glGetIntegerv ( GL_VIEWPORT, viewport );
+      if ( false == _texture.valid() || false == _inverseProjection.valid() || viewport[2] < 1 || viewport[3] < 1 )
+        return;
+
+      // Our state set binds the texture on unit zero, so state knows what
+      // is bound there after the copy.
+      state.setActiveTextureUnit ( 0 );
+      _texture->copyTexImage2D ( state, viewport[0], viewport[1], viewport[2], viewport[3] );
+      _inverseProjection->set ( osg::Matrixd::inverse ( state.getProjectionMatrix() ) );
+    }
+
+  private:
+    CopyDepth &operator = ( const CopyDepth & );
+
+    osg::ref_ptr < osg::Texture2D > _texture;
+    osg::ref_ptr < osg::Uniform > _inverseProjection;
+  };
+
+  // Quad over the viewport for a vertex shader that leaves it in clip
+  // coordinates.  It has no bound, so it is never culled.
+  class ClipQuad : public osg::Drawable
+  {
+  public:
+    ClipQuad() : osg::Drawable()
+    {
+      this->setUseDisplayList ( false );
+    }
+
+    ClipQuad ( const ClipQuad &q, const osg::CopyOp &options ) : osg::Drawable ( q, options )
+    {
+    }
+
+    virtual osg::Object *cloneType() const { return new ClipQuad; }
+    virtual osg::Object *clone ( const osg::CopyOp &options ) const { return new ClipQuad ( *this, options ); }
+
+    virtual void drawImplementation ( DrawArgs ) const
+    {
+#if OSG_VERSION_MAJOR <= 1 && OSG_VERSION_MINOR <= 2
+      this->_draw ( state );
+#else
+      this->_draw ( *info.getState() );
+#endif
+    }
+
+  protected:
+    virtual ~ClipQuad()
+    {
+    }
+
+    virtual osg::BoundingBox computeBound() const
+    {
+      return osg::BoundingBox();
+    }
+
+    void _draw ( osg::State &state ) const
+    {
+      static const GLfloat vertices[] = { -1.0f, -1.0f, 0.0f, 1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 0.0f, -1.0f, 1.0f, 0.0f };
+      state.setVertexPointer ( 3, GL_FLOAT, 0, vertices );
+      ::glDrawArrays ( GL_QUADS, 0, 4 );
+      state.disableVertexPointer();
+    }
+  };
+
+  // Texture for the depth of a whole view.
+  osg::Texture2D* makeDepthTexture()
+  {
+    osg::ref_ptr < osg::Texture2D > texture ( new osg::Texture2D );
+    texture->setInternalFormat ( GL_DEPTH_COMPONENT );
+    texture->setSourceFormat ( GL_DEPTH_COMPONENT );
+    texture->setFilter ( osg::Texture::MIN_FILTER, osg::Texture::NEAREST );
+    texture->setFilter ( osg::Texture::MAG_FILTER, osg::Texture::NEAREST );
+    texture->setWrap ( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
+    texture->setWrap ( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE );
+    texture->setResizeNonPowerOfTwoHint ( false );
+    texture->setDataVariance ( osg::Object::DYNAMIC );
+    return texture.release();
+  }
+
+  // Texture as big as the screen.  Smaller images use the corner.
+  osg::Texture2D* makeTexture()
+  {
+    osg::ref_ptr < osg::Texture2D > texture ( new osg::Texture2D );
+    texture->setInternalFormat ( GL_RGBA );
+    texture->setFilter ( osg::Texture::MIN_FILTER, osg::Texture::NEAREST );
+    texture->setFilter ( osg::Texture::MAG_FILTER, osg::Texture::NEAREST );
+    texture->setWrap ( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
+    texture->setWrap ( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE );
+    texture->setResizeNonPowerOfTwoHint ( false );
+
+    // It is resized in the update, after the last frame is drawn.
+    texture->setDataVariance ( osg::Object::DYNAMIC );
+    return texture.release();
+  }
+
+  // Camera that draws the volumes into the texture after the scene.  Its
+  // first child writes the depth of the scene before the volumes are drawn.
+  osg::Camera* makeCamera ( osg::Texture2D *texture, osg::Texture2D *depth, osg::Node *sceneDepth )
+  {
+    osg::ref_ptr < osg::Camera > camera ( new osg::Camera );
+    camera->setRenderOrder ( osg::Camera::POST_RENDER, 0 );
+    camera->setRenderTargetImplementation ( osg::Camera::FRAME_BUFFER_OBJECT );
+    camera->setReferenceFrame ( osg::Camera::ABSOLUTE_RF );
+    camera->setClearColor ( osg::Vec4 ( 0.0f, 0.0f, 0.0f, 0.0f ) );
+    camera->setClearMask ( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+    camera->attach ( osg::Camera::COLOR_BUFFER, texture );
+    camera->attach ( osg::Camera::DEPTH_BUFFER, depth );
+    camera->addChild ( sceneDepth );
+
+    // Keep the colors premultiplied and the alpha right, whatever the volume
+    // asks for, so the image can be blended over the scene afterwards.
+    osg::ref_ptr < osg::BlendFunc > premultiply ( new osg::BlendFunc );
+    premultiply->setFunction ( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+    camera->getOrCreateStateSet()->setAttributeAndModes ( premultiply.get(), osg::StateAttribute::OVERRIDE | osg::StateAttribute::ON );
+
+    return camera.release();
+  }
+
+  // Node that writes the depth of the scene, in the copied texture, before
+  // anything else is drawn.
+  osg::Node* makeSceneDepth ( osg::Program *program, osg::Texture2D *sceneDepth, osg::Uniform *inverseProjection )
+  {
+    osg::ref_ptr < osg::Geode > geode ( new osg::Geode );
+    geode->addDrawable ( new ClipQuad );
+
+    osg::ref_ptr < osg::StateSet > ss ( geode->getOrCreateStateSet() );
+    ss->setAttributeAndModes ( program, osg::StateAttribute::ON );
+    ss->setAttributeAndModes ( new osg::Depth ( osg::Depth::ALWAYS ), osg::StateAttribute::ON );
+    ss->setAttribute ( new osg::ColorMask ( false, false, false, false ) );
+    ss->setMode ( GL_BLEND, osg::StateAttribute::OFF );
+    ss->setMode ( GL_CULL_FACE, osg::StateAttribute::OFF );
+    ss->setTextureAttribute ( 0, sceneDepth );
+    ss->addUniform ( new osg::Uniform ( "SceneDepth", 0 ) );
+    ss->addUniform ( inverseProjection );
+    ss->setRenderBinDetails ( -1, "RenderBin" );
+
+    return geode.release();
+  }
+
+  // Node that copies the depth of the scene once the opaque parts are drawn.
+  osg::Node* makeCopyDepth ( osg::Texture2D *sceneDepth, osg::Uniform *inverseProjection )
+  {
+    osg::ref_ptr < osg::Geode > geode ( new osg::Geode );
+    geode->addDrawable ( new CopyDepth ( sceneDepth, inverseProjection ) );
+
+    osg::ref_ptr < osg::StateSet > ss ( geode->getOrCreateStateSet() );
+    ss->setTextureAttribute ( 0, sceneDepth );
+    ss->setRenderBinDetails ( 999, "RenderBin" );
+
+    return geode.release();
+  }
+
+  // Camera that blends the smaller image over the screen, after it is drawn.
+  osg::Camera* makeScreen ( osg::Node *quad )
+  {
+    osg::ref_ptr < osg::Camera > screen ( new osg::Camera );
+    screen->setRenderOrder ( osg::Camera::POST_RENDER, 1 );
+    screen->setRenderTargetImplementation ( osg::Camera::FRAME_BUFFER );
+    screen->setReferenceFrame ( osg::Camera::ABSOLUTE_RF );
+    screen->setClearMask ( 0 );
+    screen->setViewMatrix ( osg::Matrix::identity() );
+    screen->setProjectionMatrixAsOrtho2D ( 0.0, 1.0, 0.0, 1.0 );
+    screen->setComputeNearFarMode ( osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR );
+    screen->setCullingMode ( osg::CullSettings::NO_CULLING );
+    screen->addChild ( quad );
+    return screen.release();
+  }
+
+  // Round down to 1, 2, 4 or 8.
+  unsigned int powerOfTwo ( unsigned int scale )
+  {
+    unsigned int power ( 1 );
+    while ( power * 2 <= scale && power < 8 )
+      power *= 2;
+    return power;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+ProgressiveVolume::ProgressiveVolume() : BaseClass(),
+  _interactiveScale ( 2 ),
+  _scale ( 1 ),
+  _idleTime ( 250.0 ),
+  _views(),
+  _mutex(),
+  _quad ( 0x0 ),
+  _depthProgram ( Detail::makeProgram ( Detail::buildDepthVertexShader(), Detail::buildDepthFragmentShader() ) ),
+  _sharpness ( new osg::Uniform ( "Sharpness", 16.0f ) ),
+  _depthSharpness ( new osg::Uniform ( "DepthSharpness", 32.0f ) )
+{
+  this->_construct();
+
+  // The views are changed in the update.
+  this->setNumChildrenRequiringUpdateTraversal ( this->getNumChildrenRequiringUpdateTraversal() + 1 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+ProgressiveVolume::~ProgressiveVolume()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Make the quad the views blend over the screen.  The textures and cameras
+//  of the views are made as the views are first seen.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgressiveVolume::_construct()
+{
+  // Quad over the screen.
+  osg::ref_ptr < osg::Vec3Array > vertices ( new osg::Vec3Array );
+  vertices->push_back ( osg::Vec3 ( 0.0f, 0.0f, 0.0f ) );
+  vertices->push_back ( osg::Vec3 ( 1.0f, 0.0f, 0.0f ) );
+  vertices->push_back ( osg::Vec3 ( 1.0f, 1.0f, 0.0f ) );
+  vertices->push_back ( osg::Vec3 ( 0.0f, 1.0f, 0.0f ) );
+
+  osg::ref_ptr < osg::Vec2Array > texCoords ( new osg::Vec2Array );
+  texCoords->push_back ( osg::Vec2 ( 0.0f, 0.0f ) );
+  texCoords->push_back ( osg::Vec2 ( 1.0f, 0.0f ) );
+  texCoords->push_back ( osg::Vec2 ( 1.0f, 1.0f ) );
+  texCoords->push_back ( osg::Vec2 ( 0.0f, 1.0f ) );
+
+  osg::ref_ptr < osg::Geometry > geometry ( new osg::Geometry );
+  geometry->setVertexArray ( vertices.get() );
+  geometry->setTexCoordArray ( 0, texCoords.get() );
+  geometry->addPrimitiveSet ( new osg::DrawArrays ( GL_QUADS, 0, vertices->size() ) );
+
+  osg::ref_ptr < osg::Geode > geode ( new osg::Geode );
+  geode->addDrawable ( geometry.get() );
+
+  // Blend the premultiplied image over the scene.  The parts of the volume
+  // behind opaque geometry were left out of it, and the filter keeps them
+  // from bleeding back in, so the depth test is not needed.  Each view binds
+  // its own textures and sizes when it draws the quad.
+  osg::ref_ptr < osg::StateSet > ss ( geode->getOrCreateStateSet() );
+
+  osg::ref_ptr < osg::BlendFunc > over ( new osg::BlendFunc );
+  over->setFunction ( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+  ss->setAttributeAndModes ( over.get(), osg::StateAttribute::ON );
+  ss->setMode ( GL_DEPTH_TEST, osg::StateAttribute::OFF );
+  ss->setMode ( GL_LIGHTING, osg::StateAttribute::OFF );
+
+  osg::ref_ptr < osg::Program > program ( Detail::makeProgram ( Detail::buildVertexShader(), Detail::buildFragmentShader() ) );
+  ss->setAttributeAndModes ( program.get(), osg::StateAttribute::ON );
+
+  ss->addUniform ( new osg::Uniform ( "Image", 0 ) );
+  ss->addUniform ( new osg::Uniform ( "SceneDepth", 1 ) );
+  ss->addUniform ( _sharpness.get() );
+  ss->addUniform ( _depthSharpness.get() );
+
+  _quad = geode.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the scale while the view changes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgressiveVolume::interactiveScale ( unsigned int scale )
+{
+  _interactiveScale = Detail::powerOfTwo ( scale );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the scale while the view changes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int ProgressiveVolume::interactiveScale () const
+{
+  return _interactiveScale;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the time before refining.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgressiveVolume::idleTime ( double ms )
+{
+  _idleTime = std::max ( 0.0, ms );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the time before refining.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double ProgressiveVolume::idleTime () const
+{
+  return _idleTime;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set how strongly the filter keeps edges.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgressiveVolume::edgeSharpness ( float sharpness )
+{
+  _sharpness->set ( std::max ( 0.0f, sharpness ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get how strongly the filter keeps edges.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+float ProgressiveVolume::edgeSharpness () const
+{
+  float sharpness ( 0.0f );
+  _sharpness->get ( sharpness );
+  return sharpness;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set how strongly the filter keeps apart pixels at different depths.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgressiveVolume::depthSharpness ( float sharpness )
+{
+  _depthSharpness->set ( std::max ( 0.0f, sharpness ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get how strongly the filter keeps apart pixels at different depths.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+float ProgressiveVolume::depthSharpness () const
+{
+  float sharpness ( 0.0f );
+  _depthSharpness->get ( sharpness );
+  return sharpness;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the scale of the last frame.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int ProgressiveVolume::scale () const
+{
+  OpenThreads::ScopedLock < Mutex > guard ( const_cast < Mutex & > ( _mutex ) );
+  return _scale;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the view the camera being culled draws, making it the first time.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+ProgressiveVolume::View &ProgressiveVolume::_view ( osgUtil::CullVisitor &cv )
+{
+  OpenThreads::ScopedLock < Mutex > guard ( _mutex );
+
+  // Elements of a map stay where they are as others are added.
+  View &view ( _views[cv.getCurrentCamera()] );
+  if ( false == view.camera.valid() )
+  {
+    view.texture = Detail::makeTexture();
+    view.depth = Detail::makeDepthTexture();
+    view.sceneDepth = Detail::makeDepthTexture();
+    view.inverseProjection = new osg::Uniform ( osg::Uniform::FLOAT_MAT4, "SceneProjectionInverse" );
+    view.inverseProjection->setDataVariance ( osg::Object::DYNAMIC );
+    view.camera = Detail::makeCamera ( view.texture.get(), view.depth.get(),
+                                       Detail::makeSceneDepth ( _depthProgram.get(), view.sceneDepth.get(), view.inverseProjection.get() ) );
+    view.copy = Detail::makeCopyDepth ( view.sceneDepth.get(), view.inverseProjection.get() );
+    view.screen = Detail::makeScreen ( _quad.get() );
+  }
+
+  return view;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Pick the scale for this frame.  It drops as soon as the view changes and
+//  halves each frame once the view has been still long enough.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgressiveVolume::_updateScale ( View &view, osgUtil::CullVisitor &cv )
+{
+  const osg::FrameStamp *fs ( cv.getFrameStamp() );
+
+  if ( 0x0 == fs || 0x0 == cv.getModelViewMatrix() || 0x0 == cv.getProjectionMatrix() )
+  {
+    view.scale = 1;
+    return;
+  }
+
+  // Drawn already this frame.
+  if ( view.started && fs->getFrameNumber() == view.frame )
+    return;
+
+  const double now ( fs->getReferenceTime() * 1000.0 );
+  const osg::Matrixd viewMatrix ( *cv.getModelViewMatrix() );
+  const osg::Matrixd projection ( *cv.getProjectionMatrix() );
+
+  if ( view.started && ( viewMatrix != view.viewMatrix || projection != view.projectionMatrix ) )
+    view.lastChange = now;
+  else if ( false == view.started )
+    view.lastChange = now - _idleTime;
+
+  view.viewMatrix = viewMatrix;
+  view.projectionMatrix = projection;
+  view.frame = fs->getFrameNumber();
+  view.started = true;
+
+  if ( ( now - view.lastChange ) < _idleTime )
+    view.scale = _interactiveScale;
+  else if ( view.scale > 1 )
+    view.scale /= 2;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Resize the textures the views asked for, and have the cameras draw the
+//  same children as we do, after the one that writes the scene's depth.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgressiveVolume::_update()
+{
+  for ( Views::iterator iter = _views.begin(); iter != _views.end(); ++iter )
+  {
+    View &view ( iter->second );
+
+    if ( view.wanted[0] != view.size[0] || view.wanted[1] != view.size[1] )
+    {
+      view.size[0] = view.wanted[0];
+      view.size[1] = view.wanted[1];
+
+      view.texture->setTextureSize ( view.size[0], view.size[1] );
+      view.texture->dirtyTextureObject();
+      view.depth->setTextureSize ( view.size[0], view.size[1] );
+      view.depth->dirtyTextureObject();
+
+      // Have the frame buffer object made again for the new texture.
+      view.camera->setRenderingCache ( 0x0 );
+    }
+
+    osg::Camera &camera ( *view.camera );
+    bool same ( camera.getNumChildren() == this->getNumChildren() + 1 );
+    for ( unsigned int i = 0; same && i < this->getNumChildren(); ++i )
+      same = ( camera.getChild ( i + 1 ) == this->getChild ( i ) );
+
+    if ( same )
+      continue;
+
+    camera.removeChildren ( 1, camera.getNumChildren() - 1 );
+    for ( unsigned int i = 0; i < this->getNumChildren(); ++i )
+      camera.addChild ( this->getChild ( i ) );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Draw the volumes, into the view's texture when the view is changing.
+//  The scene's depth is copied once the opaque parts are drawn, then the
+//  volumes are drawn into the texture, which is then blended over the
+//  screen.  Only this view's nodes and a state set made for this frame are
+//  touched.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgressiveVolume::_cull ( osgUtil::CullVisitor &cv )
+{
+  View &view ( this->_view ( cv ) );
+  this->_updateScale ( view, cv );
+
+  {
+    OpenThreads::ScopedLock < Mutex > guard ( _mutex );
+    _scale = view.scale;
+  }
+
+  // Full resolution goes straight to the screen.
+  const osg::Viewport *vp ( cv.getViewport() );
+  if ( 1 == view.scale || 0x0 == vp || vp->width() < 1 || vp->height() < 1 )
+  {
+    BaseClass::traverse ( cv );
+    return;
+  }
+
+  // Until the update makes the texture fit, draw to the screen.
+  const unsigned int width ( static_cast < unsigned int > ( vp->width() ) );
+  const unsigned int height ( static_cast < unsigned int > ( vp->height() ) );
+  view.wanted[0] = width;
+  view.wanted[1] = height;
+
+  if ( width != view.size[0] || height != view.size[1] || view.camera->getNumChildren() != this->getNumChildren() + 1 )
+  {
+    BaseClass::traverse ( cv );
+    return;
+  }
+
+  const unsigned int s ( std::max ( 1u, ( width  + view.scale - 1 ) / view.scale ) );
+  const unsigned int t ( std::max ( 1u, ( height + view.scale - 1 ) / view.scale ) );
+
+  // A new viewport, since the last frame's may still be drawing.
+  view.camera->setViewport ( new osg::Viewport ( 0, 0, s, t ) );
+  view.camera->setViewMatrix ( *cv.getModelViewMatrix() );
+  view.camera->setProjectionMatrix ( *cv.getProjectionMatrix() );
+  view.copy->accept ( cv );
+  view.camera->accept ( cv );
+
+  // Stretch this view's texture over the screen.
+  osg::ref_ptr < osg::StateSet > ss ( new osg::StateSet );
+  ss->setTextureAttributeAndModes ( 0, view.texture.get(), osg::StateAttribute::ON );
+  ss->setTextureAttribute ( 1, view.sceneDepth.get() );
+  ss->addUniform ( view.inverseProjection.get() );
+  ss->addUniform ( new osg::Uniform ( "TexelSize", osg::Vec2 ( 1.0f / width, 1.0f / height ) ) );
+  ss->addUniform ( new osg::Uniform ( "Extent", osg::Vec2 ( static_cast < float > ( s ) / width, static_cast < float > ( t ) / height ) ) );
+
+  cv.pushStateSet ( ss.get() );
+  view.screen->accept ( cv );
+  cv.popStateSet();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Draw the volumes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgressiveVolume::traverse ( osg::NodeVisitor &nv )
+{
+  if ( osg::NodeVisitor::UPDATE_VISITOR == nv.getVisitorType() )
+    this->_update();
+
+  osgUtil::CullVisitor *cv ( dynamic_cast < osgUtil::CullVisitor * > ( &nv ) );
+  if ( 0x0 != cv )
+    this->_cull ( *cv );
+  else
+    BaseClass::traverse ( nv );
+}
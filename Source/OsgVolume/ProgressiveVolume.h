@@ -0,0 +1,144 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Group that draws its volumes at a fraction of the screen resolution while
+//  the view changes.  The volumes are drawn into a texture, which is then
+//  stretched over the screen with a filter that keeps the edges between
+//  different colors, and between surfaces at different depths, sharp.  When
+//  the view stops, the resolution doubles each frame until the volumes are
+//  drawn to the screen again.
+//
+//  Works with Texture3DVolume and GPURayCasting, or anything else that
+//  blends over what is behind it.
+//
+//  Each view has its own textures and cameras, and its own scale.  The cull
+//  only picks the scale and draws.  The textures are resized, and the
+//  cameras given our children, in the update.
+//
+//  The smaller image is drawn after the rest of the scene.  The depth of
+//  the scene is copied to a texture first and written into the smaller
+//  image's depth buffer, so the parts of the volumes behind opaque geometry
+//  are left out, and the filter only blends pixels at about the same depth.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_PROGRESSIVE_VOLUME_H__
+#define __OSGTOOLS_VOLUME_PROGRESSIVE_VOLUME_H__
+
+#include "OsgVolume/Export.h"
+
+#include "osg/Camera"
+#include "osg/Group"
+#include "osg/Matrixd"
+#include "osg/Program"
+#include "osg/Texture2D"
+#include "osg/Uniform"
+
+#include "OpenThreads/Mutex"
+
+#include <map>
+
+namespace osgUtil { class CullVisitor; }
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT ProgressiveVolume : public osg::Group
+{
+public:
+  /// Typedefs.
+  typedef osg::Group                             BaseClass;
+
+  /// Construction.
+  ProgressiveVolume();
+
+  /// Get/Set how many screen pixels across one volume pixel covers while
+  /// the view changes.  It is rounded down to 1, 2, 4 or 8.
+  void                             interactiveScale ( unsigned int scale );
+  unsigned int                     interactiveScale () const;
+
+  /// Get/Set how long the view must be still before it is refined, in
+  /// milliseconds.
+  void                             idleTime ( double ms );
+  double                           idleTime () const;
+
+  /// Get/Set how strongly the filter keeps edges.  Zero is plain bilinear.
+  void                             edgeSharpness ( float sharpness );
+  float                            edgeSharpness () const;
+
+  /// Get/Set how strongly the filter keeps apart pixels at different depths
+  /// of the scene, for a difference in depth relative to the distance.
+  void                             depthSharpness ( float sharpness );
+  float                            depthSharpness () const;
+
+  /// Get the scale of the last view drawn.  One is full resolution.
+  unsigned int                     scale () const;
+
+  /// Draw the volumes.
+  virtual void                     traverse ( osg::NodeVisitor &nv );
+
+protected:
+  virtual ~ProgressiveVolume();
+
+  struct View
+  {
+    View() : texture ( 0x0 ), depth ( 0x0 ), camera ( 0x0 ), sceneDepth ( 0x0 ), inverseProjection ( 0x0 ), copy ( 0x0 ), screen ( 0x0 ), scale ( 1 ), lastChange ( 0.0 ), frame ( 0 ), started ( false ), viewMatrix(), projectionMatrix()
+    {
+      size[0] = size[1] = 0;
+      wanted[0] = wanted[1] = 0;
+    }
+
+    osg::ref_ptr < osg::Texture2D > texture;
+    osg::ref_ptr < osg::Texture2D > depth;
+    osg::ref_ptr < osg::Camera > camera;
+    osg::ref_ptr < osg::Texture2D > sceneDepth;
+    osg::ref_ptr < osg::Uniform > inverseProjection;
+    osg::ref_ptr < osg::Node > copy;
+    osg::ref_ptr < osg::Camera > screen;
+    unsigned int size[2];
+    unsigned int wanted[2];
+    unsigned int scale;
+    double lastChange;
+    unsigned int frame;
+    bool started;
+    osg::Matrixd viewMatrix;
+    osg::Matrixd projectionMatrix;
+  };
+
+  void                             _construct();
+  View &                           _view ( osgUtil::CullVisitor &cv );
+  void                             _updateScale ( View &view, osgUtil::CullVisitor &cv );
+  void                             _update();
+  void                             _cull ( osgUtil::CullVisitor &cv );
+
+private:
+
+  typedef OpenThreads::Mutex Mutex;
+  typedef std::map < const osg::Camera *, View > Views;
+
+  ProgressiveVolume ( const ProgressiveVolume & );
+  ProgressiveVolume &operator = ( const ProgressiveVolume & );
+
+  unsigned int                  _interactiveScale;
+  unsigned int                  _scale;
+  double                        _idleTime;
+  Views                         _views;
+  Mutex                         _mutex;
+  osg::ref_ptr < osg::Node >    _quad;
+  osg::ref_ptr < osg::Program > _depthProgram;
+  osg::ref_ptr < osg::Uniform > _sharpness;
+  osg::ref_ptr < osg::Uniform > _depthSharpness;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_PROGRESSIVE_VOLUME_H__
@@ -0,0 +1,661 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Load voxels of any precision from a raw file.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/RawVoxels.h"
+#include "OsgVolume/MappedImage.h"
+#include "OsgVolume/Parallel.h"
+
+#include "osg/Texture"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for converting the voxels.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // Read a voxel that may not be aligned, swapping its bytes if asked.
+  template < class T > inline T read ( const unsigned char *bytes, bool swap )
+  {
+    unsigned char ordered[sizeof ( T )];
+    if ( swap )
+    {
+      for ( unsigned int i = 0; i < sizeof ( T ); ++i )
+        ordered[i] = bytes[sizeof ( T ) - 1 - i];
+    }
+    else
+    {
+      std::memcpy ( ordered, bytes, sizeof ( T ) );
+    }
+
+    T value;
+    std::memcpy ( &value, ordered, sizeof ( T ) );
+    return value;
+  }
+
+  // What the voxels become.
+  inline GLenum outputType ( OsgVolume::RawVoxels::Type type, bool quantize )
+  {
+    if ( quantize )
+      return GL_UNSIGNED_BYTE;
+
+    switch ( type )
+    {
+    case OsgVolume::RawVoxels::UINT8:
+    case OsgVolume::RawVoxels::INT8:
+      return GL_UNSIGNED_BYTE;
+    case OsgVolume::RawVoxels::FLOAT32:
+    case OsgVolume::RawVoxels::FLOAT64:
+      return GL_FLOAT;
+    default:
+      return GL_UNSIGNED_SHORT;
+    }
+  }
+
+  // Largest output value.
+  inline double top ( GLenum type )
+  {
+    switch ( type )
+    {
+    case GL_UNSIGNED_BYTE:
+      return 255.0;
+    case GL_UNSIGNED_SHORT:
+      return 65535.0;
+    default:
+      return 1.0;
+    }
+  }
+
+  // Shift that moves signed voxels up to start at zero.
+  inline double shift ( OsgVolume::RawVoxels::Type type )
+  {
+    switch ( type )
+    {
+    case OsgVolume::RawVoxels::INT8:
+      return 128.0;
+    case OsgVolume::RawVoxels::INT16:
+      return 32768.0;
+    default:
+      return 0.0;
+    }
+  }
+
+  // Store a value as the output, rounded and clamped for integers.
+  template < class Out > struct Store
+  {
+    static Out convert ( double v )
+    {
+      const double high ( static_cast < double > ( std::numeric_limits < Out >::max() ) );
+      return static_cast < Out > ( std::min ( std::max ( v, 0.0 ), high ) + 0.5 );
+    }
+  };
+  template <> struct Store < float >
+  {
+    static float convert ( double v ) { return static_cast < float > ( v ); }
+  };
+
+  // Find the smallest and largest voxel of each slice.  Not-a-number is
+  // never smaller or larger, so it is left out.
+  template < class In > class SliceRange
+  {
+  public:
+    SliceRange ( const unsigned char *bytes, bool swap, unsigned int sliceSize, unsigned int numSlices ) :
+      _bytes ( bytes ),
+      _swap ( swap ),
+      _sliceSize ( sliceSize ),
+      _low  ( numSlices,  std::numeric_limits < double >::max() ),
+      _high ( numSlices, -std::numeric_limits < double >::max() )
+    {
+    }
+
+    void operator () ( unsigned int k )
+    {
+      const unsigned char *bytes ( _bytes + static_cast < std::size_t > ( k ) * _sliceSize * sizeof ( In ) );
+      double low ( _low[k] ), high ( _high[k] );
+
+      for ( unsigned int i = 0; i < _sliceSize; ++i )
+      {
+        const double v ( static_cast < double > ( Detail::read < In > ( bytes + i * sizeof ( In ), _swap ) ) );
+        if ( v < low )
+          low = v;
+        if ( v > high )
+          high = v;
+      }
+
+      _low[k] = low;
+      _high[k] = high;
+    }
+
+    void range ( double &low, double &high ) const
+    {
+      low = *std::min_element ( _low.begin(), _low.end() );
+      high = *std::max_element ( _high.begin(), _high.end() );
+    }
+
+  private:
+
+    SliceRange &operator = ( const SliceRange & );
+
+    const unsigned char *_bytes;
+    bool _swap;
+    unsigned int _sliceSize;
+    std::vector < double > _low;
+    std::vector < double > _high;
+  };
+
+  // Convert each slice to the output type with value * scale + shift.
+  template < class In, class Out > class ConvertSlices
+  {
+  public:
+    ConvertSlices ( const unsigned char *bytes, bool swap, unsigned int sliceSize, double scale, double shift, Out *voxels ) :
+      _bytes ( bytes ),
+      _swap ( swap ),
+      _sliceSize ( sliceSize ),
+      _scale ( scale ),
+      _shift ( shift ),
+      _voxels ( voxels )
+    {
+    }
+
+    void operator () ( unsigned int k )
+    {
+      const std::size_t first ( static_cast < std::size_t > ( k ) * _sliceSize );
+      const unsigned char *bytes ( _bytes + first * sizeof ( In ) );
+      Out *voxels ( _voxels + first );
+
+      for ( unsigned int i = 0; i < _sliceSize; ++i )
+      {
+        const double v ( static_cast < double > ( Detail::read < In > ( bytes + i * sizeof ( In ), _swap ) ) );
+        voxels[i] = Store < Out >::convert ( v * _scale + _shift );
+      }
+    }
+
+  private:
+
+    ConvertSlices &operator = ( const ConvertSlices & );
+
+    const unsigned char *_bytes;
+    bool _swap;
+    unsigned int _sliceSize;
+    double _scale;
+    double _shift;
+    Out *_voxels;
+  };
+
+  // Find the smallest and largest voxel on all processors.
+  template < class In > inline void range ( const unsigned char *bytes, bool swap, unsigned int sliceSize, unsigned int numSlices, double &low, double &high )
+  {
+    SliceRange < In > slices ( bytes, swap, sliceSize, numSlices );
+    OsgVolume::Parallel::forEach ( numSlices, slices );
+    slices.range ( low, high );
+  }
+
+  // Convert the slices from the first one into the image on all processors.
+  template < class In, class Out > inline void convert ( const unsigned char *bytes, bool swap, double scale, double shift, unsigned int first, unsigned int count, osg::Image &image )
+  {
+    const unsigned int sliceSize ( image.s() * image.t() );
+    const std::size_t skip ( static_cast < std::size_t > ( first ) * sliceSize );
+
+    ConvertSlices < In, Out > slices ( bytes + skip * sizeof ( In ), swap, sliceSize, scale, shift, reinterpret_cast < Out * > ( image.data() ) + skip );
+    OsgVolume::Parallel::forEach ( count, slices );
+  }
+
+  template < class In > inline void convert ( const unsigned char *bytes, bool swap, double scale, double shift, unsigned int first, unsigned int count, osg::Image &image )
+  {
+    switch ( image.getDataType() )
+    {
+    case GL_UNSIGNED_BYTE:
+      Detail::convert < In, unsigned char > ( bytes, swap, scale, shift, first, count, image );
+      break;
+    case GL_UNSIGNED_SHORT:
+      Detail::convert < In, unsigned short > ( bytes, swap, scale, shift, first, count, image );
+      break;
+    case GL_FLOAT:
+      Detail::convert < In, float > ( bytes, swap, scale, shift, first, count, image );
+      break;
+    }
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+RawVoxels::Layout::Layout() :
+  type ( RawVoxels::UINT8 ),
+  endian ( RawVoxels::hostEndian() ),
+  offset ( 0 ),
+  rescale ( false ),
+  quantize ( false )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the type from the name.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+RawVoxels::Type RawVoxels::type ( const std::string &name )
+{
+  if ( name.empty() || "uint8" == name || "uchar" == name || "unsigned char" == name )
+    return RawVoxels::UINT8;
+  if ( "int8" == name || "char" == name || "signed char" == name )
+    return RawVoxels::INT8;
+  if ( "uint16" == name || "ushort" == name || "unsigned short" == name )
+    return RawVoxels::UINT16;
+  if ( "int16" == name || "short" == name )
+    return RawVoxels::INT16;
+  if ( "uint32" == name || "uint" == name || "unsigned int" == name )
+    return RawVoxels::UINT32;
+  if ( "int32" == name || "int" == name )
+    return RawVoxels::INT32;
+  if ( "float32" == name || "float" == name )
+    return RawVoxels::FLOAT32;
+  if ( "float64" == name || "double" == name )
+    return RawVoxels::FLOAT64;
+
+  throw std::runtime_error ( "Error 3071569412: unknown voxel type '" + name + "'" );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the byte order from the name.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+RawVoxels::Endian RawVoxels::endian ( const std::string &name )
+{
+  if ( name.empty() )
+    return RawVoxels::hostEndian();
+  if ( "little" == name )
+    return RawVoxels::LITTLE_ENDIAN_ORDER;
+  if ( "big" == name )
+    return RawVoxels::BIG_ENDIAN_ORDER;
+
+  throw std::runtime_error ( "Error 1648320957: unknown byte order '" + name + "'" );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the byte order of this machine.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+RawVoxels::Endian RawVoxels::hostEndian()
+{
+  const unsigned short one ( 1 );
+  return ( 1 == *reinterpret_cast < const unsigned char * > ( &one ) ) ? RawVoxels::LITTLE_ENDIAN_ORDER : RawVoxels::BIG_ENDIAN_ORDER;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of bytes in a voxel of the type.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int RawVoxels::numBytes ( Type type )
+{
+  switch ( type )
+  {
+  case RawVoxels::UINT8:
+  case RawVoxels::INT8:
+    return 1;
+  case RawVoxels::UINT16:
+  case RawVoxels::INT16:
+    return 2;
+  case RawVoxels::UINT32:
+  case RawVoxels::INT32:
+  case RawVoxels::FLOAT32:
+    return 4;
+  case RawVoxels::FLOAT64:
+    return 8;
+  }
+  return 1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Is the type rescaled when the file does not say?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool RawVoxels::rescaleByDefault ( Type type )
+{
+  return ( RawVoxels::numBytes ( type ) > 2 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Are voxels of the layout drawn as they are?  Bytes, shorts and floats
+//  in the order of this machine, aligned and left alone, are.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool RawVoxels::mapped ( const Layout &layout )
+{
+  const unsigned int bytes ( RawVoxels::numBytes ( layout.type ) );
+  const bool swap ( bytes > 1 && layout.endian != RawVoxels::hostEndian() );
+  const bool aligned ( 0 == layout.offset % bytes );
+  const bool known ( RawVoxels::UINT8 == layout.type || RawVoxels::UINT16 == layout.type || RawVoxels::FLOAT32 == layout.type );
+
+  return ( known && false == swap && aligned && false == layout.rescale && false == layout.quantize );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the texture format that keeps the precision of the data type.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+GLint RawVoxels::internalFormat ( GLenum dataType )
+{
+  switch ( dataType )
+  {
+  case GL_UNSIGNED_BYTE:
+    return GL_LUMINANCE;
+  case GL_FLOAT:
+    return GL_LUMINANCE32F_ARB;
+  default:
+    return GL_LUMINANCE16;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Load the volume.  Bytes, shorts and floats that need nothing done to
+//  them are mapped straight into the image.  Everything else is converted
+//  into a new image, after which the file is let go.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* RawVoxels::load ( const std::string &filename, const Layout &layout, unsigned int s, unsigned int t, unsigned int r )
+{
+  if ( 0 == s || 0 == t || 0 == r )
+    throw std::runtime_error ( "Error 2590417736: raw volume '" + filename + "' has no voxels" );
+
+  if ( RawVoxels::mapped ( layout ) )
+  {
+    switch ( layout.type )
+    {
+    case RawVoxels::UINT8:
+      return new MappedImage ( filename, layout.offset, s, t, r, GL_LUMINANCE, GL_LUMINANCE, GL_UNSIGNED_BYTE );
+    case RawVoxels::UINT16:
+      return new MappedImage ( filename, layout.offset, s, t, r, GL_LUMINANCE16, GL_LUMINANCE, GL_UNSIGNED_SHORT );
+    case RawVoxels::FLOAT32:
+      return new MappedImage ( filename, layout.offset, s, t, r, RawVoxels::internalFormat ( GL_FLOAT ), GL_LUMINANCE, GL_FLOAT );
+    default:
+      break;
+    }
+  }
+
+  SliceReader::RefPtr reader ( new SliceReader ( filename, layout, s, t, r ) );
+
+  osg::ref_ptr < osg::Image > image ( new osg::Image );
+  image->allocateImage ( s, t, r, GL_LUMINANCE, reader->dataType() );
+  image->setInternalTextureFormat ( reader->internalFormat() );
+
+  reader->read ( 0, r, *image );
+  return image.release();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.  The file is mapped as bytes, since the voxels may not be
+//  aligned or in the order of this machine.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+RawVoxels::SliceReader::SliceReader ( const std::string &filename, const Layout &layout, unsigned int s, unsigned int t, unsigned int r ) : BaseClass(),
+  _filename ( filename ),
+  _layout ( layout ),
+  _swap ( false ),
+  _scale ( 1.0 ),
+  _shift ( 0.0 ),
+  _dataType ( Detail::outputType ( layout.type, layout.quantize ) ),
+  _file ( 0x0 )
+{
+  if ( 0 == s || 0 == t || 0 == r )
+    throw std::runtime_error ( "Error 1409337861: raw volume '" + filename + "' has no voxels" );
+
+  _size[0] = s;
+  _size[1] = t;
+  _size[2] = r;
+
+  _file = new MappedImage ( filename, layout.offset, s * RawVoxels::numBytes ( layout.type ), t, r, GL_LUMINANCE, GL_LUMINANCE, GL_UNSIGNED_BYTE );
+
+  this->_init();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor for voxels already in memory.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+RawVoxels::SliceReader::SliceReader ( osg::Image *bytes, const Layout &layout, unsigned int s, unsigned int t, unsigned int r ) : BaseClass(),
+  _filename ( ( 0x0 != bytes ) ? bytes->getFileName() : std::string() ),
+  _layout ( layout ),
+  _swap ( false ),
+  _scale ( 1.0 ),
+  _shift ( 0.0 ),
+  _dataType ( Detail::outputType ( layout.type, layout.quantize ) ),
+  _file ( bytes )
+{
+  if ( 0 == s || 0 == t || 0 == r )
+    throw std::runtime_error ( "Error 1409337861: raw volume '" + _filename + "' has no voxels" );
+
+  _size[0] = s;
+  _size[1] = t;
+  _size[2] = r;
+
+  const unsigned long long needed ( static_cast < unsigned long long > ( s ) * t * r * RawVoxels::numBytes ( layout.type ) );
+  if ( 0x0 == bytes || 0x0 == bytes->data() || static_cast < unsigned long long > ( bytes->getTotalSizeInBytes() ) < needed )
+    throw std::runtime_error ( "Error 2718160935: voxels in memory are fewer than the raw volume '" + _filename + "' needs" );
+
+  _layout.offset = 0;
+
+  this->_init();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Find the scale and shift.  When the voxels are rescaled, all of them
+//  are read once to find their range.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void RawVoxels::SliceReader::_init()
+{
+  const Layout &layout ( _layout );
+  const unsigned int bytes ( RawVoxels::numBytes ( layout.type ) );
+  _swap = ( bytes > 1 && layout.endian != RawVoxels::hostEndian() );
+
+  const bool rescale ( layout.rescale || layout.quantize || RawVoxels::UINT32 == layout.type || RawVoxels::INT32 == layout.type );
+  if ( false == rescale )
+  {
+    _shift = Detail::shift ( layout.type );
+    return;
+  }
+
+  const unsigned char *data ( _file->data() );
+  const unsigned int sliceSize ( _size[0] * _size[1] );
+  const unsigned int r ( _size[2] );
+  double low ( 0 ), high ( 0 );
+
+  switch ( layout.type )
+  {
+  case RawVoxels::UINT8:
+    Detail::range < unsigned char > ( data, _swap, sliceSize, r, low, high );
+    break;
+  case RawVoxels::INT8:
+    Detail::range < signed char > ( data, _swap, sliceSize, r, low, high );
+    break;
+  case RawVoxels::UINT16:
+    Detail::range < unsigned short > ( data, _swap, sliceSize, r, low, high );
+    break;
+  case RawVoxels::INT16:
+    Detail::range < short > ( data, _swap, sliceSize, r, low, high );
+    break;
+  case RawVoxels::UINT32:
+    Detail::range < unsigned int > ( data, _swap, sliceSize, r, low, high );
+    break;
+  case RawVoxels::INT32:
+    Detail::range < int > ( data, _swap, sliceSize, r, low, high );
+    break;
+  case RawVoxels::FLOAT32:
+    Detail::range < float > ( data, _swap, sliceSize, r, low, high );
+    break;
+  case RawVoxels::FLOAT64:
+    Detail::range < double > ( data, _swap, sliceSize, r, low, high );
+    break;
+  default:
+    throw std::runtime_error ( "Error 1183975064: voxel type of '" + _filename + "' not supported" );
+  }
+
+  // A volume of one value, or of nothing but not-a-number, becomes zero.
+  _scale = ( high > low ) ? Detail::top ( _dataType ) / ( high - low ) : 0.0;
+  _shift = ( high > low ) ? -low * _scale : 0.0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+RawVoxels::SliceReader::~SliceReader()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the size of the volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int RawVoxels::SliceReader::s() const
+{
+  return _size[0];
+}
+unsigned int RawVoxels::SliceReader::t() const
+{
+  return _size[1];
+}
+unsigned int RawVoxels::SliceReader::r() const
+{
+  return _size[2];
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the type the voxels become.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+GLenum RawVoxels::SliceReader::dataType() const
+{
+  return _dataType;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the texture format the voxels become.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+GLint RawVoxels::SliceReader::internalFormat() const
+{
+  return RawVoxels::internalFormat ( _dataType );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Convert the slices into the image on all processors.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void RawVoxels::SliceReader::read ( unsigned int first, unsigned int count, osg::Image &image ) const
+{
+  if ( static_cast < unsigned int > ( image.s() ) != _size[0] ||
+       static_cast < unsigned int > ( image.t() ) != _size[1] ||
+       static_cast < unsigned int > ( image.r() ) != _size[2] ||
+       image.getDataType() != _dataType || 0x0 == image.data() )
+  {
+    throw std::runtime_error ( "Error 3922087145: image does not match the raw volume '" + _filename + "'" );
+  }
+
+  if ( first > _size[2] || count > _size[2] - first )
+    throw std::runtime_error ( "Error 2260947713: slices are past the end of the raw volume '" + _filename + "'" );
+
+  const unsigned char *data ( _file->data() );
+
+  switch ( _layout.type )
+  {
+  case RawVoxels::UINT8:
+    Detail::convert < unsigned char > ( data, _swap, _scale, _shift, first, count, image );
+    break;
+  case RawVoxels::INT8:
+    Detail::convert < signed char > ( data, _swap, _scale, _shift, first, count, image );
+    break;
+  case RawVoxels::UINT16:
+    Detail::convert < unsigned short > ( data, _swap, _scale, _shift, first, count, image );
+    break;
+  case RawVoxels::INT16:
+    Detail::convert < short > ( data, _swap, _scale, _shift, first, count, image );
+    break;
+  case RawVoxels::UINT32:
+    Detail::convert < unsigned int > ( data, _swap, _scale, _shift, first, count, image );
+    break;
+  case RawVoxels::INT32:
+    Detail::convert < int > ( data, _swap, _scale, _shift, first, count, image );
+    break;
+  case RawVoxels::FLOAT32:
+    Detail::convert < float > ( data, _swap, _scale, _shift, first, count, image );
+    break;
+  case RawVoxels::FLOAT64:
+    Detail::convert < double > ( data, _swap, _scale, _shift, first, count, image );
+    break;
+  }
+}
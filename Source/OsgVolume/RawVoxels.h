@@ -0,0 +1,168 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Load voxels of any precision from a raw file.  Voxels the volumes can
+//  draw as they are stay mapped from the file.  Others are converted in one
+//  pass on all processors: bytes are swapped, signed values are shifted and
+//  wide values are scaled into the range of 8 or 16 bit textures.  The
+//  slice reader does the same a few slices at a time, so that a volume can
+//  be drawn while the rest of it loads.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_RAW_VOXELS_H__
+#define __OSGTOOLS_VOLUME_RAW_VOXELS_H__
+
+#include "OsgVolume/Export.h"
+
+#include "Usul/Base/Referenced.h"
+#include "Usul/Pointers/Pointers.h"
+
+#include "osg/Image"
+#include "osg/ref_ptr"
+
+#include <cstddef>
+#include <string>
+
+namespace OsgVolume {
+namespace RawVoxels {
+
+
+/// Voxel types found in raw files.
+enum Type
+{
+  UINT8,
+  INT8,
+  UINT16,
+  INT16,
+  UINT32,
+  INT32,
+  FLOAT32,
+  FLOAT64
+};
+
+
+/// Byte orders.
+enum Endian
+{
+  LITTLE_ENDIAN_ORDER,
+  BIG_ENDIAN_ORDER
+};
+
+
+/// How the file is laid out and what to make of it.
+struct OSG_VOLUME_EXPORT Layout
+{
+  Layout();
+
+  Type type;
+  Endian endian;
+  std::size_t offset;
+
+  /// Stretch the smallest and largest voxels over the whole range of the
+  /// texture.  Always done for 32 bit integers, which have no texture.
+  bool rescale;
+
+  /// Make 8 bit voxels whatever the type, scaled from the smallest to the
+  /// largest voxel.
+  bool quantize;
+};
+
+
+/// Get the type from names like "uint16", "short" or "float".  An empty
+/// name is UINT8.  Throws if the name is not known.
+OSG_VOLUME_EXPORT Type          type ( const std::string &name );
+
+/// Get the byte order from "little" or "big".  An empty name is the order
+/// of this machine.  Throws if the name is not known.
+OSG_VOLUME_EXPORT Endian        endian ( const std::string &name );
+
+/// Get the byte order of this machine.
+OSG_VOLUME_EXPORT Endian        hostEndian();
+
+/// Get the number of bytes in a voxel of the type.
+OSG_VOLUME_EXPORT unsigned int  numBytes ( Type type );
+
+/// Is the type rescaled when the file does not say?  True for 32 bit
+/// integers and floats, which are scaled to [0,1].
+OSG_VOLUME_EXPORT bool          rescaleByDefault ( Type type );
+
+/// Get the texture format that keeps all of the precision of voxels of the
+/// data type: 8 or 16 bit luminance, or 32 bit float luminance for floats,
+/// which are neither clamped nor quantized.
+OSG_VOLUME_EXPORT GLint         internalFormat ( GLenum dataType );
+
+/// Are voxels of the layout drawn as they are, so that load() maps them
+/// straight from the file instead of converting them?
+OSG_VOLUME_EXPORT bool          mapped ( const Layout &layout );
+
+/// Load the volume.  Throws if the file cannot be mapped or is too small.
+OSG_VOLUME_EXPORT osg::Image*   load ( const std::string &filename, const Layout &layout, unsigned int s, unsigned int t, unsigned int r );
+
+
+/// Converts the voxels of a mapped file into an image a few slices at a
+/// time.  The file stays mapped while the reader lives.
+class OSG_VOLUME_EXPORT SliceReader : public Usul::Base::Referenced
+{
+public:
+  /// Typedefs.
+  typedef Usul::Base::Referenced BaseClass;
+
+  USUL_DECLARE_REF_POINTERS ( SliceReader );
+
+  /// Map the file.  When the voxels are rescaled, all of them are read
+  /// here once to find their range.  Throws like load().
+  SliceReader ( const std::string &filename, const Layout &layout, unsigned int s, unsigned int t, unsigned int r );
+
+  /// Use voxels that are already in memory, from the first byte of the
+  /// image; the offset of the layout is not used.  Throws if the image is
+  /// too small.
+  SliceReader ( osg::Image *bytes, const Layout &layout, unsigned int s, unsigned int t, unsigned int r );
+
+  /// Get the size of the volume.
+  unsigned int                  s() const;
+  unsigned int                  t() const;
+  unsigned int                  r() const;
+
+  /// Get the type and texture format the voxels become.
+  GLenum                        dataType() const;
+  GLint                         internalFormat() const;
+
+  /// Convert the slices into the image, which must be of the size and
+  /// type above.  Throws if it is not or the slices are past the end.
+  void                          read ( unsigned int first, unsigned int count, osg::Image &image ) const;
+
+protected:
+  virtual ~SliceReader();
+
+  void                          _init();
+
+private:
+
+  SliceReader ( const SliceReader & );
+  SliceReader &operator = ( const SliceReader & );
+
+  std::string _filename;
+  Layout _layout;
+  unsigned int _size[3];
+  bool _swap;
+  double _scale;
+  double _shift;
+  GLenum _dataType;
+  osg::ref_ptr < osg::Image > _file;
+};
+
+
+} // namespace RawVoxels
+} // namespace OsgVolume
+
+
+#endif // __OSGTOOLS_VOLUME_RAW_VOXELS_H__
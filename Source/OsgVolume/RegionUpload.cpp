@@ -0,0 +1,291 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Sends one box of voxels from an image to a texture.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/RegionUpload.h"
+
+#include "osg/State"
+
+#include <algorithm>
+#include <cmath>
+
+#ifndef GL_UNPACK_SKIP_IMAGES
+#define GL_UNPACK_SKIP_IMAGES 0x806D
+#endif
+
+#ifndef GL_UNPACK_IMAGE_HEIGHT
+#define GL_UNPACK_IMAGE_HEIGHT 0x806E
+#endif
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+RegionUpload::Region::Region()
+{
+  for ( unsigned int a = 0; a < 3; ++a )
+  {
+    offset[a] = 0;
+    size[a] = 0;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Does the region have any voxels?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool RegionUpload::Region::valid() const
+{
+  return size[0] > 0 && size[1] > 0 && size[2] > 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Are the regions the same?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool RegionUpload::Region::operator == ( const Region &region ) const
+{
+  for ( unsigned int a = 0; a < 3; ++a )
+  {
+    if ( offset[a] != region.offset[a] || size[a] != region.size[a] )
+      return false;
+  }
+  return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Are the regions different?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool RegionUpload::Region::operator != ( const Region &region ) const
+{
+  return false == ( *this == region );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+RegionUpload::RegionUpload ( osg::Image *image, const Region &region ) : BaseClass(),
+  _image ( image ),
+  _region ( region ),
+  _mutex(),
+  _uploaded()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+RegionUpload::~RegionUpload()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Make a texture the size of the region.  It has no image, so osg never
+//  sends the whole volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Texture3D* RegionUpload::texture ( osg::Image *image, const Region &region )
+{
+  osg::ref_ptr < osg::Texture3D > texture ( new osg::Texture3D );
+
+  // The caller may change the internal format afterwards.
+  if ( 0x0 != image )
+  {
+    texture->setInternalFormatMode ( osg::Texture::USE_USER_DEFINED_FORMAT );
+    texture->setInternalFormat ( image->getInternalTextureFormat() );
+    texture->setSourceFormat ( image->getPixelFormat() );
+    texture->setSourceType ( image->getDataType() );
+  }
+
+  texture->setTextureSize ( region.size[0], region.size[1], region.size[2] );
+  texture->setSubloadCallback ( new RegionUpload ( image, region ) );
+
+  return texture.release();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the whole voxels covering the texture coordinates.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+RegionUpload::Region RegionUpload::region ( const osg::Image &image, const osg::Vec3 &lower, const osg::Vec3 &upper )
+{
+  const int dims[3] = { image.s(), image.t(), std::max ( 1, image.r() ) };
+
+  Region region;
+  for ( unsigned int a = 0; a < 3; ++a )
+  {
+    if ( dims[a] <= 0 )
+      return Region();
+
+    const double first ( std::floor ( std::min ( lower[a], upper[a] ) * dims[a] ) );
+    const double last  ( std::ceil  ( std::max ( lower[a], upper[a] ) * dims[a] ) );
+
+    const int begin ( static_cast < int > ( std::max ( 0.0, std::min ( first, static_cast < double > ( dims[a] ) ) ) ) );
+    const int end   ( static_cast < int > ( std::max ( 0.0, std::min ( last,  static_cast < double > ( dims[a] ) ) ) ) );
+
+    if ( end <= begin )
+      return Region();
+
+    region.offset[a] = static_cast < unsigned int > ( begin );
+    region.size[a] = static_cast < unsigned int > ( end - begin );
+  }
+
+  return region;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* RegionUpload::image() const
+{
+  return _image.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the region.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const RegionUpload::Region& RegionUpload::region() const
+{
+  return _region;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Is the region inside the image?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool RegionUpload::_fits() const
+{
+  if ( false == _image.valid() || 0x0 == _image->data() || false == _region.valid() )
+    return false;
+
+  const int dims[3] = { _image->s(), _image->t(), std::max ( 1, _image->r() ) };
+  for ( unsigned int a = 0; a < 3; ++a )
+  {
+    if ( static_cast < int > ( _region.offset[a] + _region.size[a] ) > dims[a] )
+      return false;
+  }
+  return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Allocate the texture and send the region.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void RegionUpload::load ( const osg::Texture3D &texture, osg::State &state ) const
+{
+  const unsigned int context ( state.getContextID() );
+  const osg::Texture3D::Extensions *extensions ( osg::Texture3D::getExtensions ( context, true ) );
+
+  {
+    Guard guard ( _mutex );
+    _uploaded[context] = 0;
+  }
+
+  if ( 0x0 == extensions || false == this->_fits() )
+    return;
+
+  extensions->glTexImage3D ( GL_TEXTURE_3D, 0, texture.getInternalFormat(),
+                             _region.size[0], _region.size[1], _region.size[2], 0,
+                             _image->getPixelFormat(), _image->getDataType(), 0x0 );
+
+  this->subload ( texture, state );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Send the region if the image changed since it was last sent.  The image
+//  is read in place; the pixel store skips to the first voxel and strides
+//  over the rest of each row and slice.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void RegionUpload::subload ( const osg::Texture3D &, osg::State &state ) const
+{
+  const unsigned int context ( state.getContextID() );
+  const osg::Texture3D::Extensions *extensions ( osg::Texture3D::getExtensions ( context, true ) );
+
+  if ( 0x0 == extensions || false == this->_fits() )
+    return;
+
+  // Zero means never sent, so counts are kept one up.
+  const unsigned int modified ( _image->getModifiedCount() + 1 );
+  {
+    Guard guard ( _mutex );
+    if ( _uploaded[context] == modified )
+      return;
+    _uploaded[context] = modified;
+  }
+
+  glPixelStorei ( GL_UNPACK_ALIGNMENT,    _image->getPacking() );
+  glPixelStorei ( GL_UNPACK_ROW_LENGTH,   _image->s() );
+  glPixelStorei ( GL_UNPACK_IMAGE_HEIGHT, _image->t() );
+  glPixelStorei ( GL_UNPACK_SKIP_PIXELS,  _region.offset[0] );
+  glPixelStorei ( GL_UNPACK_SKIP_ROWS,    _region.offset[1] );
+  glPixelStorei ( GL_UNPACK_SKIP_IMAGES,  _region.offset[2] );
+
+  extensions->glTexSubImage3D ( GL_TEXTURE_3D, 0, 0, 0, 0,
+                                _region.size[0], _region.size[1], _region.size[2],
+                                _image->getPixelFormat(), _image->getDataType(), _image->data() );
+
+  // Put the pixel store back for everyone else.
+  glPixelStorei ( GL_UNPACK_ROW_LENGTH,   0 );
+  glPixelStorei ( GL_UNPACK_IMAGE_HEIGHT, 0 );
+  glPixelStorei ( GL_UNPACK_SKIP_PIXELS,  0 );
+  glPixelStorei ( GL_UNPACK_SKIP_ROWS,    0 );
+  glPixelStorei ( GL_UNPACK_SKIP_IMAGES,  0 );
+}
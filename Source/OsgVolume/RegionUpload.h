@@ -0,0 +1,96 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Sends one box of voxels from an image to a texture just big enough for
+//  it.  The rest of the image never leaves main memory.  The box is sent
+//  again whenever the image is dirtied.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_REGION_UPLOAD_H__
+#define __OSGTOOLS_VOLUME_REGION_UPLOAD_H__
+
+#include "OsgVolume/Export.h"
+
+#include "OpenThreads/Mutex"
+#include "OpenThreads/ScopedLock"
+
+#include "osg/Image"
+#include "osg/Texture3D"
+#include "osg/Vec3"
+#include "osg/buffered_value"
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT RegionUpload : public osg::Texture3D::SubloadCallback
+{
+public:
+  /// Typedefs.
+  typedef osg::Texture3D::SubloadCallback        BaseClass;
+  typedef osg::ref_ptr < RegionUpload >          RefPtr;
+  typedef osg::ref_ptr < osg::Image >            ImagePtr;
+  typedef OpenThreads::Mutex                     Mutex;
+  typedef OpenThreads::ScopedLock < Mutex >      Guard;
+
+  /// The first voxel and the number of voxels on each axis.
+  struct OSG_VOLUME_EXPORT Region
+  {
+    Region();
+
+    bool                           valid() const;
+    bool                           operator == ( const Region &region ) const;
+    bool                           operator != ( const Region &region ) const;
+
+    unsigned int                   offset[3];
+    unsigned int                   size[3];
+  };
+
+  /// Construction.
+  RegionUpload ( osg::Image *image, const Region &region );
+
+  /// Make a texture the size of the region that gets its voxels from the image.
+  static osg::Texture3D*           texture ( osg::Image *image, const Region &region );
+
+  /// Get the whole voxels covering the texture coordinates from lower to
+  /// upper.  The region is not valid when they cover none of the image.
+  static Region                    region ( const osg::Image &image, const osg::Vec3 &lower, const osg::Vec3 &upper );
+
+  /// Get the image and region.
+  osg::Image*                      image() const;
+  const Region&                    region() const;
+
+  /// Allocate the texture and send the region.
+  virtual void                     load ( const osg::Texture3D &texture, osg::State &state ) const;
+
+  /// Send the region again if the image changed.
+  virtual void                     subload ( const osg::Texture3D &texture, osg::State &state ) const;
+
+protected:
+  virtual ~RegionUpload();
+
+  bool                             _fits() const;
+
+private:
+
+  RegionUpload ( const RegionUpload & );
+  RegionUpload &operator = ( const RegionUpload & );
+
+  ImagePtr                      _image;
+  Region                        _region;
+  mutable Mutex                 _mutex;
+  mutable osg::buffered_value < unsigned int > _uploaded;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_REGION_UPLOAD_H__
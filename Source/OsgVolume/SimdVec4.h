@@ -0,0 +1,172 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Four floats that are operated on together.  Uses SSE when the compiler
+//  targets it, otherwise plain loops that the optimizer can still vectorize.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_SIMD_VEC4_H__
+#define __OSGTOOLS_VOLUME_SIMD_VEC4_H__
+
+#ifndef OSG_VOLUME_USE_SSE
+# if defined ( __SSE2__ ) || defined ( _M_X64 ) || ( defined ( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#  define OSG_VOLUME_USE_SSE 1
+# else
+#  define OSG_VOLUME_USE_SSE 0
+# endif
+#endif
+
+#if OSG_VOLUME_USE_SSE
+# include <xmmintrin.h>
+#else
+# include <cmath>
+#endif
+
+namespace OsgVolume {
+namespace Simd {
+
+
+class Vec4
+{
+public:
+
+#if OSG_VOLUME_USE_SSE
+
+  Vec4() : _v ( _mm_setzero_ps() )
+  {
+  }
+
+  explicit Vec4 ( float s ) : _v ( _mm_set1_ps ( s ) )
+  {
+  }
+
+  Vec4 ( float x, float y, float z, float w ) : _v ( _mm_setr_ps ( x, y, z, w ) )
+  {
+  }
+
+  /// Load four floats.  The pointer does not have to be aligned.
+  static Vec4 load ( const float *p )
+  {
+    return Vec4 ( _mm_loadu_ps ( p ) );
+  }
+
+  /// Store four floats.  The pointer does not have to be aligned.
+  void store ( float *p ) const
+  {
+    _mm_storeu_ps ( p, _v );
+  }
+
+  Vec4 operator + ( const Vec4 &b ) const { return Vec4 ( _mm_add_ps ( _v, b._v ) ); }
+  Vec4 operator - ( const Vec4 &b ) const { return Vec4 ( _mm_sub_ps ( _v, b._v ) ); }
+  Vec4 operator * ( const Vec4 &b ) const { return Vec4 ( _mm_mul_ps ( _v, b._v ) ); }
+  Vec4 operator / ( const Vec4 &b ) const { return Vec4 ( _mm_div_ps ( _v, b._v ) ); }
+
+  /// Component-wise square root.
+  static Vec4 sqrt ( const Vec4 &a ) { return Vec4 ( _mm_sqrt_ps ( a._v ) ); }
+
+  /// Component-wise minimum and maximum.
+  static Vec4 minimum ( const Vec4 &a, const Vec4 &b ) { return Vec4 ( _mm_min_ps ( a._v, b._v ) ); }
+  static Vec4 maximum ( const Vec4 &a, const Vec4 &b ) { return Vec4 ( _mm_max_ps ( a._v, b._v ) ); }
+
+  /// Broadcast the fourth component.
+  Vec4 wwww() const { return Vec4 ( _mm_shuffle_ps ( _v, _v, _MM_SHUFFLE ( 3, 3, 3, 3 ) ) ); }
+
+  float w() const
+  {
+    return _mm_cvtss_f32 ( _mm_shuffle_ps ( _v, _v, _MM_SHUFFLE ( 3, 3, 3, 3 ) ) );
+  }
+
+private:
+
+  explicit Vec4 ( __m128 v ) : _v ( v )
+  {
+  }
+
+  __m128 _v;
+
+#else
+
+  Vec4()
+  {
+    _v[0] = _v[1] = _v[2] = _v[3] = 0.0f;
+  }
+
+  explicit Vec4 ( float s )
+  {
+    _v[0] = _v[1] = _v[2] = _v[3] = s;
+  }
+
+  Vec4 ( float x, float y, float z, float w )
+  {
+    _v[0] = x; _v[1] = y; _v[2] = z; _v[3] = w;
+  }
+
+  /// Load four floats.
+  static Vec4 load ( const float *p )
+  {
+    return Vec4 ( p[0], p[1], p[2], p[3] );
+  }
+
+  /// Store four floats.
+  void store ( float *p ) const
+  {
+    for ( unsigned int i = 0; i < 4; ++i )
+      p[i] = _v[i];
+  }
+
+  Vec4 operator + ( const Vec4 &b ) const { Vec4 r; for ( unsigned int i = 0; i < 4; ++i ) r._v[i] = _v[i] + b._v[i]; return r; }
+  Vec4 operator - ( const Vec4 &b ) const { Vec4 r; for ( unsigned int i = 0; i < 4; ++i ) r._v[i] = _v[i] - b._v[i]; return r; }
+  Vec4 operator * ( const Vec4 &b ) const { Vec4 r; for ( unsigned int i = 0; i < 4; ++i ) r._v[i] = _v[i] * b._v[i]; return r; }
+  Vec4 operator / ( const Vec4 &b ) const { Vec4 r; for ( unsigned int i = 0; i < 4; ++i ) r._v[i] = _v[i] / b._v[i]; return r; }
+
+  /// Component-wise square root.
+  static Vec4 sqrt ( const Vec4 &a ) { Vec4 r; for ( unsigned int i = 0; i < 4; ++i ) r._v[i] = std::sqrt ( a._v[i] ); return r; }
+
+  /// Component-wise minimum and maximum.
+  static Vec4 minimum ( const Vec4 &a, const Vec4 &b ) { Vec4 r; for ( unsigned int i = 0; i < 4; ++i ) r._v[i] = ( a._v[i] < b._v[i] ) ? a._v[i] : b._v[i]; return r; }
+  static Vec4 maximum ( const Vec4 &a, const Vec4 &b ) { Vec4 r; for ( unsigned int i = 0; i < 4; ++i ) r._v[i] = ( a._v[i] > b._v[i] ) ? a._v[i] : b._v[i]; return r; }
+
+  /// Broadcast the fourth component.
+  Vec4 wwww() const { return Vec4 ( _v[3] ); }
+
+  float w() const
+  {
+    return _v[3];
+  }
+
+private:
+
+  float _v[4];
+
+#endif
+};
+
+
+/// Linear interpolation: a + ( b - a ) * u.
+inline Vec4 lerp ( const Vec4 &a, const Vec4 &b, const Vec4 &u )
+{
+  return a + ( b - a ) * u;
+}
+
+
+/// Clamp each component to [0,1].
+inline Vec4 saturate ( const Vec4 &v )
+{
+  return Vec4::minimum ( Vec4::maximum ( v, Vec4 ( 0.0f ) ), Vec4 ( 1.0f ) );
+}
+
+
+} // namespace Simd
+} // namespace OsgVolume
+
+
+#endif // __OSGTOOLS_VOLUME_SIMD_VEC4_H__
@@ -0,0 +1,146 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Image that is filled a few slices at a time while it is drawn.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/SlabImage.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+SlabImage::SlabImage ( int s, int t, int r, GLint internalFormat, GLenum pixelFormat, GLenum type ) : BaseClass(),
+  _mutex(),
+  _numLoaded ( 0 ),
+  _voxels ( 0x0 )
+{
+  this->allocateImage ( s, t, r, pixelFormat, type );
+  this->setInternalTextureFormat ( internalFormat );
+
+  if ( 0x0 != this->data() )
+    std::memset ( this->data(), 0, this->getTotalSizeInBytes() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.  Nothing is read here.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+SlabImage::SlabImage ( osg::Image *voxels ) : BaseClass(),
+  _mutex(),
+  _numLoaded ( 0 ),
+  _voxels ( voxels )
+{
+  if ( _voxels.valid() && 0x0 != _voxels->data() )
+    this->setImage ( _voxels->s(), _voxels->t(), _voxels->r(), _voxels->getInternalTextureFormat(), _voxels->getPixelFormat(),
+                     _voxels->getDataType(), _voxels->data(), osg::Image::NO_DELETE, _voxels->getPacking() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+SlabImage::~SlabImage()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Is the image one of these that is still loading?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool SlabImage::loading ( const osg::Image *image )
+{
+  const SlabImage *slabs ( dynamic_cast < const SlabImage * > ( image ) );
+  return ( 0x0 != slabs && false == slabs->complete() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of slices loaded.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int SlabImage::numLoaded() const
+{
+  Guard guard ( _mutex );
+  return _numLoaded;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the number of slices loaded.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void SlabImage::numLoaded ( unsigned int slices )
+{
+  Guard guard ( _mutex );
+  _numLoaded = std::min ( std::max ( _numLoaded, slices ), static_cast < unsigned int > ( std::max ( 1, this->r() ) ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Are all the slices loaded?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool SlabImage::complete() const
+{
+  return this->numLoaded() >= static_cast < unsigned int > ( std::max ( 1, this->r() ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Touch a byte of every page of the slices.  Pages are never smaller than
+//  this, so every one is read from the file here rather than on the draw
+//  thread when the slices are sent.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void SlabImage::pageIn ( unsigned int first, unsigned int count ) const
+{
+  const unsigned int r ( static_cast < unsigned int > ( std::max ( 1, this->r() ) ) );
+  if ( 0x0 == this->data() || first >= r )
+    return;
+
+  const std::size_t PAGE ( 4096 );
+  const std::size_t slice ( this->getImageSizeInBytes() );
+  const unsigned char *bytes ( this->data() + slice * first );
+  const std::size_t size ( slice * std::min ( count, r - first ) );
+
+  volatile unsigned char sum ( 0 );
+  for ( std::size_t i = 0; i < size; i += PAGE )
+    sum += bytes[i];
+  if ( size > 0 )
+    sum += bytes[size - 1];
+}
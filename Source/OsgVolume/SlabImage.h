@@ -0,0 +1,80 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Image that is filled a few slices at a time while it is drawn.  Slices
+//  from zero up to the number loaded hold voxels; the rest are drawn as
+//  zero.  A texture made with SlabUpload sends each slice once it is
+//  loaded.  The voxels may be another image's, such as a mapped file, that
+//  are used in place; loading their slices pages them in.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_SLAB_IMAGE_H__
+#define __OSGTOOLS_VOLUME_SLAB_IMAGE_H__
+
+#include "OsgVolume/Export.h"
+
+#include "OpenThreads/Mutex"
+#include "OpenThreads/ScopedLock"
+
+#include "osg/Image"
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT SlabImage : public osg::Image
+{
+public:
+  /// Typedefs.
+  typedef osg::Image                             BaseClass;
+  typedef osg::ref_ptr < SlabImage >             RefPtr;
+  typedef OpenThreads::Mutex                     Mutex;
+  typedef OpenThreads::ScopedLock < Mutex >      Guard;
+
+  /// Make the image with every voxel zero and no slices loaded.
+  SlabImage ( int s, int t, int r, GLint internalFormat, GLenum pixelFormat, GLenum type );
+
+  /// Use the voxels of the image in place, with no slices loaded.  The
+  /// image is kept while this one lives.
+  SlabImage ( osg::Image *voxels );
+
+  /// Is the image one of these that is still loading?
+  static bool                      loading ( const osg::Image *image );
+
+  /// Get/Set the number of slices loaded.  Set it after the voxels of the
+  /// slices are in place.  It never goes down.
+  unsigned int                     numLoaded() const;
+  void                             numLoaded ( unsigned int slices );
+
+  /// Are all the slices loaded?
+  bool                             complete() const;
+
+  /// Touch a byte of every page of the slices, so that voxels used in place
+  /// are in memory before the slices are said to be loaded.
+  void                             pageIn ( unsigned int first, unsigned int count ) const;
+
+protected:
+  virtual ~SlabImage();
+
+private:
+
+  SlabImage ( const SlabImage & );
+  SlabImage &operator = ( const SlabImage & );
+
+  mutable Mutex                 _mutex;
+  unsigned int                  _numLoaded;
+  osg::ref_ptr < osg::Image >   _voxels;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_SLAB_IMAGE_H__
@@ -0,0 +1,164 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Sends an image that is still loading to a texture.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/SlabUpload.h"
+
+#include "osg/State"
+
+#include <algorithm>
+#include <vector>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+SlabUpload::SlabUpload ( SlabImage *image ) : BaseClass(),
+  _image ( image ),
+  _mutex(),
+  _uploaded()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+SlabUpload::~SlabUpload()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Make a texture the size of the image.  It has no image, so osg never
+//  sends the volume on its own.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Texture3D* SlabUpload::texture ( SlabImage *image )
+{
+  osg::ref_ptr < osg::Texture3D > texture ( new osg::Texture3D );
+
+  if ( 0x0 != image )
+  {
+    texture->setInternalFormatMode ( osg::Texture::USE_USER_DEFINED_FORMAT );
+    texture->setInternalFormat ( image->getInternalTextureFormat() );
+    texture->setSourceFormat ( image->getPixelFormat() );
+    texture->setSourceType ( image->getDataType() );
+    texture->setTextureSize ( image->s(), image->t(), std::max ( 1, image->r() ) );
+  }
+
+  texture->setSubloadCallback ( new SlabUpload ( image ) );
+
+  return texture.release();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+SlabImage* SlabUpload::image() const
+{
+  return _image.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Allocate the texture, send the slices loaded and zero the rest.  The
+//  slices not loaded are never read from the image, since they may be
+//  pages of a mapped file that are not in memory yet.  The count is taken
+//  before sending, so slices that arrive while it is sent go again next
+//  time.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void SlabUpload::load ( const osg::Texture3D &texture, osg::State &state ) const
+{
+  const unsigned int context ( state.getContextID() );
+  const osg::Texture3D::Extensions *extensions ( osg::Texture3D::getExtensions ( context, true ) );
+
+  if ( 0x0 == extensions || false == _image.valid() || 0x0 == _image->data() )
+    return;
+
+  const unsigned int loaded ( _image->numLoaded() );
+  const int r ( std::max ( 1, _image->r() ) );
+
+  glPixelStorei ( GL_UNPACK_ALIGNMENT, _image->getPacking() );
+  extensions->glTexImage3D ( GL_TEXTURE_3D, 0, texture.getInternalFormat(),
+                             _image->s(), _image->t(), r, 0,
+                             _image->getPixelFormat(), _image->getDataType(), 0x0 );
+
+  if ( loaded > 0 )
+  {
+    extensions->glTexSubImage3D ( GL_TEXTURE_3D, 0, 0, 0, 0,
+                                  _image->s(), _image->t(), loaded,
+                                  _image->getPixelFormat(), _image->getDataType(), _image->data() );
+  }
+
+  const std::vector < unsigned char > zeros ( ( static_cast < int > ( loaded ) < r ) ? _image->getImageSizeInBytes() : 0, 0 );
+  for ( int k = loaded; k < r; ++k )
+  {
+    extensions->glTexSubImage3D ( GL_TEXTURE_3D, 0, 0, 0, k,
+                                  _image->s(), _image->t(), 1,
+                                  _image->getPixelFormat(), _image->getDataType(), &zeros[0] );
+  }
+
+  Guard guard ( _mutex );
+  _uploaded[context] = loaded;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Send the slices loaded since the last time.  They are whole slices one
+//  after the other in the image, so they go in one call.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void SlabUpload::subload ( const osg::Texture3D &, osg::State &state ) const
+{
+  const unsigned int context ( state.getContextID() );
+  const osg::Texture3D::Extensions *extensions ( osg::Texture3D::getExtensions ( context, true ) );
+
+  if ( 0x0 == extensions || false == _image.valid() || 0x0 == _image->data() )
+    return;
+
+  const unsigned int loaded ( _image->numLoaded() );
+  unsigned int first ( 0 );
+  {
+    Guard guard ( _mutex );
+    first = _uploaded[context];
+    if ( loaded <= first )
+      return;
+    _uploaded[context] = loaded;
+  }
+
+  glPixelStorei ( GL_UNPACK_ALIGNMENT, _image->getPacking() );
+  extensions->glTexSubImage3D ( GL_TEXTURE_3D, 0, 0, 0, first,
+                                _image->s(), _image->t(), loaded - first,
+                                _image->getPixelFormat(), _image->getDataType(), _image->data ( 0, 0, first ) );
+}
@@ -0,0 +1,73 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Sends an image that is still loading to a texture.  The texture is made
+//  once with the slices loaded so far, and after that only the slices
+//  loaded since the last draw are sent.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_SLAB_UPLOAD_H__
+#define __OSGTOOLS_VOLUME_SLAB_UPLOAD_H__
+
+#include "OsgVolume/Export.h"
+#include "OsgVolume/SlabImage.h"
+
+#include "OpenThreads/Mutex"
+#include "OpenThreads/ScopedLock"
+
+#include "osg/Texture3D"
+#include "osg/buffered_value"
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT SlabUpload : public osg::Texture3D::SubloadCallback
+{
+public:
+  /// Typedefs.
+  typedef osg::Texture3D::SubloadCallback        BaseClass;
+  typedef osg::ref_ptr < SlabUpload >            RefPtr;
+  typedef OpenThreads::Mutex                     Mutex;
+  typedef OpenThreads::ScopedLock < Mutex >      Guard;
+
+  /// Construction.
+  SlabUpload ( SlabImage *image );
+
+  /// Make a texture the size of the image that gets its slices as they load.
+  static osg::Texture3D*           texture ( SlabImage *image );
+
+  /// Get the image.
+  SlabImage*                       image() const;
+
+  /// Allocate the texture and send the slices loaded.  The rest are zero.
+  virtual void                     load ( const osg::Texture3D &texture, osg::State &state ) const;
+
+  /// Send the slices loaded since the last time.
+  virtual void                     subload ( const osg::Texture3D &texture, osg::State &state ) const;
+
+protected:
+  virtual ~SlabUpload();
+
+private:
+
+  SlabUpload ( const SlabUpload & );
+  SlabUpload &operator = ( const SlabUpload & );
+
+  SlabImage::RefPtr             _image;
+  mutable Mutex                 _mutex;
+  mutable osg::buffered_value < unsigned int > _uploaded;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_SLAB_UPLOAD_H__
@@ -9,14 +9,24 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "OsgVolume/Texture3DVolume.h"
+#include "OsgVolume/LevelDrawable.h"
+#include "OsgVolume/ProgramCache.h"
+#include "OsgVolume/SlabUpload.h"
+#include "OsgVolume/TransferFunction1D.h"
+#include "OsgVolume/Voxels.h"
 
 #include "Usul/Bits/Bits.h"
 
 #include "osg/Texture1D"
-#include "osg/Texture3D"
+#include "osg/Texture2D"
 #include "osg/Shader"
 #include "osg/BlendFunc"
 
+#include "osgUtil/CullVisitor"
+
+#include "OpenThreads/ScopedLock"
+
+#include <algorithm>
 #include <sstream>
 
 using namespace OsgVolume;
@@ -31,14 +41,41 @@ using namespace OsgVolume;
 Texture3DVolume::Texture3DVolume() : BaseClass (),
   _volume ( 0x0, 0 ),
   _geometry ( new Geometry ),
-  _flags ( _USE_TRANSFER_FUNCTION ),
+  _flags ( _USE_TRANSFER_FUNCTION | _SPECIALIZE ),
   _transferFunction ( 0x0 ),
   _tfTextureUnit ( 1 ),
   _program ( Texture3DVolume::createProgram() ),
   _bbLengths ( new osg::Uniform ( "bb", osg::Vec3 ( 1.0f, 1.0f, 1.0f ) ) ),
   _bbMin ( new osg::Uniform ( "bbMin", osg::Vec3 ( 0.0f, 0.0f, 0.0f ) ) ),
   _volumeSampler ( new osg::Uniform ( "Volume", 0 ) ),
-  _tfSampler ( new osg::Uniform ( "TransferFunction", 1 ) )
+  _tfSampler ( new osg::Uniform ( "TransferFunction", 1 ) ),
+  _preIntegrationUnit ( 3 ),
+  _preIntegrated ( new osg::Uniform ( "PreIntegrated", false ) ),
+  _preIntegrationSampler ( new osg::Uniform ( "PreIntegrationTable", 3 ) ),
+  _numPlanes ( new osg::Uniform ( "NumPlanes", 1.0f ) ),
+  _gradientUnit ( 2 ),
+  _gradient ( 0x0 ),
+  _gradientTexture ( 0x0 ),
+  _shading ( new osg::Uniform ( "Shading", false ) ),
+  _useGradientVolume ( new osg::Uniform ( "UseGradientVolume", false ) ),
+  _gradientSampler ( new osg::Uniform ( "Gradient", 2 ) ),
+  _voxelSize ( new osg::Uniform ( "VoxelSize", osg::Vec3 ( 0.01f, 0.01f, 0.01f ) ) ),
+  _voxelLength ( new osg::Uniform ( "VoxelLength", osg::Vec3 ( 0.0f, 0.0f, 0.0f ) ) ),
+  _texOffset ( new osg::Uniform ( "TexOffset", osg::Vec3 ( 0.0f, 0.0f, 0.0f ) ) ),
+  _texScale ( new osg::Uniform ( "TexScale", osg::Vec3 ( 1.0f, 1.0f, 1.0f ) ) ),
+  _compressedUnit ( 4 ),
+  _compressedVolume ( 0x0 ),
+  _compressed ( new osg::Uniform ( "Compressed", false ) ),
+  _bb ( osg::Vec3 ( -1.0f, -1.0f, -1.0f ), osg::Vec3 ( 1.0f, 1.0f, 1.0f ) ),
+  _windowOffset ( 0.0f, 0.0f, 0.0f ),
+  _windowScale ( 1.0f, 1.0f, 1.0f ),
+  _roi(),
+  _region(),
+  _pyramid ( 0x0 ),
+  _levelStateSets(),
+  _levelDrawables(),
+  _level ( 0 ),
+  _levelMutex()
 {
   this->_construct();
 }
@@ -60,7 +97,34 @@ Texture3DVolume::Texture3DVolume( osg::Program *program ) : BaseClass (),
   _bbLengths ( new osg::Uniform ( "bb", osg::Vec3 ( 1.0f, 1.0f, 1.0f ) ) ),
   _bbMin ( new osg::Uniform ( "bbMin", osg::Vec3 ( 0.0f, 0.0f, 0.0f ) ) ),
   _volumeSampler ( new osg::Uniform ( "Volume", 0 ) ),
-  _tfSampler ( new osg::Uniform ( "TransferFunction", 1 ) )
+  _tfSampler ( new osg::Uniform ( "TransferFunction", 1 ) ),
+  _preIntegrationUnit ( 3 ),
+  _preIntegrated ( new osg::Uniform ( "PreIntegrated", false ) ),
+  _preIntegrationSampler ( new osg::Uniform ( "PreIntegrationTable", 3 ) ),
+  _numPlanes ( new osg::Uniform ( "NumPlanes", 1.0f ) ),
+  _gradientUnit ( 2 ),
+  _gradient ( 0x0 ),
+  _gradientTexture ( 0x0 ),
+  _shading ( new osg::Uniform ( "Shading", false ) ),
+  _useGradientVolume ( new osg::Uniform ( "UseGradientVolume", false ) ),
+  _gradientSampler ( new osg::Uniform ( "Gradient", 2 ) ),
+  _voxelSize ( new osg::Uniform ( "VoxelSize", osg::Vec3 ( 0.01f, 0.01f, 0.01f ) ) ),
+  _voxelLength ( new osg::Uniform ( "VoxelLength", osg::Vec3 ( 0.0f, 0.0f, 0.0f ) ) ),
+  _texOffset ( new osg::Uniform ( "TexOffset", osg::Vec3 ( 0.0f, 0.0f, 0.0f ) ) ),
+  _texScale ( new osg::Uniform ( "TexScale", osg::Vec3 ( 1.0f, 1.0f, 1.0f ) ) ),
+  _compressedUnit ( 4 ),
+  _compressedVolume ( 0x0 ),
+  _compressed ( new osg::Uniform ( "Compressed", false ) ),
+  _bb ( osg::Vec3 ( -1.0f, -1.0f, -1.0f ), osg::Vec3 ( 1.0f, 1.0f, 1.0f ) ),
+  _windowOffset ( 0.0f, 0.0f, 0.0f ),
+  _windowScale ( 1.0f, 1.0f, 1.0f ),
+  _roi(),
+  _region(),
+  _pyramid ( 0x0 ),
+  _levelStateSets(),
+  _levelDrawables(),
+  _level ( 0 ),
+  _levelMutex()
 {
   this->_construct();
 }
@@ -92,9 +156,22 @@ void Texture3DVolume::_construct()
   ss->addUniform ( _bbMin.get() );
   ss->addUniform ( _volumeSampler.get() );
   ss->addUniform ( _tfSampler.get() );
+  ss->addUniform ( _preIntegrated.get() );
+  ss->addUniform ( _preIntegrationSampler.get() );
+  ss->addUniform ( _numPlanes.get() );
+  ss->addUniform ( _shading.get() );
+  ss->addUniform ( _useGradientVolume.get() );
+  ss->addUniform ( _gradientSampler.get() );
+  ss->addUniform ( _voxelSize.get() );
+  ss->addUniform ( _voxelLength.get() );
+  ss->addUniform ( _texOffset.get() );
+  ss->addUniform ( _texScale.get() );
+  ss->addUniform ( _compressed.get() );
+  _numPlanes->set ( static_cast<float> ( _geometry->numPlanes() ) );
   
   // Add the program
   ss->setAttributeAndModes( _program.get(), osg::StateAttribute::ON | osg::StateAttribute::PROTECTED );
+  this->_applyProgram();
   
   // Add the planes.
   this->addDrawable ( _geometry.get() );
@@ -147,27 +224,46 @@ void Texture3DVolume::image ( osg::Image* image, TextureUnit unit )
   _volume.first = image;
   _volume.second = unit;
 
-  // Create the 3D texture.
-  osg::ref_ptr < osg::Texture3D > texture3D ( new osg::Texture3D );
-  texture3D->setImage( image );
-  
-  //texture3D->setUnRefImageDataAfterApply ( true );
+  // Find the voxels under the region of interest, if there is one.
+  this->_applyRegion();
 
-  texture3D->setFilter( osg::Texture3D::MIN_FILTER, osg::Texture3D::LINEAR );
-  texture3D->setFilter( osg::Texture3D::MAG_FILTER, osg::Texture3D::LINEAR );
-  texture3D->setWrap( osg::Texture3D::WRAP_R, osg::Texture3D::CLAMP_TO_EDGE );
-  texture3D->setWrap( osg::Texture3D::WRAP_S, osg::Texture3D::CLAMP_TO_EDGE );
-  texture3D->setWrap( osg::Texture3D::WRAP_T, osg::Texture3D::CLAMP_TO_EDGE );
+  // Compressed blocks take the place of the texture.
+  if ( false == this->_applyCompression() )
+  {
+    // Create the 3D texture.  With a region only its voxels are sent, and
+    // an image still loading is sent a few slices at a time.
+    SlabImage *slabs ( SlabImage::loading ( image ) ? static_cast < SlabImage * > ( image ) : 0x0 );
+    osg::ref_ptr < osg::Texture3D > texture3D ( _region.valid() ? RegionUpload::texture ( image, _region ) :
+                                                ( 0x0 != slabs ) ? SlabUpload::texture ( slabs ) : new osg::Texture3D );
+    if ( false == _region.valid() && 0x0 == slabs )
+      texture3D->setImage( image );
+    
+    //texture3D->setUnRefImageDataAfterApply ( true );
 
-  // Resize if we are suppose to.
-  texture3D->setResizeNonPowerOfTwoHint( this->resizePowerTwo() );
+    texture3D->setFilter( osg::Texture3D::MIN_FILTER, osg::Texture3D::LINEAR );
+    texture3D->setFilter( osg::Texture3D::MAG_FILTER, osg::Texture3D::LINEAR );
+    texture3D->setWrap( osg::Texture3D::WRAP_R, osg::Texture3D::CLAMP_TO_EDGE );
+    texture3D->setWrap( osg::Texture3D::WRAP_S, osg::Texture3D::CLAMP_TO_EDGE );
+    texture3D->setWrap( osg::Texture3D::WRAP_T, osg::Texture3D::CLAMP_TO_EDGE );
 
-  // Get the state set.
-  osg::ref_ptr< osg::StateSet > ss ( this->getOrCreateStateSet() );
-  ss->setTextureAttributeAndModes ( unit, texture3D.get(), osg::StateAttribute::ON );
+    // Resize if we are suppose to.
+    texture3D->setResizeNonPowerOfTwoHint( this->resizePowerTwo() );
+
+    this->getOrCreateStateSet()->setTextureAttributeAndModes ( unit, texture3D.get(), osg::StateAttribute::ON );
+
+    // Coarser copies to draw from when the volume is small on screen.
+    this->_applyPyramid ( texture3D.get() );
+  }
+  else
+  {
+    this->_applyPyramid ( 0x0 );
+  }
   
   // Set the uniform value.
   _volumeSampler->set ( static_cast<int> ( unit ) );
+
+  // The gradients depend on the image.
+  this->_applyShading();
 }
 
 
@@ -179,7 +275,9 @@ void Texture3DVolume::image ( osg::Image* image, TextureUnit unit )
 
 unsigned int Texture3DVolume::numPlanes() const
 {
-  return _geometry->numPlanes();
+  float num ( 1.0f );
+  _numPlanes->get ( num );
+  return static_cast<unsigned int> ( num );
 }
 
 
@@ -191,7 +289,10 @@ unsigned int Texture3DVolume::numPlanes() const
 
 void Texture3DVolume::numPlanes ( unsigned int num )
 {
-  _geometry->numPlanes( num );
+  _numPlanes->set ( static_cast<float> ( num ) );
+
+  // A region of interest gets its share of the planes.
+  this->_applyRegion();
 }
 
 
@@ -210,13 +311,30 @@ namespace Detail
 
     os << "uniform vec3 bb;\n";
     os << "uniform vec3 bbMin;\n";
+    os << "uniform float NumPlanes;\n";
+    os << "uniform vec3 TexOffset;\n";
+    os << "uniform vec3 TexScale;\n";
+    os << "uniform vec3 VoxelLength;\n";
     os << "varying vec4 vertex;\n";
+    os << "varying float opacityExponent;\n";
     os << "void main(void)\n";
     os << "{\n";
-    os << "   gl_TexCoord[0].x =  ( ( gl_Vertex.x - bbMin.x ) ) / bb.x;\n";
-    os << "   gl_TexCoord[0].y =  ( ( gl_Vertex.y - bbMin.y ) ) / bb.y;\n";
-    os << "   gl_TexCoord[0].z =  ( ( gl_Vertex.z - bbMin.z ) ) / bb.z;\n";
+    os << "   gl_TexCoord[0].x =  TexOffset.x + TexScale.x * ( ( gl_Vertex.x - bbMin.x ) ) / bb.x;\n";
+    os << "   gl_TexCoord[0].y =  TexOffset.y + TexScale.y * ( ( gl_Vertex.y - bbMin.y ) ) / bb.y;\n";
+    os << "   gl_TexCoord[0].z =  TexOffset.z + TexScale.z * ( ( gl_Vertex.z - bbMin.z ) ) / bb.z;\n";
     os << "   gl_TexCoord[0].w =  ( gl_Vertex.w + 1.0 ) / 2.0;\n";
+
+    // Where the ray through this vertex meets the next slice back.  The
+    // slices are the depth of the box divided by the number of planes apart.
+    os << "   vec3 axis = normalize ( ( gl_ModelViewMatrixInverse * vec4 ( 0.0, 0.0, -1.0, 0.0 ) ).xyz );\n";
+    os << "   vec3 eye = ( gl_ModelViewMatrixInverse * vec4 ( 0.0, 0.0, 0.0, 1.0 ) ).xyz;\n";
+    os << "   vec3 ray = ( 0.0 == gl_ProjectionMatrix[3][3] ) ? normalize ( gl_Vertex.xyz - eye ) : axis;\n";
+    os << "   float spacing = dot ( abs ( axis ), bb ) / NumPlanes;\n";
+    os << "   vec3 back = gl_Vertex.xyz + ray * ( spacing / max ( dot ( ray, axis ), 0.01 ) );\n";
+    os << "   gl_TexCoord[1] = vec4 ( TexOffset + TexScale * ( back - bbMin ) / bb, 1.0 );\n";
+
+    // The transfer function's opacities are for slices one voxel apart.
+    os << "   opacityExponent = all ( greaterThan ( VoxelLength, vec3 ( 0.0 ) ) ) ? length ( ( back - gl_Vertex.xyz ) / VoxelLength ) : 1.0;\n";
     os << "   gl_Position = ftransform();\n";
     os << "   vertex = gl_ModelViewMatrix * gl_Vertex;\n";
     os << "   gl_ClipVertex = vertex;\n";
@@ -276,51 +394,81 @@ namespace Detail
     "}\n"
   };
 
-  static const char* fragTransferFunctionSource = 
+  // The scalar at a texture coordinate, from either kind of storage.
+  static const char* volumeUniformsSource = 
   {
-    "uniform sampler3D Volume;\n"
-    "uniform sampler1D TransferFunction;\n"
-    "varying vec4 vertex;\n"
-    "void main(void)\n"
-    "{\n"    
-    "  float index = vec4( texture3D( Volume, gl_TexCoord[0].xyz ) ).x;\n"
-    "  vec4 color = vec4( texture1D( TransferFunction, index ) );\n"
-    "  gl_FragColor = vec4( color );\n"
-    "}\n"
+  "uniform sampler3D Volume;\n"
+  "uniform bool Compressed;\n"
   };
-  
-  static const char* fragTransferFunctionSourceWithShading = 
+
+  static const char* volumeScalarSource = 
+  {
+  "float volumeScalar ( vec3 texCoord )\n"
+  "{\n"
+  "  if ( Compressed )\n"
+  "    return compressedScalar ( Volume, texCoord );\n"
+  "  return texture3D ( Volume, texCoord ).x;\n"
+  "}\n"
+  };
+
+  static const char* fragTransferFunctionSource = 
   {
-  "uniform sampler3D Volume;\n"
   "uniform sampler1D TransferFunction;\n"
+  "uniform bool PreIntegrated;\n"
+  "uniform sampler2D PreIntegrationTable;\n"
+  "uniform bool Shading;\n"
+  "uniform bool UseGradientVolume;\n"
+  "uniform sampler3D Gradient;\n"
+  "uniform vec3 VoxelSize;\n"
+  "uniform vec3 bb;\n"
+  "uniform vec3 TexScale;\n"
   "varying vec4 vertex;\n"
+  "varying float opacityExponent;\n"
   "void main(void)\n"
   "{\n"    
   "   vec3 texCoord = gl_TexCoord[0].xyz;\n"
-  "   float index = vec4( texture3D( Volume, texCoord ) ).x;\n"
+  "   float index = volumeScalar ( texCoord );\n"
   "   vec4 color = vec4( texture1D( TransferFunction, index ) );\n"
+  "   if ( PreIntegrated )\n"
+  "     color = texture2D ( PreIntegrationTable, vec2 ( index, volumeScalar ( gl_TexCoord[1].xyz ) ) );\n"
+  "   color.a = 1.0 - pow ( max ( 1.0 - color.a, 0.0 ), opacityExponent );\n"
+  "   if ( AlwaysShade || Shading )\n"
+  "   {\n"
+  "     vec3 normal;\n"
+
+  // Use the precomputed gradient when there is one.
+  "     if ( UseGradientVolume )\n"
+  "       normal = texture3D ( Gradient, texCoord ).xyz * 2.0 - 1.0;\n"
+
+  // Otherwise take central differences one voxel apart.
+  "     else\n"
+  "     {\n"
+  "       vec3 sample1, sample2;\n"
+  "       vec3 deltaX = vec3 ( VoxelSize.x, 0.0, 0.0 );\n"
+  "       vec3 deltaY = vec3 ( 0.0, VoxelSize.y, 0.0 );\n"
+  "       vec3 deltaZ = vec3 ( 0.0, 0.0, VoxelSize.z );\n"
+  "       sample1.x = volumeScalar ( texCoord - deltaX );\n"
+  "       sample2.x = volumeScalar ( texCoord + deltaX );\n"
+  "       sample1.y = volumeScalar ( texCoord - deltaY );\n"
+  "       sample2.y = volumeScalar ( texCoord + deltaY );\n"
+  "       sample1.z = volumeScalar ( texCoord - deltaZ );\n"
+  "       sample2.z = volumeScalar ( texCoord + deltaZ );\n"
+  "       normal = ( sample2 - sample1 ) * TexScale / ( VoxelSize * bb );\n"
+  "     }\n"
   
-  // Compute gradient.
-  "   vec3 sample1, sample2;\n"
-  "   vec3 deltaX = vec3 ( 0.01, 0.0, 0.0 );\n"
-  "   vec3 deltaY = vec3 ( 0.0, 0.01, 0.0 );\n"
-  "   vec3 deltaZ = vec3 ( 0.0, 0.0, 0.01 );\n"
-  "   sample1.x = texture3D( Volume, texCoord - deltaX ).x;\n"
-  "   sample2.x = texture3D( Volume, texCoord + deltaX ).x;\n"
-  "   sample1.y = texture3D( Volume, texCoord - deltaY ).x;\n"
-  "   sample2.y = texture3D( Volume, texCoord + deltaY ).x;\n"
-  "   sample1.z = texture3D( Volume, texCoord - deltaZ ).x;\n"
-  "   sample2.z = texture3D( Volume, texCoord + deltaZ ).x;\n"
-  
-  // Take difference and normalize.
-  "   vec3 normal = normalize ( sample2 - sample1 );\n"
+  // Flat regions have nothing to shade.
+  "     if ( dot ( normal, normal ) > 1.0e-8 )\n"
+  "     {\n"
+  "       normal = normalize ( gl_NormalMatrix * normal );\n"
   
   // Calculate light and viewing direction.
-  "   vec3 light = normalize ( gl_LightSource[0].position.xyz - vertex.xyz );\n"
-  "   vec3 view = normalize ( -vertex.xyz );\n"
+  "       vec3 light = normalize ( gl_LightSource[0].position.xyz - vertex.xyz );\n"
+  "       vec3 view = normalize ( -vertex.xyz );\n"
   
   // Add to color.
-  "   color.rgb += shading ( normal, view, light );\n"
+  "       color.rgb += shading ( normal, view, light );\n"
+  "     }\n"
+  "   }\n"
   "  gl_FragColor = vec4( color );\n"
   "}\n"
   };
@@ -329,10 +477,10 @@ namespace Detail
   {
     if ( transferFunction )
     {
-      if ( shading )
-        return buildShadingFunction ( osg::Vec3f ( 0.1f, 0.1f, 0.1f ), osg::Vec3f ( 0.6f, 0.6f, 0.6f ), osg::Vec3f ( 0.8f, 0.8f, 0.8f ), 50.0 ) + fragTransferFunctionSourceWithShading;
-      
-      return fragTransferFunctionSource;
+      // Programs made without shading can still turn it on with the Shading uniform.
+      const std::string alwaysShade ( shading ? "const bool AlwaysShade = true;\n" : "const bool AlwaysShade = false;\n" );
+      return buildShadingFunction ( osg::Vec3f ( 0.1f, 0.1f, 0.1f ), osg::Vec3f ( 0.6f, 0.6f, 0.6f ), osg::Vec3f ( 0.8f, 0.8f, 0.8f ), 50.0 ) + alwaysShade +
+        volumeUniformsSource + CompressedVolume::shaderSource() + volumeScalarSource + fragTransferFunctionSource;
     }
 
     return fragSource;
@@ -346,19 +494,9 @@ namespace Detail
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-osg::Program* Texture3DVolume::createProgram ( bool useTransferFunction, bool useShading )
+osg::ref_ptr<osg::Program> Texture3DVolume::createProgram ( bool useTransferFunction, bool useShading )
 {
-  osg::ref_ptr< osg::Program > program ( new osg::Program ); 
-	osg::ref_ptr< osg::Shader > vertShader ( new osg::Shader ( osg::Shader::VERTEX ) );
-	osg::ref_ptr< osg::Shader > fragShader ( new osg::Shader ( osg::Shader::FRAGMENT ) );
-
-  vertShader->setShaderSource ( Detail::buildVertexShader() );
-  fragShader->setShaderSource ( Detail::buildFagmentShader ( useTransferFunction, useShading ) );
-
-	program->addShader ( vertShader.get() );
-	program->addShader ( fragShader.get() );
- 
-  return program.release();
+  return ProgramCache::program ( Detail::buildVertexShader(), Detail::buildFagmentShader ( useTransferFunction, useShading ) );
 }
 
 
@@ -370,7 +508,7 @@ osg::Program* Texture3DVolume::createProgram ( bool useTransferFunction, bool us
 
 void Texture3DVolume::boundingBox ( const osg::BoundingBox& bb )
 {
-  _geometry->boundingBox ( bb );
+  _bb = bb;
   
   const osg::Vec3 min ( bb._min );
   const osg::Vec3 max ( bb._max );
@@ -380,9 +518,12 @@ void Texture3DVolume::boundingBox ( const osg::BoundingBox& bb )
   const double yLength ( max.y() - min.y() );
   const double zLength ( max.z() - min.z() );
   
-  // Set uniform values.
+  // Set uniform values.  They stay on the whole box with a region of
+  // interest, so the slices keep the same spacing.
   _bbLengths->set ( osg::Vec3 ( xLength, yLength, zLength ) );
   _bbMin->set ( min );
+
+  this->_applyBounds();
 }
 
 
@@ -394,7 +535,197 @@ void Texture3DVolume::boundingBox ( const osg::BoundingBox& bb )
 
 const osg::BoundingBox& Texture3DVolume::boundingBox() const
 {
-  return _geometry->boundingBox();
+  return _bb;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the part of the texture the bounding box covers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::textureWindow ( const osg::Vec3& offset, const osg::Vec3& scale )
+{
+  _windowOffset = offset;
+  _windowScale = scale;
+
+  this->_applyBounds();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the offset of the part of the texture the bounding box covers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Vec3 Texture3DVolume::textureOffset() const
+{
+  return _windowOffset;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the scale of the part of the texture the bounding box covers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Vec3 Texture3DVolume::textureScale() const
+{
+  return _windowScale;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the region of interest.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::regionOfInterest ( const osg::BoundingBox& roi )
+{
+  _roi = roi;
+
+  this->_applyBounds();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the region of interest.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::BoundingBox& Texture3DVolume::regionOfInterest() const
+{
+  return _roi;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The box, texture window or region of interest changed.  A different
+//  region needs a new texture; otherwise only the gradients may change.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::_applyBounds()
+{
+  if ( this->_applyRegion() && 0x0 != this->image() )
+    this->image ( this->image(), _volume.second );
+  else
+    this->_applyShading();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Fit the planes and texture coordinates to the region of interest.  The
+//  planes are snapped out to whole voxels, and the texture coordinates are
+//  moved into the smaller texture holding just those voxels.  Returns true
+//  when the voxels in the region changed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool Texture3DVolume::_applyRegion()
+{
+  const RegionUpload::Region last ( _region );
+  _region = RegionUpload::Region();
+
+  osg::BoundingBox box ( _bb );
+  osg::Vec3 offset ( _windowOffset ), scale ( _windowScale );
+
+  const osg::Image *image ( this->image() );
+  const bool use ( _roi.valid() && _bb.valid() );
+  bool empty ( use && false == _roi.intersects ( _bb ) );
+
+  if ( use && false == empty && 0x0 != image && image->s() > 0 && image->t() > 0 )
+  {
+    // Texture coordinates of the part of the box in the region.
+    const osg::Vec3 lengths ( _bb._max - _bb._min );
+    osg::Vec3 lower ( offset ), upper ( offset + scale );
+    for ( unsigned int a = 0; a < 3; ++a )
+    {
+      if ( lengths[a] > 0.0f )
+      {
+        lower[a] = offset[a] + scale[a] * ( std::max ( _roi._min[a], _bb._min[a] ) - _bb._min[a] ) / lengths[a];
+        upper[a] = offset[a] + scale[a] * ( std::min ( _roi._max[a], _bb._max[a] ) - _bb._min[a] ) / lengths[a];
+      }
+    }
+
+    _region = RegionUpload::region ( *image, lower, upper );
+    empty = false == _region.valid();
+
+    if ( _region.valid() )
+    {
+      const float dims[3] = { static_cast<float> ( image->s() ), static_cast<float> ( image->t() ), static_cast<float> ( std::max ( 1, image->r() ) ) };
+      for ( unsigned int a = 0; a < 3; ++a )
+      {
+        const float first ( static_cast<float> ( _region.offset[a] ) );
+        const float size ( static_cast<float> ( _region.size[a] ) );
+
+        // The box over whole voxels, kept inside the volume.
+        if ( lengths[a] > 0.0f && 0.0f != _windowScale[a] )
+        {
+          box._min[a] = std::max ( _bb._min[a], _bb._min[a] + lengths[a] * ( first / dims[a] - _windowOffset[a] ) / _windowScale[a] );
+          box._max[a] = std::min ( _bb._max[a], _bb._min[a] + lengths[a] * ( ( first + size ) / dims[a] - _windowOffset[a] ) / _windowScale[a] );
+        }
+
+        // The same coordinates in the smaller texture.
+        offset[a] = ( _windowOffset[a] * dims[a] - first ) / size;
+        scale[a] = _windowScale[a] * dims[a] / size;
+      }
+    }
+  }
+
+  _texOffset->set ( offset );
+  _texScale->set ( scale );
+
+  // One voxel of the whole image in the world, which the opacities are for.
+  if ( 0x0 != image && image->s() > 0 && image->t() > 0 )
+  {
+    const osg::Vec3 lengths ( _bb._max - _bb._min );
+    const float dims[3] = { static_cast<float> ( image->s() ), static_cast<float> ( image->t() ), static_cast<float> ( std::max ( 1, image->r() ) ) };
+    osg::Vec3 length;
+    for ( unsigned int a = 0; a < 3; ++a )
+      length[a] = ( 0.0f != _windowScale[a] ) ? lengths[a] / ( dims[a] * _windowScale[a] ) : 0.0f;
+    _voxelLength->set ( length );
+  }
+
+  // One voxel in texture space.  Coarser levels bring their own.
+  if ( _region.valid() )
+    _voxelSize->set ( osg::Vec3 ( 1.0f / _region.size[0], 1.0f / _region.size[1], 1.0f / _region.size[2] ) );
+  else if ( 0x0 != image && image->s() > 0 && image->t() > 0 )
+    _voxelSize->set ( osg::Vec3 ( 1.0f / image->s(), 1.0f / image->t(), 1.0f / std::max ( 1, image->r() ) ) );
+
+  if ( box._min != _geometry->boundingBox()._min || box._max != _geometry->boundingBox()._max )
+    _geometry->boundingBox ( box );
+
+  // A smaller box needs fewer planes for the same spacing.
+  const unsigned int planes ( this->numPlanes() );
+  const float whole ( _bb.radius() ), part ( box.radius() );
+  if ( _region.valid() && whole > 0.0f )
+    _geometry->numPlanes ( std::max ( 1u, static_cast<unsigned int> ( std::ceil ( planes * part / whole ) ) ) );
+  else
+    _geometry->numPlanes ( planes );
+
+  // Nothing is drawn when the region misses the volume.
+  const bool drawn ( this->containsDrawable ( _geometry.get() ) );
+  if ( empty && drawn )
+    this->removeDrawable ( _geometry.get() );
+  else if ( false == empty && false == drawn )
+    this->addDrawable ( _geometry.get() );
+
+  // The levels follow the geometry.
+  this->_applyLevels();
+
+  // The gradients are cut to the region too.
+  if ( _region != last )
+    _gradientTexture = 0x0;
+
+  return _region != last;
 }
 
 
@@ -407,6 +738,7 @@ const osg::BoundingBox& Texture3DVolume::boundingBox() const
 void Texture3DVolume::useTransferFunction ( bool b )
 {
   _flags = Usul::Bits::set ( _flags, _USE_TRANSFER_FUNCTION, b );
+  this->_applyProgram();
 }
 
 
@@ -466,6 +798,9 @@ void Texture3DVolume::transferFunction ( TransferFunction* tf, TextureUnit unit
 
     // Set the uniform value.
     _tfSampler->set ( static_cast<int> ( unit ) );
+
+    // The table belongs to the transfer function.
+    this->_applyPreIntegration();
   }
 }
 
@@ -480,3 +815,407 @@ OsgVolume::TransferFunction* Texture3DVolume::transferFunction() const
 {
   return _transferFunction.get();
 }
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set use of the pre-integrated table.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::preIntegration ( bool b, TextureUnit unit )
+{
+  // Remove the old table in case the unit changed.
+  this->getOrCreateStateSet()->removeTextureAttribute ( _preIntegrationUnit, osg::StateAttribute::TEXTURE );
+
+  _flags = Usul::Bits::set ( _flags, _PRE_INTEGRATION, b );
+  _preIntegrationUnit = unit;
+
+  this->_applyPreIntegration();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get use of the pre-integrated table.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool Texture3DVolume::preIntegration() const
+{
+  return Usul::Bits::has ( _flags, _PRE_INTEGRATION );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Bind the pre-integrated table if there is one to use.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::_applyPreIntegration()
+{
+  TransferFunction1D *tf ( dynamic_cast < TransferFunction1D * > ( _transferFunction.get() ) );
+  const bool use ( this->preIntegration() && 0x0 != tf );
+
+  if ( use )
+  {
+    osg::ref_ptr< osg::StateSet > ss ( this->getOrCreateStateSet() );
+    ss->setTextureAttributeAndModes ( _preIntegrationUnit, tf->preIntegratedTexture(), osg::StateAttribute::ON );
+    _preIntegrationSampler->set ( static_cast<int> ( _preIntegrationUnit ) );
+  }
+
+  _preIntegrated->set ( use );
+  this->_applyProgram();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set shading.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::useShading ( bool b, TextureUnit unit )
+{
+  // Remove the old gradients in case the unit changed.
+  if ( unit != _gradientUnit && _gradientTexture.valid() )
+  {
+    this->getOrCreateStateSet()->removeTextureAttribute ( _gradientUnit, osg::StateAttribute::TEXTURE );
+    _gradientTexture = 0x0;
+  }
+
+  _flags = Usul::Bits::set ( _flags, _USE_SHADING, b );
+  _gradientUnit = unit;
+
+  this->_applyShading();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get shading.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool Texture3DVolume::useShading() const
+{
+  return Usul::Bits::has ( _flags, _USE_SHADING );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Bind the gradients if shading is on.  They stay bound when shading is
+//  turned off, so turning it back on only flips the uniform.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::_applyShading()
+{
+  const bool shading ( this->useShading() );
+  _shading->set ( shading );
+
+  osg::Image *image ( this->image() );
+  if ( false == shading || 0x0 == image || 0x0 == image->data() || false == Voxels::supported ( image->getDataType() ) || SlabImage::loading ( image ) )
+  {
+    _useGradientVolume->set ( false );
+    this->_applyProgram();
+    return;
+  }
+
+  // The distance between voxels.  The box covers the scaled part of the texture.
+  const osg::BoundingBox &bb ( this->boundingBox() );
+  const osg::Vec3 scale ( _windowScale );
+  const osg::Vec3f spacing ( ( bb.xMax() - bb.xMin() ) / ( image->s() * scale[0] ),
+                             ( bb.yMax() - bb.yMin() ) / ( image->t() * scale[1] ),
+                             ( bb.zMax() - bb.zMin() ) / ( std::max ( 1, image->r() ) * scale[2] ) );
+
+  GradientVolume::RefPtr gradient ( GradientVolume::cached ( image, spacing ) );
+
+  // Make a new texture only when the gradients changed.
+  if ( gradient.get() != _gradient.get() || false == _gradientTexture.valid() )
+  {
+    _gradient = gradient;
+
+    // With a region of interest the gradients are cut the same way.
+    _gradientTexture = ( _region.valid() ? RegionUpload::texture ( _gradient->image(), _region ) : new osg::Texture3D );
+    if ( false == _region.valid() )
+      _gradientTexture->setImage ( _gradient->image() );
+    _gradientTexture->setFilter( osg::Texture3D::MIN_FILTER, osg::Texture3D::LINEAR );
+    _gradientTexture->setFilter( osg::Texture3D::MAG_FILTER, osg::Texture3D::LINEAR );
+    _gradientTexture->setWrap( osg::Texture3D::WRAP_R, osg::Texture3D::CLAMP_TO_EDGE );
+    _gradientTexture->setWrap( osg::Texture3D::WRAP_S, osg::Texture3D::CLAMP_TO_EDGE );
+    _gradientTexture->setWrap( osg::Texture3D::WRAP_T, osg::Texture3D::CLAMP_TO_EDGE );
+    _gradientTexture->setResizeNonPowerOfTwoHint( this->resizePowerTwo() );
+
+    osg::ref_ptr< osg::StateSet > ss ( this->getOrCreateStateSet() );
+    ss->setTextureAttributeAndModes ( _gradientUnit, _gradientTexture.get(), osg::StateAttribute::ON );
+  }
+
+  _gradientSampler->set ( static_cast<int> ( _gradientUnit ) );
+  _useGradientVolume->set ( true );
+  this->_applyProgram();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set compressed storage.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::compressed ( bool b, TextureUnit unit )
+{
+  // Remove the old ends in case the unit changed.
+  if ( _compressedVolume.valid() )
+    this->getOrCreateStateSet()->removeTextureAttribute ( _compressedUnit, osg::StateAttribute::TEXTURE );
+
+  _flags = Usul::Bits::set ( _flags, _COMPRESSED, b );
+  _compressedUnit = unit;
+
+  // Bind the storage again.
+  if ( 0x0 != this->image() )
+    this->image ( this->image(), _volume.second );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get compressed storage.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool Texture3DVolume::compressed() const
+{
+  return Usul::Bits::has ( _flags, _COMPRESSED );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the compressed volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+CompressedVolume* Texture3DVolume::compressedVolume() const
+{
+  return _compressedVolume.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Bind the compressed blocks if compression is on.  Returns false when the
+//  image should be bound as it is.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool Texture3DVolume::_applyCompression()
+{
+  osg::Image *image ( this->image() );
+  const bool use ( this->compressed() && false == _region.valid() && 0x0 != image && 0x0 != image->data() && Voxels::supported ( image->getDataType() ) && false == SlabImage::loading ( image ) );
+
+  _compressed->set ( use );
+  this->_applyProgram();
+
+  if ( false == use )
+  {
+    _compressedVolume = 0x0;
+    return false;
+  }
+
+  // Compress only when the image changed.
+  if ( false == _compressedVolume.valid() || false == _compressedVolume->current ( image ) )
+    _compressedVolume = new CompressedVolume ( image );
+
+  _compressedVolume->apply ( *this->getOrCreateStateSet(), _volume.second, _compressedUnit );
+  return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set drawing from coarser copies.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::levelOfDetail ( bool b, bool preserveMaximum )
+{
+  _flags = Usul::Bits::set ( _flags, _LEVEL_OF_DETAIL, b );
+  _flags = Usul::Bits::set ( _flags, _PRESERVE_MAXIMUM, preserveMaximum );
+
+  // Bind the storage again.
+  if ( 0x0 != this->image() )
+    this->image ( this->image(), _volume.second );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get drawing from coarser copies.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool Texture3DVolume::levelOfDetail() const
+{
+  return Usul::Bits::has ( _flags, _LEVEL_OF_DETAIL );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the coarser copies.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+VolumePyramid* Texture3DVolume::pyramid() const
+{
+  return _pyramid.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the level drawn.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int Texture3DVolume::level() const
+{
+  OpenThreads::ScopedLock < OpenThreads::Mutex > guard ( _levelMutex );
+  return _level;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Traverse this node.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::traverse ( osg::NodeVisitor &nv )
+{
+  // Each level is a drawable of its own that culls itself from views it
+  // does not suit.  Remember the level for this view.
+  osgUtil::CullVisitor *cv ( ( false == _levelDrawables.empty() ) ? dynamic_cast < osgUtil::CullVisitor * > ( &nv ) : 0x0 );
+  if ( 0x0 != cv )
+  {
+    const unsigned int level ( LevelDrawable::levelFor ( *_pyramid, *cv, _geometry->getBound() ) );
+    OpenThreads::ScopedLock < OpenThreads::Mutex > guard ( _levelMutex );
+    _level = level;
+  }
+
+  BaseClass::traverse ( nv );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Make a texture for each level of the pyramid, set up like the one for
+//  the whole image, and a state set that binds it.  Shading without
+//  gradients steps one of the level's voxels.  The state sets do not change
+//  once made, so any number of views may draw them at once.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::_applyPyramid ( osg::Texture3D *texture )
+{
+  osg::Image *image ( this->image() );
+  const bool use ( this->levelOfDetail() && 0x0 != texture && false == _region.valid() && 0x0 != image && 0x0 != image->data() && Voxels::supported ( image->getDataType() ) && false == SlabImage::loading ( image ) );
+  const bool preserveMaximum ( Usul::Bits::has ( _flags, _PRESERVE_MAXIMUM ) );
+
+  _levelStateSets.clear();
+  {
+    OpenThreads::ScopedLock < OpenThreads::Mutex > guard ( _levelMutex );
+    _level = 0;
+  }
+
+  if ( false == use )
+  {
+    _pyramid = 0x0;
+    this->_applyLevels();
+    return;
+  }
+
+  // Build the levels only when the image changed.
+  if ( false == _pyramid.valid() || false == _pyramid->current ( image, preserveMaximum ) )
+    _pyramid = new VolumePyramid ( image, preserveMaximum );
+
+  // A level is sent to the card the first time it is drawn.  The whole
+  // image is in our own state set.
+  _levelStateSets.push_back ( 0x0 );
+  for ( unsigned int i = 1; i < _pyramid->numLevels(); ++i )
+  {
+    osg::Image *drawn ( _pyramid->level ( i ) );
+    osg::ref_ptr < osg::Texture3D > coarse ( new osg::Texture3D ( *texture ) );
+    coarse->setImage ( drawn );
+
+    osg::ref_ptr < osg::StateSet > ss ( new osg::StateSet );
+    ss->setTextureAttributeAndModes ( _volume.second, coarse.get(), osg::StateAttribute::ON );
+    ss->addUniform ( new osg::Uniform ( "VoxelSize", osg::Vec3 ( 1.0f / drawn->s(), 1.0f / drawn->t(), 1.0f / std::max ( 1, drawn->r() ) ) ) );
+    _levelStateSets.push_back ( ss );
+  }
+
+  this->_applyLevels();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Add a drawable for each coarser level, drawing our geometry with the
+//  level's state set.  Each drawable, and the geometry for the whole image,
+//  is culled from views that want another level.  Called again when the
+//  geometry changes, since the drawables take its bound.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::_applyLevels()
+{
+  for ( unsigned int i = 0; i < _levelDrawables.size(); ++i )
+    this->removeDrawable ( _levelDrawables[i].get() );
+  _levelDrawables.clear();
+  _geometry->setCullCallback ( 0x0 );
+
+  // Nothing is drawn when the geometry is not.
+  if ( _levelStateSets.size() < 2 || false == _pyramid.valid() || false == this->containsDrawable ( _geometry.get() ) )
+    return;
+
+  _geometry->setCullCallback ( new LevelDrawable::Cull ( _pyramid.get(), 0 ) );
+  for ( unsigned int i = 1; i < _levelStateSets.size(); ++i )
+  {
+    osg::ref_ptr < osg::Drawable > drawable ( new LevelDrawable ( _geometry.get(), _pyramid.get(), i, _levelStateSets[i].get() ) );
+    this->addDrawable ( drawable.get() );
+    _levelDrawables.push_back ( drawable );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Swap in the program made for the switches now in use.  The switches are
+//  constants in it, so the shader has no branches it will not take.  A
+//  program given to the constructor is kept as it is.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture3DVolume::_applyProgram()
+{
+  if ( false == Usul::Bits::has ( _flags, _SPECIALIZE ) )
+    return;
+
+  ProgramCache::Constants constants;
+  ProgramCache::fold ( *_compressed, constants );
+  ProgramCache::fold ( *_preIntegrated, constants );
+  ProgramCache::fold ( *_shading, constants );
+  ProgramCache::fold ( *_useGradientVolume, constants );
+
+  osg::ref_ptr < osg::Program > program ( ProgramCache::program ( Detail::buildVertexShader(), Detail::buildFagmentShader ( this->useTransferFunction(), false ), constants ) );
+  if ( program == _program )
+    return;
+
+  _program = program;
+
+  osg::ref_ptr < osg::StateSet > ss ( this->getOrCreateStateSet() );
+  ss->setAttributeAndModes( _program.get(), osg::StateAttribute::ON | osg::StateAttribute::PROTECTED );
+}
@@ -11,17 +11,26 @@
 #ifndef __OSGTOOLS_VOLUME_3D_TEXTURE_VOLUME_H__
 #define __OSGTOOLS_VOLUME_3D_TEXTURE_VOLUME_H__
 
+#include "OsgVolume/CompressedVolume.h"
 #include "OsgVolume/Export.h"
+#include "OsgVolume/GradientVolume.h"
 #include "OsgVolume/PlanarProxyGeometry.h"
+#include "OsgVolume/RegionUpload.h"
 #include "OsgVolume/TransferFunction.h"
+#include "OsgVolume/VolumePyramid.h"
 
 #include "OsgTools/Configure/OSG.h"
 
 #include "osg/Geode"
 #include "osg/Image"
 #include "osg/Program"
+#include "osg/Texture3D"
 #include "osg/Uniform"
 
+#include "OpenThreads/Mutex"
+
+#include <vector>
+
 namespace OsgVolume {
 
 
@@ -40,9 +49,14 @@ public:
   Texture3DVolume();
   Texture3DVolume( osg::Program * );
   
-  static osg::Program*             createProgram ( bool useTransferFunction = true, bool useShading = false );
+  /// Get the generic program, with the switches left as uniforms.  It is
+  /// shared with every other caller, so do not change it.  Volumes made
+  /// without a program use ones with the switches folded in instead.
+  static osg::ref_ptr<osg::Program> createProgram ( bool useTransferFunction = true, bool useShading = false );
   
-  /// Get/Set the image.
+  /// Get/Set the image.  A SlabImage still loading is sent as its slices
+  /// come in, without compression, coarser copies or gradients; set it
+  /// again once it is complete to get those.
   osg::Image*                      image();
   const osg::Image*                image() const;
   void                             image ( osg::Image* image, TextureUnit unit = 0 );
@@ -55,6 +69,18 @@ public:
   void                             boundingBox ( const osg::BoundingBox& bb );
   const osg::BoundingBox&          boundingBox() const;
 
+  /// Get/Set the part of the texture the bounding box covers.  Texture
+  /// coordinates are offset + scale * ( vertex - min ) / lengths.
+  void                             textureWindow ( const osg::Vec3& offset, const osg::Vec3& scale );
+  osg::Vec3                        textureOffset() const;
+  osg::Vec3                        textureScale() const;
+
+  /// Get/Set the region of interest.  Only the part of the volume inside it
+  /// is drawn, and only the voxels under it are sent to the texture.  An
+  /// invalid box draws the whole volume.  Compression is not used with one.
+  void                             regionOfInterest ( const osg::BoundingBox& roi );
+  const osg::BoundingBox&          regionOfInterest() const;
+
   /// Get/Set the resize power of two flag.
   void                             resizePowerTwo ( bool b );
   bool                             resizePowerTwo() const;
@@ -66,18 +92,66 @@ public:
   /// Get/Set the transfer function as an image.
   void                             transferFunction ( TransferFunction* tf, TextureUnit unit = 1 );
   TransferFunction*                transferFunction() const;
+
+  /// Get/Set use of the transfer function's pre-integrated table.  Each
+  /// fragment then shades the slab between its slice and the next one.
+  void                             preIntegration ( bool b, TextureUnit unit = 3 );
+  bool                             preIntegration() const;
+
+  /// Get/Set shading.  The gradients are found once on the CPU, using the
+  /// bounding box for the voxel spacing, and kept with the image.
+  void                             useShading ( bool b, TextureUnit unit = 2 );
+  bool                             useShading() const;
+
+  /// Get/Set compressed storage.  The image is kept on the GPU in 4x4x4
+  /// blocks, with the ends of the blocks on the given unit, and decoded in
+  /// the fragment shader.
+  void                             compressed ( bool b, TextureUnit unit = 4 );
+  bool                             compressed() const;
+
+  /// Get the compressed volume, which has the compression error.  May be null.
+  CompressedVolume*                compressedVolume() const;
+
+  /// Get/Set drawing from coarser copies of the image when the volume covers
+  /// few pixels.  The copies are made when the image is set.  With
+  /// preserveMaximum each coarse voxel is the largest it covers instead of
+  /// the mean.  Not used with compression or a region of interest.
+  void                             levelOfDetail ( bool b, bool preserveMaximum = false );
+  bool                             levelOfDetail() const;
+
+  /// Get the copies, which may be null, and the level the last view culled
+  /// chose.  Each view draws the level that suits it.
+  VolumePyramid*                   pyramid() const;
+  unsigned int                     level() const;
+
+  /// Traverse this node.
+  virtual void                     traverse ( osg::NodeVisitor &nv );
   
 protected:
   virtual ~Texture3DVolume();
 
   void                             _construct();
+  void                             _applyPreIntegration();
+  void                             _applyShading();
+  bool                             _applyCompression();
+  void                             _applyPyramid ( osg::Texture3D *texture );
+  void                             _applyLevels();
+  void                             _applyProgram();
+  bool                             _applyRegion();
+  void                             _applyBounds();
 
 private:
 
   enum RenderFlags
   {
     _USE_TRANSFER_FUNCTION = 0x00000001,
-    _RESIZE_POWER_TWO      = 0x00000002
+    _RESIZE_POWER_TWO      = 0x00000002,
+    _PRE_INTEGRATION       = 0x00000004,
+    _USE_SHADING           = 0x00000008,
+    _COMPRESSED            = 0x00000010,
+    _SPECIALIZE            = 0x00000020,
+    _LEVEL_OF_DETAIL       = 0x00000040,
+    _PRESERVE_MAXIMUM      = 0x00000080
   };
 
   TexutreInfo                  _volume;
@@ -90,6 +164,33 @@ private:
   osg::ref_ptr<osg::Uniform>   _bbMin;
   osg::ref_ptr<osg::Uniform>   _volumeSampler;
   osg::ref_ptr<osg::Uniform>   _tfSampler;
+  unsigned int                 _preIntegrationUnit;
+  osg::ref_ptr<osg::Uniform>   _preIntegrated;
+  osg::ref_ptr<osg::Uniform>   _preIntegrationSampler;
+  osg::ref_ptr<osg::Uniform>   _numPlanes;
+  unsigned int                 _gradientUnit;
+  GradientVolume::RefPtr       _gradient;
+  osg::ref_ptr<osg::Texture3D> _gradientTexture;
+  osg::ref_ptr<osg::Uniform>   _shading;
+  osg::ref_ptr<osg::Uniform>   _useGradientVolume;
+  osg::ref_ptr<osg::Uniform>   _gradientSampler;
+  osg::ref_ptr<osg::Uniform>   _voxelSize;
+  osg::ref_ptr<osg::Uniform>   _voxelLength;
+  osg::ref_ptr<osg::Uniform>   _texOffset;
+  osg::ref_ptr<osg::Uniform>   _texScale;
+  unsigned int                 _compressedUnit;
+  CompressedVolume::RefPtr     _compressedVolume;
+  osg::ref_ptr<osg::Uniform>   _compressed;
+  osg::BoundingBox             _bb;
+  osg::Vec3                    _windowOffset;
+  osg::Vec3                    _windowScale;
+  osg::BoundingBox             _roi;
+  RegionUpload::Region         _region;
+  VolumePyramid::RefPtr        _pyramid;
+  std::vector < osg::ref_ptr < osg::StateSet > > _levelStateSets;
+  std::vector < osg::ref_ptr < osg::Drawable > > _levelDrawables;
+  unsigned int                 _level;
+  mutable OpenThreads::Mutex   _levelMutex;
 };
 
 
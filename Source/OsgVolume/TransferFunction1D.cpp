@@ -9,16 +9,149 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "OsgVolume/TransferFunction1D.h"
+#include "OsgVolume/Parallel.h"
+#include "OsgVolume/SimdVec4.h"
 
 #include "Usul/Functions/Color.h"
 #include "Usul/Math/Interpolate.h"
 
+#include "OpenThreads/Mutex"
+#include "OpenThreads/ScopedLock"
+
+#include "osg/State"
 #include "osg/Texture1D"
+#include "osg/Texture2D"
+#include "osg/buffered_value"
 
+#include <algorithm>
+#include <cmath>
+#include <deque>
 #include <iostream>
+#include <limits>
 
 using namespace OsgVolume;
 
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Sends the colors that changed to the texture.  Each context remembers
+//  the last change it has, and gets the span covering all the changes
+//  since then.  Contexts too far behind get the whole table.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+struct TransferFunction1D::Subload : public osg::Texture1D::SubloadCallback
+{
+  typedef OpenThreads::Mutex Mutex;
+  typedef OpenThreads::ScopedLock < Mutex > Guard;
+
+  Subload() : osg::Texture1D::SubloadCallback(),
+    _mutex(),
+    _count ( 0 ),
+    _changes(),
+    _uploaded(),
+    _width()
+  {
+  }
+
+  // Remember the colors that changed.
+  void changed ( unsigned int first, unsigned int last )
+  {
+    Guard guard ( _mutex );
+
+    _changes.push_back ( Change ( ++_count, Span ( first, last ) ) );
+    while ( _changes.size() > 32 )
+      _changes.pop_front();
+  }
+
+  // Allocate the texture and send all the colors.
+  virtual void load ( const osg::Texture1D &texture, osg::State &state ) const
+  {
+    const osg::Image *image ( texture.getImage() );
+    const unsigned int context ( state.getContextID() );
+
+    Guard guard ( _mutex );
+    _uploaded[context] = _count;
+    _width[context] = 0;
+
+    if ( 0x0 == image || 0x0 == image->data() || image->s() <= 0 )
+      return;
+
+    glPixelStorei ( GL_UNPACK_ALIGNMENT, image->getPacking() );
+    glTexImage1D ( GL_TEXTURE_1D, 0, image->getInternalTextureFormat(), image->s(), 0, image->getPixelFormat(), image->getDataType(), image->data() );
+    _width[context] = image->s();
+  }
+
+  // Send the colors that changed.
+  virtual void subload ( const osg::Texture1D &texture, osg::State &state ) const
+  {
+    const osg::Image *image ( texture.getImage() );
+    const unsigned int context ( state.getContextID() );
+
+    if ( 0x0 == image || 0x0 == image->data() )
+      return;
+
+    // A new size needs a new allocation.
+    if ( static_cast < int > ( _width[context] ) != image->s() )
+    {
+      this->load ( texture, state );
+      return;
+    }
+
+    unsigned int first ( image->s() ), last ( 0 );
+    {
+      Guard guard ( _mutex );
+
+      if ( _uploaded[context] == _count )
+        return;
+
+      if ( _changes.empty() || _changes.front().first > _uploaded[context] + 1 )
+      {
+        first = 0;
+        last = image->s() - 1;
+      }
+      else
+      {
+        for ( Changes::const_iterator iter = _changes.begin(); iter != _changes.end(); ++iter )
+        {
+          if ( iter->first > _uploaded[context] )
+          {
+            first = std::min ( first, iter->second.first );
+            last  = std::max ( last,  iter->second.second );
+          }
+        }
+      }
+
+      _uploaded[context] = _count;
+    }
+
+    last = std::min ( last, static_cast < unsigned int > ( image->s() - 1 ) );
+    if ( first > last )
+      return;
+
+    glPixelStorei ( GL_UNPACK_ALIGNMENT, image->getPacking() );
+    glTexSubImage1D ( GL_TEXTURE_1D, 0, first, last - first + 1, image->getPixelFormat(), image->getDataType(), image->data ( first ) );
+  }
+
+protected:
+
+  virtual ~Subload()
+  {
+  }
+
+private:
+
+  typedef std::pair < unsigned int, unsigned int > Span;
+  typedef std::pair < unsigned int, Span > Change;
+  typedef std::deque < Change > Changes;
+
+  mutable Mutex _mutex;
+  unsigned int _count;
+  Changes _changes;
+  mutable osg::buffered_value < unsigned int > _uploaded;
+  mutable osg::buffered_value < unsigned int > _width;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  Constructor.
@@ -32,7 +165,16 @@ TransferFunction1D::TransferFunction1D () :
   _colors(),
   _colorMap(),
   _opacityMap(),
-  _colorMode ( COLOR_MODE_RGB )
+  _colorMode ( COLOR_MODE_RGB ),
+  _dirtyFirst ( 0 ),
+  _dirtyLast ( std::numeric_limits < unsigned int >::max() ),
+  _texture ( 0x0 ),
+  _subload ( 0x0 ),
+  _preIntegration ( false ),
+  _preIntegratedColors(),
+  _preIntegratedTable(),
+  _preIntegratedImage ( 0x0 ),
+  _preIntegratedTexture ( 0x0 )
 {
   this->_init();
 }
@@ -47,6 +189,7 @@ TransferFunction1D::TransferFunction1D () :
 void TransferFunction1D::_init()
 {
   _image = new osg::Image;
+  _preIntegratedImage = new osg::Image;
 }
 
 
@@ -130,7 +273,10 @@ void TransferFunction1D::maximium ( double maximium )
 osg::Texture* TransferFunction1D::texture()
 {
   this->calculateColors();
-  
+
+  if ( _texture.valid() )
+    return _texture.get();
+
   // Create the 1D texture.
   osg::ref_ptr < osg::Texture1D > texture1D ( new osg::Texture1D );
   texture1D->setImage ( _image.get() );
@@ -139,8 +285,13 @@ osg::Texture* TransferFunction1D::texture()
   texture1D->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
   texture1D->setWrap  ( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
   texture1D->setInternalFormatMode ( osg::Texture::USE_IMAGE_DATA_FORMAT );
-  
-  return texture1D.release();
+
+  // Changes go up with glTexSubImage1D.
+  _subload = new Subload;
+  texture1D->setSubloadCallback ( _subload.get() );
+
+  _texture = texture1D.get();
+  return _texture.get();
 }
 
 
@@ -153,6 +304,7 @@ osg::Texture* TransferFunction1D::texture()
 void TransferFunction1D::color ( unsigned int index, const RGB& color )
 {
   _colorMap[index] = color;
+  this->_markDirtyAround ( _colorMap, index );
 }
 
 
@@ -165,6 +317,56 @@ void TransferFunction1D::color ( unsigned int index, const RGB& color )
 void TransferFunction1D::opacity ( unsigned int index, RGB::value_type opacity )
 {
   _opacityMap[index] = opacity;
+  this->_markDirtyAround ( _opacityMap, index );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Mark the span between the control points around the index as dirty.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+template < class Map > void TransferFunction1D::_markDirtyAround ( const Map &map, unsigned int index )
+{
+  typename Map::const_iterator iter ( map.find ( index ) );
+  if ( map.end() == iter )
+    return;
+
+  unsigned int first ( index ), last ( index );
+
+  if ( map.begin() != iter )
+  {
+    typename Map::const_iterator previous ( iter );
+    first = ( --previous )->first;
+  }
+
+  typename Map::const_iterator next ( iter );
+  if ( map.end() != ++next )
+    last = next->first;
+
+  this->_markDirty ( first, last );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Mark the span as dirty.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void TransferFunction1D::_markDirty ( unsigned int first, unsigned int last )
+{
+  if ( _dirtyFirst > _dirtyLast )
+  {
+    _dirtyFirst = first;
+    _dirtyLast = last;
+  }
+  else
+  {
+    _dirtyFirst = std::min ( _dirtyFirst, first );
+    _dirtyLast = std::max ( _dirtyLast, last );
+  }
 }
 
 
@@ -179,15 +381,61 @@ void TransferFunction1D::calculateColors()
   // Return if we don't have enough colors.
   if ( _colorMap.size() < 2 || _opacityMap.size() < 2 )
     return;
-  
-  _colors.clear();
-  
-      // First interpolate the colors.
+
+  const unsigned int size ( _colorMap.rbegin()->first + 1 );
+  unsigned int first ( _dirtyFirst ), last ( std::min ( _dirtyLast, size - 1 ) );
+
+  // A new size means all new colors.
+  if ( size != _colors.size() )
+  {
+    _colors.resize ( size );
+    first = 0;
+    last = size - 1;
+  }
+
+  if ( first <= last )
   {
-    ColorMap::const_iterator current ( _colorMap.begin() );
-    ColorMap::const_iterator next ( ++_colorMap.begin() );
+    this->_interpolateRange ( first, last );
+
+    // Set the image data.  The image already points at the colors unless they moved.
+    if ( _image->data() != reinterpret_cast < unsigned char * > ( &_colors[0] ) || _image->s() != static_cast < int > ( size ) )
+      _image->setImage( _colors.size(), 1, 1, GL_RGBA, GL_RGBA, GL_FLOAT, reinterpret_cast < unsigned char * > ( &_colors[0] ), osg::Image::NO_DELETE );
+    _image->dirty();
+
+    if ( _subload.valid() )
+      _subload->changed ( first, last );
+  }
+
+  // Nothing is dirty now.
+  _dirtyFirst = 1;
+  _dirtyLast = 0;
+
+  // Update the segment table.
+  if ( _preIntegration )
+    this->_calculatePreIntegrated();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Interpolate the colors in [first,last].
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void TransferFunction1D::_interpolateRange ( unsigned int first, unsigned int last )
+{
+  for ( unsigned int i = first; i <= last; ++i )
+    _colors.at ( i ).set ( 0.0, 0.0, 0.0, 0.0 );
+
+  // First interpolate the colors.
+  {
+    ColorMap::const_iterator current ( _colorMap.upper_bound ( first ) );
+    if ( _colorMap.begin() != current )
+      --current;
+    ColorMap::const_iterator next ( current );
+    ++next;
     
-    while ( next != _colorMap.end() )
+    while ( next != _colorMap.end() && current->first <= last )
     {
       unsigned int index0 ( current->first );
       unsigned int index1 ( next->first );
@@ -195,16 +443,11 @@ void TransferFunction1D::calculateColors()
       RGB color0 ( current->second );
       RGB color1 ( next->second );
       
-      _colors.resize ( index1 + 1 );
-      
-      for ( unsigned int i = index0; i <= index1; ++i )
+      for ( unsigned int i = std::max ( index0, first ); i <= std::min ( index1, last ); ++i )
       {
-        if ( index0 != index1 )
-        {
-          double u ( static_cast<double> ( i - index0 ) / ( index1 - index0 ) );
-          RGB color ( this->_interpolate ( u, color0, color1 ) );
-          _colors.at ( i ).set ( color[0], color[1], color[2], 1.0 );
-        }
+        double u ( static_cast<double> ( i - index0 ) / ( index1 - index0 ) );
+        RGB color ( this->_interpolate ( u, color0, color1 ) );
+        _colors.at ( i ).set ( color[0], color[1], color[2], 1.0 );
       }
       
       current = next;
@@ -214,10 +457,13 @@ void TransferFunction1D::calculateColors()
   
   // Interpolate the opacities.
   {
-    OpacityMap::const_iterator current ( _opacityMap.begin() );
-    OpacityMap::const_iterator next ( ++_opacityMap.begin() );
+    OpacityMap::const_iterator current ( _opacityMap.upper_bound ( first ) );
+    if ( _opacityMap.begin() != current )
+      --current;
+    OpacityMap::const_iterator next ( current );
+    ++next;
     
-    while ( next != _opacityMap.end() )
+    while ( next != _opacityMap.end() && current->first <= last )
     {
       unsigned int index0 ( current->first );
       unsigned int index1 ( next->first );
@@ -225,41 +471,214 @@ void TransferFunction1D::calculateColors()
       RGB::value_type opacity0 ( current->second );
       RGB::value_type opacity1 ( next->second );
       
-      //colors.resize ( index1 + 1 );
-      
-      for ( unsigned int i = index0; i <= index1; ++i )
+      for ( unsigned int i = std::max ( index0, first ); i <= std::min ( index1, last ) && i < _colors.size(); ++i )
       {
-        if ( index0 != index1 && i < _colors.size() )
-        {
-          double u ( static_cast<double> ( i - index0 ) / ( index1 - index0 ) );
-          RGB::value_type opacity ( Usul::Math::Interpolate<float>::linear ( u, opacity0, opacity1 ) );
-          _colors.at ( i )[3] = opacity;
-        }
+        double u ( static_cast<double> ( i - index0 ) / ( index1 - index0 ) );
+        RGB::value_type opacity ( Usul::Math::Interpolate<float>::linear ( u, opacity0, opacity1 ) );
+        _colors.at ( i )[3] = opacity;
       }
       
       current = next;
       ++next;
     }
   }
-  
-  /*for ( unsigned int i = 0; i < _colors.size(); ++i )
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the pre-integration flag.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void TransferFunction1D::preIntegration ( bool b )
+{
+  _preIntegration = b;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the pre-integration flag.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool TransferFunction1D::preIntegration() const
+{
+  return _preIntegration;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the pre-integrated image.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* TransferFunction1D::preIntegratedImage() const
+{
+  return _preIntegratedImage.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the pre-integrated texture.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Texture* TransferFunction1D::preIntegratedTexture()
+{
+  this->preIntegration ( true );
+  this->calculateColors();
+
+  if ( _preIntegratedTexture.valid() )
+    return _preIntegratedTexture.get();
+
+  // Create the 2D texture.  The image is dirtied when the table changes.
+  osg::ref_ptr < osg::Texture2D > texture2D ( new osg::Texture2D );
+  texture2D->setImage ( _preIntegratedImage.get() );
+
+  texture2D->setFilter( osg::Texture::MIN_FILTER, osg::Texture::LINEAR );
+  texture2D->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
+  texture2D->setWrap  ( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
+  texture2D->setWrap  ( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE );
+  texture2D->setInternalFormatMode ( osg::Texture::USE_IMAGE_DATA_FORMAT );
+
+  _preIntegratedTexture = texture2D.get();
+  return _preIntegratedTexture.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for building the pre-integrated table.
+//
+//  The opacity of entry i is for one voxel, so its extinction is
+//  -log ( 1 - alpha ).  A segment whose scalar runs from front to back sees
+//  the average extinction of the entries in between, which is a difference
+//  of prefix sums.  Its color is the extinction weighted average color of
+//  the same entries.  Ignoring the attenuation inside the segment makes the
+//  table symmetric, so the order the samples are taken in does not matter,
+//  and the diagonal is the 1D table itself.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // Largest opacity of one entry, so the extinction stays finite.
+  const float maxOpacity ( 0.999f );
+
+  struct PreIntegrateRows
   {
-    Color color ( _colors[i] );
-    std::cout << i 
-      << ": " 
-      << static_cast<unsigned int> ( color[0] )
-      << " " 
-      << static_cast<unsigned int> ( color[1] )
-      << " " 
-      << static_cast<unsigned int> ( color[2] )
-      << " " 
-      << static_cast<unsigned int> ( color[3] )
-      << std::endl;
-  }*/
-  
+    PreIntegrateRows ( const float *colors, const float *sums, float *table, unsigned int size, unsigned int first, unsigned int last ) :
+      _colors ( colors ),
+      _sums ( sums ),
+      _table ( table ),
+      _size ( size ),
+      _first ( first ),
+      _last ( last )
+    {
+    }
+
+    // Fill the entries of the row that cover a changed entry.
+    void operator () ( unsigned int row )
+    {
+      unsigned int begin ( 0 ), end ( _size );
+      if ( row < _first )
+        begin = _first;
+      else if ( row > _last )
+        end = _last + 1;
+
+      float *out ( _table + ( row * _size ) * 4 );
+
+      for ( unsigned int column = begin; column < end; ++column )
+      {
+        const unsigned int lo ( std::min ( row, column ) );
+        const unsigned int hi ( std::max ( row, column ) );
+
+        const OsgVolume::Simd::Vec4 sum ( OsgVolume::Simd::Vec4::load ( _sums + ( hi + 1 ) * 4 ) - OsgVolume::Simd::Vec4::load ( _sums + lo * 4 ) );
+        const float extinction ( sum.w() );
+
+        if ( extinction > 1e-6f )
+        {
+          const float alpha ( 1.0f - std::exp ( -extinction / static_cast < float > ( hi - lo + 1 ) ) );
+          const float scale ( 1.0f / extinction );
+          ( sum * OsgVolume::Simd::Vec4 ( scale, scale, scale, 0.0f ) + OsgVolume::Simd::Vec4 ( 0.0f, 0.0f, 0.0f, alpha ) ).store ( out + column * 4 );
+        }
+        else
+        {
+          // Nothing to weight with, so use the middle color.
+          const float *color ( _colors + ( ( lo + hi ) / 2 ) * 4 );
+          ( OsgVolume::Simd::Vec4::load ( color ) * OsgVolume::Simd::Vec4 ( 1.0f, 1.0f, 1.0f, 0.0f ) ).store ( out + column * 4 );
+        }
+      }
+    }
+
+  private:
+    const float *_colors;
+    const float *_sums;
+    float *_table;
+    unsigned int _size;
+    unsigned int _first;
+    unsigned int _last;
+  };
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Update the pre-integrated table.  Only the entries whose segment covers
+//  a color that changed since the last time are computed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void TransferFunction1D::_calculatePreIntegrated()
+{
+  const unsigned int size ( _colors.size() );
+  if ( 0 == size )
+    return;
+
+  // Find the range of entries that changed.
+  unsigned int first ( 0 ), last ( size - 1 );
+  if ( _preIntegratedColors.size() == size && _preIntegratedTable.size() == size * size * 4 )
+  {
+    while ( first < size && _colors[first] == _preIntegratedColors[first] )
+      ++first;
+
+    // Nothing to do.
+    if ( first == size )
+      return;
+
+    while ( last > first && _colors[last] == _preIntegratedColors[last] )
+      --last;
+  }
+  else
+  {
+    _preIntegratedTable.resize ( size * size * 4 );
+  }
+
+  // Prefix sums of the extinction weighted colors and the extinction.
+  std::vector < float > sums ( ( size + 1 ) * 4, 0.0f );
+  for ( unsigned int i = 0; i < size; ++i )
+  {
+    const Color &color ( _colors[i] );
+    const float alpha ( std::min ( std::max ( color[3], 0.0f ), Detail::maxOpacity ) );
+    const float extinction ( -std::log ( 1.0f - alpha ) );
+
+    const OsgVolume::Simd::Vec4 weighted ( OsgVolume::Simd::Vec4 ( color[0], color[1], color[2], 1.0f ) * OsgVolume::Simd::Vec4 ( extinction ) );
+    ( OsgVolume::Simd::Vec4::load ( &sums[i * 4] ) + weighted ).store ( &sums[( i + 1 ) * 4] );
+  }
+
+  // Fill the rows.
+  Detail::PreIntegrateRows rows ( &_colors[0][0], &sums[0], &_preIntegratedTable[0], size, first, last );
+  OsgVolume::Parallel::forEach ( size, rows );
+
+  _preIntegratedColors = _colors;
+
   // Set the image data.
-  _image->setImage( _colors.size(), 1, 1, GL_RGBA, GL_RGBA, GL_FLOAT, reinterpret_cast < unsigned char * > ( &_colors[0] ), osg::Image::NO_DELETE );
-  _image->dirty();
+  _preIntegratedImage->setImage ( size, size, 1, GL_RGBA, GL_RGBA, GL_FLOAT, reinterpret_cast < unsigned char * > ( &_preIntegratedTable[0] ), osg::Image::NO_DELETE );
+  _preIntegratedImage->dirty();
 }
 
 
@@ -311,6 +730,7 @@ TransferFunction1D::RGB TransferFunction1D::_interpolate ( double u, const RGB&
 void TransferFunction1D::colorMap ( const ColorMap& colorMap )
 {
   _colorMap = colorMap;
+  this->_markDirty ( 0, std::numeric_limits < unsigned int >::max() );
 }
 
 
@@ -335,6 +755,7 @@ TransferFunction1D::ColorMap TransferFunction1D::colorMap() const
 void TransferFunction1D::opacityMap ( const OpacityMap& opacityMap )
 {
   _opacityMap = opacityMap;
+  this->_markDirty ( 0, std::numeric_limits < unsigned int >::max() );
 }
 
 
@@ -359,6 +780,7 @@ TransferFunction1D::OpacityMap TransferFunction1D::opacityMap() const
 void TransferFunction1D::colorMode ( ColorMode mode )
 {
   _colorMode = mode;
+  this->_markDirty ( 0, std::numeric_limits < unsigned int >::max() );
 }
 
 
@@ -46,7 +46,8 @@ public:
   /// Get the number of dimensions for this transfer function.
   virtual unsigned int   dimensions() const;
   
-  /// Get the texture.
+  /// Get the texture.  The same texture is returned every time.  Changes
+  /// to the colors are sent to it with a sub-image upload.
   virtual osg::Texture*  texture();
 
   /// Get/Set the mininium value.
@@ -57,6 +58,8 @@ public:
   double                 maximium() const;
   void                   maximium ( double );
   
+  /// Update the colors between the control points that changed since the
+  /// last time.
   void                   calculateColors();
   
   /// Set the color.
@@ -77,6 +80,19 @@ public:
   void                   opacityMap ( const OpacityMap& opacityMap );
   OpacityMap             opacityMap() const;
 
+  /// Set/get the pre-integration flag.  When set, calculateColors() also
+  /// updates the table of ( front scalar, back scalar ) segments.
+  void                   preIntegration ( bool b );
+  bool                   preIntegration() const;
+
+  /// Get the pre-integrated table as a square GL_RGBA image and as a texture.
+  /// Entry ( front, back ) holds the color and opacity of a ray segment one
+  /// voxel long whose scalar goes from front to back.  The table is symmetric.
+  /// The same texture is returned every time, and changes to the colors dirty
+  /// its image.
+  osg::Image*            preIntegratedImage() const;
+  osg::Texture*          preIntegratedTexture();
+
 protected:
   
   virtual ~TransferFunction1D();
@@ -84,12 +100,20 @@ protected:
   void                   _init();
   
   RGB                    _interpolate ( double u, const RGB& color0, const RGB& color1 ) const;
+  void                   _interpolateRange ( unsigned int first, unsigned int last );
+
+  void                   _markDirty ( unsigned int first, unsigned int last );
+  template < class Map > void _markDirtyAround ( const Map &map, unsigned int index );
+
+  void                   _calculatePreIntegrated();
   
 private:
   
   typedef OsgVolume::TransferFunction BaseClass;
   typedef Usul::Math::Vec4f   Color;
   typedef std::vector<Color>  Colors;
+
+  struct Subload;
   
   double _minimium;
   double _maximium;
@@ -97,6 +121,15 @@ private:
   ColorMap _colorMap;
   OpacityMap _opacityMap;
   ColorMode _colorMode;
+  unsigned int _dirtyFirst;
+  unsigned int _dirtyLast;
+  osg::ref_ptr<osg::Texture> _texture;
+  osg::ref_ptr<Subload> _subload;
+  bool _preIntegration;
+  Colors _preIntegratedColors;
+  std::vector<float> _preIntegratedTable;
+  osg::ref_ptr<osg::Image> _preIntegratedImage;
+  osg::ref_ptr<osg::Texture> _preIntegratedTexture;
 };
 
 
@@ -0,0 +1,493 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Many small volumes packed into a few large 3D textures.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/VolumeAtlas.h"
+#include "OsgVolume/Parallel.h"
+#include "OsgVolume/ProgramCache.h"
+
+#include "osg/BlendFunc"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // The texture coordinates come with the vertices.
+  static const char* vertexSource = 
+  {
+  "void main(void)\n"
+  "{\n"
+  "   gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+  "   gl_Position = ftransform();\n"
+  "   gl_ClipVertex = gl_ModelViewMatrix * gl_Vertex;\n"
+  "}\n"
+  };
+
+  static const char* fragmentSource = 
+  {
+  "uniform sampler3D Volume;\n"
+  "uniform sampler1D TransferFunction;\n"
+  "void main(void)\n"
+  "{\n"
+  "   float index = texture3D ( Volume, gl_TexCoord[0].xyz ).x;\n"
+  "   gl_FragColor = texture1D ( TransferFunction, index );\n"
+  "}\n"
+  };
+
+  // The atlas and slot of each block.
+  typedef std::pair < unsigned int, unsigned int > Place;
+  typedef std::vector < Place > Places;
+
+  // The size of a block with its border.
+  inline void slotSize ( const osg::Image &block, unsigned int size[3] )
+  {
+    size[0] = static_cast < unsigned int > ( block.s() ) + 2;
+    size[1] = static_cast < unsigned int > ( block.t() ) + 2;
+    size[2] = static_cast < unsigned int > ( std::max ( 1, block.r() ) ) + 2;
+  }
+
+  // Spread the lowest 10 bits out to every third bit.
+  inline unsigned int spreadBits ( unsigned int v )
+  {
+    v &= 0x3ff;
+    v = ( v | ( v << 16 ) ) & 0x030000ff;
+    v = ( v | ( v <<  8 ) ) & 0x0300f00f;
+    v = ( v | ( v <<  4 ) ) & 0x030c30c3;
+    v = ( v | ( v <<  2 ) ) & 0x09249249;
+    return v;
+  }
+
+  // Order the blocks along the Morton curve through their centers, so the
+  // blocks that fill one texture are near each other in space.
+  typedef std::pair < unsigned int, unsigned int > Code;
+  void mortonOrder ( const VolumeAtlas::Boxes &boxes, std::vector < unsigned int > &order )
+  {
+    osg::BoundingBox all;
+    for ( unsigned int i = 0; i < boxes.size(); ++i )
+      all.expandBy ( boxes[i] );
+
+    std::vector < Code > codes ( boxes.size() );
+    for ( unsigned int i = 0; i < boxes.size(); ++i )
+    {
+      const osg::Vec3 center ( boxes[i].center() );
+      unsigned int code ( 0 );
+      for ( unsigned int axis = 0; axis < 3; ++axis )
+      {
+        const float length ( all._max[axis] - all._min[axis] );
+        const float u ( ( length > 0.0f ) ? ( center[axis] - all._min[axis] ) / length : 0.0f );
+        const unsigned int cell ( static_cast < unsigned int > ( std::min ( std::max ( u, 0.0f ), 1.0f ) * 1023.0f ) );
+        code |= spreadBits ( cell ) << axis;
+      }
+      codes[i] = Code ( code, i );
+    }
+
+    std::sort ( codes.begin(), codes.end() );
+
+    order.resize ( codes.size() );
+    for ( unsigned int i = 0; i < codes.size(); ++i )
+      order[i] = codes[i].second;
+  }
+
+  // The voxel where a slot starts.
+  inline unsigned int slotOrigin ( const unsigned int slots[3], unsigned int slot, unsigned int axis, unsigned int size )
+  {
+    switch ( axis )
+    {
+      case 0:  return ( slot % slots[0] ) * size;
+      case 1:  return ( ( slot / slots[0] ) % slots[1] ) * size;
+      default: return ( slot / ( slots[0] * slots[1] ) ) * size;
+    }
+  }
+
+  // Copy each block into its slot with a border of one voxel, repeating
+  // the block's edge, so filtering never reaches into the next block.
+  template < class Atlases > struct Pack
+  {
+    Pack ( const VolumeAtlas::Images &images, Atlases &atlases, const Places &places ) :
+      _images ( images ),
+      _atlases ( atlases ),
+      _places ( places )
+    {
+    }
+
+    void operator () ( unsigned int i )
+    {
+      const osg::Image &block ( *_images[i] );
+      osg::Image &image ( *_atlases[_places[i].first].image );
+      const unsigned int *slots ( _atlases[_places[i].first].slots );
+      const unsigned int slot ( _places[i].second );
+
+      const unsigned int s ( block.s() ), t ( block.t() ), r ( std::max ( 1, block.r() ) );
+      const unsigned int x0 ( slotOrigin ( slots, slot, 0, s + 2 ) );
+      const unsigned int y0 ( slotOrigin ( slots, slot, 1, t + 2 ) );
+      const unsigned int z0 ( slotOrigin ( slots, slot, 2, r + 2 ) );
+      const unsigned int bytes ( block.getPixelSizeInBits() / 8 );
+
+      for ( unsigned int k = 0; k < r + 2; ++k )
+      {
+        const unsigned int z ( std::min ( std::max ( k, 1u ) - 1, r - 1 ) );
+        for ( unsigned int j = 0; j < t + 2; ++j )
+        {
+          const unsigned int y ( std::min ( std::max ( j, 1u ) - 1, t - 1 ) );
+          const unsigned char *from ( block.data ( 0, y, z ) );
+          unsigned char *to ( image.data ( x0, y0 + j, z0 + k ) );
+
+          ::memcpy ( to, from, bytes );
+          ::memcpy ( to + bytes, from, s * bytes );
+          ::memcpy ( to + ( s + 1 ) * bytes, from + ( s - 1 ) * bytes, bytes );
+        }
+      }
+    }
+
+  private:
+    Pack &operator = ( const Pack & );
+
+    const VolumeAtlas::Images &_images;
+    Atlases &_atlases;
+    const Places &_places;
+  };
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+VolumeAtlas::VolumeAtlas() : BaseClass(),
+  _atlases(),
+  _numBlocks ( 0 ),
+  _maxTextureSize ( 256 ),
+  _numPlanes ( 1 ),
+  _transferFunction ( 0x0 ),
+  _program ( ProgramCache::program ( Detail::vertexSource, Detail::fragmentSource ) ),
+  _volumeSampler ( new osg::Uniform ( "Volume", 0 ) ),
+  _tfSampler ( new osg::Uniform ( "TransferFunction", 1 ) )
+{
+  osg::ref_ptr < osg::StateSet > ss ( this->getOrCreateStateSet() );
+
+  // Blend the slices of every block.
+  osg::ref_ptr< osg::BlendFunc > blendFunc ( new osg::BlendFunc );
+  blendFunc->setFunction( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+  ss->setAttributeAndModes( blendFunc.get(), osg::StateAttribute::OVERRIDE | osg::StateAttribute::ON );
+  ss->setMode ( GL_CULL_FACE, osg::StateAttribute::OVERRIDE | osg::StateAttribute::OFF );
+  ss->setRenderBinDetails ( 1000, "RenderBin" );
+
+  ss->addUniform ( _volumeSampler.get() );
+  ss->addUniform ( _tfSampler.get() );
+  ss->setAttributeAndModes( _program.get(), osg::StateAttribute::ON | osg::StateAttribute::PROTECTED );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+VolumeAtlas::~VolumeAtlas()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the blocks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeAtlas::blocks ( const Images &images, const Boxes &boxes )
+{
+  if ( images.size() != boxes.size() )
+    throw std::runtime_error ( "Error 2963018457: number of images and boxes differ" );
+
+  if ( images.empty() )
+  {
+    this->_clear();
+    return;
+  }
+
+  if ( false == images.front().valid() )
+    throw std::runtime_error ( "Error 1804739265: null image given for a block" );
+
+  const osg::Image &front ( *images.front() );
+  for ( Images::const_iterator iter = images.begin(); iter != images.end(); ++iter )
+  {
+    const osg::Image *image ( iter->get() );
+    if ( 0x0 == image || 0x0 == image->data() )
+      throw std::runtime_error ( "Error 1804739265: null image given for a block" );
+
+    if ( image->s() != front.s() || image->t() != front.t() || image->r() != front.r() ||
+         image->getPixelFormat() != front.getPixelFormat() || image->getDataType() != front.getDataType() )
+      throw std::runtime_error ( "Error 3361492870: blocks in an atlas must all have the same size and format" );
+  }
+
+  // Each block has a border of one voxel.
+  unsigned int size[3];
+  Detail::slotSize ( front, size );
+  if ( size[0] > _maxTextureSize || size[1] > _maxTextureSize || size[2] > _maxTextureSize )
+    throw std::runtime_error ( "Error 2578134409: block is larger than the largest texture" );
+
+  // Textures made for blocks of another size or format cannot be reused.
+  if ( false == _atlases.empty() )
+  {
+    const Atlas &atlas ( _atlases.front() );
+    const osg::Image &image ( *atlas.image );
+    if ( static_cast < unsigned int > ( image.s() ) != atlas.slots[0] * size[0] ||
+         static_cast < unsigned int > ( image.t() ) != atlas.slots[1] * size[1] ||
+         static_cast < unsigned int > ( image.r() ) != atlas.slots[2] * size[2] ||
+         image.getPixelFormat() != front.getPixelFormat() || image.getDataType() != front.getDataType() )
+    {
+      this->_clear();
+    }
+  }
+
+  // Fill the textures there are, in Morton order, and make more if needed.
+  // Each texture then covers a compact region, so sorting the textures by
+  // depth blends them in the right order.
+  const unsigned int count ( images.size() );
+  std::vector < unsigned int > order;
+  Detail::mortonOrder ( boxes, order );
+
+  Detail::Places places ( count );
+  unsigned int numAtlases ( 0 );
+  for ( unsigned int start = 0; start < count; ++numAtlases )
+  {
+    if ( numAtlases == _atlases.size() )
+      this->_addAtlas ( count - start, front );
+
+    const unsigned int num ( std::min ( _atlases[numAtlases].capacity, count - start ) );
+    for ( unsigned int i = 0; i < num; ++i )
+      places[order[start + i]] = Detail::Place ( numAtlases, i );
+
+    start += num;
+  }
+
+  // Drop the textures no longer needed.
+  for ( unsigned int i = numAtlases; i < _atlases.size(); ++i )
+    this->removeDrawable ( _atlases[i].geometry.get() );
+  _atlases.resize ( numAtlases );
+
+  Detail::Pack < Atlases > pack ( images, _atlases, places );
+  OsgVolume::Parallel::forEach ( count, pack );
+
+  // Where each block is in its texture.
+  std::vector < AtlasGeometry::Blocks > blocks ( numAtlases );
+  for ( unsigned int i = 0; i < count; ++i )
+  {
+    const Atlas &atlas ( _atlases[places[i].first] );
+    const osg::Image &image ( *atlas.image );
+    const float lengths[3] = { static_cast < float > ( image.s() ), static_cast < float > ( image.t() ), static_cast < float > ( image.r() ) };
+
+    AtlasGeometry::Block block;
+    block.bb = boxes[i];
+    for ( unsigned int axis = 0; axis < 3; ++axis )
+    {
+      const unsigned int origin ( Detail::slotOrigin ( atlas.slots, places[i].second, axis, size[axis] ) );
+      block.offset[axis] = ( origin + 1 ) / lengths[axis];
+      block.scale[axis] = ( size[axis] - 2 ) / lengths[axis];
+    }
+    blocks[places[i].first].push_back ( block );
+  }
+
+  // Send the new voxels to the textures already made.
+  for ( unsigned int i = 0; i < numAtlases; ++i )
+  {
+    _atlases[i].image->dirty();
+    _atlases[i].geometry->blocks ( blocks[i] );
+  }
+
+  _numBlocks = count;
+  this->dirtyBound();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Make a texture for up to the given number of blocks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeAtlas::_addAtlas ( unsigned int numBlocks, const osg::Image &block )
+{
+  unsigned int size[3];
+  Detail::slotSize ( block, size );
+
+  // Fill x first, then y, then z, so a few blocks make a small texture.
+  Atlas atlas;
+  const unsigned int most[3] = { _maxTextureSize / size[0], _maxTextureSize / size[1], _maxTextureSize / size[2] };
+  atlas.slots[0] = std::min ( most[0], numBlocks );
+  atlas.slots[1] = std::min ( most[1], ( numBlocks + atlas.slots[0] - 1 ) / atlas.slots[0] );
+  atlas.slots[2] = std::min ( most[2], ( numBlocks + atlas.slots[0] * atlas.slots[1] - 1 ) / ( atlas.slots[0] * atlas.slots[1] ) );
+  atlas.capacity = atlas.slots[0] * atlas.slots[1] * atlas.slots[2];
+
+  atlas.image = new osg::Image;
+  atlas.image->allocateImage ( atlas.slots[0] * size[0], atlas.slots[1] * size[1], atlas.slots[2] * size[2], block.getPixelFormat(), block.getDataType() );
+  atlas.image->setInternalTextureFormat ( block.getInternalTextureFormat() );
+
+  atlas.texture = new osg::Texture3D;
+  atlas.texture->setImage ( atlas.image.get() );
+  atlas.texture->setFilter( osg::Texture3D::MIN_FILTER, osg::Texture3D::LINEAR );
+  atlas.texture->setFilter( osg::Texture3D::MAG_FILTER, osg::Texture3D::LINEAR );
+  atlas.texture->setWrap( osg::Texture3D::WRAP_R, osg::Texture3D::CLAMP_TO_EDGE );
+  atlas.texture->setWrap( osg::Texture3D::WRAP_S, osg::Texture3D::CLAMP_TO_EDGE );
+  atlas.texture->setWrap( osg::Texture3D::WRAP_T, osg::Texture3D::CLAMP_TO_EDGE );
+  atlas.texture->setResizeNonPowerOfTwoHint( false );
+
+  atlas.geometry = new AtlasGeometry;
+  atlas.geometry->numPlanes ( _numPlanes );
+  atlas.geometry->getOrCreateStateSet()->setTextureAttributeAndModes ( 0, atlas.texture.get(), osg::StateAttribute::ON );
+
+  this->addDrawable ( atlas.geometry.get() );
+  _atlases.push_back ( atlas );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Remove the textures and blocks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeAtlas::_clear()
+{
+  this->removeDrawables ( 0, this->getNumDrawables() );
+  _atlases.clear();
+  _numBlocks = 0;
+  this->dirtyBound();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of blocks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int VolumeAtlas::numBlocks() const
+{
+  return _numBlocks;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of textures.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int VolumeAtlas::numAtlases() const
+{
+  return _atlases.size();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the largest size of a texture.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeAtlas::maxTextureSize ( unsigned int size )
+{
+  _maxTextureSize = size;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the largest size of a texture.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int VolumeAtlas::maxTextureSize() const
+{
+  return _maxTextureSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the number of planes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeAtlas::numPlanes ( unsigned int num )
+{
+  _numPlanes = num;
+
+  for ( Atlases::iterator iter = _atlases.begin(); iter != _atlases.end(); ++iter )
+    iter->geometry->numPlanes ( num );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of planes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int VolumeAtlas::numPlanes() const
+{
+  return _numPlanes;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the transfer function.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeAtlas::transferFunction ( TransferFunction* tf, TextureUnit unit )
+{
+  osg::ref_ptr< osg::StateSet > ss ( this->getOrCreateStateSet() );
+
+  // Remove the old one in case the unit changed.
+  if ( _transferFunction.valid() )
+    ss->removeTextureAttribute ( _transferFunction->textureUnit(), osg::StateAttribute::TEXTURE );
+
+  _transferFunction = tf;
+
+  if ( 0x0 != tf )
+  {
+    tf->textureUnit ( unit );
+    ss->setTextureAttributeAndModes ( unit, tf->texture(), osg::StateAttribute::ON );
+    _tfSampler->set ( static_cast < int > ( unit ) );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the transfer function.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+OsgVolume::TransferFunction* VolumeAtlas::transferFunction() const
+{
+  return _transferFunction.get();
+}
@@ -0,0 +1,114 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Many small volumes of the same size, like the leaf blocks of an adaptive
+//  mesh, packed into a few large 3D textures.  Each texture is drawn by one
+//  AtlasGeometry with one program, instead of one node, texture and state
+//  set per block.  Packing new blocks of the same size writes over the
+//  textures already made when the blocks fit in them.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_VOLUME_ATLAS_H__
+#define __OSGTOOLS_VOLUME_VOLUME_ATLAS_H__
+
+#include "OsgVolume/AtlasGeometry.h"
+#include "OsgVolume/Export.h"
+#include "OsgVolume/TransferFunction.h"
+
+#include "osg/Geode"
+#include "osg/Image"
+#include "osg/Program"
+#include "osg/Texture3D"
+#include "osg/Uniform"
+
+#include <vector>
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT VolumeAtlas : public osg::Geode
+{
+public:
+  /// Typedefs.
+  typedef osg::Geode                             BaseClass;
+  typedef unsigned int                           TextureUnit;
+  typedef OsgVolume::TransferFunction            TransferFunction;
+  typedef std::vector < osg::ref_ptr < osg::Image > > Images;
+  typedef std::vector < osg::BoundingBox >       Boxes;
+
+  /// Construction.
+  VolumeAtlas();
+
+  /// Set the blocks.  The images must all have the same size and format.
+  /// Each is drawn in the box with the same index.
+  void                             blocks ( const Images &images, const Boxes &boxes );
+
+  /// Get the number of blocks.
+  unsigned int                     numBlocks() const;
+
+  /// Get the number of textures the blocks are packed in.
+  unsigned int                     numAtlases() const;
+
+  /// Get/Set the largest size of a texture along any side.  Changing it
+  /// takes effect the next time the blocks are set.
+  void                             maxTextureSize ( unsigned int size );
+  unsigned int                     maxTextureSize() const;
+
+  /// Get/Set the number of planes through each block.
+  void                             numPlanes ( unsigned int num );
+  unsigned int                     numPlanes() const;
+
+  /// Get/Set the transfer function.
+  void                             transferFunction ( TransferFunction* tf, TextureUnit unit = 1 );
+  TransferFunction*                transferFunction() const;
+
+protected:
+  virtual ~VolumeAtlas();
+
+  struct Atlas
+  {
+    Atlas() : image ( 0x0 ), texture ( 0x0 ), geometry ( 0x0 ), capacity ( 0 )
+    {
+      slots[0] = slots[1] = slots[2] = 0;
+    }
+
+    osg::ref_ptr < osg::Image >     image;
+    osg::ref_ptr < osg::Texture3D > texture;
+    osg::ref_ptr < AtlasGeometry >  geometry;
+    unsigned int                    slots[3];
+    unsigned int                    capacity;
+  };
+
+  typedef std::vector < Atlas >                  Atlases;
+
+  void                             _addAtlas ( unsigned int numBlocks, const osg::Image &block );
+  void                             _clear();
+
+private:
+
+  VolumeAtlas ( const VolumeAtlas & );
+  VolumeAtlas &operator = ( const VolumeAtlas & );
+
+  Atlases                       _atlases;
+  unsigned int                  _numBlocks;
+  unsigned int                  _maxTextureSize;
+  unsigned int                  _numPlanes;
+  TransferFunction::RefPtr      _transferFunction;
+  osg::ref_ptr < osg::Program > _program;
+  osg::ref_ptr < osg::Uniform > _volumeSampler;
+  osg::ref_ptr < osg::Uniform > _tfSampler;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_VOLUME_ATLAS_H__
@@ -0,0 +1,854 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Volume file (.hvol).  All numbers are little endian.
+//
+//    header   "HVOL", version, offset of the index                16 bytes
+//    bricks   level by level, each brick compressed on its own
+//    index    pixel format, data type, internal format, bytes per voxel,
+//             brick size, codec, bounding box, number of levels, then for
+//             each level its size and for each brick its offset, number
+//             of bytes, minimum, maximum and histogram
+//
+//  A brick that does not get smaller when compressed is stored as it is,
+//  which the reader sees from its number of bytes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/VolumeFile.h"
+#include "OsgVolume/Lz4.h"
+#include "OsgVolume/Parallel.h"
+#include "OsgVolume/VolumePyramid.h"
+#include "OsgVolume/Voxels.h"
+
+#ifdef _WIN32
+# ifndef NOMINMAX
+#  define NOMINMAX
+# endif
+# include <windows.h>
+#else
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for the file layout.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  const char         MAGIC[4]     = { 'H', 'V', 'O', 'L' };
+  const unsigned int VERSION      ( 1 );
+  const unsigned int HEADER_BYTES ( 16 );
+
+  // Offset, size, range and histogram of a brick in the index.
+  const unsigned int BRICK_INDEX_BYTES ( 8 + 4 + 4 + 4 + 4 * OsgVolume::VolumeFile::HISTOGRAM_BINS );
+
+  // Append little endian numbers to the bytes.
+  class Output
+  {
+  public:
+    Output ( std::vector < unsigned char > &bytes ) : _bytes ( bytes )
+    {
+    }
+
+    void put32 ( unsigned int v )
+    {
+      for ( unsigned int i = 0; i < 4; ++i )
+        _bytes.push_back ( static_cast < unsigned char > ( ( v >> ( 8 * i ) ) & 0xFF ) );
+    }
+
+    void put64 ( unsigned long long v )
+    {
+      for ( unsigned int i = 0; i < 8; ++i )
+        _bytes.push_back ( static_cast < unsigned char > ( ( v >> ( 8 * i ) ) & 0xFF ) );
+    }
+
+    void putFloat ( float v )
+    {
+      unsigned int bits ( 0 );
+      std::memcpy ( &bits, &v, 4 );
+      this->put32 ( bits );
+    }
+
+    void putDouble ( double v )
+    {
+      unsigned long long bits ( 0 );
+      std::memcpy ( &bits, &v, 8 );
+      this->put64 ( bits );
+    }
+
+  private:
+
+    Output &operator = ( const Output & );
+
+    std::vector < unsigned char > &_bytes;
+  };
+
+  // Read little endian numbers from the bytes.
+  class Input
+  {
+  public:
+    Input ( const std::vector < unsigned char > &bytes ) : _bytes ( bytes ), _at ( 0 )
+    {
+    }
+
+    unsigned int get32()
+    {
+      const unsigned char *p ( this->_next ( 4 ) );
+      unsigned int v ( 0 );
+      for ( unsigned int i = 0; i < 4; ++i )
+        v |= static_cast < unsigned int > ( p[i] ) << ( 8 * i );
+      return v;
+    }
+
+    unsigned long long get64()
+    {
+      const unsigned char *p ( this->_next ( 8 ) );
+      unsigned long long v ( 0 );
+      for ( unsigned int i = 0; i < 8; ++i )
+        v |= static_cast < unsigned long long > ( p[i] ) << ( 8 * i );
+      return v;
+    }
+
+    float getFloat()
+    {
+      const unsigned int bits ( this->get32() );
+      float v ( 0.0f );
+      std::memcpy ( &v, &bits, 4 );
+      return v;
+    }
+
+    double getDouble()
+    {
+      const unsigned long long bits ( this->get64() );
+      double v ( 0.0 );
+      std::memcpy ( &v, &bits, 8 );
+      return v;
+    }
+
+    std::size_t remaining() const
+    {
+      return _bytes.size() - _at;
+    }
+
+  private:
+
+    Input &operator = ( const Input & );
+
+    const unsigned char *_next ( std::size_t n )
+    {
+      if ( _bytes.size() - _at < n )
+        throw std::runtime_error ( "Error 3518672940: index of volume file is cut short" );
+      const unsigned char *p ( &_bytes[_at] );
+      _at += n;
+      return p;
+    }
+
+    const std::vector < unsigned char > &_bytes;
+    std::size_t _at;
+  };
+
+  // Cut the level into bricks.
+  inline void layout ( OsgVolume::VolumeFile::Level &level, unsigned int brickSize )
+  {
+    for ( unsigned int a = 0; a < 3; ++a )
+      level.numBricks[a] = ( level.size[a] + brickSize - 1 ) / brickSize;
+
+    level.bricks.resize ( level.numBricks[0] * level.numBricks[1] * level.numBricks[2] );
+
+    for ( unsigned int k = 0; k < level.numBricks[2]; ++k )
+    {
+      for ( unsigned int j = 0; j < level.numBricks[1]; ++j )
+      {
+        for ( unsigned int i = 0; i < level.numBricks[0]; ++i )
+        {
+          OsgVolume::VolumeFile::Brick &brick ( level.bricks[i + level.numBricks[0] * ( j + level.numBricks[1] * k )] );
+          const unsigned int index[3] = { i, j, k };
+          for ( unsigned int a = 0; a < 3; ++a )
+          {
+            brick.origin[a] = index[a] * brickSize;
+            brick.size[a] = std::min ( brickSize, level.size[a] - brick.origin[a] );
+          }
+        }
+      }
+    }
+  }
+
+  // Find the range and histogram of the scalar in the brick.
+  template < class VoxelType > inline void statistics ( const unsigned char *bytes, std::size_t numVoxels, unsigned int channels, GLenum format, OsgVolume::VolumeFile::Brick &brick )
+  {
+    brick.histogram.assign ( OsgVolume::VolumeFile::HISTOGRAM_BINS, 0 );
+
+    unsigned int channel ( 0 );
+    if ( false == OsgVolume::Voxels::scalarChannel ( format, channel ) )
+    {
+      brick.minimum = brick.maximum = 1.0f;
+      brick.histogram.back() = static_cast < unsigned int > ( numVoxels );
+      return;
+    }
+
+    const VoxelType *voxels ( reinterpret_cast < const VoxelType * > ( bytes ) );
+    float low ( 1.0f ), high ( 0.0f );
+
+    for ( std::size_t i = 0; i < numVoxels; ++i )
+    {
+      const float v ( OsgVolume::Voxels::normalize ( voxels[i * channels + channel] ) );
+      low = std::min ( low, v );
+      high = std::max ( high, v );
+
+      const unsigned int bin ( static_cast < unsigned int > ( v * OsgVolume::VolumeFile::HISTOGRAM_BINS ) );
+      ++brick.histogram[std::min ( bin, static_cast < unsigned int > ( OsgVolume::VolumeFile::HISTOGRAM_BINS - 1 ) )];
+    }
+
+    brick.minimum = low;
+    brick.maximum = high;
+  }
+
+  // Copy the voxels of a brick out of the level, find its statistics and
+  // compress it.  One task is one brick of a layer of bricks.
+  class PackBricks
+  {
+  public:
+    typedef std::vector < unsigned char > Block;
+    typedef std::vector < Block > Blocks;
+
+    PackBricks ( const osg::Image &image, OsgVolume::VolumeFile::Level &level, unsigned int layer, unsigned int bytesPerVoxel, OsgVolume::VolumeFile::Codec codec ) :
+      _image ( image ),
+      _level ( level ),
+      _first ( layer * level.numBricks[0] * level.numBricks[1] ),
+      _bytesPerVoxel ( bytesPerVoxel ),
+      _codec ( codec ),
+      _blocks ( level.numBricks[0] * level.numBricks[1] )
+    {
+    }
+
+    void operator () ( unsigned int i )
+    {
+      OsgVolume::VolumeFile::Brick &brick ( _level.bricks.at ( _first + i ) );
+      const std::size_t row ( brick.size[0] * _bytesPerVoxel );
+      const std::size_t numVoxels ( brick.size[0] * brick.size[1] * brick.size[2] );
+
+      Block raw ( numVoxels * _bytesPerVoxel );
+      unsigned char *out ( &raw[0] );
+      for ( unsigned int k = 0; k < brick.size[2]; ++k )
+      {
+        for ( unsigned int j = 0; j < brick.size[1]; ++j )
+        {
+          std::memcpy ( out, _image.data ( brick.origin[0], brick.origin[1] + j, brick.origin[2] + k ), row );
+          out += row;
+        }
+      }
+
+      const unsigned int channels ( osg::Image::computeNumComponents ( _image.getPixelFormat() ) );
+      switch ( _image.getDataType() )
+      {
+      case GL_UNSIGNED_BYTE:
+        Detail::statistics < unsigned char > ( &raw[0], numVoxels, channels, _image.getPixelFormat(), brick );
+        break;
+      case GL_UNSIGNED_SHORT:
+        Detail::statistics < unsigned short > ( &raw[0], numVoxels, channels, _image.getPixelFormat(), brick );
+        break;
+      case GL_FLOAT:
+        Detail::statistics < float > ( &raw[0], numVoxels, channels, _image.getPixelFormat(), brick );
+        break;
+      }
+
+      Block &block ( _blocks.at ( i ) );
+      if ( OsgVolume::VolumeFile::LZ4 == _codec )
+      {
+        block.resize ( OsgVolume::Lz4::bound ( raw.size() ) );
+        const std::size_t size ( OsgVolume::Lz4::compress ( &raw[0], raw.size(), &block[0], block.size() ) );
+        block.resize ( size );
+      }
+
+      // Keep it as it is when compressing does not help.
+      if ( block.empty() || block.size() >= raw.size() )
+        block.swap ( raw );
+
+      brick.numBytes = static_cast < unsigned int > ( block.size() );
+    }
+
+    const Blocks &blocks() const
+    {
+      return _blocks;
+    }
+
+  private:
+
+    PackBricks &operator = ( const PackBricks & );
+
+    const osg::Image &_image;
+    OsgVolume::VolumeFile::Level &_level;
+    unsigned int _first;
+    unsigned int _bytesPerVoxel;
+    OsgVolume::VolumeFile::Codec _codec;
+    Blocks _blocks;
+  };
+
+  // Read the bricks a region touches and copy their voxels into it.
+  class ReadRegion
+  {
+  public:
+    typedef std::vector < unsigned int > Indices;
+
+    ReadRegion ( const OsgVolume::VolumeFile &file, unsigned int level, const Indices &bricks, const unsigned int first[3], osg::Image &image, unsigned int bytesPerVoxel ) :
+      _file ( file ),
+      _level ( level ),
+      _bricks ( bricks ),
+      _image ( image ),
+      _bytesPerVoxel ( bytesPerVoxel )
+    {
+      std::copy ( first, first + 3, _first );
+    }
+
+    void operator () ( unsigned int i )
+    {
+      const unsigned int index ( _bricks.at ( i ) );
+      const OsgVolume::VolumeFile::Brick &brick ( _file.level ( _level ).bricks.at ( index ) );
+
+      std::vector < unsigned char > voxels ( _file.brickBytes ( _level, index ) );
+      _file.readBrick ( _level, index, &voxels[0] );
+
+      // Where the brick and region overlap, in the voxels of the level.
+      const unsigned int size[3] = { static_cast < unsigned int > ( _image.s() ), static_cast < unsigned int > ( _image.t() ), static_cast < unsigned int > ( _image.r() ) };
+      unsigned int low[3], high[3];
+      for ( unsigned int a = 0; a < 3; ++a )
+      {
+        low[a] = std::max ( brick.origin[a], _first[a] );
+        high[a] = std::min ( brick.origin[a] + brick.size[a], _first[a] + size[a] );
+      }
+
+      const std::size_t row ( ( high[0] - low[0] ) * _bytesPerVoxel );
+      for ( unsigned int k = low[2]; k < high[2]; ++k )
+      {
+        for ( unsigned int j = low[1]; j < high[1]; ++j )
+        {
+          const std::size_t from ( ( ( k - brick.origin[2] ) * brick.size[1] + ( j - brick.origin[1] ) ) * brick.size[0] + ( low[0] - brick.origin[0] ) );
+          std::memcpy ( _image.data ( low[0] - _first[0], j - _first[1], k - _first[2] ), &voxels[from * _bytesPerVoxel], row );
+        }
+      }
+    }
+
+  private:
+
+    ReadRegion &operator = ( const ReadRegion & );
+
+    const OsgVolume::VolumeFile &_file;
+    unsigned int _level;
+    const Indices &_bricks;
+    unsigned int _first[3];
+    osg::Image &_image;
+    unsigned int _bytesPerVoxel;
+  };
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructors.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+VolumeFile::Brick::Brick() :
+  offset ( 0 ),
+  numBytes ( 0 ),
+  minimum ( 0.0f ),
+  maximum ( 0.0f ),
+  histogram()
+{
+  std::fill ( origin, origin + 3, 0 );
+  std::fill ( size, size + 3, 0 );
+}
+
+VolumeFile::Level::Level() :
+  bricks()
+{
+  std::fill ( size, size + 3, 0 );
+  std::fill ( numBricks, numBricks + 3, 0 );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Write the volume and its coarser levels.  Each layer of bricks is packed
+//  on all processors, then written in order.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeFile::write ( const std::string &filename, osg::Image *volume, const osg::BoundingBox &bb, unsigned int brickSize, Codec codec, bool preserveMaximum )
+{
+  if ( 0x0 == volume || 0x0 == volume->data() )
+    throw std::runtime_error ( "Error 2047519386: no volume given to write to '" + filename + "'" );
+
+  brickSize = std::max ( 1u, brickSize );
+
+  VolumePyramid::RefPtr pyramid ( new VolumePyramid ( volume, preserveMaximum, brickSize ) );
+
+  std::ofstream out ( filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+  if ( false == out.is_open() )
+    throw std::runtime_error ( "Error 1597023846: could not open '" + filename + "' for writing" );
+
+  // The index offset is filled in at the end.
+  std::vector < unsigned char > header;
+  header.insert ( header.end(), Detail::MAGIC, Detail::MAGIC + 4 );
+  Detail::Output ( header ).put32 ( Detail::VERSION );
+  Detail::Output ( header ).put64 ( 0 );
+  out.write ( reinterpret_cast < const char * > ( &header[0] ), header.size() );
+
+  const unsigned int bytesPerVoxel ( osg::Image::computePixelSizeInBits ( volume->getPixelFormat(), volume->getDataType() ) / 8 );
+  unsigned long long offset ( Detail::HEADER_BYTES );
+
+  Levels levels ( pyramid->numLevels() );
+  for ( unsigned int l = 0; l < levels.size(); ++l )
+  {
+    const osg::Image &image ( *pyramid->level ( l ) );
+    Level &level ( levels[l] );
+    level.size[0] = image.s();
+    level.size[1] = image.t();
+    level.size[2] = std::max ( 1, image.r() );
+    Detail::layout ( level, brickSize );
+
+    for ( unsigned int layer = 0; layer < level.numBricks[2]; ++layer )
+    {
+      Detail::PackBricks pack ( image, level, layer, bytesPerVoxel, codec );
+      OsgVolume::Parallel::forEach ( level.numBricks[0] * level.numBricks[1], pack );
+
+      const unsigned int first ( layer * level.numBricks[0] * level.numBricks[1] );
+      for ( unsigned int i = 0; i < pack.blocks().size(); ++i )
+      {
+        const Detail::PackBricks::Block &block ( pack.blocks()[i] );
+        level.bricks[first + i].offset = offset;
+        out.write ( reinterpret_cast < const char * > ( &block[0] ), block.size() );
+        offset += block.size();
+      }
+    }
+  }
+
+  // The index.
+  std::vector < unsigned char > index;
+  Detail::Output output ( index );
+  output.put32 ( volume->getPixelFormat() );
+  output.put32 ( volume->getDataType() );
+  output.put32 ( volume->getInternalTextureFormat() );
+  output.put32 ( bytesPerVoxel );
+  output.put32 ( brickSize );
+  output.put32 ( codec );
+  output.putDouble ( bb.xMin() );
+  output.putDouble ( bb.yMin() );
+  output.putDouble ( bb.zMin() );
+  output.putDouble ( bb.xMax() );
+  output.putDouble ( bb.yMax() );
+  output.putDouble ( bb.zMax() );
+  output.put32 ( levels.size() );
+  for ( Levels::const_iterator level = levels.begin(); level != levels.end(); ++level )
+  {
+    for ( unsigned int a = 0; a < 3; ++a )
+      output.put32 ( level->size[a] );
+
+    for ( Bricks::const_iterator brick = level->bricks.begin(); brick != level->bricks.end(); ++brick )
+    {
+      output.put64 ( brick->offset );
+      output.put32 ( brick->numBytes );
+      output.putFloat ( brick->minimum );
+      output.putFloat ( brick->maximum );
+      for ( unsigned int i = 0; i < brick->histogram.size(); ++i )
+        output.put32 ( brick->histogram[i] );
+    }
+  }
+  out.write ( reinterpret_cast < const char * > ( &index[0] ), index.size() );
+
+  // Now say where the index is.
+  std::vector < unsigned char > where;
+  Detail::Output ( where ).put64 ( offset );
+  out.seekp ( 8 );
+  out.write ( reinterpret_cast < const char * > ( &where[0] ), where.size() );
+
+  out.close();
+  if ( out.fail() )
+    throw std::runtime_error ( "Error 3860217745: could not write '" + filename + "'" );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+VolumeFile::VolumeFile ( const std::string &filename ) : BaseClass(),
+  _filename ( filename ),
+#ifdef _WIN32
+  _file ( INVALID_HANDLE_VALUE ),
+#else
+  _file ( -1 ),
+#endif
+  _pixelFormat ( GL_LUMINANCE ),
+  _dataType ( GL_UNSIGNED_BYTE ),
+  _internalFormat ( GL_LUMINANCE ),
+  _bytesPerVoxel ( 1 ),
+  _brickSize ( 1 ),
+  _codec ( VolumeFile::NONE ),
+  _bb(),
+  _levels()
+{
+#ifdef _WIN32
+  _file = ::CreateFileA ( _filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0x0, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, 0x0 );
+  if ( INVALID_HANDLE_VALUE == _file )
+#else
+  _file = ::open ( _filename.c_str(), O_RDONLY );
+  if ( _file < 0 )
+#endif
+    throw std::runtime_error ( "Error 2781940063: could not open '" + _filename + "'" );
+
+  // The destructor does not run when the constructor throws.
+  try
+  {
+    this->_readIndex();
+  }
+  catch ( ... )
+  {
+    this->_close();
+    throw;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+VolumeFile::~VolumeFile()
+{
+  this->_close();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Close the file.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeFile::_close()
+{
+#ifdef _WIN32
+  if ( INVALID_HANDLE_VALUE != _file )
+    ::CloseHandle ( _file );
+  _file = INVALID_HANDLE_VALUE;
+#else
+  if ( _file >= 0 )
+    ::close ( _file );
+  _file = -1;
+#endif
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Read bytes at the offset.  Nothing is shared between reads, so bricks
+//  can be read from many threads at once.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeFile::_read ( unsigned long long offset, unsigned char *bytes, std::size_t size ) const
+{
+  while ( size > 0 )
+  {
+#ifdef _WIN32
+    OVERLAPPED overlapped;
+    std::memset ( &overlapped, 0, sizeof ( overlapped ) );
+    overlapped.Offset = static_cast < DWORD > ( offset & 0xFFFFFFFF );
+    overlapped.OffsetHigh = static_cast < DWORD > ( offset >> 32 );
+
+    DWORD count ( 0 );
+    const DWORD wanted ( static_cast < DWORD > ( std::min < std::size_t > ( size, 0x40000000 ) ) );
+    if ( 0 == ::ReadFile ( _file, bytes, wanted, &count, &overlapped ) || 0 == count )
+#else
+    const ssize_t count ( ::pread ( _file, bytes, size, static_cast < off_t > ( offset ) ) );
+    if ( count <= 0 )
+#endif
+      throw std::runtime_error ( "Error 1228350796: could not read from '" + _filename + "'" );
+
+    bytes += count;
+    size -= count;
+    offset += count;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Read the header and the index, and check that they fit the file.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeFile::_readIndex()
+{
+#ifdef _WIN32
+  LARGE_INTEGER large;
+  if ( 0 == ::GetFileSizeEx ( _file, &large ) )
+    throw std::runtime_error ( "Error 3301792545: could not get the size of '" + _filename + "'" );
+  const unsigned long long fileSize ( large.QuadPart );
+#else
+  struct stat info;
+  if ( 0 != ::fstat ( _file, &info ) )
+    throw std::runtime_error ( "Error 3301792545: could not get the size of '" + _filename + "'" );
+  const unsigned long long fileSize ( info.st_size );
+#endif
+
+  if ( fileSize < Detail::HEADER_BYTES )
+    throw std::runtime_error ( "Error 2465918033: '" + _filename + "' is not a volume file" );
+
+  std::vector < unsigned char > header ( Detail::HEADER_BYTES );
+  this->_read ( 0, &header[0], header.size() );
+  if ( 0 != std::memcmp ( &header[0], Detail::MAGIC, 4 ) )
+    throw std::runtime_error ( "Error 2465918033: '" + _filename + "' is not a volume file" );
+
+  std::vector < unsigned char > rest ( header.begin() + 4, header.end() );
+  Detail::Input input ( rest );
+  if ( Detail::VERSION != input.get32() )
+    throw std::runtime_error ( "Error 1049736582: version of volume file '" + _filename + "' is not supported" );
+
+  const unsigned long long indexOffset ( input.get64() );
+  if ( indexOffset < Detail::HEADER_BYTES || indexOffset >= fileSize )
+    throw std::runtime_error ( "Error 3793106254: index of volume file '" + _filename + "' is out of place" );
+
+  std::vector < unsigned char > index ( static_cast < std::size_t > ( fileSize - indexOffset ) );
+  this->_read ( indexOffset, &index[0], index.size() );
+
+  Detail::Input in ( index );
+  _pixelFormat = in.get32();
+  _dataType = in.get32();
+  _internalFormat = in.get32();
+  _bytesPerVoxel = in.get32();
+  _brickSize = in.get32();
+  _codec = static_cast < Codec > ( in.get32() );
+
+  if ( false == Voxels::supported ( _dataType ) || 0 == _brickSize ||
+       _bytesPerVoxel != osg::Image::computePixelSizeInBits ( _pixelFormat, _dataType ) / 8 || 0 == _bytesPerVoxel )
+    throw std::runtime_error ( "Error 1675230489: voxels of volume file '" + _filename + "' are not supported" );
+
+  if ( VolumeFile::NONE != _codec && VolumeFile::LZ4 != _codec )
+    throw std::runtime_error ( "Error 4190862273: compression of volume file '" + _filename + "' is not supported" );
+
+  const double xMin ( in.getDouble() ), yMin ( in.getDouble() ), zMin ( in.getDouble() );
+  const double xMax ( in.getDouble() ), yMax ( in.getDouble() ), zMax ( in.getDouble() );
+  _bb.set ( xMin, yMin, zMin, xMax, yMax, zMax );
+
+  const unsigned int numLevels ( in.get32() );
+  if ( 0 == numLevels || numLevels > 32 )
+    throw std::runtime_error ( "Error 2930582617: volume file '" + _filename + "' has a bad number of levels" );
+
+  _levels.resize ( numLevels );
+  for ( Levels::iterator level = _levels.begin(); level != _levels.end(); ++level )
+  {
+    for ( unsigned int a = 0; a < 3; ++a )
+    {
+      level->size[a] = in.get32();
+      if ( 0 == level->size[a] )
+        throw std::runtime_error ( "Error 2930582617: volume file '" + _filename + "' has an empty level" );
+    }
+
+    // Check the sizes before making the bricks, so that a bad index cannot
+    // ask for more of them than it has room for, or for a brick too big to
+    // decode into.
+    const unsigned long long maxBricks ( in.remaining() / Detail::BRICK_INDEX_BYTES );
+    unsigned long long numBricks ( 1 ), brickBytes ( _bytesPerVoxel );
+    for ( unsigned int a = 0; a < 3; ++a )
+    {
+      const unsigned long long across ( ( static_cast < unsigned long long > ( level->size[a] ) + _brickSize - 1 ) / _brickSize );
+      if ( across > maxBricks / numBricks )
+        throw std::runtime_error ( "Error 2614083957: volume file '" + _filename + "' has more bricks than its index holds" );
+      numBricks *= across;
+
+      brickBytes *= std::min ( _brickSize, level->size[a] );
+      if ( brickBytes > static_cast < unsigned long long > ( 0xFFFFFFFF ) )
+        throw std::runtime_error ( "Error 1907346218: bricks of volume file '" + _filename + "' are too big" );
+    }
+
+    Detail::layout ( *level, _brickSize );
+
+    for ( Bricks::iterator brick = level->bricks.begin(); brick != level->bricks.end(); ++brick )
+    {
+      brick->offset = in.get64();
+      brick->numBytes = in.get32();
+      brick->minimum = in.getFloat();
+      brick->maximum = in.getFloat();
+      brick->histogram.resize ( HISTOGRAM_BINS );
+      for ( unsigned int i = 0; i < brick->histogram.size(); ++i )
+        brick->histogram[i] = in.get32();
+
+      const unsigned long long raw ( static_cast < unsigned long long > ( brick->size[0] ) * brick->size[1] * brick->size[2] * _bytesPerVoxel );
+      if ( brick->offset < Detail::HEADER_BYTES || brick->offset + brick->numBytes > indexOffset || 0 == brick->numBytes || brick->numBytes > raw )
+        throw std::runtime_error ( "Error 3126749508: brick of volume file '" + _filename + "' is out of place" );
+    }
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the file.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const std::string& VolumeFile::filename() const
+{
+  return _filename;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the bounding box.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const osg::BoundingBox& VolumeFile::boundingBox() const
+{
+  return _bb;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of voxels along each side of a full brick.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int VolumeFile::brickSize() const
+{
+  return _brickSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of levels.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int VolumeFile::numLevels() const
+{
+  return _levels.size();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the level.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+const VolumeFile::Level& VolumeFile::level ( unsigned int i ) const
+{
+  return _levels.at ( i );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of bytes a brick holds once read.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+std::size_t VolumeFile::brickBytes ( unsigned int level, unsigned int brick ) const
+{
+  const Brick &b ( _levels.at ( level ).bricks.at ( brick ) );
+  return static_cast < std::size_t > ( b.size[0] ) * b.size[1] * b.size[2] * _bytesPerVoxel;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Read a brick.  Bricks stored as they are go straight into the voxels.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeFile::readBrick ( unsigned int level, unsigned int brick, unsigned char *voxels ) const
+{
+  const Brick &b ( _levels.at ( level ).bricks.at ( brick ) );
+  const std::size_t raw ( this->brickBytes ( level, brick ) );
+
+  if ( b.numBytes == raw )
+  {
+    this->_read ( b.offset, voxels, raw );
+    return;
+  }
+
+  std::vector < unsigned char > block ( b.numBytes );
+  this->_read ( b.offset, &block[0], block.size() );
+  Lz4::decompress ( &block[0], block.size(), voxels, raw );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Read a whole level.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* VolumeFile::image ( unsigned int level ) const
+{
+  const unsigned int first[3] = { 0, 0, 0 };
+  return this->region ( level, first, this->level ( level ).size );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Read the voxels in [first,last) of a level.  The bricks are read and
+//  decompressed on all processors.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* VolumeFile::region ( unsigned int level, const unsigned int first[3], const unsigned int last[3] ) const
+{
+  const Level &l ( this->level ( level ) );
+
+  unsigned int lo[3], hi[3];
+  for ( unsigned int a = 0; a < 3; ++a )
+  {
+    lo[a] = std::min ( first[a], l.size[a] );
+    hi[a] = std::min ( last[a], l.size[a] );
+    if ( hi[a] <= lo[a] )
+      throw std::runtime_error ( "Error 1832067494: region of volume file '" + _filename + "' is empty" );
+  }
+
+  osg::ref_ptr < osg::Image > image ( new osg::Image );
+  image->allocateImage ( hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2], _pixelFormat, _dataType );
+  image->setInternalTextureFormat ( _internalFormat );
+
+  Detail::ReadRegion::Indices bricks;
+  for ( unsigned int k = lo[2] / _brickSize; k <= ( hi[2] - 1 ) / _brickSize; ++k )
+    for ( unsigned int j = lo[1] / _brickSize; j <= ( hi[1] - 1 ) / _brickSize; ++j )
+      for ( unsigned int i = lo[0] / _brickSize; i <= ( hi[0] - 1 ) / _brickSize; ++i )
+        bricks.push_back ( i + l.numBricks[0] * ( j + l.numBricks[1] * k ) );
+
+  Detail::ReadRegion read ( *this, level, bricks, lo, *image, _bytesPerVoxel );
+  OsgVolume::Parallel::forEach ( bricks.size(), read );
+
+  return image.release();
+}
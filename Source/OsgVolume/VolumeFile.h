@@ -0,0 +1,149 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Volume file (.hvol).  The volume and its coarser levels are cut into
+//  bricks, each compressed on its own, with the index of all of them at the
+//  end of the file.  Opening reads only the index.  Any brick of any level
+//  is then one read from the file, so loading a level or a region costs
+//  what it covers rather than the size of the whole volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_VOLUME_FILE_H__
+#define __OSGTOOLS_VOLUME_VOLUME_FILE_H__
+
+#include "OsgVolume/Export.h"
+
+#include "Usul/Base/Referenced.h"
+#include "Usul/Pointers/Pointers.h"
+
+#include "osg/BoundingBox"
+#include "osg/Image"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT VolumeFile : public Usul::Base::Referenced
+{
+public:
+  /// Typedefs.
+  typedef Usul::Base::Referenced                 BaseClass;
+  typedef std::vector < unsigned int >           Histogram;
+
+  USUL_DECLARE_REF_POINTERS ( VolumeFile );
+
+  /// How the bricks are compressed.
+  enum Codec
+  {
+    NONE = 0,
+    LZ4 = 1
+  };
+
+  /// Number of bins in the histogram of each brick.
+  enum { HISTOGRAM_BINS = 64 };
+
+  /// A brick of a level.  The minimum, maximum and histogram are of the
+  /// scalar the shaders see, in [0,1].
+  struct OSG_VOLUME_EXPORT Brick
+  {
+    Brick();
+
+    unsigned long long offset;
+    unsigned int numBytes;
+    unsigned int origin[3];
+    unsigned int size[3];
+    float minimum;
+    float maximum;
+    Histogram histogram;
+  };
+  typedef std::vector < Brick >                  Bricks;
+
+  /// A level, with its bricks along s, then t, then r.
+  struct OSG_VOLUME_EXPORT Level
+  {
+    Level();
+
+    unsigned int size[3];
+    unsigned int numBricks[3];
+    Bricks bricks;
+  };
+  typedef std::vector < Level >                  Levels;
+
+  /// Write the volume and its coarser levels.  Levels are added until one
+  /// brick holds the whole level.  Throws if the file cannot be written.
+  static void                      write ( const std::string &filename, osg::Image *volume, const osg::BoundingBox &bb,
+                                           unsigned int brickSize = 64, Codec codec = LZ4, bool preserveMaximum = false );
+
+  /// Open the file and read its index.  Throws if it is not a volume file.
+  VolumeFile ( const std::string &filename );
+
+  /// Get the file.
+  const std::string&               filename() const;
+
+  /// Get the bounding box the volume was written with.
+  const osg::BoundingBox&          boundingBox() const;
+
+  /// Get the number of voxels along each side of a full brick.
+  unsigned int                     brickSize() const;
+
+  /// Get the number of levels, and a level.  Level zero is the volume.
+  unsigned int                     numLevels() const;
+  const Level&                     level ( unsigned int i ) const;
+
+  /// Get the number of bytes a brick holds once read.
+  std::size_t                      brickBytes ( unsigned int level, unsigned int brick ) const;
+
+  /// Read a brick into the voxels, which must hold brickBytes() of them.
+  void                             readBrick ( unsigned int level, unsigned int brick, unsigned char *voxels ) const;
+
+  /// Read a whole level.
+  osg::Image*                      image ( unsigned int level ) const;
+
+  /// Read the voxels in [first,last) of a level.  Only the bricks the
+  /// region touches are read.
+  osg::Image*                      region ( unsigned int level, const unsigned int first[3], const unsigned int last[3] ) const;
+
+protected:
+  virtual ~VolumeFile();
+
+  void                             _close();
+  void                             _read ( unsigned long long offset, unsigned char *bytes, std::size_t size ) const;
+  void                             _readIndex();
+
+private:
+
+  VolumeFile ( const VolumeFile & );
+  VolumeFile &operator = ( const VolumeFile & );
+
+  std::string                   _filename;
+#ifdef _WIN32
+  void *                        _file;
+#else
+  int                           _file;
+#endif
+  GLenum                        _pixelFormat;
+  GLenum                        _dataType;
+  GLint                         _internalFormat;
+  unsigned int                  _bytesPerVoxel;
+  unsigned int                  _brickSize;
+  Codec                         _codec;
+  osg::BoundingBox              _bb;
+  Levels                        _levels;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_VOLUME_FILE_H__
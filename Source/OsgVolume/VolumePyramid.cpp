@@ -0,0 +1,266 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Coarser copies of a volume.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OsgVolume/VolumePyramid.h"
+#include "OsgVolume/Parallel.h"
+#include "OsgVolume/Voxels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace OsgVolume;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for building the levels.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  // How integers and floats add up and divide.
+  template < class VoxelType > struct Sum               { typedef unsigned int Type; };
+  template <> struct Sum < float >                      { typedef float Type; };
+
+  template < class SumType, class VoxelType > inline VoxelType mean ( SumType sum, unsigned int count )
+  {
+    return static_cast < VoxelType > ( ( sum + count / 2 ) / count );
+  }
+  template <> inline float mean < float, float > ( float sum, unsigned int count )
+  {
+    return sum / static_cast < float > ( count );
+  }
+
+  // Make one slice of the coarser level from up to two slices of the finer one.
+  // Every channel is reduced, so images of several channels stay whole.
+  template < class VoxelType > class HalveSlices
+  {
+  public:
+    typedef typename Sum < VoxelType >::Type SumType;
+
+    HalveSlices ( const osg::Image &fine, osg::Image &coarse, bool preserveMaximum ) :
+      _fine ( fine ),
+      _coarse ( coarse ),
+      _channels ( osg::Image::computeNumComponents ( fine.getPixelFormat() ) ),
+      _preserveMaximum ( preserveMaximum )
+    {
+      _size[0] = fine.s();
+      _size[1] = fine.t();
+      _size[2] = std::max ( 1, fine.r() );
+    }
+
+    void operator () ( unsigned int k )
+    {
+      const unsigned int ks[2] = { std::min ( 2 * k, _size[2] - 1 ), std::min ( 2 * k + 1, _size[2] - 1 ) };
+      const unsigned int numK ( ( ks[0] == ks[1] ) ? 1 : 2 );
+
+      for ( unsigned int j = 0; j < static_cast < unsigned int > ( _coarse.t() ); ++j )
+      {
+        const unsigned int js[2] = { std::min ( 2 * j, _size[1] - 1 ), std::min ( 2 * j + 1, _size[1] - 1 ) };
+        const unsigned int numJ ( ( js[0] == js[1] ) ? 1 : 2 );
+
+        VoxelType *out ( reinterpret_cast < VoxelType * > ( _coarse.data ( 0, j, k ) ) );
+
+        for ( unsigned int i = 0; i < static_cast < unsigned int > ( _coarse.s() ); ++i )
+        {
+          const unsigned int is[2] = { std::min ( 2 * i, _size[0] - 1 ), std::min ( 2 * i + 1, _size[0] - 1 ) };
+          const unsigned int numI ( ( is[0] == is[1] ) ? 1 : 2 );
+
+          for ( unsigned int c = 0; c < _channels; ++c )
+          {
+            SumType sum ( 0 );
+            VoxelType high ( this->_voxel ( is[0], js[0], ks[0], c ) );
+
+            for ( unsigned int kk = 0; kk < numK; ++kk )
+            {
+              for ( unsigned int jj = 0; jj < numJ; ++jj )
+              {
+                for ( unsigned int ii = 0; ii < numI; ++ii )
+                {
+                  const VoxelType v ( this->_voxel ( is[ii], js[jj], ks[kk], c ) );
+                  sum += v;
+                  high = std::max ( high, v );
+                }
+              }
+            }
+
+            out[i * _channels + c] = ( _preserveMaximum ? high : Detail::mean < SumType, VoxelType > ( sum, numI * numJ * numK ) );
+          }
+        }
+      }
+    }
+
+  private:
+
+    HalveSlices &operator = ( const HalveSlices & );
+
+    VoxelType _voxel ( unsigned int i, unsigned int j, unsigned int k, unsigned int c ) const
+    {
+      return reinterpret_cast < const VoxelType * > ( _fine.data ( i, j, k ) )[c];
+    }
+
+    const osg::Image &_fine;
+    osg::Image &_coarse;
+    unsigned int _size[3];
+    unsigned int _channels;
+    bool _preserveMaximum;
+  };
+
+  template < class VoxelType > inline void halve ( const osg::Image &fine, osg::Image &coarse, bool preserveMaximum )
+  {
+    HalveSlices < VoxelType > slices ( fine, coarse, preserveMaximum );
+    OsgVolume::Parallel::forEach ( std::max ( 1, coarse.r() ), slices );
+  }
+
+  // Number of voxels across the diagonal of the image.
+  inline float diagonal ( const osg::Image &image )
+  {
+    const float s ( static_cast < float > ( image.s() ) );
+    const float t ( static_cast < float > ( image.t() ) );
+    const float r ( static_cast < float > ( std::max ( 1, image.r() ) ) );
+    return std::sqrt ( s * s + t * t + r * r );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+VolumePyramid::VolumePyramid ( osg::Image *volume, bool preserveMaximum, unsigned int smallest ) : BaseClass(),
+  _levels(),
+  _modifiedCount ( 0 ),
+  _preserveMaximum ( preserveMaximum )
+{
+  if ( 0x0 == volume || 0x0 == volume->data() )
+    throw std::runtime_error ( "Error 1985203746: no volume given for the pyramid" );
+
+  if ( false == Voxels::supported ( volume->getDataType() ) )
+    throw std::runtime_error ( "Error 3365801927: volume data type not supported by the pyramid" );
+
+  _modifiedCount = volume->getModifiedCount();
+  _levels.push_back ( volume );
+
+  smallest = std::max ( 1u, smallest );
+
+  while ( true )
+  {
+    const osg::Image &fine ( *_levels.back() );
+    const int size[3] = { fine.s(), fine.t(), std::max ( 1, fine.r() ) };
+    if ( static_cast < unsigned int > ( std::max ( size[0], std::max ( size[1], size[2] ) ) ) <= smallest )
+      break;
+
+    ImagePtr coarse ( new osg::Image );
+    coarse->allocateImage ( ( size[0] + 1 ) / 2, ( size[1] + 1 ) / 2, ( size[2] + 1 ) / 2, fine.getPixelFormat(), fine.getDataType() );
+    coarse->setInternalTextureFormat ( fine.getInternalTextureFormat() );
+
+    switch ( fine.getDataType() )
+    {
+    case GL_UNSIGNED_BYTE:
+      Detail::halve < unsigned char > ( fine, *coarse, _preserveMaximum );
+      break;
+    case GL_UNSIGNED_SHORT:
+      Detail::halve < unsigned short > ( fine, *coarse, _preserveMaximum );
+      break;
+    case GL_FLOAT:
+      Detail::halve < float > ( fine, *coarse, _preserveMaximum );
+      break;
+    }
+
+    _levels.push_back ( coarse );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+VolumePyramid::~VolumePyramid()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Was this built from the volume as it is now?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool VolumePyramid::current ( const osg::Image *volume, bool preserveMaximum ) const
+{
+  return ( 0x0 != volume &&
+           false == _levels.empty() &&
+           volume == _levels.front().get() &&
+           volume->getModifiedCount() == _modifiedCount &&
+           preserveMaximum == _preserveMaximum );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Is the largest voxel kept instead of the mean?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool VolumePyramid::preserveMaximum () const
+{
+  return _preserveMaximum;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the number of levels.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int VolumePyramid::numLevels () const
+{
+  return _levels.size();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the level.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+osg::Image* VolumePyramid::level ( unsigned int i ) const
+{
+  return _levels.at ( i ).get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the level to draw the volume from when it spans the pixels.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int VolumePyramid::levelFor ( float pixels ) const
+{
+  unsigned int level ( 0 );
+  while ( level + 1 < _levels.size() && Detail::diagonal ( *_levels[level + 1] ) >= pixels )
+    ++level;
+  return level;
+}
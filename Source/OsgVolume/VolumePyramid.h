@@ -0,0 +1,80 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Coarser copies of a volume, each with half the voxels of the one before
+//  along every axis.  A volume that covers few pixels on screen can draw
+//  from a small copy instead of the whole texture.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_VOLUME_PYRAMID_H__
+#define __OSGTOOLS_VOLUME_VOLUME_PYRAMID_H__
+
+#include "OsgVolume/Export.h"
+
+#include "Usul/Base/Referenced.h"
+#include "Usul/Pointers/Pointers.h"
+
+#include "osg/Image"
+#include "osg/ref_ptr"
+
+#include <vector>
+
+namespace OsgVolume {
+
+
+class OSG_VOLUME_EXPORT VolumePyramid : public Usul::Base::Referenced
+{
+public:
+  /// Typedefs.
+  typedef Usul::Base::Referenced                 BaseClass;
+  typedef osg::ref_ptr < osg::Image >            ImagePtr;
+  typedef std::vector < ImagePtr >               Levels;
+
+  USUL_DECLARE_REF_POINTERS ( VolumePyramid );
+
+  /// Construction.  Level zero is the volume itself.  Levels are added until
+  /// the longest side has no more than the smallest number of voxels.  Each
+  /// coarse voxel is the mean of the ones it covers, or with preserveMaximum
+  /// their largest, so thin bright features do not fade away.
+  VolumePyramid ( osg::Image *volume, bool preserveMaximum = false, unsigned int smallest = 16 );
+
+  /// Was this built from the volume as it is now, the same way?
+  bool                             current ( const osg::Image *volume, bool preserveMaximum ) const;
+
+  /// Is the largest voxel kept instead of the mean?
+  bool                             preserveMaximum () const;
+
+  /// Get the number of levels, and a level.
+  unsigned int                     numLevels () const;
+  osg::Image*                      level ( unsigned int i ) const;
+
+  /// Get the coarsest level that still has a voxel for every pixel across
+  /// the diagonal of the volume, when it spans the given number of pixels.
+  unsigned int                     levelFor ( float pixels ) const;
+
+protected:
+  virtual ~VolumePyramid();
+
+private:
+
+  VolumePyramid ( const VolumePyramid & );
+  VolumePyramid &operator = ( const VolumePyramid & );
+
+  Levels                        _levels;
+  unsigned int                  _modifiedCount;
+  bool                          _preserveMaximum;
+};
+
+
+}
+
+#endif // __OSGTOOLS_VOLUME_VOLUME_PYRAMID_H__
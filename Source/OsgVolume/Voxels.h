@@ -0,0 +1,70 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Read voxels the way the shaders see them.  The shaders use the alpha of
+//  the texel as the scalar, and the texture unit maps integers to [0,1].
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __OSGTOOLS_VOLUME_VOXELS_H__
+#define __OSGTOOLS_VOLUME_VOXELS_H__
+
+#include "osg/Image"
+
+#include <algorithm>
+
+namespace OsgVolume {
+namespace Voxels {
+
+
+/// Convert a voxel to [0,1] the way the texture unit does.
+inline float normalize ( unsigned char v )  { return static_cast < float > ( v ) / 255.0f; }
+inline float normalize ( unsigned short v ) { return static_cast < float > ( v ) / 65535.0f; }
+inline float normalize ( float v )          { return std::min ( std::max ( v, 0.0f ), 1.0f ); }
+
+
+/// Get the channel that becomes the texel's alpha.  Returns false when the
+/// format has no alpha, in which case the alpha is always one.
+inline bool scalarChannel ( GLenum format, unsigned int &channel )
+{
+  switch ( format )
+  {
+  case GL_LUMINANCE:
+  case GL_ALPHA:
+  case GL_INTENSITY:
+    channel = 0;
+    return true;
+  case GL_LUMINANCE_ALPHA:
+    channel = 1;
+    return true;
+  case GL_RGBA:
+  case GL_BGRA:
+    channel = 3;
+    return true;
+  default:
+    channel = 0;
+    return false;
+  }
+}
+
+
+/// Is the data type one we can read?
+inline bool supported ( GLenum type )
+{
+  return ( GL_UNSIGNED_BYTE == type || GL_UNSIGNED_SHORT == type || GL_FLOAT == type );
+}
+
+
+} // namespace Voxels
+} // namespace OsgVolume
+
+
+#endif // __OSGTOOLS_VOLUME_VOXELS_H__
@@ -77,6 +77,7 @@ FlashDocument::FlashDocument() :
   _timesteps(),
   _vTimeSteps(),
   _program ( Volume::createProgram() ),
+  _atlas ( new OsgVolume::VolumeAtlas ),
   _scalar( 1 ),
   _functionType( IFlashDocument::NO_FUNCTION ),
   SERIALIZE_XML_INITIALIZER_LIST
@@ -96,6 +97,7 @@ FlashDocument::FlashDocument() :
   blendFunc->setFunction( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
   _root->getOrCreateStateSet()->setAttributeAndModes( blendFunc.get(), osg::StateAttribute::OVERRIDE | osg::StateAttribute::ON );
   _root->getOrCreateStateSet()->setRenderBinDetails ( 1, "DepthSortedBin" );
+  _atlas->getOrCreateStateSet()->setRenderBinDetails ( 1, "DepthSortedBin" );
 }
 
 
@@ -344,6 +346,9 @@ void FlashDocument::_buildScene ( Usul::Interfaces::IUnknown* caller )
   Usul::Interfaces::IRenderInfoOSG::QueryPtr ri ( caller );
   osg::RenderInfo info ( ri.valid() ? ri->getRenderInfo() : osg::RenderInfo() );
   
+  // Keep the atlas textures so the next timestep can reuse them.
+  _root->removeChild ( _atlas.get() );
+
   osg::ref_ptr<osgUtil::GLObjectsVisitor> visitor ( new osgUtil::GLObjectsVisitor ( osgUtil::GLObjectsVisitor::RELEASE_STATE_ATTRIBUTES | osgUtil::GLObjectsVisitor::RELEASE_DISPLAY_LISTS ) );
   visitor->setRenderInfo ( info );
   _root->accept ( *visitor );
@@ -382,6 +387,10 @@ void FlashDocument::_buildScene ( Usul::Interfaces::IUnknown* caller )
       TransferFunction1D::RefPtr tf ( _transferFunctions.at ( _currentTransferFunction ) );
 
       const unsigned int numNodes ( timestep->numNodes() );
+
+      // The leaf blocks drawn with the atlas.
+      OsgVolume::VolumeAtlas::Images images;
+      OsgVolume::VolumeAtlas::Boxes boxes;
       
       // Make bounding boxes.
       for ( unsigned int num = 0; num < numNodes; ++num )
@@ -419,10 +428,19 @@ void FlashDocument::_buildScene ( Usul::Interfaces::IUnknown* caller )
           if ( _drawVolume )
           {
             osg::ref_ptr<osg::Image> image ( timestep->buildVolume ( num, useMin, useMax ) );
+#if USE_RAY_CASTING
             low->addChild  ( this->_buildVolume ( *timestep, image.get(), 1,  bb, tf.get() ) );
             //high->addChild ( this->_buildVolume ( *timestep, image.get(), 64, bb, tf.get() ) );
+#else
+            images.push_back ( image );
+            boxes.push_back ( bb );
+#endif
           }
           
+          // Nothing else to draw for this block.
+          if ( 0 == low->getNumChildren() )
+            continue;
+
           // Make a lod.
           osg::ref_ptr<osg::LOD> lod ( new osg::LOD );
           lod->setCenter ( bb.center() );
@@ -435,6 +453,12 @@ void FlashDocument::_buildScene ( Usul::Interfaces::IUnknown* caller )
         }
       }
       
+      // Pack the blocks into as few textures as they fit in.
+      _atlas->transferFunction ( tf.get() );
+      _atlas->blocks ( images, boxes );
+      if ( false == images.empty() )
+        _root->addChild ( _atlas.get() );
+
       _root->addChild ( this->_buildLegend ( useMin, useMax, tf.get(), caller ) );
 	  //_root->addChild ( this->_buildLegend ( minimum, maximum, tf.get(), caller ) );
     }
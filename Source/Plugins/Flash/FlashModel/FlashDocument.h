@@ -34,6 +34,7 @@
 #include "OsgVolume/GPURayCasting.h"
 #include "OsgVolume/Texture3DVolume.h"
 #include "OsgVolume/TransferFunction1D.h"
+#include "OsgVolume/VolumeAtlas.h"
 
 #include "osg/BoundingBox"
 #include "osg/Group"
@@ -219,6 +220,7 @@ private:
   Timesteps _vTimeSteps;
 
   osg::ref_ptr<osg::Program> _program;
+  osg::ref_ptr<OsgVolume::VolumeAtlas> _atlas;
   
    // Function variables
   double  _scalar;
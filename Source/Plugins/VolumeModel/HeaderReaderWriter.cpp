@@ -0,0 +1,501 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Reads volumes described by NRRD and MetaImage headers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "VolumeModel/HeaderReaderWriter.h"
+#include "VolumeModel/VolumeDocument.h"
+
+#include "OsgVolume/CompressedVoxels.h"
+#include "OsgVolume/RawVoxels.h"
+
+#include "Usul/File/Path.h"
+#include "Usul/Strings/Case.h"
+
+#include "osg/Vec3"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+USUL_IMPLEMENT_IUNKNOWN_MEMBERS ( HeaderReaderWriter, HeaderReaderWriter::BaseClass );
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for reading the headers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  typedef OsgVolume::RawVoxels::Layout Layout;
+  typedef OsgVolume::CompressedVoxels::Codec Codec;
+  typedef std::vector < std::string > Words;
+
+  // What the header says about the voxels.
+  struct Header
+  {
+    Header() :
+      file(),
+      codec ( OsgVolume::CompressedVoxels::NONE ),
+      start ( 0 ),
+      layout(),
+      spacing ( 1.0f, 1.0f, 1.0f ),
+      atEnd ( false ),
+      haveType ( false ),
+      haveSpacing ( false )
+    {
+      size[0] = size[1] = size[2] = 0;
+    }
+
+    std::string file;
+    Codec codec;
+    std::size_t start;
+    Layout layout;
+    unsigned int size[3];
+    osg::Vec3f spacing;
+    bool atEnd;
+    bool haveType;
+    bool haveSpacing;
+  };
+
+  inline std::string trim ( const std::string &s )
+  {
+    const std::string::size_type first ( s.find_first_not_of ( " \t\r\n" ) );
+    if ( std::string::npos == first )
+      return std::string();
+    const std::string::size_type last ( s.find_last_not_of ( " \t\r\n" ) );
+    return s.substr ( first, last - first + 1 );
+  }
+
+  inline Words words ( const std::string &s )
+  {
+    Words result;
+    std::istringstream in ( s );
+    std::string word;
+    while ( in >> word )
+      result.push_back ( word );
+    return result;
+  }
+
+  inline bool flag ( const std::string &value )
+  {
+    const std::string v ( Usul::Strings::lowerCase ( value ) );
+    return ( "true" == v || "1" == v );
+  }
+
+  // Whole number, which may be negative.
+  inline long number ( const std::string &value, const std::string &key, const std::string &filename )
+  {
+    char *end ( 0x0 );
+    const long n ( std::strtol ( value.c_str(), &end, 10 ) );
+    if ( value.empty() || 0x0 == end || '\0' != *end )
+      throw std::runtime_error ( "Error 2381709546: '" + key + "' in '" + filename + "' is not a number" );
+    return n;
+  }
+
+  // Sizes of the three axes.
+  inline void sizes ( const std::string &value, Header &header, const std::string &key, const std::string &filename )
+  {
+    const Words w ( Detail::words ( value ) );
+    if ( 3 != w.size() )
+      throw std::runtime_error ( "Error 1947226801: only volumes of three dimensions can be read, '" + filename + "' says " + value );
+    for ( unsigned int i = 0; i < 3; ++i )
+    {
+      const long n ( Detail::number ( w[i], key, filename ) );
+      if ( n <= 0 )
+        throw std::runtime_error ( "Error 3172845096: '" + filename + "' has no voxels" );
+      header.size[i] = static_cast < unsigned int > ( n );
+    }
+  }
+
+  // Size of a voxel.  Values that are not positive numbers, like NRRD's
+  // "nan", are one.
+  inline void spacing ( const Words &w, Header &header )
+  {
+    for ( unsigned int i = 0; i < 3 && i < w.size(); ++i )
+    {
+      const double d ( std::strtod ( w[i].c_str(), 0x0 ) );
+      header.spacing[i] = ( d > 0.0 && d < 1e30 ) ? static_cast < float > ( d ) : 1.0f;
+    }
+    header.haveSpacing = true;
+  }
+
+  // Path of a data file named in the header, which is relative to it.
+  inline std::string path ( const std::string &header, const std::string &name )
+  {
+    const bool absolute ( false == name.empty() && ( '/' == name[0] || '\\' == name[0] || ( name.size() > 1 && ':' == name[1] ) ) );
+    return ( absolute ) ? name : Usul::File::directory ( header, true ) + name;
+  }
+
+  // NRRD types, after lower case.
+  inline OsgVolume::RawVoxels::Type nrrdType ( const std::string &name, const std::string &filename )
+  {
+    if ( "signed char" == name || "int8" == name || "int8_t" == name )
+      return OsgVolume::RawVoxels::INT8;
+    if ( "uchar" == name || "unsigned char" == name || "uint8" == name || "uint8_t" == name )
+      return OsgVolume::RawVoxels::UINT8;
+    if ( "short" == name || "short int" == name || "signed short" == name || "signed short int" == name || "int16" == name || "int16_t" == name )
+      return OsgVolume::RawVoxels::INT16;
+    if ( "ushort" == name || "unsigned short" == name || "unsigned short int" == name || "uint16" == name || "uint16_t" == name )
+      return OsgVolume::RawVoxels::UINT16;
+    if ( "int" == name || "signed int" == name || "int32" == name || "int32_t" == name )
+      return OsgVolume::RawVoxels::INT32;
+    if ( "uint" == name || "unsigned int" == name || "uint32" == name || "uint32_t" == name )
+      return OsgVolume::RawVoxels::UINT32;
+    if ( "float" == name )
+      return OsgVolume::RawVoxels::FLOAT32;
+    if ( "double" == name )
+      return OsgVolume::RawVoxels::FLOAT64;
+
+    throw std::runtime_error ( "Error 1288093412: voxel type '" + name + "' of '" + filename + "' not supported" );
+  }
+
+  // MetaImage types.
+  inline OsgVolume::RawVoxels::Type metaType ( const std::string &name, const std::string &filename )
+  {
+    if ( "MET_UCHAR" == name )
+      return OsgVolume::RawVoxels::UINT8;
+    if ( "MET_CHAR" == name )
+      return OsgVolume::RawVoxels::INT8;
+    if ( "MET_USHORT" == name )
+      return OsgVolume::RawVoxels::UINT16;
+    if ( "MET_SHORT" == name )
+      return OsgVolume::RawVoxels::INT16;
+    if ( "MET_UINT" == name )
+      return OsgVolume::RawVoxels::UINT32;
+    if ( "MET_INT" == name )
+      return OsgVolume::RawVoxels::INT32;
+    if ( "MET_FLOAT" == name )
+      return OsgVolume::RawVoxels::FLOAT32;
+    if ( "MET_DOUBLE" == name )
+      return OsgVolume::RawVoxels::FLOAT64;
+
+    throw std::runtime_error ( "Error 2660158237: voxel type '" + name + "' of '" + filename + "' not supported" );
+  }
+
+  // Where the voxels start in a file with its header.
+  inline std::size_t here ( std::istream &in, const std::string &filename )
+  {
+    const std::streamoff position ( in.tellg() );
+    if ( position < 0 )
+      throw std::runtime_error ( "Error 2749160358: no voxels follow the header of '" + filename + "'" );
+    return static_cast < std::size_t > ( position );
+  }
+
+  // Read a NRRD header.  Fields are "key: value" up to a blank line, after
+  // which the voxels follow unless a data file is named.  A byte skip is
+  // counted in the decompressed voxels; -1 puts them at the end of a raw
+  // file.
+  inline void nrrd ( std::istream &in, const std::string &filename, Header &header )
+  {
+    std::string line;
+    std::getline ( in, line );
+    if ( 0 != line.compare ( 0, 7, "NRRD000" ) )
+      throw std::runtime_error ( "Error 3848711025: '" + filename + "' is not a NRRD file" );
+
+    bool attached ( true );
+    unsigned int dimension ( 0 );
+    while ( std::getline ( in, line ) )
+    {
+      line = Detail::trim ( line );
+      if ( line.empty() )
+        break;
+      if ( '#' == line[0] )
+        continue;
+
+      // Key/value pairs are not about the voxels.
+      const std::string::size_type colon ( line.find ( ':' ) );
+      if ( std::string::npos == colon || ( colon + 1 < line.size() && '=' == line[colon + 1] ) )
+        continue;
+
+      std::string key;
+      {
+        const std::string k ( Usul::Strings::lowerCase ( line.substr ( 0, colon ) ) );
+        for ( std::string::const_iterator i = k.begin(); i != k.end(); ++i )
+        {
+          if ( ' ' != *i )
+            key += *i;
+        }
+      }
+      const std::string value ( Detail::trim ( line.substr ( colon + 1 ) ) );
+
+      if ( "type" == key )
+      {
+        header.layout.type = Detail::nrrdType ( Usul::Strings::lowerCase ( value ), filename );
+        header.haveType = true;
+      }
+      else if ( "dimension" == key )
+        dimension = static_cast < unsigned int > ( Detail::number ( value, key, filename ) );
+      else if ( "sizes" == key )
+        Detail::sizes ( value, header, key, filename );
+      else if ( "spacings" == key )
+        Detail::spacing ( Detail::words ( value ), header );
+      else if ( "spacedirections" == key && false == header.haveSpacing )
+      {
+        // Lengths of the vectors "(x,y,z)".
+        Words lengths;
+        std::string::size_type open ( value.find ( '(' ) );
+        while ( std::string::npos != open )
+        {
+          const std::string::size_type close ( value.find ( ')', open ) );
+          if ( std::string::npos == close )
+            break;
+
+          std::string v ( value.substr ( open + 1, close - open - 1 ) );
+          for ( std::string::iterator i = v.begin(); i != v.end(); ++i )
+            *i = ( ',' == *i ) ? ' ' : *i;
+
+          double length ( 0.0 );
+          const Words w ( Detail::words ( v ) );
+          for ( unsigned int i = 0; i < w.size(); ++i )
+          {
+            const double d ( std::strtod ( w[i].c_str(), 0x0 ) );
+            length += d * d;
+          }
+
+          std::ostringstream out;
+          out << std::sqrt ( length );
+          lengths.push_back ( out.str() );
+          open = value.find ( '(', close );
+        }
+        Detail::spacing ( lengths, header );
+      }
+      else if ( "endian" == key )
+        header.layout.endian = OsgVolume::RawVoxels::endian ( Usul::Strings::lowerCase ( value ) );
+      else if ( "encoding" == key )
+        header.codec = OsgVolume::CompressedVoxels::codec ( value );
+      else if ( "datafile" == key )
+      {
+        if ( "LIST" == value || Detail::words ( value ).size() > 1 )
+          throw std::runtime_error ( "Error 4098372610: '" + filename + "' names more than one data file, which is not supported" );
+        header.file = Detail::path ( filename, value );
+        attached = false;
+      }
+      else if ( "byteskip" == key )
+      {
+        const long skip ( Detail::number ( value, key, filename ) );
+        if ( skip < -1 )
+          throw std::runtime_error ( "Error 1731259840: byte skip of '" + filename + "' is not valid" );
+        header.atEnd = ( -1 == skip );
+        header.layout.offset = ( skip > 0 ) ? static_cast < std::size_t > ( skip ) : 0;
+      }
+      else if ( "lineskip" == key && 0 != Detail::number ( value, key, filename ) )
+        throw std::runtime_error ( "Error 2512786930: line skip of '" + filename + "' is not supported" );
+    }
+
+    if ( 3 != dimension )
+      throw std::runtime_error ( "Error 1947226801: only volumes of three dimensions can be read" );
+
+    if ( attached )
+    {
+      header.file = filename;
+      header.start = Detail::here ( in, filename );
+    }
+  }
+
+  // Read a MetaImage header.  Fields are "Key = Value", and the data file
+  // is the last of them; LOCAL means the voxels follow in this file.  A
+  // header size is the number of bytes of the data file before the voxels,
+  // or -1 for the voxels at the end.
+  inline void meta ( std::istream &in, const std::string &filename, Header &header )
+  {
+    std::string line;
+    bool done ( false );
+    while ( false == done && std::getline ( in, line ) )
+    {
+      const std::string::size_type equals ( line.find ( '=' ) );
+      if ( std::string::npos == equals )
+        continue;
+
+      const std::string key ( Detail::trim ( line.substr ( 0, equals ) ) );
+      const std::string value ( Detail::trim ( line.substr ( equals + 1 ) ) );
+
+      if ( "NDims" == key && 3 != Detail::number ( value, key, filename ) )
+        throw std::runtime_error ( "Error 1947226801: only volumes of three dimensions can be read, '" + filename + "' has " + value );
+      else if ( "DimSize" == key )
+        Detail::sizes ( value, header, key, filename );
+      else if ( "ElementSpacing" == key || ( "ElementSize" == key && false == header.haveSpacing ) )
+        Detail::spacing ( Detail::words ( value ), header );
+      else if ( "ElementType" == key )
+      {
+        header.layout.type = Detail::metaType ( value, filename );
+        header.haveType = true;
+      }
+      else if ( "ElementByteOrderMSB" == key || "BinaryDataByteOrderMSB" == key )
+        header.layout.endian = ( Detail::flag ( value ) ) ? OsgVolume::RawVoxels::BIG_ENDIAN_ORDER : OsgVolume::RawVoxels::LITTLE_ENDIAN_ORDER;
+      else if ( "CompressedData" == key )
+        header.codec = ( Detail::flag ( value ) ) ? OsgVolume::CompressedVoxels::ZLIB : OsgVolume::CompressedVoxels::NONE;
+      else if ( "ElementNumberOfChannels" == key && 1 != Detail::number ( value, key, filename ) )
+        throw std::runtime_error ( "Error 3905517248: '" + filename + "' has more than one channel, which is not supported" );
+      else if ( "HeaderSize" == key )
+      {
+        const long size ( Detail::number ( value, key, filename ) );
+        header.atEnd = ( -1 == size );
+        header.start += ( size > 0 ) ? static_cast < std::size_t > ( size ) : 0;
+      }
+      else if ( "ElementDataFile" == key )
+      {
+        if ( "LOCAL" == value )
+        {
+          header.file = filename;
+          header.start += Detail::here ( in, filename );
+        }
+        else if ( "LIST" == value || Detail::words ( value ).size() > 1 )
+          throw std::runtime_error ( "Error 4098372610: '" + filename + "' names more than one data file, which is not supported" );
+        else
+          header.file = Detail::path ( filename, value );
+        done = true;
+      }
+    }
+
+    if ( false == done )
+      throw std::runtime_error ( "Error 2014457739: '" + filename + "' does not name its data file" );
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+HeaderReaderWriter::HeaderReaderWriter() : BaseClass ()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+HeaderReaderWriter::~HeaderReaderWriter()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Read the header and the voxels it points at.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void HeaderReaderWriter::read ( const std::string &name, VolumeDocument &doc, Unknown *caller )
+{
+  Detail::Header header;
+  {
+    std::ifstream in ( name.c_str(), std::ios::binary );
+    if ( false == in.is_open() )
+      throw std::runtime_error ( "Error 3489112065: could not open '" + name + "'" );
+
+    const std::string ext ( Usul::Strings::lowerCase ( Usul::File::extension ( name ) ) );
+    if ( "mhd" == ext || "mha" == ext )
+      Detail::meta ( in, name, header );
+    else
+      Detail::nrrd ( in, name, header );
+  }
+
+  if ( false == header.haveType || 0 == header.size[0] )
+    throw std::runtime_error ( "Error 1607352981: '" + name + "' does not give the type and size of its voxels" );
+
+  header.layout.rescale = OsgVolume::RawVoxels::rescaleByDefault ( header.layout.type );
+
+  const unsigned int s ( header.size[0] ), t ( header.size[1] ), r ( header.size[2] );
+
+  // Voxels at the end of the file are found from its size.
+  if ( header.atEnd )
+  {
+    if ( OsgVolume::CompressedVoxels::NONE != header.codec )
+      throw std::runtime_error ( "Error 2906641875: compressed voxels at the end of '" + header.file + "' are not supported" );
+
+    std::ifstream in ( header.file.c_str(), std::ios::binary );
+    in.seekg ( 0, std::ios::end );
+    const unsigned long long size ( static_cast < unsigned long long > ( in.tellg() ) );
+    const unsigned long long needed ( static_cast < unsigned long long > ( s ) * t * r * OsgVolume::RawVoxels::numBytes ( header.layout.type ) );
+    if ( false == in.good() || size < needed )
+      throw std::runtime_error ( "Error 1322075496: '" + header.file + "' holds fewer voxels than its size says" );
+
+    header.start = 0;
+    header.layout.offset = static_cast < std::size_t > ( size - needed );
+  }
+
+  // Compressed files are decompressed as they are read.
+  osg::ref_ptr < osg::Image > image ( OsgVolume::CompressedVoxels::load ( header.file, header.codec, header.start, header.layout, s, t, r ) );
+
+  doc.image3D ( image.get() );
+
+  double xHalf ( s * header.spacing[0] / 2.0 );
+  double yHalf ( t * header.spacing[1] / 2.0 );
+  double zHalf ( r * header.spacing[2] / 2.0 );
+
+  doc.boundingBox ( osg::BoundingBox ( -xHalf, -yHalf, -zHalf, xHalf, yHalf, zHalf ) );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Finish reading.  Everything was read in read().
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void HeaderReaderWriter::finish ( VolumeDocument &doc, Unknown *caller )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Write the document to given file name.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void HeaderReaderWriter::write ( const std::string &filename, const VolumeDocument &doc, Unknown *caller ) const
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Clear the document.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void HeaderReaderWriter::clear ( Usul::Interfaces::IUnknown *caller )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Query for interface.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+Usul::Interfaces::IUnknown* HeaderReaderWriter::queryInterface( unsigned long iid )
+{
+  switch ( iid )
+  {
+  case Usul::Interfaces::IUnknown::IID:
+  case IReaderWriter::IID:
+    return static_cast < IReaderWriter * > ( this );
+  default:
+    return 0x0;
+  }
+}
@@ -0,0 +1,57 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Reads volumes described by NRRD (.nhdr, .nrrd) and MetaImage (.mhd,
+//  .mha) headers, with the voxels raw or compressed, in the header's file
+//  or one it names.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __HELIOS_VOLUME_MODEL_HEADER_READER_WRITER_H__
+#define __HELIOS_VOLUME_MODEL_HEADER_READER_WRITER_H__
+
+#include "VolumeModel/IReaderWriter.h"
+
+#include "OsgTools/Configure/OSG.h"
+
+#include "Usul/Base/Object.h"
+
+class HeaderReaderWriter : public Usul::Base::Object,
+                           public IReaderWriter
+{
+public:
+  typedef Usul::Base::Object BaseClass;
+
+  USUL_DECLARE_IUNKNOWN_MEMBERS;
+
+  HeaderReaderWriter();
+
+  /// Clear any existing data.
+  virtual void                clear ( Unknown *caller = 0x0 );
+
+  /// Read the file and add it to existing document's data.
+  virtual void                read ( const std::string &filename, VolumeDocument &doc, Unknown *caller = 0x0 );
+
+  /// Finish any reading that was put off until the data is needed.
+  virtual void                finish ( VolumeDocument &doc, Unknown *caller = 0x0 );
+
+  /// Write the document to given file name.
+  virtual void                write ( const std::string &filename, const VolumeDocument &doc, Unknown *caller = 0x0  ) const;
+
+protected:
+  virtual ~HeaderReaderWriter();
+
+  HeaderReaderWriter ( const HeaderReaderWriter& rhs );
+  HeaderReaderWriter& operator= ( const HeaderReaderWriter& rhs );
+};
+
+
+#endif // __HELIOS_VOLUME_MODEL_HEADER_READER_WRITER_H__
@@ -35,6 +35,9 @@ public:
   /// Read the file and add it to existing document's data.
   virtual void                read ( const std::string &filename, VolumeDocument &doc, Unknown *caller = 0x0 ) = 0;
 
+  /// Finish any reading that was put off until the data is needed.
+  virtual void                finish ( VolumeDocument &doc, Unknown *caller = 0x0 ) = 0;
+
   /// Write the document to given file name.
   virtual void                write ( const std::string &filename, const VolumeDocument &doc, Unknown *caller = 0x0  ) const = 0;
 };
@@ -10,13 +10,11 @@
 
 #include "VolumeModel/ImageReaderWriter.h"
 #include "VolumeModel/VolumeDocument.h"
-#include "OsgVolume/Image3d.h"
 
 #include "Usul/File/Path.h"
+#include "Usul/Jobs/Manager.h"
 #include "Usul/Strings/Case.h"
 
-#include "osgDB/ReadFile"
-
 USUL_IMPLEMENT_IUNKNOWN_MEMBERS ( ImageReaderWriter, ImageReaderWriter::BaseClass );
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -27,7 +25,9 @@ USUL_IMPLEMENT_IUNKNOWN_MEMBERS ( ImageReaderWriter, ImageReaderWriter::BaseClas
 
 ImageReaderWriter::ImageReaderWriter() : BaseClass (),
   _imageList(),
-  _filenames()
+  _filenames(),
+  _numRead ( 0 ),
+  _job ( 0x0 )
 {
 }
 
@@ -40,37 +40,67 @@ ImageReaderWriter::ImageReaderWriter() : BaseClass (),
 
 ImageReaderWriter::~ImageReaderWriter()
 {
+  if ( _job.valid() )
+    _job->cancel();
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-//  Read the file and add it to existing data.
+//  Add the file to the stack.  Nothing is decoded here, so inserting many
+//  files only collects their names; finish() decodes them all at once.
 //
 ///////////////////////////////////////////////////////////////////////////////
 
 void ImageReaderWriter::read ( const std::string &name, VolumeDocument &doc, Unknown *caller )
 {
-  // Read the image.
-  ImagePtr image ( osgDB::readImageFile ( name ) );
-  if ( !image.valid() )
-    throw std::runtime_error ( "Error 1350090608: Could not load image file: " + name );
+  {
+    Guard guard ( this->mutex() );
+    _filenames.push_back ( name );
+  }
+
+  doc.dirty ( true );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Start a job that decodes the files added since the last time on all
+//  processors and stacks them into the 3D image, off the update thread.
+//  Files added while it runs go to the next job, started once it ends.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void ImageReaderWriter::finish ( VolumeDocument &doc, Unknown *caller )
+{
+  Guard guard ( this->mutex() );
+
+  if ( _job.valid() || _numRead == _filenames.size() )
+    return;
+
+  const Filenames names ( _filenames.begin() + _numRead, _filenames.end() );
+  _numRead = _filenames.size();
+
+  _job = new StackImagesJob ( &doc, this, names, _imageList );
+  Usul::Jobs::Manager::instance().addJob ( _job.get() );
+}
 
-  // Set the image name and push it into our list.
-  image->setFileName ( name );
-  _imageList.push_back ( image.get() );
 
-  _filenames.push_back ( name );
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The job ended.  A job that was canceled by clear() is ignored.
+//
+///////////////////////////////////////////////////////////////////////////////
 
-  osg::ref_ptr < osg::Image > image3D ( OsgVolume::image3d ( _imageList, true, 1000, caller ) );
-  doc.image3D ( image3D.get() );
+void ImageReaderWriter::stacked ( StackImagesJob *job, const StackImagesJob::Images &images )
+{
+  Guard guard ( this->mutex() );
 
-  unsigned int numImages ( _imageList.size() );
-  double zSize ( 1.0f / numImages );
-  zSize *= 0.5;
+  if ( 0x0 == job || job != _job.get() )
+    return;
 
-  osg::BoundingBox bb ( -1.0, -1.0, -zSize, 1.0, 1.0, zSize );
-  doc.boundingBox ( bb );
+  _imageList = images;
+  _job = 0x0;
 }
 
 
@@ -93,8 +123,16 @@ void ImageReaderWriter::write ( const std::string &filename, const VolumeDocumen
 
 void ImageReaderWriter::clear ( Usul::Interfaces::IUnknown *caller )
 {
+  Guard guard ( this->mutex() );
+
+  // Stop stacking.
+  if ( _job.valid() )
+    _job->cancel();
+  _job = 0x0;
+
   _imageList.clear();
   _filenames.clear();
+  _numRead = 0;
 }
 
 
@@ -12,6 +12,7 @@
 #define __HELIOS_VOLUME_MODEL_IMAGE_READER_WRITER_H__
 
 #include "VolumeModel/IReaderWriter.h"
+#include "VolumeModel/StackImagesJob.h"
 
 #include "OsgTools/Configure/OSG.h"
 
@@ -36,9 +37,15 @@ public:
   /// Read the file and add it to existing document's data.
   virtual void                read ( const std::string &filename, VolumeDocument &doc, Unknown *caller = 0x0 );
 
+  /// Finish any reading that was put off until the data is needed.
+  virtual void                finish ( VolumeDocument &doc, Unknown *caller = 0x0 );
+
   /// Write the document to given file name.
   virtual void                write ( const std::string &filename, const VolumeDocument &doc, Unknown *caller = 0x0  ) const;
 
+  /// Called by the job when it ends with the images now stacked.
+  void                        stacked ( StackImagesJob *job, const StackImagesJob::Images &images );
+
 protected:
   virtual ~ImageReaderWriter();
 
@@ -53,6 +60,8 @@ private:
 
   ImageList _imageList;
   Filenames _filenames;
+  unsigned int _numRead;
+  StackImagesJob::RefPtr _job;
 };
 
 
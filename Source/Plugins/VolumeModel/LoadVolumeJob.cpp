@@ -0,0 +1,109 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "VolumeModel/LoadVolumeJob.h"
+#include "VolumeModel/VolumeDocument.h"
+
+#include "Usul/Adaptors/MemberFunction.h"
+#include "Usul/Functions/SafeCall.h"
+
+#include <algorithm>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+LoadVolumeJob::LoadVolumeJob ( VolumeDocument* document, SliceReader* reader, SlabImage* image, unsigned int slabSize ) :
+  BaseClass (),
+  _document ( document ),
+  _reader ( reader ),
+  _image ( image ),
+  _slabSize ( std::max ( 1u, slabSize ) )
+{
+  USUL_TRACE_SCOPE;
+
+  if ( 0x0 != _document )
+    _document->ref ();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+LoadVolumeJob::~LoadVolumeJob ()
+{
+  USUL_TRACE_SCOPE;
+
+  if ( 0x0 != _document )
+    _document->unref ();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Read the volume.  A file that cannot be read is reported, and the image
+//  is finished with the slices that did not load left at zero, so that it
+//  is not drawn as loading forever.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void LoadVolumeJob::_started ()
+{
+  USUL_TRACE_SCOPE;
+
+  // Return if we don't have any.
+  if ( 0x0 == _document || false == _image.valid() )
+    return;
+
+  Usul::Functions::safeCall ( Usul::Adaptors::memberFunction ( this, &LoadVolumeJob::_read ), "2840193675" );
+
+  // Stop if the document was cleared.
+  if ( this->canceled () )
+    return;
+
+  _image->numLoaded ( std::max ( 1, _image->r() ) );
+
+  // Build the scene again now that the whole volume is here.
+  _document->dirty ( true );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Read the slabs.  The voxels of each slab are in place before the image
+//  says it is loaded, so the draw thread never sends a partial slab, nor
+//  waits on the disk for a mapped one.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void LoadVolumeJob::_read ()
+{
+  USUL_TRACE_SCOPE;
+
+  const unsigned int r ( std::max ( 1, _image->r() ) );
+
+  for ( unsigned int first = 0; first < r; first += _slabSize )
+  {
+    // Stop if the document was cleared.
+    if ( this->canceled () )
+      return;
+
+    const unsigned int count ( std::min ( _slabSize, r - first ) );
+    if ( _reader.valid() )
+      _reader->read ( first, count, *_image );
+    else
+      _image->pageIn ( first, count );
+    _image->numLoaded ( first + count );
+  }
+}
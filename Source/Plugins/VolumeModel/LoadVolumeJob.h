@@ -0,0 +1,55 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Job to fill the document's image from a raw file a slab at a time.  The
+//  volume is drawn while it loads, each slab showing up once it is in.
+//  Without a reader the image uses a mapped file in place, and each slab is
+//  paged in before it is shown.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __HELIOS_VOLUME_MODEL_LOAD_VOLUME_JOB_H__
+#define __HELIOS_VOLUME_MODEL_LOAD_VOLUME_JOB_H__
+
+#include "OsgVolume/RawVoxels.h"
+#include "OsgVolume/SlabImage.h"
+
+#include "Usul/Jobs/Job.h"
+
+class VolumeDocument;
+
+class LoadVolumeJob : public Usul::Jobs::Job
+{
+public:
+  typedef Usul::Jobs::Job                             BaseClass;
+  typedef OsgVolume::RawVoxels::SliceReader          SliceReader;
+  typedef OsgVolume::SlabImage                        SlabImage;
+
+  USUL_DECLARE_REF_POINTERS ( LoadVolumeJob );
+
+  // The reader is null when the image uses its voxels in place.
+  LoadVolumeJob ( VolumeDocument* document, SliceReader* reader, SlabImage* image, unsigned int slabSize );
+
+protected:
+  virtual ~LoadVolumeJob ();
+
+  virtual void _started ();
+
+  void _read ();
+
+  VolumeDocument* _document;
+  SliceReader::RefPtr _reader;
+  SlabImage::RefPtr _image;
+  unsigned int _slabSize;
+};
+
+
+#endif // __HELIOS_VOLUME_MODEL_LOAD_VOLUME_JOB_H__
@@ -12,6 +12,7 @@
 #include "VolumeModel/VolumeDocument.h"
 
 #include "Usul/Convert/Vector3.h"
+#include "Usul/Jobs/Manager.h"
 #include "Usul/Convert/Vector4.h"
 #include "Usul/File/Path.h"
 #include "Usul/Strings/Case.h"
@@ -21,10 +22,27 @@
 #include "XmlTree/Document.h"
 #include "XmlTree/XercesLife.h"
 
+#include "OsgVolume/CompressedVoxels.h"
+#include "OsgVolume/RawVoxels.h"
+#include "OsgVolume/SlabImage.h"
 #include "OsgVolume/TransferFunction1D.h"
 
 USUL_IMPLEMENT_IUNKNOWN_MEMBERS ( RawReaderWriter, RawReaderWriter::BaseClass );
 
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Volumes load in the background when they are bigger than this, a slab
+//  of this many slices at a time.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  const unsigned long BACKGROUND_BYTES ( 64 * 1024 * 1024 );
+  const unsigned int  SLAB_SIZE ( 16 );
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  Constructor.
@@ -33,7 +51,8 @@ USUL_IMPLEMENT_IUNKNOWN_MEMBERS ( RawReaderWriter, RawReaderWriter::BaseClass );
 
 RawReaderWriter::RawReaderWriter() : BaseClass (),
 _filename(),
-_size()
+_size(),
+_job ( 0x0 )
 {
 }
 
@@ -46,6 +65,8 @@ _size()
 
 RawReaderWriter::~RawReaderWriter()
 {
+  if ( _job.valid() )
+    _job->cancel();
 }
 
 
@@ -68,6 +89,7 @@ void RawReaderWriter::read ( const std::string &name, VolumeDocument &doc, Unkno
   // Get the nodes from the document.
   Children file ( document->find ( "file", true ) );
   Children size ( document->find ( "size", true ) );
+  Children spacing ( document->find ( "spacing", true ) );
   Children transferFunctions ( document->find ( "transfer_function", true ) );
 
   // Make sure we have a filename and size.
@@ -76,30 +98,84 @@ void RawReaderWriter::read ( const std::string &name, VolumeDocument &doc, Unkno
     _filename = file.front()->value ();
     Usul::Convert::Type < std::string, Usul::Math::Vec3ui >::convert ( size.front()->value(), _size );
 
+    // How the voxels are laid out in the file, for example:
+    // <file type="int16" endian="big" offset="512" rescale="true">ct.raw</file>
+    // A compressed file says so, or ends in .gz or .zst, and the offset
+    // counts the decompressed bytes:
+    // <file type="uint16" encoding="gzip">ct.raw.gz</file>
+    OsgVolume::RawVoxels::Layout layout;
+    OsgVolume::CompressedVoxels::Codec codec ( OsgVolume::CompressedVoxels::NONE );
+    {
+      XmlTree::Node::Attributes a ( file.front()->attributes () );
+      layout.type = OsgVolume::RawVoxels::type ( Usul::Strings::lowerCase ( a["type"] ) );
+      layout.endian = OsgVolume::RawVoxels::endian ( Usul::Strings::lowerCase ( a["endian"] ) );
+      layout.rescale = OsgVolume::RawVoxels::rescaleByDefault ( layout.type );
+
+      unsigned int offset ( 0 );
+      Usul::Convert::Type < std::string, unsigned int >::convert ( a["offset"], offset );
+      layout.offset = offset;
+
+      if ( false == a["rescale"].empty() )
+        layout.rescale = ( "true" == Usul::Strings::lowerCase ( a["rescale"] ) );
+      layout.quantize = ( "true" == Usul::Strings::lowerCase ( a["quantize"] ) );
+
+      codec = ( a["encoding"].empty() ) ?
+        OsgVolume::CompressedVoxels::extension ( _filename ) :
+        OsgVolume::CompressedVoxels::codec ( Usul::Strings::lowerCase ( a["encoding"] ) );
+    }
+
+    // Size of a voxel in the world.
+    Usul::Math::Vec3f voxel ( 1.0f, 1.0f, 1.0f );
+    if ( spacing.size() > 0 )
+      Usul::Convert::Type < std::string, Usul::Math::Vec3f >::convert ( spacing.front()->value(), voxel );
+
     //std::string directory ( Usul::File::directory ( _filename, false ) );
     //Usul::System::CurrentDirectory cwd ( directory );
 
-    // Read the file.
-    FILE *fp ( fopen( _filename.c_str(), "rb" ) );
-
-    if ( 0x0 != fp )
+    // Voxels that can be drawn as they are stay mapped from the file.  Big
+    // volumes are drawn a slab at a time as a job brings them in: mapped
+    // slabs are paged in by the job, so the draw thread never waits on the
+    // disk, and others are converted into memory.  Compressed voxels are
+    // decompressed on all threads as they are read.
+    const unsigned long long bytes ( static_cast < unsigned long long > ( _size[0] ) * _size[1] * _size[2] * OsgVolume::RawVoxels::numBytes ( layout.type ) );
+    if ( OsgVolume::CompressedVoxels::NONE != codec )
     {
-	    unsigned int size ( _size[0] * _size[1] * _size[2] );
-
-      osg::ref_ptr < osg::Image > image ( new osg::Image );
-      image->allocateImage( _size[0], _size[1], _size[2], GL_LUMINANCE, GL_UNSIGNED_BYTE );
+      osg::ref_ptr < osg::Image > image ( OsgVolume::CompressedVoxels::load ( _filename, codec, 0, layout, _size[0], _size[1], _size[2] ) );
+      doc.image3D ( image.get() );
+    }
+    else if ( bytes > Detail::BACKGROUND_BYTES )
+    {
+      OsgVolume::RawVoxels::SliceReader::RefPtr reader ( 0x0 );
+      OsgVolume::SlabImage::RefPtr image ( 0x0 );
+      if ( OsgVolume::RawVoxels::mapped ( layout ) )
+      {
+        osg::ref_ptr < osg::Image > voxels ( OsgVolume::RawVoxels::load ( _filename, layout, _size[0], _size[1], _size[2] ) );
+        image = new OsgVolume::SlabImage ( voxels.get() );
+      }
+      else
+      {
+        reader = new OsgVolume::RawVoxels::SliceReader ( _filename, layout, _size[0], _size[1], _size[2] );
+        image = new OsgVolume::SlabImage ( _size[0], _size[1], _size[2], reader->internalFormat(), GL_LUMINANCE, reader->dataType() );
+      }
 
-      fread( image->data(), sizeof ( unsigned char ), size, fp );
-      fclose( fp );
+      doc.image3D ( image.get() );
 
+      if ( _job.valid() )
+        _job->cancel();
+      _job = new LoadVolumeJob ( &doc, reader.get(), image.get(), Detail::SLAB_SIZE );
+      Usul::Jobs::Manager::instance().addJob ( _job.get() );
+    }
+    else
+    {
+      osg::ref_ptr < osg::Image > image ( OsgVolume::RawVoxels::load ( _filename, layout, _size[0], _size[1], _size[2] ) );
       doc.image3D ( image.get() );
+    }
 
-      double xHalf ( _size[0] / 2.0 );
-      double yHalf ( _size[1] / 2.0 );
-      double zHalf ( _size[2] / 2.0 );
+    double xHalf ( _size[0] * voxel[0] / 2.0 );
+    double yHalf ( _size[1] * voxel[1] / 2.0 );
+    double zHalf ( _size[2] * voxel[2] / 2.0 );
 
-      doc.boundingBox ( osg::BoundingBox ( -xHalf, -yHalf, -zHalf, xHalf, yHalf, zHalf ) );
-    }
+    doc.boundingBox ( osg::BoundingBox ( -xHalf, -yHalf, -zHalf, xHalf, yHalf, zHalf ) );
   }
 
   for ( Children::iterator iter = transferFunctions.begin(); iter != transferFunctions.end(); ++iter )
@@ -107,6 +183,17 @@ void RawReaderWriter::read ( const std::string &name, VolumeDocument &doc, Unkno
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Finish reading.  Everything was read in read().
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void RawReaderWriter::finish ( VolumeDocument &doc, Unknown *caller )
+{
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  Add a transfer function.
@@ -169,6 +256,10 @@ void RawReaderWriter::write ( const std::string &filename, const VolumeDocument
 
 void RawReaderWriter::clear ( Usul::Interfaces::IUnknown *caller )
 {
+  // Stop filling the image.
+  if ( _job.valid() )
+    _job->cancel();
+  _job = 0x0;
 }
 
 
@@ -12,6 +12,7 @@
 #define __HELIOS_VOLUME_MODEL_RAW_READER_WRITER_H__
 
 #include "VolumeModel/IReaderWriter.h"
+#include "VolumeModel/LoadVolumeJob.h"
 
 #include "OsgTools/Configure/OSG.h"
 
@@ -39,6 +40,9 @@ public:
   /// Read the file and add it to existing document's data.
   virtual void                read ( const std::string &filename, VolumeDocument &doc, Unknown *caller = 0x0 );
 
+  /// Finish any reading that was put off until the data is needed.
+  virtual void                finish ( VolumeDocument &doc, Unknown *caller = 0x0 );
+
   /// Write the document to given file name.
   virtual void                write ( const std::string &filename, const VolumeDocument &doc, Unknown *caller = 0x0  ) const;
 
@@ -54,6 +58,7 @@ private:
   
   std::string _filename;
   Usul::Math::Vec3ui _size;
+  LoadVolumeJob::RefPtr _job;
 };
 
 
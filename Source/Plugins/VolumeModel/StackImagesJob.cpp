@@ -0,0 +1,210 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "VolumeModel/StackImagesJob.h"
+#include "VolumeModel/ImageReaderWriter.h"
+#include "VolumeModel/VolumeDocument.h"
+
+#include "OsgVolume/Image3d.h"
+#include "OsgVolume/Parallel.h"
+
+#include "Usul/Adaptors/MemberFunction.h"
+#include "Usul/Functions/SafeCall.h"
+
+#include "osgDB/ReadFile"
+
+#include <iostream>
+#include <stdexcept>
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Helpers for decoding the images.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+namespace Detail
+{
+  typedef std::vector < std::string > Errors;
+
+  // Decode each image into its place in the list.  A file that cannot be
+  // decoded leaves its image null and says why, so the others still load.
+  class DecodeImages
+  {
+  public:
+    typedef StackImagesJob::Images Images;
+    typedef StackImagesJob::Filenames Names;
+
+    DecodeImages ( const Names &names, Images &images, Errors &errors, unsigned int first ) :
+      _names ( names ),
+      _images ( images ),
+      _errors ( errors ),
+      _first ( first )
+    {
+    }
+
+    void operator () ( unsigned int i )
+    {
+      const unsigned int index ( _first + i );
+      const std::string &name ( _names.at ( index ) );
+
+      try
+      {
+        osg::ref_ptr < osg::Image > image ( osgDB::readImageFile ( name ) );
+        if ( false == image.valid() )
+          throw std::runtime_error ( "Error 1350090608: Could not load image file: " + name );
+
+        image->setFileName ( name );
+        _images.at ( index ) = image;
+      }
+      catch ( const std::exception &e )
+      {
+        _errors.at ( index ) = e.what();
+      }
+      catch ( ... )
+      {
+        _errors.at ( index ) = "Error 3962851407: Unknown exception caught while loading image file: " + name;
+      }
+    }
+
+  private:
+
+    DecodeImages &operator = ( const DecodeImages & );
+
+    const Names &_names;
+    Images &_images;
+    Errors &_errors;
+    unsigned int _first;
+  };
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+StackImagesJob::StackImagesJob ( VolumeDocument* document, ImageReaderWriter* reader, const Filenames &names, const Images &stacked ) :
+  BaseClass (),
+  _document ( document ),
+  _reader ( reader ),
+  _names ( names ),
+  _stacked ( stacked )
+{
+  USUL_TRACE_SCOPE;
+
+  if ( 0x0 != _document )
+    _document->ref ();
+
+  if ( 0x0 != _reader )
+    _reader->ref ();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+StackImagesJob::~StackImagesJob ()
+{
+  USUL_TRACE_SCOPE;
+
+  if ( 0x0 != _document )
+    _document->unref ();
+
+  if ( 0x0 != _reader )
+    _reader->unref ();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Stack the images.  The reader is always told when the job ends, with the
+//  images it had if the new ones could not be stacked, so that it starts
+//  another job for files added in the meantime.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void StackImagesJob::_started ()
+{
+  USUL_TRACE_SCOPE;
+
+  // Return if we don't have any.
+  if ( 0x0 == _document || 0x0 == _reader )
+    return;
+
+  Usul::Functions::safeCall ( Usul::Adaptors::memberFunction ( this, &StackImagesJob::_stack ), "1728350946" );
+
+  _reader->stacked ( this, _stacked );
+
+  // Stop if the document was cleared.
+  if ( this->canceled () )
+    return;
+
+  _document->dirty ( true );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Decode the files on all processors, then make the 3D image once.  The
+//  first file is decoded on this thread so that its plugin is loaded before
+//  the others ask for it.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void StackImagesJob::_stack ()
+{
+  USUL_TRACE_SCOPE;
+
+  const unsigned int numNew ( _names.size() );
+  if ( 0 == numNew )
+    return;
+
+  Images images ( numNew );
+  Detail::Errors errors ( numNew );
+
+  Detail::DecodeImages first ( _names, images, errors, 0 );
+  first ( 0 );
+
+  Detail::DecodeImages rest ( _names, images, errors, 1 );
+  OsgVolume::Parallel::forEach ( numNew - 1, rest );
+
+  // Stack the files that decoded, in order, and report the others.
+  Images stacked ( _stacked );
+  for ( unsigned int i = 0; i < numNew; ++i )
+  {
+    if ( images[i].valid() )
+      stacked.push_back ( images[i] );
+    else
+      std::cout << errors[i] << std::endl;
+  }
+
+  // Stop if the document was cleared.
+  if ( this->canceled () || stacked.size() == _stacked.size() )
+    return;
+
+  osg::ref_ptr < osg::Image > image3D ( OsgVolume::image3d ( stacked, true, 1000, 0x0 ) );
+
+  // Stop if the document was cleared.
+  if ( this->canceled () )
+    return;
+
+  _document->image3D ( image3D.get() );
+
+  double zSize ( 1.0f / stacked.size() );
+  zSize *= 0.5;
+
+  osg::BoundingBox bb ( -1.0, -1.0, -zSize, 1.0, 1.0, zSize );
+  _document->boundingBox ( bb );
+
+  _stacked.swap ( stacked );
+}
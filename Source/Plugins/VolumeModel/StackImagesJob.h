@@ -0,0 +1,59 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Job to decode image files on all processors and stack them, after the
+//  images already stacked, into the document's 3D image.  A file that
+//  cannot be decoded is reported and left out.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __HELIOS_VOLUME_MODEL_STACK_IMAGES_JOB_H__
+#define __HELIOS_VOLUME_MODEL_STACK_IMAGES_JOB_H__
+
+#include "Usul/Jobs/Job.h"
+
+#include "osg/Image"
+#include "osg/ref_ptr"
+
+#include <string>
+#include <vector>
+
+class ImageReaderWriter;
+class VolumeDocument;
+
+class StackImagesJob : public Usul::Jobs::Job
+{
+public:
+  typedef Usul::Jobs::Job                             BaseClass;
+  typedef osg::ref_ptr < osg::Image >                 ImagePtr;
+  typedef std::vector < ImagePtr >                    Images;
+  typedef std::vector < std::string >                 Filenames;
+
+  USUL_DECLARE_REF_POINTERS ( StackImagesJob );
+
+  // The reader is told the images stacked when the job ends.
+  StackImagesJob ( VolumeDocument* document, ImageReaderWriter* reader, const Filenames &names, const Images &stacked );
+
+protected:
+  virtual ~StackImagesJob ();
+
+  virtual void _started ();
+
+  void _stack ();
+
+  VolumeDocument* _document;
+  ImageReaderWriter* _reader;
+  Filenames _names;
+  Images _stacked;
+};
+
+
+#endif // __HELIOS_VOLUME_MODEL_STACK_IMAGES_JOB_H__
@@ -14,11 +14,16 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "VolumeModel/VolumeDocument.h"
+#include "VolumeModel/HeaderReaderWriter.h"
 #include "VolumeModel/ImageReaderWriter.h"
 #include "VolumeModel/RawReaderWriter.h"
+#include "VolumeModel/VolumeFileReaderWriter.h"
 
+#include "OsgVolume/BrickedVolume.h"
 #include "OsgVolume/Image3d.h"
+#include "OsgVolume/ProgramCache.h"
 #include "OsgVolume/Texture3DVolume.h"
+#include "OsgVolume/VolumeFile.h"
 #include "OsgVolume/GPURayCasting.h"
 
 #include "OsgTools/Box.h"
@@ -31,6 +36,8 @@
 
 #include "osg/MatrixTransform"
 
+#include <stdexcept>
+
 USUL_IMPLEMENT_IUNKNOWN_MEMBERS ( VolumeDocument, VolumeDocument::BaseClass );
 
 
@@ -48,7 +55,11 @@ VolumeDocument::VolumeDocument() : BaseClass ( "Volume Document" ),
   _readerWriter ( 0x0 ),
   _dirty ( false ),
   _transferFunctions(),
-  _activeTransferFunction()
+  _activeTransferFunction(),
+  _adaptiveQuality ( new OsgVolume::AdaptiveQuality ),
+  _progressiveVolume ( new OsgVolume::ProgressiveVolume ),
+  _progressive ( false ),
+  _maxTextureSize ( 0 )
 {
   OsgVolume::TransferFunction1D::RefPtr tf ( new OsgVolume::TransferFunction1D );
   tf->color ( 0, Usul::Math::Vec3f ( 0.0f, 0.0f, 1.0f ) );
@@ -71,6 +82,10 @@ VolumeDocument::VolumeDocument() : BaseClass ( "Volume Document" ),
 
 VolumeDocument::~VolumeDocument()
 {
+  // Let go of the volumes, then of the programs no other document draws with.
+  _root->removeChildren ( 0, _root->getNumChildren() );
+  _progressiveVolume->removeChildren ( 0, _progressiveVolume->getNumChildren() );
+  OsgVolume::ProgramCache::prune();
 }
 
 
@@ -104,7 +119,8 @@ Usul::Interfaces::IUnknown *VolumeDocument::queryInterface ( unsigned long iid )
 
 bool VolumeDocument::canExport ( const std::string &file ) const
 {
-  return false;
+  const std::string ext ( Usul::Strings::lowerCase ( Usul::File::extension ( file ) ) );
+  return ( ext == "hvol" );
 }
 
 
@@ -130,7 +146,7 @@ bool VolumeDocument::canInsert ( const std::string &file ) const
 bool VolumeDocument::canOpen ( const std::string &file ) const
 {
   const std::string ext ( Usul::Strings::lowerCase ( Usul::File::extension ( file ) ) );
-  return ( ext == "rawvol" );
+  return ( ext == "rawvol" || ext == "hvol" || ext == "nhdr" || ext == "nrrd" || ext == "mhd" || ext == "mha" );
 }
 
 
@@ -143,7 +159,7 @@ bool VolumeDocument::canOpen ( const std::string &file ) const
 bool VolumeDocument::canSave ( const std::string &file ) const
 {
   const std::string ext ( Usul::Strings::lowerCase ( Usul::File::extension ( file ) ) );
-  return ( ext == "" );
+  return ( ext == "hvol" );
 }
 
 
@@ -163,6 +179,10 @@ void VolumeDocument::read ( const std::string &name, Unknown *caller, Unknown *p
     std::string ext ( Usul::Strings::lowerCase ( Usul::File::extension ( name ) ) );
     if ( "rawvol" == ext )
       _readerWriter = new RawReaderWriter;
+    else if ( "hvol" == ext )
+      _readerWriter = new VolumeFileReaderWriter;
+    else if ( "nhdr" == ext || "nrrd" == ext || "mhd" == ext || "mha" == ext )
+      _readerWriter = new HeaderReaderWriter;
   }
 
   if ( _readerWriter.valid () )
@@ -180,6 +200,17 @@ void VolumeDocument::read ( const std::string &name, Unknown *caller, Unknown *p
 
 void VolumeDocument::write ( const std::string &filename, Unknown *caller, Unknown *progress ) const
 {
+  // Any volume can be written as a volume file.
+  const std::string ext ( Usul::Strings::lowerCase ( Usul::File::extension ( filename ) ) );
+  if ( "hvol" == ext )
+  {
+    if ( 0x0 == this->image3D() )
+      throw std::runtime_error ( "Error 2306148957: no volume to write to '" + filename + "'" );
+
+    OsgVolume::VolumeFile::write ( filename, this->image3D(), this->boundingBox() );
+    return;
+  }
+
   if ( _readerWriter.valid () )
     _readerWriter->write ( filename, *this, caller );
 }
@@ -208,6 +239,7 @@ void VolumeDocument::clear ( Usul::Interfaces::IUnknown *caller )
 VolumeDocument::Filters VolumeDocument::filtersExport() const
 {
   Filters filters;
+  filters.push_back ( Filter ( "Volume (*.hvol)",        "*.hvol"        ) );
   return filters;
 }
 
@@ -241,6 +273,9 @@ VolumeDocument::Filters VolumeDocument::filtersOpen() const
 {
   Filters filters;
   filters.push_back ( Filter ( "Raw  (*.rawvol)",        "*.rawvol"        ) );
+  filters.push_back ( Filter ( "Volume (*.hvol)",        "*.hvol"        ) );
+  filters.push_back ( Filter ( "NRRD (*.nhdr *.nrrd)",   "*.nhdr;*.nrrd"   ) );
+  filters.push_back ( Filter ( "MetaImage (*.mhd *.mha)", "*.mhd;*.mha"    ) );
   return filters;
 }
 
@@ -254,6 +289,7 @@ VolumeDocument::Filters VolumeDocument::filtersOpen() const
 VolumeDocument::Filters VolumeDocument::filtersSave() const
 {
   Filters filters;
+  filters.push_back ( Filter ( "Volume (*.hvol)",        "*.hvol"        ) );
   return filters;
 }
 
@@ -268,7 +304,7 @@ osg::Node *VolumeDocument::buildScene ( const BaseClass::Options &opt, Unknown *
 {
   this->setStatusBar ( "Building scene..." );
 
-  this->_buildScene();
+  this->_buildScene ( caller );
 
   return _root.get();
 }
@@ -309,7 +345,7 @@ bool VolumeDocument::dirty () const
 void VolumeDocument::updateNotify ( Usul::Interfaces::IUnknown *caller )
 {
   if ( this->dirty() )
-    this->_buildScene();
+    this->_buildScene ( caller );
 }
 
 
@@ -319,37 +355,70 @@ void VolumeDocument::updateNotify ( Usul::Interfaces::IUnknown *caller )
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-void VolumeDocument::_buildScene ()
+void VolumeDocument::_buildScene ( Unknown *caller )
 {
+  // Clear the flag first, so that a job that finishes while the scene is
+  // built asks for another build.
+  this->dirty ( false );
+
+  // Read what the reader put off until now.
+  if ( _readerWriter.valid () )
+    _readerWriter->finish ( *this, caller );
+
   _root->removeChildren ( 0, _root->getNumChildren() );
 
   if ( _readerWriter.valid () )
   {
+    osg::ref_ptr < osg::Node > volume ( 0x0 );
+    TransferFunctionPtr tf ( 0x0 );
+    if ( _transferFunctions.size() > 0 )
+      tf = _transferFunctions.at ( _activeTransferFunction );
+
+    // Volumes too big for one texture are drawn in bricks, whichever way
+    // the others are drawn.
+    if ( OsgVolume::BrickedVolume::needsBricks ( this->image3D(), this->maxTextureSize() ) )
+    {
+      osg::ref_ptr < OsgVolume::BrickedVolume > bricks ( new OsgVolume::BrickedVolume );
+      bricks->numPlanes ( 256 );
+      bricks->image ( this->image3D() );
+      bricks->boundingBox ( this->boundingBox() );
+      if ( tf.valid() )
+        bricks->transferFunction ( tf.get() );
+      volume = bricks.get();
+    }
+    else
+    {
 #if 1
-    osg::ref_ptr<OsgVolume::Texture3DVolume> volume ( new OsgVolume::Texture3DVolume );
-    volume->numPlanes ( 256 );
-    volume->resizePowerTwo ( true );
-    volume->image ( this->image3D() );
-    volume->boundingBox ( this->boundingBox() );
-    
+      osg::ref_ptr<OsgVolume::Texture3DVolume> texture ( new OsgVolume::Texture3DVolume );
+      texture->numPlanes ( 256 );
+      texture->resizePowerTwo ( true );
+      texture->image ( this->image3D() );
+      texture->boundingBox ( this->boundingBox() );
+      if ( tf.valid() )
+        texture->transferFunction ( tf.get() );
+      volume = texture.get();
 #else
-    osg::ref_ptr < OsgVolume::GPURayCasting > volume ( new OsgVolume::GPURayCasting );
-    volume->samplingRate ( 0.05 );
-    //volume->resizePowerTwo ( true );
-    volume->image ( this->image3D() );
-    volume->boundingBox ( this->boundingBox() );
-    
+      osg::ref_ptr < OsgVolume::GPURayCasting > rayCasting ( new OsgVolume::GPURayCasting );
+      rayCasting->samplingRate ( 0.05 );
+      //rayCasting->resizePowerTwo ( true );
+      rayCasting->maxTextureSize ( this->maxTextureSize() );
+      rayCasting->image ( this->image3D() );
+      rayCasting->boundingBox ( this->boundingBox() );
+      if ( tf.valid() )
+        rayCasting->transferFunction ( tf.get() );
+      volume = rayCasting.get();
 #endif
+    }
 
-    if ( _transferFunctions.size() > 0 )
-      volume->transferFunction ( _transferFunctions.at ( _activeTransferFunction ) );
+    // Draw less while the view changes.
+    volume->setCullCallback ( _adaptiveQuality.get() );
     
-    OsgTools::ColorBox box ( volume->boundingBox() );
+    OsgTools::ColorBox box ( this->boundingBox() );
     box.color_policy().color ( osg::Vec4 ( 0, 0, 1, 1 ) );
     
     // Position it.
     osg::ref_ptr<osg::MatrixTransform> mt ( new osg::MatrixTransform );
-    mt->setMatrix ( osg::Matrix::translate ( volume->boundingBox().center() ) );
+    mt->setMatrix ( osg::Matrix::translate ( this->boundingBox().center() ) );
     mt->addChild ( box() );
     
     // Wire-frame.
@@ -358,10 +427,16 @@ void VolumeDocument::_buildScene ()
     
     _root->addChild ( mt.get() );
     
+    // Draw smaller while the view changes if we should.
+    _progressiveVolume->removeChildren ( 0, _progressiveVolume->getNumChildren() );
+    if ( this->isProgressive() )
+    {
+      _progressiveVolume->addChild ( volume.get() );
+      volume = _progressiveVolume.get();
+    }
+
     _root->addChild ( volume.get() );
   }
-
-  this->dirty ( false );
 }
 
 
@@ -423,6 +498,89 @@ osg::BoundingBox VolumeDocument::boundingBox() const
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the frame time to aim for while the view changes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeDocument::targetFrameTime ( double ms )
+{
+  _adaptiveQuality->targetFrameTime ( ms );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the frame time to aim for while the view changes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double VolumeDocument::targetFrameTime () const
+{
+  return _adaptiveQuality->targetFrameTime();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set drawing at a lower resolution while the view changes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeDocument::progressive ( bool b )
+{
+  {
+    Guard guard ( this->mutex() );
+    _progressive = b;
+  }
+  this->dirty ( true );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Are we drawing at a lower resolution while the view changes?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool VolumeDocument::isProgressive () const
+{
+  Guard guard ( this->mutex() );
+  return _progressive;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the widest 3D texture to make before splitting into bricks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeDocument::maxTextureSize ( unsigned int size )
+{
+  {
+    Guard guard ( this->mutex() );
+    _maxTextureSize = size;
+  }
+  this->dirty ( true );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the widest 3D texture to make before splitting into bricks.  Until
+//  a context has drawn a 3D texture, 512 is assumed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned int VolumeDocument::maxTextureSize () const
+{
+  Guard guard ( this->mutex() );
+  return ( 0 == _maxTextureSize ) ? OsgVolume::BrickedVolume::maxTextureSize ( 512 ) : _maxTextureSize;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  Add a transfer function.
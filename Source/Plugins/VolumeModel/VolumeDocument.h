@@ -18,6 +18,8 @@
 
 #include "VolumeModel/IReaderWriter.h"
 
+#include "OsgVolume/AdaptiveQuality.h"
+#include "OsgVolume/ProgressiveVolume.h"
 #include "OsgVolume/TransferFunction1D.h"
 #include "OsgVolume/ITransferFunction1DList.h"
 
@@ -97,6 +99,19 @@ public:
   /// Add a transfer function.
   void                        addTransferFunction ( TransferFunction* );
 
+  /// Get/Set the frame time to aim for while the view changes, in milliseconds.
+  void                        targetFrameTime ( double ms );
+  double                      targetFrameTime () const;
+
+  /// Get/Set drawing at a lower resolution while the view changes.
+  void                        progressive ( bool b );
+  bool                        isProgressive () const;
+
+  /// Get/Set the widest 3D texture to make before splitting into bricks.
+  /// Zero asks the graphics contexts.
+  void                        maxTextureSize ( unsigned int size );
+  unsigned int                maxTextureSize () const;
+
 protected:
 
   /// Do not copy.
@@ -106,7 +121,7 @@ protected:
   /// Use reference counting.
   virtual ~VolumeDocument();
 
-  void                        _buildScene ();
+  void                        _buildScene ( Unknown *caller = 0x0 );
 
   /// Update (Usul::Interfaces::IUpdateListener).
   virtual void                             updateNotify ( Usul::Interfaces::IUnknown *caller );
@@ -134,6 +149,10 @@ private:
   bool _dirty;
   TransferFunctions _transferFunctions;
   unsigned int _activeTransferFunction;
+  osg::ref_ptr < OsgVolume::AdaptiveQuality > _adaptiveQuality;
+  osg::ref_ptr < OsgVolume::ProgressiveVolume > _progressiveVolume;
+  bool _progressive;
+  unsigned int _maxTextureSize;
 };
 
 
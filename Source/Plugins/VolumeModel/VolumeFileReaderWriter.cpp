@@ -0,0 +1,131 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Reads and writes volume files (.hvol).
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "VolumeModel/VolumeFileReaderWriter.h"
+#include "VolumeModel/VolumeDocument.h"
+
+USUL_IMPLEMENT_IUNKNOWN_MEMBERS ( VolumeFileReaderWriter, VolumeFileReaderWriter::BaseClass );
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Constructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+VolumeFileReaderWriter::VolumeFileReaderWriter() : BaseClass (),
+  _file ( 0x0 )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Destructor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+VolumeFileReaderWriter::~VolumeFileReaderWriter()
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Open the file and read the finest level.  The file stays open, but
+//  nothing reads other levels or regions from it yet: the document has no
+//  level-of-detail or region-of-interest path of its own, so the volumes
+//  build their coarse levels from the finest one.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeFileReaderWriter::read ( const std::string &name, VolumeDocument &doc, Unknown *caller )
+{
+  OsgVolume::VolumeFile::RefPtr file ( new OsgVolume::VolumeFile ( name ) );
+
+  osg::ref_ptr < osg::Image > image ( file->image ( 0 ) );
+  image->setFileName ( name );
+
+  _file = file;
+
+  doc.image3D ( image.get() );
+  doc.boundingBox ( file->boundingBox() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Finish reading.  Everything was read in read().
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeFileReaderWriter::finish ( VolumeDocument &doc, Unknown *caller )
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Write the document to given file name.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeFileReaderWriter::write ( const std::string &filename, const VolumeDocument &doc, Unknown *caller ) const
+{
+  OsgVolume::VolumeFile::write ( filename, doc.image3D(), doc.boundingBox() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Clear the document.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void VolumeFileReaderWriter::clear ( Usul::Interfaces::IUnknown *caller )
+{
+  _file = 0x0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the open file.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+OsgVolume::VolumeFile* VolumeFileReaderWriter::file() const
+{
+  return _file.get();
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Query for interface.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+Usul::Interfaces::IUnknown* VolumeFileReaderWriter::queryInterface( unsigned long iid )
+{
+  switch ( iid )
+  {
+  case Usul::Interfaces::IUnknown::IID:
+  case IReaderWriter::IID:
+    return static_cast < IReaderWriter * > ( this );
+  default:
+    return 0x0;
+  }
+}
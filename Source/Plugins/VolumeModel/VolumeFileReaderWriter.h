@@ -0,0 +1,64 @@
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (c) 2008, Arizona State University
+//  All rights reserved.
+//  BSD License: http://www.opensource.org/licenses/bsd-license.html
+//
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Reads and writes volume files (.hvol).
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef __HELIOS_VOLUME_MODEL_VOLUME_FILE_READER_WRITER_H__
+#define __HELIOS_VOLUME_MODEL_VOLUME_FILE_READER_WRITER_H__
+
+#include "VolumeModel/IReaderWriter.h"
+
+#include "OsgTools/Configure/OSG.h"
+
+#include "OsgVolume/VolumeFile.h"
+
+#include "Usul/Base/Object.h"
+
+class VolumeFileReaderWriter : public Usul::Base::Object,
+                               public IReaderWriter
+{
+public:
+  typedef Usul::Base::Object BaseClass;
+
+  USUL_DECLARE_IUNKNOWN_MEMBERS;
+
+  VolumeFileReaderWriter();
+
+  /// Clear any existing data.
+  virtual void                clear ( Unknown *caller = 0x0 );
+
+  /// Read the file and add it to existing document's data.
+  virtual void                read ( const std::string &filename, VolumeDocument &doc, Unknown *caller = 0x0 );
+
+  /// Finish any reading that was put off until the data is needed.
+  virtual void                finish ( VolumeDocument &doc, Unknown *caller = 0x0 );
+
+  /// Write the document to given file name.
+  virtual void                write ( const std::string &filename, const VolumeDocument &doc, Unknown *caller = 0x0  ) const;
+
+  /// Get the open file.  Other levels and regions of it are not read yet.
+  OsgVolume::VolumeFile*      file() const;
+
+protected:
+  virtual ~VolumeFileReaderWriter();
+
+  VolumeFileReaderWriter ( const VolumeFileReaderWriter& rhs );
+  VolumeFileReaderWriter& operator= ( const VolumeFileReaderWriter& rhs );
+
+private:
+
+  OsgVolume::VolumeFile::RefPtr _file;
+};
+
+
+#endif // __HELIOS_VOLUME_MODEL_VOLUME_FILE_READER_WRITER_H__
@@ -92,10 +92,14 @@ WRFDocument::WRFDocument() :
   _z ( 0 ),
   _num2DFields ( 0 ),
   _numPlanes ( 256 ),
+  _targetFrameTime ( 50.0 ),
+  _progressive ( false ),
   _channelInfo (),
   _root ( new osg::MatrixTransform ),
   _volumeTransform ( new osg::MatrixTransform ),
   _volumeNode ( new Volume ),
+  _adaptiveQuality ( new OsgVolume::AdaptiveQuality ),
+  _progressiveVolume ( new OsgVolume::ProgressiveVolume ),
   _bb (),
   _dirty ( true ),
   _requests (),
@@ -128,6 +132,14 @@ WRFDocument::WRFDocument() :
   this->_addMember ( "lower_left", _lowerLeft );
   this->_addMember ( "upper_right", _upperRight );
   this->_addMember ( "cell_size", _cellSize );
+  this->_addMember ( "target_frame_time", _targetFrameTime );
+  this->_addMember ( "progressive", _progressive );
+
+  // Draw fewer planes while the view changes.
+  _volumeNode->setCullCallback ( _adaptiveQuality.get() );
+
+  // Volumes far away on the planet draw from smaller copies.
+  _volumeNode->levelOfDetail ( true );
 }
 
 
@@ -425,10 +437,18 @@ void WRFDocument::_buildScene()
 #else
     _volumeNode->numPlanes ( _numPlanes );
 #endif
+    _adaptiveQuality->targetFrameTime ( _targetFrameTime );
     _volumeNode->image ( image.get() );
 
-    // Add the volume to the scene.
-    _volumeTransform->addChild ( _volumeNode.get() );
+    // Add the volume to the scene, drawn smaller while the view changes if we should.
+    _progressiveVolume->removeChildren ( 0, _progressiveVolume->getNumChildren() );
+    if ( _progressive )
+    {
+      _progressiveVolume->addChild ( _volumeNode.get() );
+      _volumeTransform->addChild ( _progressiveVolume.get() );
+    }
+    else
+      _volumeTransform->addChild ( _volumeNode.get() );
     //_volumeTransform->addChild ( this->_buildVectorField ( _currentTimestep, 0, 1 ) );
   }
 #else
@@ -906,6 +926,22 @@ void WRFDocument::menuAdd ( MenuKit::Menu& menu, Usul::Interfaces::IUnknown * ca
   wrf->append ( Button::create ( Usul::Strings::format ( "Multiply planes x ", 0.5  ), boost::bind ( &WRFDocument::numPlanesMultiply, this, 0.5 ) ) );
   wrf->append ( Button::create ( Usul::Strings::format ( "Multiply planes x ", 0.25 ), boost::bind ( &WRFDocument::numPlanesMultiply, this, 0.25 ) ) );
 
+  typedef void ( WRFDocument::*SetFrameTime ) ( double );
+  const SetFrameTime setFrameTime ( &WRFDocument::targetFrameTime );
+
+  MenuKit::Menu::RefPtr rate ( new MenuKit::Menu ( "Frame Rate" ) );
+  rate->append ( RadioButton::create ( "Full Quality", boost::bind ( setFrameTime, this, 0.0 ), boost::bind ( &WRFDocument::isTargetFrameTime, this, 0.0 ) ) );
+  const double fps[] = { 10.0, 20.0, 30.0 };
+  for ( unsigned int i = 0; i < sizeof ( fps ) / sizeof ( fps[0] ); ++i )
+  {
+    rate->append ( RadioButton::create ( Usul::Strings::format ( fps[i], " fps" ), 
+      boost::bind ( setFrameTime, this, 1000.0 / fps[i] ), 
+      boost::bind ( &WRFDocument::isTargetFrameTime, this, 1000.0 / fps[i] ) ) );
+  }
+  wrf->append ( rate.get() );
+
+  wrf->append ( ToggleButton::create ( "Progressive Rendering", Usul::Adaptors::memberFunction<void> ( this, &WRFDocument::progressive ), Usul::Adaptors::memberFunction<bool> ( this, &WRFDocument::isProgressive ) ) );
+
   MenuKit::Menu::RefPtr tf ( new MenuKit::Menu ( "Transfer Functions" ) );
   typedef TransferFunctions::const_iterator ConstIterator;
   for ( ConstIterator iter = _transferFunctions.begin(); iter != _transferFunctions.end(); ++iter )
@@ -1046,6 +1082,82 @@ unsigned int WRFDocument::numPlanes () const
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set the frame time to aim for while the view changes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void WRFDocument::targetFrameTime ( double ms )
+{
+  USUL_TRACE_SCOPE;
+  Guard guard ( this->mutex() );
+  _targetFrameTime = ms;
+  _adaptiveQuality->targetFrameTime ( ms );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Get the frame time to aim for while the view changes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+double WRFDocument::targetFrameTime () const
+{
+  USUL_TRACE_SCOPE;
+  Guard guard ( this->mutex() );
+  return _targetFrameTime;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Is this the frame time to aim for?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool WRFDocument::isTargetFrameTime ( double ms ) const
+{
+  USUL_TRACE_SCOPE;
+  Usul::Predicates::CloseFloat < double > close ( 10 );
+  return close ( ms, this->targetFrameTime() );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Set drawing at a lower resolution while the view changes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void WRFDocument::progressive ( bool b )
+{
+  USUL_TRACE_SCOPE;
+
+  {
+    Guard guard ( this->mutex() );
+    _progressive = b;
+  }
+
+  this->dirty ( true );
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  Are we drawing at a lower resolution while the view changes?
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool WRFDocument::isProgressive () const
+{
+  USUL_TRACE_SCOPE;
+  Guard guard ( this->mutex() );
+  return _progressive;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  Load job has finished.
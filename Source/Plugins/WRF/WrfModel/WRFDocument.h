@@ -37,7 +37,9 @@
 
 #include "Serialize/XML/Macros.h"
 
+#include "OsgVolume/AdaptiveQuality.h"
 #include "OsgVolume/GPURayCasting.h"
+#include "OsgVolume/ProgressiveVolume.h"
 #include "OsgVolume/Texture3DVolume.h"
 #include "OsgVolume/TransferFunction.h"
 
@@ -147,6 +149,15 @@ public:
   void                        numPlanes ( unsigned int numPlanes );
   unsigned int                numPlanes () const;
 
+  /// Get/Set the frame time to aim for while the view changes, in milliseconds.
+  void                        targetFrameTime ( double ms );
+  double                      targetFrameTime () const;
+  bool                        isTargetFrameTime ( double ms ) const;
+
+  /// Get/Set drawing at a lower resolution while the view changes.
+  void                        progressive ( bool b );
+  bool                        isProgressive () const;
+
   /// Add volume
   void                        addData( unsigned int timestep, unsigned int channel, const FloatData& data );
 
@@ -267,10 +278,14 @@ private:
   unsigned int _z;
   unsigned int _num2DFields;
   unsigned int _numPlanes;
+  double _targetFrameTime;
+  bool _progressive;
   ChannelInfos _channelInfo;
   osg::ref_ptr < osg::MatrixTransform > _root;
   osg::ref_ptr < osg::MatrixTransform > _volumeTransform;
   osg::ref_ptr < Volume > _volumeNode;
+  osg::ref_ptr < OsgVolume::AdaptiveQuality > _adaptiveQuality;
+  osg::ref_ptr < OsgVolume::ProgressiveVolume > _progressiveVolume;
   osg::BoundingBox _bb;
   bool _dirty;
   Requests _requests;